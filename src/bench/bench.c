@@ -0,0 +1,217 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define INITIAL_RESULTS 256
+#define MAX_NAME_LEN 64
+#define REPETITIONS 5
+
+struct bench_result
+{
+    char name[MAX_NAME_LEN];
+    const char *unit;
+    double value;
+    char higher_is_better;
+};
+
+// the table grows as the cases report, the suite adds rows per core count
+static struct bench_result *results;
+static unsigned int num_results;
+static unsigned int max_results;
+
+volatile unsigned long bench_sink;
+
+// run time of a single repetition
+double bench_repetition_ns = 50e6;
+
+double bench_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+unsigned long long bench_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    unsigned long long cycles;
+    __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(cycles));
+    return cycles;
+#else
+    return (unsigned long long)bench_now_ns();
+#endif
+}
+
+double bench_measure(bench_fn fn, void *arg)
+{
+    unsigned long iterations = 1;
+    double elapsed = 0;
+    double best = -1;
+    unsigned int i;
+
+    // calibrate the number of iterations of a single repetition
+    while (1)
+    {
+        double start = bench_now_ns();
+        fn(arg, iterations);
+        elapsed = bench_now_ns() - start;
+
+        if (elapsed >= bench_repetition_ns / 10)
+            break;
+        iterations *= 2;
+    }
+    iterations = (unsigned long)(iterations * bench_repetition_ns / elapsed) + 1;
+
+    for (i = 0; i < REPETITIONS; i++)
+    {
+        double start = bench_now_ns();
+        double ns_per_iteration;
+
+        fn(arg, iterations);
+        ns_per_iteration = (bench_now_ns() - start) / iterations;
+        if (best < 0 || ns_per_iteration < best)
+            best = ns_per_iteration;
+    }
+
+    return best;
+}
+
+void bench_report(const char *name, const char *unit, double value, char higher_is_better)
+{
+    struct bench_result *result;
+
+    if (num_results >= max_results)
+    {
+        unsigned int capacity = max_results ? 2 * max_results : INITIAL_RESULTS;
+        struct bench_result *grown = realloc(results, capacity * sizeof(*results));
+
+        if (!grown)
+        {
+            fprintf(stderr, "out of memory, %s is not recorded\n", name);
+            return;
+        }
+        results = grown;
+        max_results = capacity;
+    }
+
+    result = &results[num_results++];
+    strncpy(result->name, name, MAX_NAME_LEN - 1);
+    result->name[MAX_NAME_LEN - 1] = '\0';
+    result->unit = unit;
+    result->value = value;
+    result->higher_is_better = higher_is_better;
+
+    fprintf(stderr, "%-48s %14.3f %s\n", result->name, value, unit);
+}
+
+void bench_write_json(const char *path)
+{
+    FILE *out = stdout;
+    unsigned int i;
+
+    if (path && strcmp(path, "-") != 0)
+        out = fopen(path, "w");
+    if (!out)
+    {
+        fprintf(stderr, "can not write %s\n", path);
+        return;
+    }
+
+    // one result per line, which is what bench_compare reads back
+    fprintf(out, "{\n  \"benchmarks\": [\n");
+    for (i = 0; i < num_results; i++)
+    {
+        fprintf(out, "    {\"name\": \"%s\", \"unit\": \"%s\", \"value\": %.6g, \"better\": \"%s\"}%s\n",
+                results[i].name, results[i].unit, results[i].value,
+                results[i].higher_is_better ? "higher" : "lower",
+                i + 1 < num_results ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+
+    if (out != stdout)
+        fclose(out);
+}
+
+static struct bench_result *find_result(const char *name)
+{
+    unsigned int i;
+    for (i = 0; i < num_results; i++)
+        if (strcmp(results[i].name, name) == 0)
+            return &results[i];
+    return 0;
+}
+
+int bench_compare(const char *path, double threshold)
+{
+    FILE *in = fopen(path, "r");
+    char line[256];
+    int regressions = 0;
+
+    if (!in)
+    {
+        fprintf(stderr, "can not read baseline %s\n", path);
+        return -1;
+    }
+
+    fprintf(stderr, "\n%-48s %14s %14s %9s\n", "benchmark", "baseline", "current", "change");
+    while (fgets(line, sizeof(line), in))
+    {
+        char name[MAX_NAME_LEN];
+        double baseline;
+        double change;
+        struct bench_result *result;
+        const char *verdict = "";
+
+        if (sscanf(line, " {\"name\": \"%63[^\"]\", \"unit\": \"%*[^\"]\", \"value\": %lf", name, &baseline) != 2)
+            continue;
+
+        result = find_result(name);
+        if (!result || baseline == 0)
+            continue;
+
+        change = (result->value - baseline) / baseline;
+        if (!result->higher_is_better)
+            change = -change;
+
+        // positive change is an improvement in either direction
+        if (change < -threshold)
+        {
+            verdict = "REGRESSION";
+            ++regressions;
+        }
+        fprintf(stderr, "%-48s %14.3f %14.3f %+8.1f%% %s\n",
+                name, baseline, result->value, change * 100, verdict);
+    }
+    fclose(in);
+
+    return regressions;
+}
@@ -0,0 +1,100 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef BENCH_H
+#define BENCH_H
+
+/** a measured routine, which runs the benchmarked operation the given times */
+typedef void (*bench_fn)(void *arg, unsigned long iterations);
+
+/** a benchmark case, which measures and reports one or more results */
+struct bench_case
+{
+    const char *name;
+    void (*run)(void);
+};
+
+/** run time of a single repetition of a measurement, in nanoseconds */
+extern double bench_repetition_ns;
+
+/** sink for results of benchmarked operations, prevents them from being optimized out */
+extern volatile unsigned long bench_sink;
+
+/** return the monotonic time in nanoseconds */
+double bench_now_ns(void);
+
+/** return the cycle counter where the CPU has one, otherwise the monotonic time in nanoseconds */
+unsigned long long bench_cycles(void);
+
+/**
+ * @brief Measure the cost of a single iteration of the routine.
+ *
+ * The number of iterations is calibrated to run for a while, the best of
+ * several repetitions is taken to filter out noise.
+ *
+ * @return double nanoseconds per iteration
+ */
+double bench_measure(bench_fn fn, void *arg);
+
+/**
+ * @brief Record a result.
+ *
+ * @param name unique name of the result, such as "crc/update_crc_buf/255"
+ * @param unit unit of the value
+ * @param value the measured value
+ * @param higher_is_better direction in which the value improves
+ */
+void bench_report(const char *name, const char *unit, double value, char higher_is_better);
+
+/** write the recorded results as JSON */
+void bench_write_json(const char *path);
+
+/**
+ * @brief Compare the recorded results against a baseline written by bench_write_json.
+ *
+ * @param path the baseline file
+ * @param threshold tolerated relative change, 0.1 for 10%
+ * @return int number of regressions, -1 if the baseline can not be read
+ */
+int bench_compare(const char *path, double threshold);
+
+// benchmark cases
+void crc_bench(void);
+void buffer_bench(void);
+void data_layer_bench(void);
+void worst_case_bench(void);
+void link_bench(void);
+void timer_bench(void);
+void trace_bench(void);
+void histogram_bench(void);
+void tx_queue_bench(void);
+void compression_bench(void);
+void framing_bench(void);
+void header_bench(void);
+void mux_bench(void);
+#ifdef WHISPER_BENCH_GATEWAY
+void gateway_bench(void);
+void shm_bench(void);
+void udp_bench(void);
+#endif
+
+#endif // BENCH_H
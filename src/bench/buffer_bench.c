@@ -0,0 +1,99 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "array_buffer.h"
+#include "ring_buffer.h"
+
+#define BUF_LEN 240
+#define CHUNK_LEN 16
+
+static uint8_t storage[BUF_LEN];
+static uint8_t chunk[CHUNK_LEN];
+static array_buffer_t ab;
+static ring_buffer_t rb;
+
+static void array_buffer_push_pop(void *arg, unsigned long iterations)
+{
+    while (iterations--)
+    {
+        array_buffer__push(ab, chunk, CHUNK_LEN);
+        array_buffer__pop(ab, CHUNK_LEN);
+    }
+    bench_sink += array_buffer__size(ab);
+}
+
+/** drain a full buffer one byte at a time, which is how the parser resynchronizes */
+static void array_buffer_drain(void *arg, unsigned long iterations)
+{
+    while (iterations--)
+    {
+        while (array_buffer__size(ab) < BUF_LEN)
+            array_buffer__push(ab, chunk, CHUNK_LEN);
+        while (array_buffer__size(ab) > 0)
+            array_buffer__pop(ab, 1);
+    }
+    bench_sink += array_buffer__size(ab);
+}
+
+static void ring_buffer_push_pop(void *arg, unsigned long iterations)
+{
+    while (iterations--)
+    {
+        ring_buffer_push(rb, chunk, CHUNK_LEN);
+        ring_buffer_batch_pop(rb, CHUNK_LEN);
+    }
+    bench_sink += ring_buffer_size(rb);
+}
+
+static void ring_buffer_drain(void *arg, unsigned long iterations)
+{
+    while (iterations--)
+    {
+        while (ring_buffer_size(rb) < BUF_LEN)
+            ring_buffer_push(rb, chunk, CHUNK_LEN);
+        while (ring_buffer_size(rb) > 0)
+            ring_buffer_pop(rb);
+    }
+    bench_sink += ring_buffer_size(rb);
+}
+
+void buffer_bench(void)
+{
+    ab = malloc(SIZEOF_ARRAY_BUFFER_T);
+    array_buffer__init(ab, storage, BUF_LEN);
+    rb = ring_buffer_create(storage, BUF_LEN);
+
+    bench_report("buffer/array_buffer/push_pop_16", "ns/op",
+                 bench_measure(array_buffer_push_pop, 0), 0);
+    bench_report("buffer/array_buffer/fill_pop_1", "ns/byte",
+                 bench_measure(array_buffer_drain, 0) / BUF_LEN, 0);
+    bench_report("buffer/ring_buffer/push_pop_16", "ns/op",
+                 bench_measure(ring_buffer_push_pop, 0), 0);
+    bench_report("buffer/ring_buffer/fill_pop_1", "ns/byte",
+                 bench_measure(ring_buffer_drain, 0) / BUF_LEN, 0);
+
+    free(rb);
+    free(ab);
+}
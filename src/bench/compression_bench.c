@@ -0,0 +1,199 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "lz.h"
+
+#define NUM_PAYLOADS 256
+#define BAUD 9600
+// the bytes of a frame around the payload, and of the acknowledgement
+#define FRAME_OVERHEAD 8
+#define ACK_LEN 10
+
+struct corpus
+{
+    const char *name;
+    uint8_t payloads[NUM_PAYLOADS][255];
+    uint8_t lens[NUM_PAYLOADS];
+};
+
+static struct corpus corpora[4];
+static struct corpus *measured;
+static const uint8_t *measured_dict;
+static uint16_t measured_dict_len;
+
+/** log lines of a gateway */
+static void fill_log(struct corpus *corpus)
+{
+    static const char *events[] = {"link up", "link down", "retransmit", "frame dropped", "config reloaded"};
+    unsigned int i;
+
+    corpus->name = "log";
+    for (i = 0; i < NUM_PAYLOADS; i++)
+        corpus->lens[i] = sprintf((char *)corpus->payloads[i],
+                                  "2026-10-18T12:%02u:%02u.%03uZ INFO gateway: port %u %s, rssi -%u dBm, queue %u",
+                                  i / 60 % 60, i % 60, rand() % 1000, rand() % 4, events[rand() % 5], 60 + rand() % 30,
+                                  rand() % 16);
+}
+
+/** blobs of configuration, keys and values */
+static void fill_config(struct corpus *corpus)
+{
+    unsigned int i;
+
+    corpus->name = "config";
+    for (i = 0; i < NUM_PAYLOADS; i++)
+        corpus->lens[i] = sprintf((char *)corpus->payloads[i],
+                                  "{\"port\":%u,\"baud\":%u,\"parity\":\"none\",\"stop_bits\":1,\"retries\":%u,"
+                                  "\"timeout_ms\":%u,\"enabled\":true,\"name\":\"sensor-%03u\",\"group\":\"hall-%u\","
+                                  "\"report_interval_s\":%u,\"alarm_high\":%u,\"alarm_low\":%u}",
+                                  rand() % 4, rand() % 2 ? 9600 : 19200, 1 + rand() % 5, 50 * (1 + rand() % 10),
+                                  rand() % 1000, rand() % 10, 10 * (1 + rand() % 60), 50 + rand() % 50, rand() % 20);
+}
+
+/** binary records of sensors, 16 little endian counters and readings changing slowly */
+static void fill_records(struct corpus *corpus)
+{
+    unsigned long values[16] = {0};
+    unsigned int i;
+    unsigned int j;
+
+    corpus->name = "records";
+    for (i = 0; i < NUM_PAYLOADS; i++)
+    {
+        for (j = 0; j < 16; j++)
+        {
+            values[j] += rand() % 8;
+            corpus->payloads[i][4 * j] = values[j];
+            corpus->payloads[i][4 * j + 1] = values[j] >> 8;
+            corpus->payloads[i][4 * j + 2] = values[j] >> 16;
+            corpus->payloads[i][4 * j + 3] = values[j] >> 24;
+        }
+        corpus->lens[i] = 64;
+    }
+}
+
+/** encrypted or already compressed payloads */
+static void fill_random(struct corpus *corpus)
+{
+    unsigned int i;
+    unsigned int j;
+
+    corpus->name = "random";
+    for (i = 0; i < NUM_PAYLOADS; i++)
+    {
+        for (j = 0; j < 128; j++)
+            corpus->payloads[i][j] = rand();
+        corpus->lens[i] = 128;
+    }
+}
+
+static void compress(void *arg, unsigned long iterations)
+{
+    uint8_t out[255];
+
+    while (iterations--)
+    {
+        unsigned int i = iterations % NUM_PAYLOADS;
+        bench_sink += whisper_lz__compress(measured_dict, measured_dict_len, measured->payloads[i], measured->lens[i],
+                                           out, measured->lens[i] - 1);
+    }
+}
+
+/** a dictionary of sample payloads, taken from another run of the source of the corpus */
+static uint16_t train(void (*fill)(struct corpus *corpus), uint8_t *dict)
+{
+    static struct corpus samples;
+    uint16_t dict_len = 0;
+    unsigned int i;
+
+    fill(&samples);
+    for (i = 0; i < NUM_PAYLOADS && dict_len + samples.lens[i] <= 1024; i++)
+    {
+        memcpy(&dict[dict_len], samples.payloads[i], samples.lens[i]);
+        dict_len += samples.lens[i];
+    }
+    return dict_len;
+}
+
+/** report the ratio, the goodput at BAUD and the cost of the compression of a corpus */
+static void run(struct corpus *corpus, char compression, const uint8_t *dict, uint16_t dict_len,
+                const char *variant)
+{
+    static uint8_t compressed[255];
+    unsigned long payload_bytes = 0;
+    unsigned long compressed_bytes = 0;
+    unsigned long wire = 0;
+    char name[64];
+    double ns;
+    unsigned int i;
+
+    for (i = 0; i < NUM_PAYLOADS; i++)
+    {
+        uint8_t len = corpus->lens[i];
+        // as data_sent does, compressed only if it gets shorter
+        uint8_t compressed_len =
+            compression ? whisper_lz__compress(dict, dict_len, corpus->payloads[i], len, compressed, len - 1) : 0;
+
+        payload_bytes += len;
+        compressed_bytes += compressed_len ? compressed_len : len;
+        wire += FRAME_OVERHEAD + (compressed_len ? compressed_len : len) + ACK_LEN;
+    }
+
+    sprintf(name, "compression/%s/%s/ratio", corpus->name, variant);
+    bench_report(name, "%", 100.0 * compressed_bytes / payload_bytes, 0);
+    // stop-and-wait, a message takes its frame and the acknowledgement on the line, 10 bits a byte
+    sprintf(name, "compression/%s/%s/goodput_%u", corpus->name, variant, BAUD);
+    bench_report(name, "B/s", payload_bytes / (wire * 10.0 / BAUD), 1);
+
+    if (compression)
+    {
+        measured = corpus;
+        measured_dict = dict;
+        measured_dict_len = dict_len;
+        ns = bench_measure(compress, 0);
+        sprintf(name, "compression/%s/%s/compress", corpus->name, variant);
+        bench_report(name, "ns/msg", ns, 0);
+    }
+}
+
+void compression_bench(void)
+{
+    static void (*const fills[])(struct corpus *corpus) = {fill_log, fill_config, fill_records, fill_random};
+    static uint8_t dict[1024];
+    unsigned int c;
+
+    srand(39);
+    for (c = 0; c < sizeof(fills) / sizeof(fills[0]); c++)
+    {
+        uint16_t dict_len = train(fills[c], dict);
+
+        fills[c](&corpora[c]);
+        // uncompressed, compressed alone and with a dictionary
+        run(&corpora[c], 0, 0, 0, "raw");
+        run(&corpora[c], 1, 0, 0, "lz");
+        run(&corpora[c], 1, dict, dict_len, "lz_dict");
+    }
+}
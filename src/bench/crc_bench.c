@@ -0,0 +1,71 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <stdio.h>
+#include "bench.h"
+#include "crc.h"
+
+static unsigned char data[255];
+
+static void crc_buf(void *arg, unsigned long iterations)
+{
+    unsigned char len = *(unsigned char *)arg;
+    unsigned short crc = CRC_INIT;
+
+    while (iterations--)
+        crc = update_crc_buf(data, len, crc);
+    bench_sink += crc;
+}
+
+static void crc32c_buf(void *arg, unsigned long iterations)
+{
+    unsigned char len = *(unsigned char *)arg;
+    unsigned long crc = CRC32C_INIT;
+
+    while (iterations--)
+        crc = update_crc32c_buf(data, len, crc);
+    bench_sink += crc;
+}
+
+void crc_bench(void)
+{
+    static const unsigned char lengths[] = {8, 64, 255};
+    char name[64];
+    unsigned int i;
+
+    for (i = 0; i < sizeof(data); i++)
+        data[i] = (unsigned char)(i * 31 + 7);
+
+    for (i = 0; i < sizeof(lengths); i++)
+    {
+        unsigned char len = lengths[i];
+        double ns = bench_measure(crc_buf, &len);
+
+        sprintf(name, "crc/update_crc_buf/%u", len);
+        bench_report(name, "MB/s", len / ns * 1e3, 1);
+
+        // on crc32 instructions where the machine has them, the name tells
+        ns = bench_measure(crc32c_buf, &len);
+        sprintf(name, "crc/update_crc32c_buf/%s/%u", crc32c_accelerated() ? "hw" : "table", len);
+        bench_report(name, "MB/s", len / ns * 1e3, 1);
+    }
+}
@@ -0,0 +1,258 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "data_layer.c"
+
+#define BUF_LEN 255
+#define STREAM_LEN 65536
+#define NUM_MIXES 4
+
+static uint8_t recv_buf[BUF_LEN];
+static whisper_data_layer_t dl;
+
+// the wire, on which the written frames land
+static uint8_t wire[STREAM_LEN];
+static unsigned int wire_len;
+
+static uint8_t stream[STREAM_LEN];
+static unsigned int stream_len;
+static unsigned long frames_received;
+
+static uint8_t payload[BUF_LEN];
+
+static void on_packet_received(whisper_data_layer_t dl, uint8_t *data, uint8_t data_len)
+{
+    ++frames_received;
+}
+
+static void noop_write(whisper_data_layer_t dl, const uint8_t *data, uint8_t data_len)
+{
+    bench_sink += data_len;
+}
+
+static void wire_write(whisper_data_layer_t dl, const uint8_t *data, uint8_t data_len)
+{
+    if (wire_len + data_len > STREAM_LEN)
+        return;
+    memcpy(&wire[wire_len], data, data_len);
+    wire_len += data_len;
+}
+
+static void noop_set_delay(whisper_data_layer_t dl, uint16_t delay_in_ms, void (*delay_cb)(whisper_data_layer_t dl)) {}
+static void noop_cancel_delay(whisper_data_layer_t dl) {}
+
+static void setup(void (*data_write)(whisper_data_layer_t, const uint8_t *, uint8_t))
+{
+    struct whisper_data_layer__config config = {
+        .buf = recv_buf,
+        .buf_len = BUF_LEN,
+        .packet_received_cb = on_packet_received,
+        .data_write = data_write,
+        .set_delay = noop_set_delay,
+        .cancel_delay = noop_cancel_delay,
+    };
+    whisper_data_layer__init(dl, &config);
+}
+
+static uint8_t max_payload_len(void)
+{
+    return array_buffer__capacity(dl->buf_recv) - LEN_PREFIX - LEN_HEADER - LEN_CHECKSUM;
+}
+
+/** frame a payload with the transmitter of the data layer */
+static void frame(uint8_t payload_len)
+{
+    dl->send_buffer.empty = 1;
+    whisper_data_layer__data_sent(dl, payload, payload_len, 1);
+}
+
+/**
+ * @brief Fill the stream with frames of the given payload mix.
+ *
+ * 0: tiny payloads, 1: maximum payloads, 2: random lengths, 3: random lengths
+ * and one corrupted byte in a thousand.
+ */
+static const char *build_stream(unsigned int mix)
+{
+    static const char *names[NUM_MIXES] = {"tiny", "max", "mixed", "noisy"};
+    unsigned int i;
+
+    setup(wire_write);
+    wire_len = 0;
+    srand(27);
+
+    while (wire_len < STREAM_LEN - BUF_LEN)
+    {
+        uint8_t len = 4;
+        if (mix == 1)
+            len = max_payload_len();
+        else if (mix >= 2)
+            len = 1 + rand() % max_payload_len();
+        frame(len);
+    }
+
+    if (mix == 3)
+        for (i = 0; i < wire_len; i += 1 + rand() % 2000)
+            wire[i] ^= 1 << (rand() % 8);
+
+    memcpy(stream, wire, wire_len);
+    stream_len = wire_len;
+    return names[mix];
+}
+
+static void parse_stream(void *arg, unsigned long iterations)
+{
+    uint8_t chunk_len = *(uint8_t *)arg;
+
+    while (iterations--)
+    {
+        unsigned int offset = 0;
+        while (offset < stream_len)
+        {
+            uint8_t len = stream_len - offset < chunk_len ? stream_len - offset : chunk_len;
+            whisper_data_layer__data_received(dl, &stream[offset], len);
+            offset += len;
+        }
+    }
+}
+
+static void send_frames(void *arg, unsigned long iterations)
+{
+    dl->send_buffer.header.payload_len = *(uint8_t *)arg;
+
+    while (iterations--)
+    {
+        dl->send_buffer.empty = 0;
+        dl->send_buffer.num_transmissions = 0;
+        _send_data(dl);
+    }
+}
+
+/** send a frame, receive it, acknowledge it and receive the acknowledgement */
+static void round_trip(void *arg, unsigned long iterations)
+{
+    uint8_t payload_len = *(uint8_t *)arg;
+    uint8_t frame_buf[BUF_LEN];
+
+    while (iterations--)
+    {
+        uint8_t frame_len;
+
+        wire_len = 0;
+        whisper_data_layer__data_sent(dl, payload, payload_len, 1);
+        frame_len = wire_len;
+        memcpy(frame_buf, wire, frame_len);
+
+        wire_len = 0;
+        whisper_data_layer__data_received(dl, frame_buf, frame_len);
+        whisper_data_layer__data_received(dl, wire, wire_len);
+    }
+}
+
+void data_layer_bench(void)
+{
+    static const uint8_t chunk_lens[] = {1, 16, 64, 255};
+    uint8_t payload_lens[2];
+    char name[64];
+    unsigned int mix;
+    unsigned int i;
+
+    dl = malloc(SIZEOF_WHISPER_DATA_LAYER_T);
+    for (i = 0; i < sizeof(payload); i++)
+        payload[i] = (uint8_t)(i * 17 + 3);
+
+    // parsing, for every payload mix and chunk size
+    for (mix = 0; mix < NUM_MIXES; mix++)
+    {
+        const char *mix_name = build_stream(mix);
+
+        setup(noop_write);
+        for (i = 0; i < sizeof(chunk_lens); i++)
+        {
+            uint8_t chunk_len = chunk_lens[i];
+            double ns = bench_measure(parse_stream, &chunk_len);
+
+            sprintf(name, "data_layer/parse/%s/chunk_%u", mix_name, chunk_len);
+            bench_report(name, "ns/byte", ns / stream_len, 0);
+        }
+    }
+
+    setup(noop_write);
+    payload_lens[0] = 4;
+    payload_lens[1] = max_payload_len();
+
+    // framing with a no-op writer
+    dl->send_buffer.payload = payload;
+    for (i = 0; i < sizeof(payload_lens); i++)
+    {
+        double ns = bench_measure(send_frames, &payload_lens[i]);
+
+        sprintf(name, "data_layer/send/payload_%u", payload_lens[i]);
+        bench_report(name, "frames/s", 1e9 / ns, 1);
+    }
+
+    // loopback round trips through the same instance
+    setup(wire_write);
+    for (i = 0; i < sizeof(payload_lens); i++)
+    {
+        double ns;
+
+        frames_received = 0;
+        ns = bench_measure(round_trip, &payload_lens[i]);
+        if (frames_received == 0 || !dl->send_buffer.empty)
+            fprintf(stderr, "round trip failed for payload of %u bytes\n", payload_lens[i]);
+
+        sprintf(name, "data_layer/round_trip/payload_%u", payload_lens[i]);
+        bench_report(name, "ns/op", ns, 0);
+    }
+
+#ifdef WHISPER_TRACE
+    // the same round trips with every trace point recorded
+    for (i = 0; i < sizeof(payload_lens); i++)
+    {
+        static struct whisper_trace__record records[1024];
+        whisper_trace_t trace = malloc(SIZEOF_WHISPER_TRACE_T);
+        double ns, traced_ns;
+        unsigned long events;
+
+        ns = bench_measure(round_trip, &payload_lens[i]);
+
+        whisper_trace__init(trace, records, 1024, 0, 0);
+        dl->cfg.trace = trace;
+        round_trip(&payload_lens[i], 1);
+        events = whisper_trace__count(trace);
+        traced_ns = bench_measure(round_trip, &payload_lens[i]);
+        dl->cfg.trace = 0;
+
+        sprintf(name, "data_layer/round_trip_traced/payload_%u", payload_lens[i]);
+        bench_report(name, "ns/op", traced_ns, 0);
+        sprintf(name, "data_layer/trace_overhead/payload_%u", payload_lens[i]);
+        bench_report(name, "ns/event", (traced_ns - ns) / events, 0);
+        free(trace);
+    }
+#endif
+
+    free(dl);
+}
@@ -0,0 +1,232 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * Prefix against COBS framing on noisy traces.
+ *
+ * A trace of back to back data frames is recorded in either framing, its
+ * bits are flipped at a rate, and it is fed to a receiving link in chunks.
+ * Reported are the bytes a frame takes beyond its payload, the share of the
+ * frames delivered, the false frames delivered and the receive cost per byte
+ * of the trace. With prefix framing, every corruption makes the receiver
+ * search the following bytes for a prefix and try the false frames it finds,
+ * which payloads carrying frames themselves, as on a gateway forwarding
+ * them, are full of; with COBS framing, it skips to the next delimiter.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "data_layer.h"
+#include "crc.h"
+
+#define BUF_LEN 255
+#define NUM_FRAMES 512
+#define PAYLOAD_LEN 64
+#define CHUNK_LEN 16
+#define TRACE_MAX (NUM_FRAMES * (PAYLOAD_LEN + 16))
+
+static uint8_t recv_buf[BUF_LEN];
+static uint8_t payloads[NUM_FRAMES][PAYLOAD_LEN];
+static uint8_t clean[TRACE_MAX];
+static uint8_t noisy[TRACE_MAX];
+static unsigned long trace_len;
+static unsigned long delivered;
+static unsigned long false_frames;
+static uint8_t measured_framing;
+
+static void record(whisper_data_layer_t dl, const uint8_t *data, uint8_t data_len)
+{
+    memcpy(&clean[trace_len], data, data_len);
+    trace_len += data_len;
+}
+
+static void on_packet_received(whisper_data_layer_t dl, uint8_t *payload, uint8_t payload_len)
+{
+    if (payload_len == PAYLOAD_LEN)
+        ++delivered;
+    else
+        ++false_frames;
+}
+static void noop_write(whisper_data_layer_t dl, const uint8_t *data, uint8_t data_len) { bench_sink += data_len; }
+static void noop_set_delay(whisper_data_layer_t dl, uint16_t delay_in_ms, void (*delay_cb)(whisper_data_layer_t dl)) {}
+static void noop_cancel_delay(whisper_data_layer_t dl) {}
+
+static void init_link(whisper_data_layer_t dl, uint8_t framing,
+                      void (*data_write)(whisper_data_layer_t dl, const uint8_t *data, uint8_t data_len))
+{
+    struct whisper_data_layer__config config = {
+        .buf = recv_buf,
+        .buf_len = BUF_LEN,
+        .packet_received_cb = on_packet_received,
+        .data_write = data_write,
+        .set_delay = noop_set_delay,
+        .cancel_delay = noop_cancel_delay,
+        .framing = framing,
+    };
+    whisper_data_layer__init(dl, &config);
+}
+
+/** record the frames of all payloads, the acknowledgements are not part of the trace */
+static void record_trace(uint8_t framing)
+{
+    whisper_data_layer_t dl = malloc(SIZEOF_WHISPER_DATA_LAYER_T);
+    unsigned int i;
+
+    trace_len = 0;
+    for (i = 0; i < NUM_FRAMES; i++)
+    {
+        // a fresh link for every frame, as none is acknowledged
+        init_link(dl, framing, record);
+        whisper_data_layer__data_sent(dl, payloads[i], PAYLOAD_LEN, 1);
+    }
+    free(dl);
+}
+
+static void add_noise(double bit_error_rate)
+{
+    unsigned long i;
+    unsigned int bit;
+
+    memcpy(noisy, clean, trace_len);
+    for (i = 0; i < trace_len; i++)
+        for (bit = 0; bit < 8; bit++)
+            if (rand() < bit_error_rate * ((double)RAND_MAX + 1))
+                noisy[i] ^= 1 << bit;
+}
+
+static void receive(void *arg, unsigned long iterations)
+{
+    whisper_data_layer_t dl = arg;
+    unsigned long i;
+
+    while (iterations--)
+    {
+        init_link(dl, measured_framing, noop_write);
+        delivered = 0;
+        false_frames = 0;
+        for (i = 0; i < trace_len; i += CHUNK_LEN)
+            whisper_data_layer__data_received(dl, &noisy[i], trace_len - i < CHUNK_LEN ? trace_len - i : CHUNK_LEN);
+    }
+}
+
+/** random payloads, in which zeros and prefixes occur as they do in binary data */
+static void fill_random(void)
+{
+    unsigned int i;
+    unsigned int j;
+
+    for (i = 0; i < NUM_FRAMES; i++)
+        for (j = 0; j < PAYLOAD_LEN; j++)
+            payloads[i][j] = rand();
+}
+
+/** payloads carrying a frame with a prefix each */
+static void fill_tunneled(void)
+{
+    uint8_t inner_len = PAYLOAD_LEN - 8;
+    unsigned int i;
+    unsigned int j;
+
+    for (i = 0; i < NUM_FRAMES; i++)
+    {
+        uint8_t *frame = payloads[i];
+        uint16_t checksum;
+
+        frame[0] = 0x0A;
+        frame[1] = 0x0D;
+        frame[2] = i;
+        frame[3] = i >> 8;
+        frame[4] = 0x02;
+        frame[5] = inner_len;
+        for (j = 0; j < inner_len; j++)
+            frame[6 + j] = rand();
+        checksum = update_crc_buf(frame, 6 + inner_len, CRC_INIT);
+        memcpy(&frame[6 + inner_len], &checksum, 2);
+    }
+}
+
+void framing_bench(void)
+{
+    static const struct
+    {
+        const char *name;
+        uint8_t framing;
+    } framings[] = {
+        {"prefix", WHISPER_DATA_LAYER__FRAMING_PREFIX},
+        {"cobs", WHISPER_DATA_LAYER__FRAMING_COBS},
+    };
+    static const struct
+    {
+        const char *name;
+        double rate;
+    } noise[] = {
+        {"clean", 0},
+        {"ber_1e-4", 1e-4},
+        {"ber_1e-3", 1e-3},
+        {"ber_1e-2", 1e-2},
+    };
+    static const struct
+    {
+        const char *name;
+        void (*fill)(void);
+    } workloads[] = {
+        {"random", fill_random},
+        {"tunneled", fill_tunneled},
+    };
+    whisper_data_layer_t dl = malloc(SIZEOF_WHISPER_DATA_LAYER_T);
+    char name[96];
+    unsigned int w;
+    unsigned int f;
+    unsigned int n;
+
+    for (w = 0; w < sizeof(workloads) / sizeof(workloads[0]); w++)
+    {
+        srand(41);
+        workloads[w].fill();
+
+        for (f = 0; f < sizeof(framings) / sizeof(framings[0]); f++)
+        {
+            record_trace(framings[f].framing);
+            sprintf(name, "framing/%s/%s/overhead", workloads[w].name, framings[f].name);
+            bench_report(name, "B/frame", (double)trace_len / NUM_FRAMES - PAYLOAD_LEN, 0);
+
+            measured_framing = framings[f].framing;
+            for (n = 0; n < sizeof(noise) / sizeof(noise[0]); n++)
+            {
+                double ns;
+
+                srand(42 + n);
+                add_noise(noise[n].rate);
+                ns = bench_measure(receive, dl);
+
+                sprintf(name, "framing/%s/%s/%s/delivered", workloads[w].name, framings[f].name, noise[n].name);
+                bench_report(name, "%", 100.0 * delivered / NUM_FRAMES, 1);
+                sprintf(name, "framing/%s/%s/%s/false_frames", workloads[w].name, framings[f].name, noise[n].name);
+                bench_report(name, "count", false_frames, 0);
+                sprintf(name, "framing/%s/%s/%s/receive", workloads[w].name, framings[f].name, noise[n].name);
+                bench_report(name, "ns/B", ns / trace_len, 0);
+            }
+        }
+    }
+    free(dl);
+}
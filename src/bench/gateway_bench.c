@@ -0,0 +1,143 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "bench.h"
+#include "gateway.h"
+
+#define NUM_PAIRS 256
+#define BUF_LEN 255
+#define PAYLOAD_LEN 32
+
+struct end
+{
+    whisper_serial_t serial;
+    uint8_t buf[BUF_LEN];
+    uint8_t payload[PAYLOAD_LEN];
+};
+
+static struct end ends[2 * NUM_PAIRS];
+static volatile int sending;
+
+static void on_packet_received(whisper_data_layer_t dl, uint8_t *payload, uint8_t payload_len) {}
+
+static void on_data_ack(whisper_data_layer_t dl, unsigned int seq_no, uint8_t sent)
+{
+    struct end *end = whisper_serial__ctx(whisper_serial__of(dl));
+
+    // stop-and-wait, every link sends its next frame when the previous one is done
+    if (sending)
+        whisper_serial__send(end->serial, end->payload, PAYLOAD_LEN, 1);
+}
+
+/** run all links over in-memory streams on the workers, return acknowledged frames per second */
+static double run(unsigned int num_workers, unsigned long *steals)
+{
+    struct whisper_gateway__config config;
+    whisper_gateway_t gateway = malloc(SIZEOF_WHISPER_GATEWAY_T);
+    struct whisper_gateway__stats stats;
+    unsigned long before = 0;
+    unsigned long after = 0;
+    double started;
+    double elapsed;
+    unsigned int i;
+
+    memset(&config, 0, sizeof(config));
+    config.num_workers = num_workers;
+    config.pin_workers = 1;
+    whisper_gateway__init(gateway, &config);
+
+    for (i = 0; i < 2 * NUM_PAIRS; i++)
+    {
+        struct whisper_serial__config serial_config;
+        int fds[2];
+
+        if (i % 2 == 0 && socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+        {
+            fprintf(stderr, "gateway: out of descriptors\n");
+            return 0;
+        }
+
+        memset(&serial_config, 0, sizeof(serial_config));
+        serial_config.fd = fds[i % 2];
+        serial_config.link.buf = ends[i].buf;
+        serial_config.link.buf_len = BUF_LEN;
+        serial_config.link.ctx = &ends[i];
+        serial_config.link.packet_received_cb = on_packet_received;
+        serial_config.link.data_ack_cb = on_data_ack;
+        ends[i].serial = malloc(SIZEOF_WHISPER_SERIAL_T);
+        whisper_serial__open(ends[i].serial, &serial_config);
+        whisper_gateway__add(gateway, ends[i].serial, -1);
+    }
+
+    sending = 1;
+    for (i = 0; i < NUM_PAIRS; i++)
+        whisper_serial__send(ends[2 * i].serial, ends[2 * i].payload, PAYLOAD_LEN, 1);
+    whisper_gateway__start(gateway);
+
+    // warm up, then count the events of the links over the measurement
+    usleep(bench_repetition_ns / 1e3);
+    started = bench_now_ns();
+    for (i = 0; i < num_workers; i++)
+    {
+        whisper_gateway__stats(gateway, i, &stats);
+        before += stats.events;
+    }
+    usleep(4 * bench_repetition_ns / 1e3);
+    elapsed = bench_now_ns() - started;
+    *steals = 0;
+    for (i = 0; i < num_workers; i++)
+    {
+        whisper_gateway__stats(gateway, i, &stats);
+        after += stats.events;
+        *steals += stats.steals;
+    }
+
+    sending = 0;
+    whisper_gateway__destroy(gateway);
+    free(gateway);
+    for (i = 0; i < 2 * NUM_PAIRS; i++)
+        free(ends[i].serial);
+
+    // a frame takes two events, the frame at the receiver and the acknowledgement at the sender
+    return (after - before) / 2 / (elapsed / 1e9);
+}
+
+void gateway_bench(void)
+{
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned int num_workers;
+    char name[64];
+
+    for (num_workers = 1; num_workers <= (unsigned long)cores && num_workers <= 16; num_workers *= 2)
+    {
+        unsigned long steals;
+        double frames = run(num_workers, &steals);
+
+        sprintf(name, "gateway/links_%u/workers_%u", 2 * NUM_PAIRS, num_workers);
+        bench_report(name, "frames/s", frames, 1);
+    }
+}
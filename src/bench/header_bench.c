@@ -0,0 +1,171 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * Full against compact headers on a mix of small messages.
+ *
+ * A link sends the mix to a peer in memory, with the acknowledgements looped
+ * back, and the bytes both put on the line are recorded. Reported are the
+ * bytes on the line per message, the share of them that is payload, and the
+ * cost of receiving a data frame of the recorded trace, which includes
+ * writing its acknowledgement.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "data_layer.h"
+
+#define BUF_LEN 255
+#define NUM_MESSAGES 1024
+#define CHUNK_LEN 16
+#define TRACE_MAX (NUM_MESSAGES * 64)
+
+// payload lengths of the mix, mostly commands and readings of a few bytes
+static const uint8_t MIX[] = {2, 3, 4, 2, 3, 4, 8, 32};
+#define MIX_LEN (sizeof(MIX) / sizeof(MIX[0]))
+
+static uint8_t sender_buf[BUF_LEN];
+static uint8_t receiver_buf[BUF_LEN];
+static uint8_t payloads[NUM_MESSAGES][32];
+static uint8_t trace[TRACE_MAX];
+static unsigned long trace_len;
+static uint8_t acks[64];
+static uint8_t acks_len;
+static unsigned long delivered;
+static uint8_t measured_header;
+
+static void record_frame(whisper_data_layer_t dl, const uint8_t *data, uint8_t data_len)
+{
+    memcpy(&trace[trace_len], data, data_len);
+    trace_len += data_len;
+}
+
+static void record_ack(whisper_data_layer_t dl, const uint8_t *data, uint8_t data_len)
+{
+    memcpy(&acks[acks_len], data, data_len);
+    acks_len += data_len;
+}
+
+static void on_packet_received(whisper_data_layer_t dl, uint8_t *payload, uint8_t payload_len) { ++delivered; }
+static void noop_write(whisper_data_layer_t dl, const uint8_t *data, uint8_t data_len) { bench_sink += data_len; }
+static void noop_set_delay(whisper_data_layer_t dl, uint16_t delay_in_ms, void (*delay_cb)(whisper_data_layer_t dl)) {}
+static void noop_cancel_delay(whisper_data_layer_t dl) {}
+
+static void init_link(whisper_data_layer_t dl, uint8_t *buf, uint8_t header,
+                      void (*data_write)(whisper_data_layer_t dl, const uint8_t *data, uint8_t data_len))
+{
+    struct whisper_data_layer__config config = {
+        .buf = buf,
+        .buf_len = BUF_LEN,
+        .packet_received_cb = on_packet_received,
+        .data_write = data_write,
+        .set_delay = noop_set_delay,
+        .cancel_delay = noop_cancel_delay,
+        .header = header,
+    };
+    whisper_data_layer__init(dl, &config);
+}
+
+/** send the mix, return the bytes on the line of the data frames and their acknowledgements */
+static unsigned long record_trace(uint8_t header)
+{
+    whisper_data_layer_t sender = malloc(SIZEOF_WHISPER_DATA_LAYER_T);
+    whisper_data_layer_t receiver = malloc(SIZEOF_WHISPER_DATA_LAYER_T);
+    unsigned long ack_bytes = 0;
+    unsigned int i;
+
+    init_link(sender, sender_buf, header, record_frame);
+    init_link(receiver, receiver_buf, header, record_ack);
+    trace_len = 0;
+    for (i = 0; i < NUM_MESSAGES; i++)
+    {
+        unsigned long frame_at = trace_len;
+
+        whisper_data_layer__data_sent(sender, payloads[i], MIX[i % MIX_LEN], 1);
+        acks_len = 0;
+        whisper_data_layer__data_received(receiver, &trace[frame_at], trace_len - frame_at);
+        ack_bytes += acks_len;
+        whisper_data_layer__data_received(sender, acks, acks_len);
+    }
+    free(sender);
+    free(receiver);
+    return trace_len + ack_bytes;
+}
+
+static void receive(void *arg, unsigned long iterations)
+{
+    whisper_data_layer_t dl = arg;
+    unsigned long i;
+
+    while (iterations--)
+    {
+        init_link(dl, receiver_buf, measured_header, noop_write);
+        delivered = 0;
+        for (i = 0; i < trace_len; i += CHUNK_LEN)
+            whisper_data_layer__data_received(dl, &trace[i], trace_len - i < CHUNK_LEN ? trace_len - i : CHUNK_LEN);
+    }
+}
+
+void header_bench(void)
+{
+    static const struct
+    {
+        const char *name;
+        uint8_t header;
+    } headers[] = {
+        {"full", WHISPER_DATA_LAYER__HEADER_FULL},
+        {"compact", WHISPER_DATA_LAYER__HEADER_COMPACT},
+    };
+    whisper_data_layer_t dl = malloc(SIZEOF_WHISPER_DATA_LAYER_T);
+    unsigned long payload_bytes = 0;
+    char name[64];
+    unsigned int i;
+    unsigned int j;
+
+    srand(43);
+    for (i = 0; i < NUM_MESSAGES; i++)
+    {
+        for (j = 0; j < sizeof(payloads[i]); j++)
+            payloads[i][j] = rand();
+        payload_bytes += MIX[i % MIX_LEN];
+    }
+
+    for (i = 0; i < sizeof(headers) / sizeof(headers[0]); i++)
+    {
+        unsigned long wire_bytes = record_trace(headers[i].header);
+        double ns;
+
+        sprintf(name, "header/%s/wire", headers[i].name);
+        bench_report(name, "B/message", (double)wire_bytes / NUM_MESSAGES, 0);
+        sprintf(name, "header/%s/efficiency", headers[i].name);
+        bench_report(name, "%", 100.0 * payload_bytes / wire_bytes, 1);
+
+        measured_header = headers[i].header;
+        ns = bench_measure(receive, dl);
+        if (delivered != NUM_MESSAGES)
+            fprintf(stderr, "header/%s: %lu of %u messages delivered\n", headers[i].name, delivered, NUM_MESSAGES);
+        sprintf(name, "header/%s/parse", headers[i].name);
+        bench_report(name, "ns/frame", ns / NUM_MESSAGES, 0);
+    }
+    free(dl);
+}
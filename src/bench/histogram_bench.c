@@ -0,0 +1,56 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <stdlib.h>
+#include "bench.h"
+#include "histogram.h"
+
+#define NUM_VALUES 4096
+
+static struct whisper_histogram histogram;
+static unsigned long values[NUM_VALUES];
+
+static void record(void *arg, unsigned long iterations)
+{
+    while (iterations--)
+        whisper_histogram__record(&histogram, values[iterations % NUM_VALUES]);
+}
+
+static void percentile(void *arg, unsigned long iterations)
+{
+    while (iterations--)
+        bench_sink += whisper_histogram__percentile(&histogram, 999000);
+}
+
+void histogram_bench(void)
+{
+    unsigned int i;
+
+    // latencies of acknowledgements, mostly a few ms with a tail of retransmissions
+    srand(33);
+    for (i = 0; i < NUM_VALUES; i++)
+        values[i] = 500 + rand() % 5000 + (rand() % 100 == 0 ? 50000 : 0);
+
+    whisper_histogram__init(&histogram);
+    bench_report("histogram/record", "ns/op", bench_measure(record, 0), 0);
+    bench_report("histogram/percentile", "ns/op", bench_measure(percentile, 0), 0);
+}
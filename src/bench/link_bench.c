@@ -0,0 +1,90 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * Goodput and latency of the protocol on simulated links. The results are in
+ * virtual time, so they are deterministic and only change with the protocol.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "bench.h"
+#include "link_sim.h"
+
+struct scenario
+{
+    const char *name;
+    unsigned long baud;
+    double loss_rate;
+    double bit_error_rate;
+    uint8_t payload_len;
+    uint8_t fec_parity;
+};
+
+static const struct scenario scenarios[] = {
+    {"9600/clean", 9600, 0, 0, 32, 0},
+    {"115200/clean", 115200, 0, 0, 128, 0},
+    {"115200/loss_1pct", 115200, 0.01, 0, 128, 0},
+    {"115200/ber_1e-5", 115200, 0, 1e-5, 128, 0},
+    // the cost of forward error correction on a clean line, and what it buys on noisy ones
+    {"115200/clean/fec_4", 115200, 0, 0, 128, 4},
+    {"115200/ber_1e-4", 115200, 0, 1e-4, 128, 0},
+    {"115200/ber_1e-4/fec_2", 115200, 0, 1e-4, 128, 2},
+    {"115200/ber_1e-4/fec_4", 115200, 0, 1e-4, 128, 4},
+    {"115200/ber_1e-4/fec_8", 115200, 0, 1e-4, 128, 8},
+    {"115200/ber_1e-3", 115200, 0, 1e-3, 32, 0},
+    {"115200/ber_1e-3/fec_4", 115200, 0, 1e-3, 32, 4},
+    {"115200/ber_1e-3/fec_8", 115200, 0, 1e-3, 32, 8},
+};
+
+void link_bench(void)
+{
+    struct link_sim__config config;
+    struct link_sim__report report;
+    const struct link_sim__stats *stats = &report.dir[LINK_SIM__A];
+    char name[64];
+    unsigned int i;
+
+    for (i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++)
+    {
+        memset(&config, 0, sizeof(config));
+        config.wire.baud = scenarios[i].baud;
+        config.wire.loss_rate = scenarios[i].loss_rate;
+        config.wire.bit_error_rate = scenarios[i].bit_error_rate;
+        config.wire.chunk_len = 16;
+        config.wire.delay_us = 100;
+        config.workload[LINK_SIM__A].num_messages = 2000;
+        config.workload[LINK_SIM__A].payload_len = scenarios[i].payload_len;
+        config.buf_len = 255;
+        config.fec_parity = scenarios[i].fec_parity;
+        config.seed = 29;
+        link_sim__run(&config, &report);
+
+        sprintf(name, "link/%s/goodput", scenarios[i].name);
+        bench_report(name, "bit/s", stats->goodput_bps, 1);
+        sprintf(name, "link/%s/latency_p50", scenarios[i].name);
+        bench_report(name, "us", stats->latency_p50_us, 0);
+        sprintf(name, "link/%s/latency_p99", scenarios[i].name);
+        bench_report(name, "us", stats->latency_p99_us, 0);
+        sprintf(name, "link/%s/timeouts", scenarios[i].name);
+        bench_report(name, "count", stats->timeouts, 0);
+    }
+}
@@ -0,0 +1,253 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * Latency of control messages under saturating bulk load.
+ *
+ * A sender uploads logs in messages of several frames back to back, which
+ * keeps its queue full, and issues a short control message at a fixed
+ * interval. The line is simulated in virtual time without loss, a frame and
+ * its acknowledgement take the time of their bytes on the line. Reported
+ * are the latency of the control messages from being issued to being
+ * delivered and the goodput of the upload, with both on one channel in the
+ * order of submission, as with a single queue in front of the link, and on
+ * channels of their own with strict and weighted scheduling.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "mux.h"
+
+#define BAUD 115200
+#define BYTE_NS (10 * 1000000000ULL / BAUD)
+#define BUF_LEN 255
+#define BULK_LEN 4096
+#define BULK_QUEUED 4
+#define CONTROL_LEN 8
+#define CONTROL_INTERVAL_NS 20000000ULL
+#define NUM_CONTROL 500
+#define MAX_STAGED 1024
+// messages a channel holds, the control messages pile up behind the upload on a single channel
+#define QUEUE_LEN 255
+
+/** bytes written by a link and not yet on the line */
+struct line
+{
+    uint8_t data[MAX_STAGED];
+    unsigned int len;
+};
+
+static whisper_data_layer_t sender;
+static whisper_data_layer_t receiver;
+static whisper_mux_t mux;
+static uint8_t sender_buf[BUF_LEN];
+static uint8_t receiver_buf[BUF_LEN];
+static struct line lines[2];
+static struct whisper_mux__message queues[2][QUEUE_LEN];
+static struct whisper_mux__channel channels[2];
+
+static uint8_t bulk[BULK_LEN];
+static uint8_t control[NUM_CONTROL][CONTROL_LEN];
+static uint8_t control_channel;
+static uint8_t bulk_channel;
+static unsigned long long now;
+static unsigned int next_control;
+static unsigned int bulk_queued;
+static unsigned int num_delivered;
+static unsigned long long latencies[NUM_CONTROL];
+static unsigned long long bulk_bytes;
+
+static void data_write(whisper_data_layer_t dl, const uint8_t *data, uint8_t data_len)
+{
+    struct line *line = &lines[dl == receiver];
+
+    memcpy(&line->data[line->len], data, data_len);
+    line->len += data_len;
+}
+
+static void set_delay(whisper_data_layer_t dl, uint16_t delay_in_ms, void (*delay_cb)(whisper_data_layer_t dl)) {}
+static void cancel_delay(whisper_data_layer_t dl) {}
+
+/** issue the control messages due, then top up the upload, which never runs out of messages */
+static void submit_due(void)
+{
+    while (next_control < NUM_CONTROL && next_control * CONTROL_INTERVAL_NS <= now)
+        whisper_mux__submit(mux, control_channel, control[next_control++], CONTROL_LEN, 1);
+
+    for (; bulk_queued < BULK_QUEUED; bulk_queued++)
+        whisper_mux__submit(mux, bulk_channel, bulk, BULK_LEN, 1);
+}
+
+static void on_packet_received(whisper_data_layer_t dl, uint8_t *payload, uint8_t payload_len)
+{
+    unsigned int index;
+
+    // the fragments of the upload are longer
+    if (payload_len != CONTROL_LEN)
+    {
+        bulk_bytes += payload_len;
+        return;
+    }
+
+    memcpy(&index, payload, sizeof(index));
+    latencies[num_delivered++] = now - index * CONTROL_INTERVAL_NS;
+}
+
+static void on_data_ack(whisper_data_layer_t dl, unsigned int seq_no, uint8_t sent)
+{
+    whisper_mux__complete(mux, dl, seq_no, sent);
+}
+
+static void on_message_sent(whisper_data_layer_t dl, uint8_t channel, const uint8_t *data, uint16_t data_length,
+                            uint8_t sent)
+{
+    if (data == bulk)
+        --bulk_queued;
+    submit_due();
+}
+
+/** put the bytes written by a link on the line, they arrive at the other one with the last of them */
+static void transmit(unsigned int from)
+{
+    static uint8_t data[MAX_STAGED];
+    whisper_data_layer_t to = from == 0 ? receiver : sender;
+    unsigned int len = lines[from].len;
+    unsigned int offset;
+
+    now += len * BYTE_NS;
+    memcpy(data, lines[from].data, len);
+    lines[from].len = 0;
+    // the control messages issued meanwhile are queued
+    submit_due();
+    for (offset = 0; offset < len; offset += 255)
+        whisper_data_layer__data_received(to, &data[offset], len - offset > 255 ? 255 : len - offset);
+}
+
+static void init_link(whisper_data_layer_t dl, uint8_t *buf)
+{
+    struct whisper_data_layer__config config;
+
+    memset(&config, 0, sizeof(config));
+    config.buf = buf;
+    config.buf_len = BUF_LEN;
+    config.data_write = data_write;
+    config.set_delay = set_delay;
+    config.cancel_delay = cancel_delay;
+    config.data_ack_cb = on_data_ack;
+    config.packet_received_cb = on_packet_received;
+    whisper_data_layer__init(dl, &config);
+}
+
+static int compare_latencies(const void *a, const void *b)
+{
+    unsigned long long x = *(const unsigned long long *)a;
+    unsigned long long y = *(const unsigned long long *)b;
+    return x < y ? -1 : x > y;
+}
+
+/** run the load with the control messages on channel 0, and the upload on the last channel */
+static void run(uint8_t num_channels, uint8_t scheduling, uint8_t control_weight, uint8_t bulk_weight,
+                uint8_t fragment_len)
+{
+    unsigned int i;
+
+    init_link(sender, sender_buf);
+    init_link(receiver, receiver_buf);
+    memset(lines, 0, sizeof(lines));
+    memset(channels, 0, sizeof(channels));
+    for (i = 0; i < 2; i++)
+    {
+        channels[i].queue = queues[i];
+        channels[i].capacity = QUEUE_LEN;
+        channels[i].fragment_len = fragment_len;
+        channels[i].weight = i == 0 ? control_weight : bulk_weight;
+        channels[i].sent_cb = on_message_sent;
+    }
+    whisper_mux__init(mux, channels, num_channels, scheduling);
+
+    control_channel = 0;
+    bulk_channel = num_channels - 1;
+    now = 0;
+    next_control = 0;
+    bulk_queued = 0;
+    num_delivered = 0;
+    bulk_bytes = 0;
+
+    submit_due();
+    whisper_mux__drain(mux, sender);
+    // the upload keeps the line busy, a frame and its acknowledgement let the next frame go
+    while (num_delivered < NUM_CONTROL && lines[0].len > 0)
+    {
+        transmit(0);
+        transmit(1);
+    }
+
+    qsort(latencies, num_delivered, sizeof(latencies[0]), compare_latencies);
+}
+
+void mux_bench(void)
+{
+    static const struct
+    {
+        const char *name;
+        uint8_t num_channels;
+        uint8_t scheduling;
+        uint8_t control_weight;
+        uint8_t bulk_weight;
+        uint8_t fragment_len;
+    } scenarios[] = {
+        {"single_queue", 1, WHISPER_MUX__STRICT, 1, 1, 224},
+        {"strict", 2, WHISPER_MUX__STRICT, 1, 1, 224},
+        // the light control channel is never behind the upload in virtual time
+        {"weighted_1_8", 2, WHISPER_MUX__WEIGHTED, 1, 8, 224},
+        // shorter fragments trade goodput for latency
+        {"strict_fragment_64", 2, WHISPER_MUX__STRICT, 1, 1, 64},
+    };
+    char name[96];
+    unsigned int i;
+
+    sender = malloc(SIZEOF_WHISPER_DATA_LAYER_T);
+    receiver = malloc(SIZEOF_WHISPER_DATA_LAYER_T);
+    mux = malloc(SIZEOF_WHISPER_MUX_T);
+    for (i = 0; i < NUM_CONTROL; i++)
+        memcpy(control[i], &i, sizeof(i));
+
+    for (i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++)
+    {
+        run(scenarios[i].num_channels, scenarios[i].scheduling, scenarios[i].control_weight,
+            scenarios[i].bulk_weight, scenarios[i].fragment_len);
+
+        sprintf(name, "mux/%s/control_latency_p50", scenarios[i].name);
+        bench_report(name, "us", latencies[num_delivered / 2] / 1000.0, 0);
+        sprintf(name, "mux/%s/control_latency_p99", scenarios[i].name);
+        bench_report(name, "us", latencies[num_delivered * 99 / 100] / 1000.0, 0);
+        sprintf(name, "mux/%s/control_latency_max", scenarios[i].name);
+        bench_report(name, "us", latencies[num_delivered - 1] / 1000.0, 0);
+        sprintf(name, "mux/%s/bulk_goodput", scenarios[i].name);
+        bench_report(name, "bit/s", bulk_bytes * 8 * 1e9 / now, 1);
+    }
+
+    free(sender);
+    free(receiver);
+    free(mux);
+}
@@ -0,0 +1,209 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "bench.h"
+#include "serial_transport.h"
+#include "shm_transport.h"
+
+#define BUF_LEN 255
+#define RING_LEN 65536
+
+/** the two transports compared, behind one interface */
+struct transport
+{
+    const char *name;
+    void *handle;
+    int (*poll)(void *handle, int timeout_ms);
+    uint16_t (*send)(void *handle, uint8_t *data, uint8_t data_length, uint8_t ack_required);
+};
+
+struct end
+{
+    struct transport transport;
+    uint8_t buf[BUF_LEN];
+    uint8_t payload[BUF_LEN];
+    uint8_t payload_len;
+    unsigned long acked;
+};
+
+static struct end end;
+
+static int shm_poll(void *handle, int timeout_ms)
+{
+    return whisper_shm__poll(handle, timeout_ms);
+}
+
+static uint16_t shm_send(void *handle, uint8_t *data, uint8_t data_length, uint8_t ack_required)
+{
+    return whisper_shm__send(handle, data, data_length, ack_required);
+}
+
+static int serial_poll(void *handle, int timeout_ms)
+{
+    return whisper_serial__poll(handle, timeout_ms);
+}
+
+static uint16_t serial_send(void *handle, uint8_t *data, uint8_t data_length, uint8_t ack_required)
+{
+    return whisper_serial__send(handle, data, data_length, ack_required);
+}
+
+static void on_packet_received(whisper_data_layer_t dl, uint8_t *payload, uint8_t payload_len) {}
+
+static void on_data_ack(whisper_data_layer_t dl, unsigned int seq_no, uint8_t sent)
+{
+    ++end.acked;
+}
+
+static void link_config(struct whisper_data_layer__config *link)
+{
+    memset(link, 0, sizeof(*link));
+    link->buf = end.buf;
+    link->buf_len = BUF_LEN;
+    link->packet_received_cb = on_packet_received;
+    link->data_ack_cb = on_data_ack;
+}
+
+/** open a side of the link on a descriptor, the process has a single end */
+static void open_end(int shm, int fd, unsigned int side)
+{
+    memset(&end, 0, sizeof(end));
+    if (shm)
+    {
+        struct whisper_shm__config config;
+
+        config.fd = fd;
+        config.side = side;
+        link_config(&config.link);
+        end.transport.handle = malloc(SIZEOF_WHISPER_SHM_T);
+        whisper_shm__open(end.transport.handle, &config);
+        end.transport.poll = shm_poll;
+        end.transport.send = shm_send;
+    }
+    else
+    {
+        struct whisper_serial__config config;
+
+        memset(&config, 0, sizeof(config));
+        config.fd = fd;
+        link_config(&config.link);
+        end.transport.handle = malloc(SIZEOF_WHISPER_SERIAL_T);
+        whisper_serial__open(end.transport.handle, &config);
+        end.transport.poll = serial_poll;
+        end.transport.send = serial_send;
+    }
+}
+
+/** send frames one after the other, waiting for the acknowledgement, sleeping in between */
+static void round_trips(void *arg, unsigned long iterations)
+{
+    unsigned long i;
+
+    for (i = 0; i < iterations; i++)
+    {
+        unsigned long acked = end.acked;
+
+        end.transport.send(end.transport.handle, end.payload, end.payload_len, 1);
+        while (end.acked == acked)
+            end.transport.poll(end.transport.handle, 1000);
+    }
+}
+
+/** run the peer in a child process, which acknowledges the frames until it is killed */
+static pid_t start_peer(int shm, int fd)
+{
+    pid_t child = fork();
+
+    if (child == 0)
+    {
+        open_end(shm, fd, 1);
+        for (;;)
+            end.transport.poll(end.transport.handle, 1000);
+    }
+    return child;
+}
+
+static void run(const char *name, int shm)
+{
+    static const uint8_t payload_lens[] = {32, 200};
+    char result[64];
+    int fds[2];
+    pid_t peer;
+    unsigned int i;
+
+    if (shm)
+    {
+        fds[0] = fds[1] = whisper_shm__create(RING_LEN);
+        if (fds[0] < 0)
+            return;
+    }
+    else if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+        return;
+
+    peer = start_peer(shm, fds[1]);
+    if (peer < 0)
+        return;
+    open_end(shm, fds[0], 0);
+
+    for (i = 0; i < sizeof(payload_lens); i++)
+    {
+        double ns;
+
+        end.payload_len = payload_lens[i];
+        ns = bench_measure(round_trips, 0);
+
+        // a round trip wakes up each side once
+        sprintf(result, "%s/wakeup/%u", name, payload_lens[i]);
+        bench_report(result, "ns", ns / 2, 0);
+        sprintf(result, "%s/throughput/%u", name, payload_lens[i]);
+        bench_report(result, "MB/s", payload_lens[i] / ns * 1e3, 1);
+    }
+
+    kill(peer, SIGKILL);
+    waitpid(peer, 0, 0);
+    if (shm)
+    {
+        whisper_shm__close(end.transport.handle);
+        close(fds[0]);
+    }
+    else
+    {
+        // the serial transport owns its descriptor
+        whisper_serial__close(end.transport.handle);
+        close(fds[1]);
+    }
+    free(end.transport.handle);
+}
+
+void shm_bench(void)
+{
+    // the stream transport copies through the kernel, as over a pipe
+    run("shm/stream", 0);
+    run("shm/shm", 1);
+}
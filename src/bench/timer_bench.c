@@ -0,0 +1,109 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "timer_wheel.h"
+
+#define MAX_TIMERS 100000
+#define MAX_TIMEOUT 60000
+
+static whisper_timer_wheel_t wheel;
+static struct whisper_timer *timers;
+static unsigned long *expiries;
+
+static void on_expired(struct whisper_timer *timer)
+{
+    ++bench_sink;
+}
+
+/** re-arm and cancel timers among the populated ones, as retransmission timers do */
+static void add_cancel(void *arg, unsigned long iterations)
+{
+    unsigned long num_timers = *(unsigned long *)arg;
+    unsigned long i = 0;
+
+    while (iterations--)
+    {
+        struct whisper_timer *timer = &timers[i];
+        unsigned long now = whisper_timer_wheel__now(wheel);
+
+        whisper_timer_wheel__add(wheel, timer, now + expiries[i]);
+        whisper_timer_wheel__cancel(wheel, timer);
+        whisper_timer_wheel__add(wheel, timer, now + expiries[i]);
+        if (++i == num_timers)
+            i = 0;
+    }
+}
+
+/** advance tick by tick, every timer expiring is re-armed */
+static void advance(void *arg, unsigned long iterations)
+{
+    while (iterations--)
+        whisper_timer_wheel__advance(wheel, whisper_timer_wheel__now(wheel) + 1);
+}
+
+static void rearm(struct whisper_timer *timer)
+{
+    whisper_timer_wheel__add(wheel, timer, timer->expires + MAX_TIMEOUT / 2 + bench_sink++ % MAX_TIMEOUT);
+}
+
+void timer_bench(void)
+{
+    static const unsigned long populations[] = {1000, 100000};
+    char name[64];
+    unsigned int p;
+    unsigned long i;
+
+    wheel = malloc(SIZEOF_WHISPER_TIMER_WHEEL_T);
+    timers = malloc(sizeof(struct whisper_timer) * MAX_TIMERS);
+    expiries = malloc(sizeof(unsigned long) * MAX_TIMERS);
+
+    srand(30);
+    for (i = 0; i < MAX_TIMERS; i++)
+        expiries[i] = 1 + rand() % MAX_TIMEOUT;
+
+    for (p = 0; p < sizeof(populations) / sizeof(populations[0]); p++)
+    {
+        unsigned long num_timers = populations[p];
+
+        whisper_timer_wheel__init(wheel, 0);
+        for (i = 0; i < num_timers; i++)
+        {
+            whisper_timer__init(&timers[i], on_expired, 0);
+            whisper_timer_wheel__add(wheel, &timers[i], expiries[i]);
+        }
+
+        sprintf(name, "timer/add_cancel_add/%lu", num_timers);
+        bench_report(name, "ns/op", bench_measure(add_cancel, &num_timers), 0);
+
+        for (i = 0; i < num_timers; i++)
+            timers[i].cb = rearm;
+        sprintf(name, "timer/advance_tick/%lu", num_timers);
+        bench_report(name, "ns/tick", bench_measure(advance, 0), 0);
+    }
+
+    free(expiries);
+    free(timers);
+    free(wheel);
+}
@@ -0,0 +1,58 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <stdlib.h>
+#include "bench.h"
+#include "trace.h"
+
+#define CAPACITY 4096
+
+static whisper_trace_t trace;
+
+static unsigned long cycles_clock(void *ctx)
+{
+    return (unsigned long)bench_cycles();
+}
+
+static void write_records(void *arg, unsigned long iterations)
+{
+    while (iterations--)
+        whisper_trace__write(trace, WHISPER_TRACE__STATE, (uint8_t)iterations, (uint16_t)iterations);
+}
+
+void trace_bench(void)
+{
+    struct whisper_trace__record *records = malloc(CAPACITY * sizeof(struct whisper_trace__record));
+
+    trace = malloc(SIZEOF_WHISPER_TRACE_T);
+
+    // the index of the record as timestamp
+    whisper_trace__init(trace, records, CAPACITY, 0, 0);
+    bench_report("trace/write/no_clock", "ns/event", bench_measure(write_records, 0), 0);
+
+    // the cycle counter as timestamp, as an integration would use
+    whisper_trace__init(trace, records, CAPACITY, cycles_clock, 0);
+    bench_report("trace/write/cycle_clock", "ns/event", bench_measure(write_records, 0), 0);
+
+    free(trace);
+    free(records);
+}
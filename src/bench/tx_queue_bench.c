@@ -0,0 +1,237 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "histogram.h"
+#include "tx_queue.h"
+
+#define MAX_PRODUCERS 8
+#define FRAMES_PER_PRODUCER 20000
+#define CAPACITY 256
+#define BUF_LEN 255
+#define PIPE_LEN 4096
+#define PAYLOAD_LEN 32
+
+/** a direction of the loopback, the bytes written by a link and not yet fed to the other one */
+struct pipe
+{
+    uint8_t data[PIPE_LEN];
+    unsigned int len;
+};
+
+struct producer
+{
+    pthread_t thread;
+    uint8_t payload[PAYLOAD_LEN];
+    // time spent in a submission, including the retries while the link or the queue is busy
+    struct whisper_histogram submit_ns;
+};
+
+static struct whisper_tx_queue__cell cells[CAPACITY];
+static whisper_tx_queue_t queue;
+static whisper_data_layer_t sender;
+static whisper_data_layer_t receiver;
+static uint8_t sender_buf[BUF_LEN];
+static uint8_t receiver_buf[BUF_LEN];
+static struct pipe pipes[2];
+static struct producer producers[MAX_PRODUCERS];
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static char with_mutex;
+static unsigned long delivered;
+
+static void data_write(whisper_data_layer_t dl, const uint8_t *data, uint8_t data_len)
+{
+    struct pipe *pipe = &pipes[dl == receiver];
+
+    memcpy(&pipe->data[pipe->len], data, data_len);
+    pipe->len += data_len;
+}
+
+static void set_delay(whisper_data_layer_t dl, uint16_t delay_in_ms, void (*delay_cb)(whisper_data_layer_t dl)) {}
+
+static void cancel_delay(whisper_data_layer_t dl) {}
+
+static void on_packet_received(whisper_data_layer_t dl, uint8_t *payload, uint8_t payload_len)
+{
+    ++delivered;
+}
+
+static void on_data_ack(whisper_data_layer_t dl, unsigned int seq_no, uint8_t sent)
+{
+    if (!with_mutex)
+        whisper_tx_queue__complete(queue, dl, seq_no);
+}
+
+/** feed the bytes of each direction to the other link, return the number of bytes moved */
+static unsigned int pump(void)
+{
+    static uint8_t data[PIPE_LEN];
+    unsigned int moved = 0;
+    unsigned int i;
+
+    for (i = 0; i < 2; i++)
+    {
+        whisper_data_layer_t to = i == 0 ? receiver : sender;
+        unsigned int len = pipes[i].len;
+        unsigned int offset;
+
+        memcpy(data, pipes[i].data, len);
+        pipes[i].len = 0;
+        for (offset = 0; offset < len; offset += 255)
+            whisper_data_layer__data_received(to, &data[offset], len - offset > 255 ? 255 : len - offset);
+        moved += len;
+    }
+    return moved;
+}
+
+static void init_link(whisper_data_layer_t dl, uint8_t *buf)
+{
+    struct whisper_data_layer__config config;
+
+    memset(&config, 0, sizeof(config));
+    config.buf = buf;
+    config.buf_len = BUF_LEN;
+    config.data_write = data_write;
+    config.set_delay = set_delay;
+    config.cancel_delay = cancel_delay;
+    config.data_ack_cb = on_data_ack;
+    config.packet_received_cb = on_packet_received;
+    whisper_data_layer__init(dl, &config);
+}
+
+static void *produce(void *arg)
+{
+    struct producer *producer = arg;
+    unsigned long i;
+
+    for (i = 0; i < FRAMES_PER_PRODUCER; i++)
+    {
+        double started = bench_now_ns();
+
+        if (with_mutex)
+        {
+            // the way around the queue, every send under one lock, retried while a frame is in flight
+            for (;;)
+            {
+                uint16_t seq_no;
+
+                pthread_mutex_lock(&mutex);
+                seq_no = whisper_data_layer__data_sent(sender, producer->payload, PAYLOAD_LEN, 1);
+                pthread_mutex_unlock(&mutex);
+                if (seq_no)
+                    break;
+                sched_yield();
+            }
+        }
+        else
+        {
+            while (whisper_tx_queue__submit(queue, producer->payload, PAYLOAD_LEN, 1) != 0)
+                sched_yield();
+        }
+
+        whisper_histogram__record(&producer->submit_ns, bench_now_ns() - started);
+    }
+    return 0;
+}
+
+static void run(unsigned int num_producers, char mutex_mode)
+{
+    struct whisper_histogram submit_ns;
+    unsigned long total = num_producers * FRAMES_PER_PRODUCER;
+    char name[64];
+    double started;
+    double elapsed;
+    unsigned int i;
+
+    with_mutex = mutex_mode;
+    whisper_tx_queue__init(queue, cells, CAPACITY);
+    init_link(sender, sender_buf);
+    init_link(receiver, receiver_buf);
+    memset(pipes, 0, sizeof(pipes));
+    delivered = 0;
+
+    started = bench_now_ns();
+    for (i = 0; i < num_producers; i++)
+    {
+        whisper_histogram__init(&producers[i].submit_ns);
+        pthread_create(&producers[i].thread, 0, produce, &producers[i]);
+    }
+
+    // the owner of the link
+    while (delivered < total)
+    {
+        unsigned int moved;
+
+        if (with_mutex)
+        {
+            pthread_mutex_lock(&mutex);
+            moved = pump();
+            pthread_mutex_unlock(&mutex);
+        }
+        else
+        {
+            whisper_tx_queue__drain(queue, sender);
+            moved = pump();
+        }
+        if (moved == 0)
+            sched_yield();
+    }
+    elapsed = bench_now_ns() - started;
+
+    whisper_histogram__init(&submit_ns);
+    for (i = 0; i < num_producers; i++)
+    {
+        pthread_join(producers[i].thread, 0);
+        whisper_histogram__merge(&submit_ns, &producers[i].submit_ns);
+    }
+
+    sprintf(name, "tx_queue/producers_%u/%s/throughput", num_producers, mutex_mode ? "mutex" : "queue");
+    bench_report(name, "frames/s", total / (elapsed / 1e9), 1);
+    sprintf(name, "tx_queue/producers_%u/%s/submit_p50", num_producers, mutex_mode ? "mutex" : "queue");
+    bench_report(name, "ns", whisper_histogram__percentile(&submit_ns, 500000), 0);
+    sprintf(name, "tx_queue/producers_%u/%s/submit_p99", num_producers, mutex_mode ? "mutex" : "queue");
+    bench_report(name, "ns", whisper_histogram__percentile(&submit_ns, 990000), 0);
+}
+
+void tx_queue_bench(void)
+{
+    unsigned int num_producers;
+
+    queue = malloc(SIZEOF_WHISPER_TX_QUEUE_T);
+    sender = malloc(SIZEOF_WHISPER_DATA_LAYER_T);
+    receiver = malloc(SIZEOF_WHISPER_DATA_LAYER_T);
+
+    for (num_producers = 1; num_producers <= MAX_PRODUCERS; num_producers *= 4)
+    {
+        run(num_producers, 1);
+        run(num_producers, 0);
+    }
+
+    free(queue);
+    free(sender);
+    free(receiver);
+}
@@ -0,0 +1,168 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "udp_transport.h"
+
+#define MAX_DEVICES 256
+#define BUF_LEN 255
+#define PAYLOAD_LEN 32
+
+struct end
+{
+    whisper_data_layer_t dl;
+    uint8_t buf[BUF_LEN];
+    uint8_t payload[PAYLOAD_LEN];
+};
+
+static whisper_udp_t gateway;
+static whisper_udp_t devices[MAX_DEVICES];
+static struct end gateway_ends[MAX_DEVICES];
+static struct end device_ends[MAX_DEVICES];
+static unsigned int num_devices;
+static unsigned long delivered;
+
+static void on_packet_received(whisper_data_layer_t dl, uint8_t *payload, uint8_t payload_len)
+{
+    ++delivered;
+}
+
+static void on_data_ack(whisper_data_layer_t dl, unsigned int seq_no, uint8_t sent)
+{
+    struct end *end = whisper_udp__ctx(dl);
+
+    // stop-and-wait, every device sends its next frame when the previous one is done
+    whisper_udp__send(dl, end->payload, PAYLOAD_LEN, 1);
+}
+
+static whisper_udp_t open_socket(unsigned int max_links, unsigned int batch)
+{
+    struct whisper_udp__config config;
+    whisper_udp_t udp = malloc(SIZEOF_WHISPER_UDP_T);
+
+    memset(&config, 0, sizeof(config));
+    config.addr = "127.0.0.1";
+    config.max_links = max_links;
+    config.batch = batch;
+    if (whisper_udp__open(udp, &config) != 0)
+    {
+        free(udp);
+        return 0;
+    }
+    return udp;
+}
+
+static void add_link(whisper_udp_t udp, whisper_udp_t peer, struct end *end)
+{
+    struct whisper_data_layer__config config;
+
+    memset(&config, 0, sizeof(config));
+    config.buf = end->buf;
+    config.buf_len = BUF_LEN;
+    config.ctx = end;
+    config.packet_received_cb = on_packet_received;
+    config.data_ack_cb = on_data_ack;
+    end->dl = whisper_udp__add(udp, "127.0.0.1", whisper_udp__port(peer), &config);
+}
+
+/** the gateway answers the devices, then every device takes its acknowledgement and sends the next frame */
+static void rounds(double duration_ns)
+{
+    double until = bench_now_ns() + duration_ns;
+    unsigned int j;
+
+    while (bench_now_ns() < until)
+    {
+        whisper_udp__poll(gateway, 0);
+        for (j = 0; j < num_devices; j++)
+            whisper_udp__poll(devices[j], 0);
+    }
+}
+
+static void run(unsigned int devices_len, unsigned int batch)
+{
+    struct whisper_udp__stats before;
+    struct whisper_udp__stats after;
+    unsigned long frames;
+    char name[64];
+    double started;
+    double elapsed;
+    unsigned int i;
+
+    num_devices = devices_len;
+    gateway = open_socket(num_devices, batch);
+    if (!gateway)
+        return;
+    for (i = 0; i < num_devices; i++)
+    {
+        devices[i] = open_socket(1, 1);
+        if (!devices[i])
+        {
+            fprintf(stderr, "udp: out of descriptors\n");
+            num_devices = i;
+            goto close;
+        }
+        add_link(gateway, devices[i], &gateway_ends[i]);
+        add_link(devices[i], gateway, &device_ends[i]);
+        whisper_udp__send(device_ends[i].dl, device_ends[i].payload, PAYLOAD_LEN, 1);
+        whisper_udp__flush(devices[i]);
+    }
+
+    // warm up, then count the frames the gateway receives over the measurement
+    rounds(bench_repetition_ns);
+    whisper_udp__stats(gateway, &before);
+    frames = delivered;
+    started = bench_now_ns();
+    rounds(4 * bench_repetition_ns);
+    elapsed = bench_now_ns() - started;
+    frames = delivered - frames;
+    whisper_udp__stats(gateway, &after);
+
+    // both ends of all links run on one core
+    sprintf(name, "udp/links_%u/batch_%u/throughput", num_devices, batch);
+    bench_report(name, "frames/s", frames / (elapsed / 1e9), 1);
+    // the datagrams of the gateway, the frames and the acknowledgements
+    sprintf(name, "udp/links_%u/batch_%u/frames_per_syscall", num_devices, batch);
+    bench_report(name, "frames",
+                 (double)(after.datagrams_in - before.datagrams_in + after.datagrams_out - before.datagrams_out) /
+                     (after.recv_calls - before.recv_calls + after.send_calls - before.send_calls),
+                 1);
+
+close:
+    for (i = 0; i < num_devices; i++)
+    {
+        whisper_udp__close(devices[i]);
+        free(devices[i]);
+    }
+    whisper_udp__close(gateway);
+    free(gateway);
+}
+
+void udp_bench(void)
+{
+    run(64, 1);
+    run(64, 64);
+    run(MAX_DEVICES, 64);
+}
@@ -0,0 +1,129 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * whisper_bench measures the hot paths of the protocol stack and reports the
+ * results as JSON. Build it in Release mode to get meaningful numbers.
+ *
+ *   whisper_bench [--json FILE] [--baseline FILE] [--threshold PERCENT] [--quick] [CASE...]
+ *
+ * With --baseline, the results are compared against a previous JSON report and
+ * the exit code is non-zero if any of them regressed more than the threshold.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+
+static const struct bench_case cases[] = {
+    {"crc", crc_bench},
+    {"buffer", buffer_bench},
+    {"data_layer", data_layer_bench},
+    {"worst_case", worst_case_bench},
+    {"link", link_bench},
+    {"timer", timer_bench},
+    {"trace", trace_bench},
+    {"histogram", histogram_bench},
+    {"tx_queue", tx_queue_bench},
+    {"compression", compression_bench},
+    {"framing", framing_bench},
+    {"header", header_bench},
+    {"mux", mux_bench},
+#ifdef WHISPER_BENCH_GATEWAY
+    {"gateway", gateway_bench},
+    {"shm", shm_bench},
+    {"udp", udp_bench},
+#endif
+};
+
+#define NUM_CASES (sizeof(cases) / sizeof(cases[0]))
+
+static int selected(const char *name, char **filters, int num_filters)
+{
+    int i;
+
+    if (num_filters == 0)
+        return 1;
+
+    for (i = 0; i < num_filters; i++)
+        if (strcmp(filters[i], name) == 0)
+            return 1;
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    unsigned int i;
+
+    fprintf(stderr, "usage: %s [--json FILE] [--baseline FILE] [--threshold PERCENT] [--quick] [CASE...]\n", prog);
+    fprintf(stderr, "cases:");
+    for (i = 0; i < NUM_CASES; i++)
+        fprintf(stderr, " %s", cases[i].name);
+    fprintf(stderr, "\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *json_path = "-";
+    const char *baseline_path = 0;
+    double threshold = 0.1;
+    char **filters = malloc(sizeof(char *) * argc);
+    int num_filters = 0;
+    int regressions = 0;
+    unsigned int i;
+    int arg;
+
+    for (arg = 1; arg < argc; arg++)
+    {
+        if (strcmp(argv[arg], "--json") == 0 && arg + 1 < argc)
+            json_path = argv[++arg];
+        else if (strcmp(argv[arg], "--baseline") == 0 && arg + 1 < argc)
+            baseline_path = argv[++arg];
+        else if (strcmp(argv[arg], "--threshold") == 0 && arg + 1 < argc)
+            threshold = atof(argv[++arg]) / 100;
+        else if (strcmp(argv[arg], "--quick") == 0)
+            bench_repetition_ns /= 10;
+        else if (argv[arg][0] == '-')
+        {
+            usage(argv[0]);
+            return 2;
+        }
+        else
+            filters[num_filters++] = argv[arg];
+    }
+
+    for (i = 0; i < NUM_CASES; i++)
+        if (selected(cases[i].name, filters, num_filters))
+            cases[i].run();
+
+    bench_write_json(json_path);
+
+    if (baseline_path)
+    {
+        regressions = bench_compare(baseline_path, threshold);
+        if (regressions != 0)
+            fprintf(stderr, "%d regression(s) against %s\n", regressions, baseline_path);
+    }
+
+    free(filters);
+    return regressions == 0 ? 0 : 1;
+}
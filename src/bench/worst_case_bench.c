@@ -0,0 +1,170 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * Worst case latency of the receive state machine.
+ *
+ * The streams are built to trigger as much resynchronization as possible:
+ * false prefixes, nested headers announcing the maximum payload with a bad
+ * checksum, and random noise. Every call to whisper_data_layer__data_received
+ * is timed, the cost of each call is the minimum over several repetitions of
+ * the same deterministic stream, which filters out interrupts and preemption
+ * but keeps the data dependent cost.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "array_buffer.h"
+#include "data_layer.h"
+
+#define BUF_LEN 255
+#define STREAM_LEN 16384
+#define REPETITIONS 5
+
+static uint8_t recv_buf[BUF_LEN];
+static whisper_data_layer_t dl;
+static uint8_t stream[STREAM_LEN];
+static unsigned long long samples[STREAM_LEN];
+static unsigned long long sorted[STREAM_LEN];
+
+static void noop_packet_received(whisper_data_layer_t dl, uint8_t *payload, uint8_t payload_len) {}
+static void noop_write(whisper_data_layer_t dl, const uint8_t *data, uint8_t data_len) { bench_sink += data_len; }
+static void noop_set_delay(whisper_data_layer_t dl, uint16_t delay_in_ms, void (*delay_cb)(whisper_data_layer_t dl)) {}
+static void noop_cancel_delay(whisper_data_layer_t dl) {}
+
+static void setup(void)
+{
+    struct whisper_data_layer__config config = {
+        .buf = recv_buf,
+        .buf_len = BUF_LEN,
+        .packet_received_cb = noop_packet_received,
+        .data_write = noop_write,
+        .set_delay = noop_set_delay,
+        .cancel_delay = noop_cancel_delay,
+    };
+    whisper_data_layer__init(dl, &config);
+}
+
+/** repeated prefixes, none of which is followed by a valid header */
+static void build_false_prefixes(void)
+{
+    unsigned int i;
+    for (i = 0; i < STREAM_LEN; i++)
+        stream[i] = i % 2 == 0 ? 0x0A : 0x0D;
+}
+
+/** back to back headers announcing the maximum payload, each frame nests the next ones */
+static void build_max_len_bad_crc(void)
+{
+    uint8_t max_payload_len = BUF_LEN - SIZEOF_ARRAY_BUFFER_T - 2 - 4 - 2;
+    uint8_t header[] = {0x0A, 0x0D, 0x01, 0x00, 0x02, max_payload_len};
+    unsigned int i;
+
+    for (i = 0; i < STREAM_LEN; i++)
+        stream[i] = header[i % sizeof(header)];
+}
+
+static void build_noise(void)
+{
+    unsigned int i;
+
+    srand(28);
+    for (i = 0; i < STREAM_LEN; i++)
+        stream[i] = rand();
+}
+
+static int compare_samples(const void *a, const void *b)
+{
+    unsigned long long x = *(const unsigned long long *)a;
+    unsigned long long y = *(const unsigned long long *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void measure(const char *pattern, uint8_t chunk_len)
+{
+    unsigned int num_calls = STREAM_LEN / chunk_len;
+    unsigned long long max = 0;
+    double max_per_byte = 0;
+    unsigned int repetition;
+    unsigned int i;
+    char name[64];
+
+    for (repetition = 0; repetition < REPETITIONS; repetition++)
+    {
+        setup();
+        for (i = 0; i < num_calls; i++)
+        {
+            unsigned long long start = bench_cycles();
+            unsigned long long cycles;
+
+            whisper_data_layer__data_received(dl, &stream[i * chunk_len], chunk_len);
+            cycles = bench_cycles() - start;
+
+            if (repetition == 0 || cycles < samples[i])
+                samples[i] = cycles;
+        }
+    }
+
+    for (i = 0; i < num_calls; i++)
+    {
+        if (samples[i] > max)
+            max = samples[i];
+        if ((double)samples[i] / chunk_len > max_per_byte)
+            max_per_byte = (double)samples[i] / chunk_len;
+    }
+    memcpy(sorted, samples, sizeof(samples[0]) * num_calls);
+    qsort(sorted, num_calls, sizeof(sorted[0]), compare_samples);
+
+    sprintf(name, "worst_case/%s/chunk_%u/max", pattern, chunk_len);
+    bench_report(name, "cycles/call", max, 0);
+    sprintf(name, "worst_case/%s/chunk_%u/p99.9", pattern, chunk_len);
+    bench_report(name, "cycles/call", sorted[num_calls * 999 / 1000], 0);
+    sprintf(name, "worst_case/%s/chunk_%u/max_per_byte", pattern, chunk_len);
+    bench_report(name, "cycles/byte", max_per_byte, 0);
+}
+
+void worst_case_bench(void)
+{
+    static const struct
+    {
+        const char *name;
+        void (*build)(void);
+    } patterns[] = {
+        {"false_prefix", build_false_prefixes},
+        {"max_len_bad_crc", build_max_len_bad_crc},
+        {"noise", build_noise},
+    };
+    static const uint8_t chunk_lens[] = {1, 16, 255};
+    unsigned int i;
+    unsigned int j;
+
+    dl = malloc(SIZEOF_WHISPER_DATA_LAYER_T);
+    for (i = 0; i < sizeof(patterns) / sizeof(patterns[0]); i++)
+    {
+        patterns[i].build();
+        for (j = 0; j < sizeof(chunk_lens); j++)
+            measure(patterns[i].name, chunk_lens[j]);
+    }
+
+    free(dl);
+}
@@ -0,0 +1,235 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "delta.h"
+#include <string.h>
+
+#define LEN_FULL_HEADER 2
+#define LEN_DELTA_HEADER 3
+
+// flags of the delta state
+#define DELTA_BASE_VALID 0x01
+#define DELTA_PENDING_VALID 0x02
+
+struct whisper_delta
+{
+    const struct whisper_delta__schema *schema;
+    uint16_t snapshot_size;
+    /** the acknowledged snapshot of a sender, or the cached snapshot of a receiver */
+    uint8_t *base;
+    /** the snapshot in flight, only used by a sender */
+    uint8_t *pending;
+    uint8_t version;
+    uint8_t pending_version;
+    uint8_t flags;
+};
+
+const uint8_t SIZEOF_WHISPER_DELTA_T = sizeof(struct whisper_delta);
+
+#define LEN_BITMAP(schema) (((schema)->num_fields + 7) / 8)
+
+uint16_t whisper_delta__snapshot_size(const struct whisper_delta__schema *schema)
+{
+    uint16_t size = 0;
+    uint8_t i;
+    for (i = 0; i < schema->num_fields; i++)
+        size += schema->field_sizes[i];
+    return size;
+}
+
+char whisper_delta__init(whisper_delta_t d, const struct whisper_delta__schema *schema, uint8_t *buf, uint16_t buf_len)
+{
+    uint16_t snapshot_size = whisper_delta__snapshot_size(schema);
+
+    if (schema->num_fields == 0 || schema->num_fields > WHISPER_DELTA__MAX_FIELDS)
+        return -1;
+    if (buf_len < snapshot_size)
+        return -1;
+
+    d->schema = schema;
+    d->snapshot_size = snapshot_size;
+    d->base = buf;
+    // a buffer of a single snapshot is only good for receiving
+    d->pending = buf_len >= 2 * snapshot_size ? &buf[snapshot_size] : 0;
+    d->version = 0;
+    d->pending_version = 0;
+    d->flags = 0;
+
+    return 0;
+}
+
+static uint16_t encode_full(whisper_delta_t d, const uint8_t *snapshot, uint8_t *out, uint16_t out_len)
+{
+    if (out_len < LEN_FULL_HEADER + d->snapshot_size)
+        return 0;
+
+    out[0] = WHISPER_DELTA__FULL;
+    out[1] = d->pending_version;
+    memcpy(&out[LEN_FULL_HEADER], snapshot, d->snapshot_size);
+
+    return LEN_FULL_HEADER + d->snapshot_size;
+}
+
+/** return the length of the delta, or 0 if the full snapshot is not larger */
+static uint16_t encode_delta(whisper_delta_t d, const uint8_t *snapshot, uint8_t *out, uint16_t out_len)
+{
+    const struct whisper_delta__schema *schema = d->schema;
+    uint8_t len_bitmap = LEN_BITMAP(schema);
+    uint16_t full_len = LEN_FULL_HEADER + d->snapshot_size;
+    uint16_t len = LEN_DELTA_HEADER + len_bitmap;
+    uint16_t offset = 0;
+    uint8_t i;
+
+    if (len >= full_len || len > out_len)
+        return 0;
+
+    memset(&out[LEN_DELTA_HEADER], 0, len_bitmap);
+    for (i = 0; i < schema->num_fields; i++)
+    {
+        uint8_t field_size = schema->field_sizes[i];
+
+        if (memcmp(&d->base[offset], &snapshot[offset], field_size) != 0)
+        {
+            if (len + field_size >= full_len || len + field_size > out_len)
+                // the delta does not pay off, or does not fit
+                return 0;
+
+            out[LEN_DELTA_HEADER + i / 8] |= 1 << (i % 8);
+            memcpy(&out[len], &snapshot[offset], field_size);
+            len += field_size;
+        }
+        offset += field_size;
+    }
+
+    out[0] = WHISPER_DELTA__DELTA;
+    out[1] = d->pending_version;
+    out[2] = d->version;
+
+    return len;
+}
+
+uint16_t whisper_delta__encode(whisper_delta_t d, const uint8_t *snapshot, uint8_t *out, uint16_t out_len)
+{
+    uint16_t len = 0;
+
+    if (d->pending == 0)
+        // the state was initialized for receiving only
+        return 0;
+
+    // every encoded message produces a new version, which never equals the base
+    ++d->pending_version;
+    if (d->pending_version == d->version)
+        ++d->pending_version;
+
+    if (d->flags & DELTA_BASE_VALID)
+        len = encode_delta(d, snapshot, out, out_len);
+    if (len == 0)
+        len = encode_full(d, snapshot, out, out_len);
+
+    if (len > 0)
+    {
+        memcpy(d->pending, snapshot, d->snapshot_size);
+        d->flags |= DELTA_PENDING_VALID;
+    }
+
+    return len;
+}
+
+void whisper_delta__acked(whisper_delta_t d, uint8_t version)
+{
+    if (!(d->flags & DELTA_PENDING_VALID) || version != d->pending_version)
+        // acknowledgement of a snapshot which has been superseded
+        return;
+
+    memcpy(d->base, d->pending, d->snapshot_size);
+    d->version = version;
+    d->flags = DELTA_BASE_VALID;
+}
+
+void whisper_delta__resync(whisper_delta_t d)
+{
+    d->flags &= ~DELTA_BASE_VALID;
+}
+
+char whisper_delta__apply(whisper_delta_t d, const uint8_t *msg, uint16_t msg_len)
+{
+    const struct whisper_delta__schema *schema = d->schema;
+    uint8_t len_bitmap = LEN_BITMAP(schema);
+    const uint8_t *bitmap = &msg[LEN_DELTA_HEADER];
+    uint16_t len = LEN_DELTA_HEADER + len_bitmap;
+    uint16_t offset = 0;
+    uint8_t i;
+
+    if (msg_len < LEN_FULL_HEADER)
+        return WHISPER_DELTA__ERR_MALFORMED;
+
+    if (msg[0] == WHISPER_DELTA__FULL)
+    {
+        if (msg_len != LEN_FULL_HEADER + d->snapshot_size)
+            return WHISPER_DELTA__ERR_MALFORMED;
+
+        memcpy(d->base, &msg[LEN_FULL_HEADER], d->snapshot_size);
+        d->version = msg[1];
+        d->flags |= DELTA_BASE_VALID;
+        return 0;
+    }
+
+    if (msg[0] != WHISPER_DELTA__DELTA || msg_len < len)
+        return WHISPER_DELTA__ERR_MALFORMED;
+
+    if (!(d->flags & DELTA_BASE_VALID) || msg[2] != d->version)
+        // the delta is based on a snapshot we do not have
+        return WHISPER_DELTA__ERR_RESYNC;
+
+    // validate the length before touching the cached copy
+    for (i = 0; i < schema->num_fields; i++)
+        if (bitmap[i / 8] & (1 << (i % 8)))
+            len += schema->field_sizes[i];
+    if (len != msg_len)
+        return WHISPER_DELTA__ERR_MALFORMED;
+
+    len = LEN_DELTA_HEADER + len_bitmap;
+    for (i = 0; i < schema->num_fields; i++)
+    {
+        uint8_t field_size = schema->field_sizes[i];
+
+        if (bitmap[i / 8] & (1 << (i % 8)))
+        {
+            memcpy(&d->base[offset], &msg[len], field_size);
+            len += field_size;
+        }
+        offset += field_size;
+    }
+    d->version = msg[1];
+
+    return 0;
+}
+
+const uint8_t *whisper_delta__snapshot(whisper_delta_t d)
+{
+    return d->base;
+}
+
+uint8_t whisper_delta__version(whisper_delta_t d)
+{
+    return d->version;
+}
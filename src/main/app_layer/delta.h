@@ -0,0 +1,123 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef DELTA_H
+#define DELTA_H
+
+#include "basic_data_type.h"
+
+/*
+ * Delta encoding of repeated state messages.
+ *
+ * A state message is a fixed layout snapshot described by a schema, which lists
+ * the size of every field. The sender keeps the last acknowledged snapshot and
+ * only sends the fields that changed since then, marked in a bitmap. The
+ * receiver applies the delta against its cached copy. Every encoded message
+ * carries the version it produces and, for deltas, the version it is based on,
+ * so a receiver whose cache does not match asks the sender for a full resync.
+ *
+ * Encoded message layout:
+ *   FULL:  kind | version | snapshot
+ *   DELTA: kind | version | base version | bitmap | changed fields
+ *
+ * The message type is not part of the encoding, the caller frames it.
+ */
+
+#define WHISPER_DELTA__FULL 0x01
+#define WHISPER_DELTA__DELTA 0x02
+
+/** upper bound of the fields in a schema, which is limited by the bitmap */
+#define WHISPER_DELTA__MAX_FIELDS 64
+
+/** apply error: the message can not be decoded */
+#define WHISPER_DELTA__ERR_MALFORMED -1
+/** apply error: the cached copy does not match the base, a full resync is required */
+#define WHISPER_DELTA__ERR_RESYNC -2
+
+/** layout of a state message */
+struct whisper_delta__schema
+{
+    /** number of fields in the snapshot */
+    uint8_t num_fields;
+    /** size of each field in bytes, in the order they appear in the snapshot */
+    const uint8_t *field_sizes;
+};
+
+typedef struct whisper_delta *whisper_delta_t;
+
+extern const uint8_t SIZEOF_WHISPER_DELTA_T;
+
+/** return the size of a snapshot of the given schema */
+uint16_t whisper_delta__snapshot_size(const struct whisper_delta__schema *schema);
+
+/**
+ * @brief Initialize the delta state of one message type.
+ *
+ * A receiver needs a buffer of one snapshot to hold the cached copy, a sender
+ * needs two to hold the acknowledged snapshot and the one in flight.
+ *
+ * @param d the delta state to initialize
+ * @param schema layout of the message, must outlive the delta state
+ * @param buf backend buffer for the cached snapshots
+ * @param buf_len length of the buffer
+ * @return char 0 success, otherwise the schema is invalid
+ */
+char whisper_delta__init(whisper_delta_t d, const struct whisper_delta__schema *schema, uint8_t *buf, uint16_t buf_len);
+
+/**
+ * @brief Encode a snapshot against the last acknowledged one.
+ *
+ * A delta is produced if there is an acknowledged snapshot and the delta is
+ * smaller than the full snapshot, otherwise the full snapshot is encoded.
+ *
+ * @param d the sender delta state
+ * @param snapshot the current snapshot
+ * @param out destination of the encoded message
+ * @param out_len capacity of the destination
+ * @return uint16_t length of the encoded message, 0 if the destination is too small
+ */
+uint16_t whisper_delta__encode(whisper_delta_t d, const uint8_t *snapshot, uint8_t *out, uint16_t out_len);
+
+/** mark the encoded message with the given version as acknowledged by the receiver */
+void whisper_delta__acked(whisper_delta_t d, uint8_t version);
+
+/** drop the acknowledged snapshot, so the next encoded message is a full snapshot */
+void whisper_delta__resync(whisper_delta_t d);
+
+/**
+ * @brief Apply an encoded message to the cached snapshot of the receiver.
+ *
+ * @param d the receiver delta state
+ * @param msg the encoded message
+ * @param msg_len length of the encoded message
+ * @return char 0 success, WHISPER_DELTA__ERR_RESYNC if a full snapshot must be
+ * requested from the sender, WHISPER_DELTA__ERR_MALFORMED for invalid messages
+ */
+char whisper_delta__apply(whisper_delta_t d, const uint8_t *msg, uint16_t msg_len);
+
+/** return the cached snapshot, only valid after a message has been applied */
+const uint8_t *whisper_delta__snapshot(whisper_delta_t d);
+
+/** return the version of the cached snapshot */
+uint8_t whisper_delta__version(whisper_delta_t d);
+
+#endif // DELTA_H
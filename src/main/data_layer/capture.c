@@ -0,0 +1,148 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "capture.h"
+
+static const uint8_t MAGIC[] = {'W', 'C', 'A', 'P'};
+
+/** a varint of an unsigned long takes up to 10 bytes */
+#define MAX_VARINT_LEN 10
+
+struct whisper_capture
+{
+    void (*write)(void *write_ctx, const uint8_t *data, unsigned int len);
+    void *write_ctx;
+    /** timestamp of the previous record */
+    unsigned long prev_us;
+    unsigned long size;
+};
+
+const uint16_t SIZEOF_WHISPER_CAPTURE_T = sizeof(struct whisper_capture);
+
+static unsigned int put_varint(uint8_t *buf, unsigned long value)
+{
+    unsigned int len = 0;
+
+    while (value >= 0x80)
+    {
+        buf[len++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    buf[len++] = (uint8_t)value;
+    return len;
+}
+
+/** return 0 on success, -1 if the varint runs past the capture or overflows */
+static char get_varint(const uint8_t *data, unsigned long len, unsigned long *pos, unsigned long *value)
+{
+    unsigned int shift = 0;
+
+    *value = 0;
+    while (*pos < len && shift < sizeof(unsigned long) * 8)
+    {
+        uint8_t byte = data[(*pos)++];
+
+        *value |= (unsigned long)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+            return 0;
+        shift += 7;
+    }
+    return -1;
+}
+
+static void append(whisper_capture_t capture, const uint8_t *data, unsigned int len)
+{
+    capture->write(capture->write_ctx, data, len);
+    capture->size += len;
+}
+
+void whisper_capture__init(whisper_capture_t capture, void (*write)(void *write_ctx, const uint8_t *data,
+                                                                    unsigned int len),
+                           void *write_ctx)
+{
+    uint8_t version = WHISPER_CAPTURE__VERSION;
+
+    capture->write = write;
+    capture->write_ctx = write_ctx;
+    capture->prev_us = 0;
+    capture->size = 0;
+    append(capture, MAGIC, sizeof(MAGIC));
+    append(capture, &version, 1);
+}
+
+void whisper_capture__record(whisper_capture_t capture, uint8_t direction, unsigned long timestamp_us,
+                             const uint8_t *data, uint8_t len)
+{
+    uint8_t head[2 * MAX_VARINT_LEN];
+    unsigned int head_len;
+
+    if (len == 0)
+        return;
+
+    // the header and the chunk in two writes, rather than copying the chunk
+    head_len = put_varint(head, timestamp_us - capture->prev_us);
+    head_len += put_varint(&head[head_len], (unsigned long)len << 1 | (direction & 1));
+    capture->prev_us = timestamp_us;
+    append(capture, head, head_len);
+    append(capture, data, len);
+}
+
+unsigned long whisper_capture__size(whisper_capture_t capture)
+{
+    return capture->size;
+}
+
+unsigned long whisper_capture__begin(const uint8_t *data, unsigned long len)
+{
+    unsigned int i;
+
+    if (len < WHISPER_CAPTURE__HEADER_LEN)
+        return 0;
+    for (i = 0; i < sizeof(MAGIC); i++)
+        if (data[i] != MAGIC[i])
+            return 0;
+    if (data[sizeof(MAGIC)] != WHISPER_CAPTURE__VERSION)
+        return 0;
+    return WHISPER_CAPTURE__HEADER_LEN;
+}
+
+char whisper_capture__next(const uint8_t *data, unsigned long len, unsigned long *pos,
+                           struct whisper_capture__chunk *chunk)
+{
+    unsigned long delta;
+    unsigned long len_dir;
+
+    if (*pos == len)
+        return 1;
+
+    if (get_varint(data, len, pos, &delta) != 0 || get_varint(data, len, pos, &len_dir) != 0)
+        return -1;
+    if (len_dir >> 1 == 0 || len_dir >> 1 > 255 || len - *pos < len_dir >> 1)
+        return -1;
+
+    chunk->timestamp_us += delta;
+    chunk->direction = len_dir & 1;
+    chunk->len = (uint8_t)(len_dir >> 1);
+    chunk->data = &data[*pos];
+    *pos += chunk->len;
+    return 0;
+}
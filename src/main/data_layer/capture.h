@@ -0,0 +1,117 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include "basic_data_type.h"
+
+/*
+ * Capture of the raw byte stream of a link.
+ *
+ * The data layer hands every chunk it reads or writes to its capture, which
+ * encodes it as a compact record and passes the record on to a write
+ * function, e.g. appending to a file. A capture is a file header followed by
+ * the records, each of them
+ *
+ *   varint  microseconds since the previous record
+ *   varint  length << 1 | direction
+ *   bytes   the chunk
+ *
+ * where a varint takes 7 bits per byte, least significant first, with the
+ * top bit set on all but the last byte. The records are decoded in place,
+ * e.g. from a memory mapped file, see src/replay/whisper_replay.c.
+ */
+
+/** the chunk is fed to the data layer */
+#define WHISPER_CAPTURE__RX 0
+/** the chunk is written by the data layer */
+#define WHISPER_CAPTURE__TX 1
+
+/** length of the file header, "WCAP" and the version of the format */
+#define WHISPER_CAPTURE__HEADER_LEN 5
+#define WHISPER_CAPTURE__VERSION 1
+
+/** a chunk decoded from a capture */
+struct whisper_capture__chunk
+{
+    /** time of the chunk in microseconds, the sum of the deltas up to it */
+    unsigned long timestamp_us;
+    /** WHISPER_CAPTURE__RX or WHISPER_CAPTURE__TX */
+    uint8_t direction;
+    uint8_t len;
+    /** the bytes, pointing into the capture */
+    const uint8_t *data;
+};
+
+typedef struct whisper_capture *whisper_capture_t;
+
+extern const uint16_t SIZEOF_WHISPER_CAPTURE_T;
+
+/**
+ * @brief initialize a capture and write the file header
+ *
+ * @param capture memory of at least SIZEOF_WHISPER_CAPTURE_T bytes for the capture
+ * @param write appends the encoded bytes to the capture, e.g. to a file
+ * @param write_ctx passed to write
+ */
+void whisper_capture__init(whisper_capture_t capture, void (*write)(void *write_ctx, const uint8_t *data,
+                                                                    unsigned int len),
+                           void *write_ctx);
+
+/**
+ * @brief record a chunk
+ *
+ * @param capture the capture
+ * @param direction WHISPER_CAPTURE__RX or WHISPER_CAPTURE__TX
+ * @param timestamp_us current time in microseconds, wrapping around is fine
+ * @param data the chunk
+ * @param len length of the chunk
+ */
+void whisper_capture__record(whisper_capture_t capture, uint8_t direction, unsigned long timestamp_us,
+                             const uint8_t *data, uint8_t len);
+
+/** return the number of bytes written to the capture, including the file header */
+unsigned long whisper_capture__size(whisper_capture_t capture);
+
+/**
+ * @brief check the file header of a capture
+ *
+ * @param data the capture
+ * @param len length of the capture
+ * @return unsigned long the position of the first record, 0 if the header is not valid
+ */
+unsigned long whisper_capture__begin(const uint8_t *data, unsigned long len);
+
+/**
+ * @brief decode the next record of a capture
+ *
+ * @param data the capture
+ * @param len length of the capture
+ * @param pos position of the record, advanced past it
+ * @param chunk the decoded chunk, its timestamp_us is the one of the previous chunk on entry, 0 for the first
+ * @return char 0 decoded, 1 at the end of the capture, -1 if the record is truncated or corrupt
+ */
+char whisper_capture__next(const uint8_t *data, unsigned long len, unsigned long *pos,
+                           struct whisper_capture__chunk *chunk);
+
+#endif // CAPTURE_H
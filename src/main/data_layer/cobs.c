@@ -0,0 +1,132 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "cobs.h"
+
+// the longest run of a code, which is not followed by a zero
+#define MAX_RUN 254
+
+struct cursor
+{
+    const struct whisper_cobs__segment *segments;
+    uint8_t num_segments;
+    uint8_t segment;
+    uint8_t offset;
+};
+
+/** move past the exhausted segments, return 0 at the end of the frame */
+static char ahead(struct cursor *cursor)
+{
+    while (cursor->segment < cursor->num_segments &&
+           cursor->offset == cursor->segments[cursor->segment].len)
+    {
+        ++cursor->segment;
+        cursor->offset = 0;
+    }
+    return cursor->segment < cursor->num_segments;
+}
+
+unsigned int whisper_cobs__encode(const struct whisper_cobs__segment *segments, uint8_t num_segments,
+                                  void (*write)(void *ctx, const uint8_t *data, uint8_t len), void *ctx)
+{
+    static const uint8_t delimiter = WHISPER_COBS__DELIMITER;
+    struct cursor cursor = {segments, num_segments, 0, 0};
+    unsigned int written = 0;
+
+    while (1)
+    {
+        struct cursor scan = cursor;
+        uint8_t run = 0;
+        uint8_t code;
+        char zero = 0;
+
+        // the length of the run ahead, up to the next zero
+        while (run < MAX_RUN && ahead(&scan))
+        {
+            if (scan.segments[scan.segment].data[scan.offset] == 0)
+            {
+                zero = 1;
+                break;
+            }
+            ++run;
+            ++scan.offset;
+        }
+
+        code = run + 1;
+        write(ctx, &code, 1);
+        written += 1 + run;
+
+        // the run, a piece per segment it spans
+        while (run > 0 && ahead(&cursor))
+        {
+            const struct whisper_cobs__segment *segment = &segments[cursor.segment];
+            uint8_t piece = segment->len - cursor.offset;
+
+            if (piece > run)
+                piece = run;
+            write(ctx, &segment->data[cursor.offset], piece);
+            cursor.offset += piece;
+            run -= piece;
+        }
+
+        if (zero)
+        {
+            // implied by the code
+            ahead(&cursor);
+            ++cursor.offset;
+        }
+        else if (code != MAX_RUN + 1)
+            // the end of the frame
+            break;
+    }
+
+    write(ctx, &delimiter, 1);
+    return written + 1;
+}
+
+int whisper_cobs__decode(uint8_t *buf, uint16_t len)
+{
+    uint16_t in = 0;
+    uint16_t out = 0;
+
+    // the output trails the input by at least a byte, so the frame is decoded forwards in place
+    while (in < len)
+    {
+        uint8_t code = buf[in++];
+        uint8_t i;
+
+        if (code == WHISPER_COBS__DELIMITER || code - 1 > len - in)
+            return -1;
+
+        for (i = 1; i < code; i++)
+        {
+            if (buf[in] == WHISPER_COBS__DELIMITER)
+                return -1;
+            buf[out++] = buf[in++];
+        }
+
+        if (code != MAX_RUN + 1 && in < len)
+            buf[out++] = 0;
+    }
+
+    return out;
+}
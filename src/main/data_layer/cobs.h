@@ -0,0 +1,72 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef COBS_H
+#define COBS_H
+
+#include "basic_data_type.h"
+
+/*
+ * Consistent Overhead Byte Stuffing, which removes the zero bytes from a
+ * frame so that a zero can delimit frames on the wire.
+ *
+ * The frame is split at its zero bytes into runs, each one sent as a code
+ * byte of its length + 1 followed by its bytes, the zero after it implied.
+ * A code of 0xFF is a run of 254 bytes not followed by a zero. The overhead
+ * is a byte per 254 bytes, plus the delimiter. A receiver which lost track
+ * skips to the next zero, rather than searching the bytes for a frame.
+ */
+
+/** the byte between two frames, which never occurs within a frame */
+#define WHISPER_COBS__DELIMITER 0x00
+
+/** a piece of a frame */
+struct whisper_cobs__segment
+{
+    const uint8_t *data;
+    uint8_t len;
+};
+
+/**
+ * @brief encode a frame given in pieces and write it out, delimiter included
+ *
+ * The runs are written straight from the segments, with no copy.
+ *
+ * @param segments the pieces of the frame, in order, which may be empty
+ * @param num_segments the number of pieces
+ * @param write called with the encoded frame, piece by piece
+ * @param ctx passed to write
+ * @return unsigned int the length of the encoded frame
+ */
+unsigned int whisper_cobs__encode(const struct whisper_cobs__segment *segments, uint8_t num_segments,
+                                  void (*write)(void *ctx, const uint8_t *data, uint8_t len), void *ctx);
+
+/**
+ * @brief decode a frame in place
+ *
+ * @param buf the encoded frame, without the delimiter
+ * @param len the length of the encoded frame
+ * @return int the length of the frame, -1 if the encoding is corrupt
+ */
+int whisper_cobs__decode(uint8_t *buf, uint16_t len);
+
+#endif // COBS_H
@@ -28,4 +28,17 @@
 unsigned short update_crc(unsigned char val, unsigned short crc);
 unsigned short update_crc_buf(const unsigned char *buf, unsigned char len, unsigned short crc);
 
+/*
+ * CRC-32C (Castagnoli), reflected, of which the frame trailer is the
+ * complement of the register. It runs on the crc32 instructions of SSE4.2 or
+ * ARMv8 if the target has them, and on a slice-by-8 table otherwise.
+ */
+#define CRC32C_INIT 0xFFFFFFFFUL
+
+/** update the register with the bytes, the result fits 32 bits */
+unsigned long update_crc32c_buf(const unsigned char *buf, unsigned int len, unsigned long crc);
+
+/** return 1 if update_crc32c_buf runs on crc32 instructions */
+int crc32c_accelerated(void);
+
 #endif // CRC_H
\ No newline at end of file
@@ -22,153 +22,502 @@
  */
 #include "data_layer.h"
 #include <assert.h>
+#include <stddef.h>
 #include <string.h>
 #include <limits.h>
 
 #include "crc.h"
 #include "array_buffer.h"
+#include "lz.h"
+#include "fec.h"
+#include "cobs.h"
 
 #define RETRANSMISSION_DELAY_MS 50
-
-// receive buffer for protocol handling
-array_buffer_t _buf_recv;
+// interval of probing a peer without receive credits, in case its window update got lost
+#define PROBE_DELAY_MS 100
+// the interval doubles with every answered probe up to 2^MAX_PROBE_BACKOFF times
+#define MAX_PROBE_BACKOFF 4
 
 struct whisper_data_layer__packet_header
 {
     uint16_t seq_no;
     uint8_t flags;
     uint8_t payload_len;
-} * packet_header;
+};
 
-static struct buffered_packet
+struct buffered_packet
 {
     uint8_t empty;
     uint8_t ack_required;
     struct whisper_data_layer__packet_header header;
     uint8_t *payload;
     uint8_t num_transmissions;
-} send_buffer;
+    // time of data_sent in microseconds, for the acknowledgement latency
+    unsigned long sent_at;
+    // time of the latest transmission, for the time per byte on the line
+    unsigned long transmitted_at;
+};
 
 #define MAX_RETRANSMISSIONS 3
 
+// adaptive payload sizing halves its measurement once it spans that many bytes, to follow the line
+#define SIZING_WINDOW 8192
+// fixed point scale of the timeouts measured, which survive the halving
+#define SIZING_SCALE 256
+
+// data frames remembered up to the latest one received, retransmissions of which are suppressed
+#define RECEIVE_WINDOW 32
+
 // flags of the packet flags byte
 #define FLAGS_ACK 0b00000001
 #define FLAGS_DATA 0b00000010
+// a handshake frame, by which the sender starts its sequence numbers over, with FLAGS_ACK the answer to one
 #define FLAGS_SEQ_RESET 0b00000100
+#define FLAGS_COMPRESSED 0b00001000
+// the logical channel of a data frame, in the upper bits
+#define FLAGS_CHANNEL 0b11110000
+#define FLAGS_CHANNEL_SHIFT 4
+
+// payload of a handshake frame: the version, the longest payload the sender can receive, its credits left,
+// the HANDSHAKE_ bits of what it runs, the checksums it accepts and the CRC of its dictionary; handshake frames
+// always go with the CRC-16 trailer, the frames after them with the best checksum both ends accept
+#define HANDSHAKE_VERSION 1
+#define HANDSHAKE_DECOMPRESS 0x01
+#define HANDSHAKE_CREDITS 0x02
+#define LEN_HANDSHAKE 7
 
 // all valid packets begin with this
 static const uint8_t PACKET_PREFIX[] = {0x0A, 0x0D};
 
 #define LEN_PREFIX sizeof(PACKET_PREFIX)
+// on a multi-drop bus, the address of the node follows the prefix, with this bit set on the frames of the node
+#define LEN_ADDRESS 1
+#define ADDRESS_FROM_NODE 0x80
 #define LEN_HEADER sizeof(struct whisper_data_layer__packet_header)
+// the trailer of CRC-16, and of CRC-32C
 #define LEN_CHECKSUM 2
+#define LEN_CRC32C 4
+#define MAX_LEN_CHECKSUM LEN_CRC32C
+
+/*
+ * The first byte of a compact header tells its form:
+ *   0LLLLLSS           data of payload length L up to 31, S the low bits of the sequence no
+ *   10CSSSSS           acknowledgement, S the low bits of the acknowledged sequence no, C if credits follow
+ *   110000SS LLLLLLLL  data of any payload length
+ *   11100000 + header  any frame, with the full header
+ */
+#define COMPACT_DATA_SEQ 0x03
+#define COMPACT_DATA_LEN_SHIFT 2
+#define COMPACT_DATA_MAX_LEN 31
+#define COMPACT_ACK 0x80
+#define COMPACT_ACK_CREDITS 0x20
+#define COMPACT_ACK_SEQ 0x1F
+#define COMPACT_LONG_DATA 0xC0
+#define COMPACT_FULL 0xE0
+#define LEN_COMPACT_HEADER 1
+#define MAX_LEN_HEADER (1 + LEN_HEADER)
+
+// length of a compact header by the upper 3 bits of its first byte
+static const uint8_t COMPACT_HEADER_LEN[8] = {1, 1, 1, 1, 1, 1, 2, MAX_LEN_HEADER};
+
+#ifdef WHISPER_CRC32C
+#define DEFAULT_CHECKSUM WHISPER_DATA_LAYER__CHECKSUM_CRC32C
+#else
+#define DEFAULT_CHECKSUM WHISPER_DATA_LAYER__CHECKSUM_CRC16
+#endif
 
 // state of the the finite state machine
 #define STATE_PREFIX 0x00
 #define STATE_HEADER 0x01
 #define STATE_PAYLOAD 0x02
 #define STATE_CHECKSUM 0x03
+// skipping the rest of a frame too long for the receive buffer with COBS framing, or of another address
+#define STATE_DISCARD 0x04
+
+struct whisper_data_layer
+{
+    struct whisper_data_layer__config cfg;
+    // receive buffer for protocol handling
+    array_buffer_t buf_recv;
+    // header of the frame at the head of the receive buffer
+    struct whisper_data_layer__packet_header *packet_header;
+    // with compact headers, the one decoded of the frame at the head of the receive buffer, and its length on the wire
+    uint8_t compact;
+    struct whisper_data_layer__packet_header rx_header;
+    uint8_t rx_header_len;
+    struct buffered_packet send_buffer;
+    uint8_t state;
+    uint8_t next_state;
+    // on a multi-drop bus, the address byte of the frames sent and of those received, and the bytes left to skip
+    uint8_t tx_address;
+    uint8_t rx_address;
+    uint16_t skip;
+    uint16_t counter;
+    // whether the latest frame sent was acknowledged, which lets the next one go with a compact header
+    uint8_t anchored;
+    // the latest data frame received
+    uint16_t receive_counter;
+    // bit i is set if receive_counter - i was received, 0 until the first data frame
+    unsigned long receive_window;
+    // receive credits left, with flow control, and whether the peer was told there are none
+    uint8_t receive_credits;
+    uint8_t window_closed;
+    // receive credits advertised by the peer, the pending frame waits for one while blocked
+    uint8_t peer_credits;
+    uint8_t blocked;
+    // probes not answered, and answered without credits in a row, which backs the probing off
+    uint8_t probes;
+    uint8_t backoff;
+    // transmissions of the handshake so far, 0 if none is pending
+    uint8_t syncing;
+    // capabilities of the peer, valid once peer_known is set by a handshake
+    struct whisper_data_layer__peer peer;
+    uint8_t peer_known;
+    // length of the checksum trailer of the frames
+    uint8_t checksum_len;
+    // checksum of the compression dictionary, which the peer must have the same of
+    uint16_t dict_crc;
+    // bytes of the transmissions and their acknowledgements, and the timeouts among them in 1/SIZING_SCALE
+    unsigned long sizing_bytes;
+    unsigned long sizing_failures;
+    // time per byte on the line in 1/256 us, from the acknowledgements of first transmissions, 0 until measured
+    unsigned long byte_time;
+    // bytes at the head of the receive buffer known to hold no delimiter, with COBS framing
+    uint8_t scanned;
+    // the pending delay, if the link runs on a timer wheel
+    struct whisper_timer timer;
+    void (*delay_cb)(whisper_data_layer_t dl);
+    // generator polynomial of the forward error correction, if there is parity
+    uint8_t fec_generator[WHISPER_FEC__MAX_PARITY + 1];
+#ifdef WHISPER_STATS
+    // odd while the counters are being updated, see stats_begin
+    unsigned long stats_seq;
+    struct whisper_data_layer__stats stats;
+#endif
+};
+
+const uint16_t SIZEOF_WHISPER_DATA_LAYER_T = sizeof(struct whisper_data_layer);
+
+#ifdef WHISPER_STATS
+/*
+ * The counters are guarded by a sequence lock, the link is the only writer.
+ * Every entry point of the link opens an update, which nests, and readers
+ * retry if the sequence changed or was odd while they copied the counters.
+ */
+#define STATS_ADD(dl, counter, n) ((dl)->stats.counter += (n))
+
+static char stats_begin(whisper_data_layer_t dl)
+{
+    if (dl->stats_seq & 1)
+        // nested in an update, which is already open
+        return 0;
+
+    __atomic_store_n(&dl->stats_seq, dl->stats_seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    return 1;
+}
+
+static void stats_end(whisper_data_layer_t dl, char opened)
+{
+    if (!opened)
+        return;
+
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&dl->stats_seq, dl->stats_seq + 1, __ATOMIC_RELAXED);
+}
+#else
+#define STATS_ADD(dl, counter, n) ((void)(n))
+#define stats_begin(dl) 0
+#define stats_end(dl, opened) ((void)(opened))
+#endif
+
+#ifdef WHISPER_TRACE
+#define TRACE(dl, event, arg8, arg)                                                          \
+    do                                                                                       \
+    {                                                                                        \
+        if ((dl)->cfg.trace)                                                                 \
+            whisper_trace__write((dl)->cfg.trace, WHISPER_TRACE__##event, (arg8), (arg)); \
+    } while (0)
+#else
+#define TRACE(dl, event, arg8, arg) ((void)0)
+#endif
+
+static void transite(whisper_data_layer_t dl, uint8_t new_state) { dl->next_state = new_state; }
+
+static void reset(whisper_data_layer_t dl)
+{
+    transite(dl, STATE_PREFIX);
+}
+
+static void on_timer(struct whisper_timer *timer)
+{
+    whisper_data_layer_t dl = timer->arg;
+    dl->delay_cb(dl);
+}
+
+static void start_delay(whisper_data_layer_t dl, uint16_t delay_in_ms, void (*delay_cb)(whisper_data_layer_t dl))
+{
+    TRACE(dl, TIMER_START, 0, delay_in_ms);
+    if (!dl->cfg.timers)
+    {
+        dl->cfg.set_delay(dl, delay_in_ms, delay_cb);
+        return;
+    }
+
+    dl->delay_cb = delay_cb;
+    whisper_timer_wheel__add(dl->cfg.timers, &dl->timer, whisper_timer_wheel__now(dl->cfg.timers) + delay_in_ms);
+}
+
+static void stop_delay(whisper_data_layer_t dl)
+{
+    TRACE(dl, TIMER_STOP, 0, 0);
+    if (!dl->cfg.timers)
+        dl->cfg.cancel_delay(dl);
+    else
+        whisper_timer_wheel__cancel(dl->cfg.timers, &dl->timer);
+}
+
+/** offset of the header in the receive buffer, a frame encoded with COBS is decoded in place with no prefix */
+static uint8_t header_offset(whisper_data_layer_t dl)
+{
+    uint8_t address_len = dl->cfg.address ? LEN_ADDRESS : 0;
+    return (dl->cfg.framing == WHISPER_DATA_LAYER__FRAMING_COBS ? 0 : LEN_PREFIX) + address_len;
+}
+
+/** offset of the payload in the receive buffer, behind the parity of the header */
+static uint8_t payload_offset(whisper_data_layer_t dl)
+{
+    return header_offset(dl) + dl->rx_header_len + dl->cfg.fec_parity;
+}
+
+/** length of the checksum trailer of a frame with the flags, a handshake frame goes with CRC-16 */
+static uint8_t trailer_len(whisper_data_layer_t dl, uint8_t flags)
+{
+    return flags & FLAGS_SEQ_RESET ? LEN_CHECKSUM : dl->checksum_len;
+}
+
+/**
+ * checksum of the header as on the wire and the payload, which covers the
+ * prefix if there is one and the address byte on a multi-drop bus, of the
+ * trailer length
+ */
+static unsigned long checksum_of(whisper_data_layer_t dl, uint8_t checksum_len, uint8_t address, const uint8_t *header,
+                                 uint8_t header_len, const uint8_t *payload, uint8_t payload_len)
+{
+    uint8_t prefix_len = dl->cfg.framing == WHISPER_DATA_LAYER__FRAMING_COBS ? 0 : LEN_PREFIX;
+    uint8_t address_len = dl->cfg.address ? LEN_ADDRESS : 0;
+
+    if (checksum_len == LEN_CRC32C)
+    {
+        unsigned long crc = update_crc32c_buf(PACKET_PREFIX, prefix_len, CRC32C_INIT);
+        crc = update_crc32c_buf(&address, address_len, crc);
+        crc = update_crc32c_buf(header, header_len, crc);
+        return ~update_crc32c_buf(payload, payload_len, crc) & 0xFFFFFFFFUL;
+    }
+
+    uint16_t crc = update_crc_buf(PACKET_PREFIX, prefix_len, CRC_INIT);
+    crc = update_crc_buf(&address, address_len, crc);
+    crc = update_crc_buf(header, header_len, crc);
+    return update_crc_buf(payload, payload_len, crc);
+}
 
-static uint8_t state;
-static uint8_t next_state;
-struct whisper_data_layer__config cfg;
-static uint16_t counter;
-static uint16_t receive_counter;
+/** return the checksums the link accepts, a link configured with CRC-32C falls back to CRC-16 if the peer wants */
+static uint8_t accepted_checksums(whisper_data_layer_t dl)
+{
+    if ((dl->cfg.checksum ? dl->cfg.checksum : DEFAULT_CHECKSUM) == WHISPER_DATA_LAYER__CHECKSUM_CRC32C)
+        return WHISPER_DATA_LAYER__CHECKSUM_CRC16 | WHISPER_DATA_LAYER__CHECKSUM_CRC32C;
+    return WHISPER_DATA_LAYER__CHECKSUM_CRC16;
+}
+
+/** write the checksum as the trailer of a frame, least significant byte first */
+static void put_checksum(uint8_t *trailer, uint8_t checksum_len, unsigned long checksum)
+{
+    uint8_t i;
 
-static void transite(uint8_t new_state) { next_state = new_state; }
+    for (i = 0; i < checksum_len; i++)
+        trailer[i] = (uint8_t)(checksum >> (8 * i));
+}
+
+void whisper_data_layer__init(whisper_data_layer_t dl, struct whisper_data_layer__config *config)
+{
+    memset(dl, 0, sizeof(struct whisper_data_layer));
+    memcpy(&dl->cfg, config, sizeof(struct whisper_data_layer__config));
+    dl->buf_recv = (array_buffer_t)dl->cfg.buf;
+    dl->cfg.buf = &dl->cfg.buf[SIZEOF_ARRAY_BUFFER_T];
+    dl->cfg.buf_len -= SIZEOF_ARRAY_BUFFER_T;
+    array_buffer__init(dl->buf_recv, dl->cfg.buf, dl->cfg.buf_len);
+
+    dl->state = STATE_PREFIX;
+    dl->counter = 0;
+    dl->send_buffer.empty = 1;
+    dl->receive_credits = dl->cfg.credits;
+    // a peer without flow control never advertises any
+    dl->peer_credits = 1;
+    dl->checksum_len = accepted_checksums(dl) & WHISPER_DATA_LAYER__CHECKSUM_CRC32C ? LEN_CRC32C : LEN_CHECKSUM;
+    dl->dict_crc = dl->cfg.compress_dict ? update_crc_buf(dl->cfg.compress_dict, dl->cfg.compress_dict_len, CRC_INIT) : 0;
+    whisper_timer__init(&dl->timer, on_timer, dl);
+
+    assert(dl->cfg.fec_parity <= WHISPER_FEC__MAX_PARITY);
+    if (dl->cfg.fec_parity)
+        whisper_fec__generator(dl->fec_generator, dl->cfg.fec_parity);
+
+    assert(dl->cfg.address <= WHISPER_DATA_LAYER__MAX_ADDRESS);
+    dl->tx_address = dl->cfg.master ? dl->cfg.address : dl->cfg.address | ADDRESS_FROM_NODE;
+    dl->rx_address = dl->cfg.master ? dl->cfg.address | ADDRESS_FROM_NODE : dl->cfg.address;
+
+    // the parity covers a header of fixed length
+    dl->compact = dl->cfg.header == WHISPER_DATA_LAYER__HEADER_COMPACT && !dl->cfg.fec_parity;
+    dl->rx_header_len = LEN_HEADER;
+    // behind the address byte, the header is copied out of the receive buffer to be aligned
+    if (dl->compact || dl->cfg.address)
+        dl->packet_header = &dl->rx_header;
+    else
+        dl->packet_header =
+            (struct whisper_data_layer__packet_header *)array_buffer__at(dl->buf_recv, header_offset(dl));
+}
+
+/** copy data, which is updated by the link, consistently */
+static void stats_read(whisper_data_layer_t dl, void *dst, const void *src, unsigned long len)
+{
+#ifdef WHISPER_STATS
+    unsigned long seq;
+
+    do
+    {
+        // wait for the pending update to be finished
+        while ((seq = __atomic_load_n(&dl->stats_seq, __ATOMIC_ACQUIRE)) & 1)
+            ;
+
+        memcpy(dst, src, len);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (__atomic_load_n(&dl->stats_seq, __ATOMIC_RELAXED) != seq);
+#else
+    memcpy(dst, src, len);
+#endif
+}
 
-static void reset(void)
+char whisper_data_layer__stats(whisper_data_layer_t dl, struct whisper_data_layer__stats *stats)
 {
-    transite(STATE_PREFIX);
+#ifdef WHISPER_STATS
+    stats_read(dl, stats, &dl->stats, sizeof(struct whisper_data_layer__stats));
+    return 0;
+#else
+    memset(stats, 0, sizeof(struct whisper_data_layer__stats));
+    return 1;
+#endif
 }
 
-void whisper_data_layer__init(struct whisper_data_layer__config *config)
+char whisper_data_layer__ack_latency(whisper_data_layer_t dl, struct whisper_histogram *snapshot)
 {
-    memcpy(&cfg, config, sizeof(struct whisper_data_layer__config));
-    _buf_recv = (array_buffer_t)cfg.buf;
-    cfg.buf = &cfg.buf[SIZEOF_ARRAY_BUFFER_T];
-    cfg.buf_len -= SIZEOF_ARRAY_BUFFER_T;
-    array_buffer__init(_buf_recv, cfg.buf, cfg.buf_len);
+    if (!dl->cfg.ack_latency)
+        return -1;
 
-    state = STATE_PREFIX;
-    counter = 0;
-    send_buffer.empty = 1;
+    stats_read(dl, snapshot, dl->cfg.ack_latency, sizeof(struct whisper_histogram));
+    return 0;
+}
 
-    packet_header = (struct whisper_data_layer__packet_header *)array_buffer__at(_buf_recv, LEN_PREFIX);
+void *whisper_data_layer__ctx(whisper_data_layer_t dl)
+{
+    return dl->cfg.ctx;
 }
 
-static char handle_prefix(void);
-static char handle_header(void);
-static char handle_payload(void);
-static char handle_checksum(void);
+/** record a chunk in the capture of the link */
+static void capture(whisper_data_layer_t dl, uint8_t direction, const uint8_t *data, uint8_t len)
+{
+    whisper_capture__record(dl->cfg.capture, direction, dl->cfg.now_us ? dl->cfg.now_us(dl) : 0, data, len);
+}
+
+static char handle_prefix(whisper_data_layer_t dl);
+static char handle_header(whisper_data_layer_t dl);
+static char handle_payload(whisper_data_layer_t dl);
+static char handle_checksum(whisper_data_layer_t dl);
+static char handle_discard(whisper_data_layer_t dl);
+
+static void process_cobs_frames(whisper_data_layer_t dl);
 
-static void process_buffered_data(void)
+static void process_buffered_data(whisper_data_layer_t dl)
 {
     char ret = 1;
     while (ret == 1)
     {
-        next_state = state;
-        switch (state)
+        dl->next_state = dl->state;
+        switch (dl->state)
         {
         case STATE_PREFIX:
-            ret = handle_prefix();
+            ret = handle_prefix(dl);
             break;
         case STATE_HEADER:
-            ret = handle_header();
+            ret = handle_header(dl);
             break;
         case STATE_PAYLOAD:
-            ret = handle_payload();
+            ret = handle_payload(dl);
             break;
         case STATE_CHECKSUM:
-            ret = handle_checksum();
+            ret = handle_checksum(dl);
+            break;
+        case STATE_DISCARD:
+            ret = handle_discard(dl);
             break;
         default:
             // fatal, as the state is unknown
-            transite(STATE_PREFIX);
-            array_buffer__clear(_buf_recv);
+            transite(dl, STATE_PREFIX);
+            array_buffer__clear(dl->buf_recv);
             ret = -1;
         }
 
-        if (next_state != state)
-            state = next_state;
+        if (dl->next_state != dl->state)
+        {
+            TRACE(dl, STATE, dl->state, dl->next_state);
+            dl->state = dl->next_state;
+        }
     }
 }
 
-char whisper_data_layer__data_received(const uint8_t *data,
+char whisper_data_layer__data_received(whisper_data_layer_t dl, const uint8_t *data,
                                        uint8_t data_length)
 {
     // The function is a finite state machine driven by the data received event.
+    char stats_opened = stats_begin(dl);
+    STATS_ADD(dl, bytes_in, data_length);
+    TRACE(dl, DATA_IN, 0, data_length);
+    if (dl->cfg.capture)
+        capture(dl, WHISPER_CAPTURE__RX, data, data_length);
 
     // push data to the tail of the receive buffer
     while (data_length > 0)
     {
         uint16_t bytes_to_copy =
-            array_buffer__capacity(_buf_recv) - array_buffer__size(_buf_recv);
+            array_buffer__capacity(dl->buf_recv) - array_buffer__size(dl->buf_recv);
         if (bytes_to_copy > data_length)
             bytes_to_copy = data_length;
 
-        array_buffer__push(_buf_recv, data, bytes_to_copy);
+        array_buffer__push(dl->buf_recv, data, bytes_to_copy);
+        data += bytes_to_copy;
         data_length -= bytes_to_copy;
 
         // process the buffered data
-        process_buffered_data();
+        if (dl->cfg.framing == WHISPER_DATA_LAYER__FRAMING_COBS)
+            process_cobs_frames(dl);
+        else
+            process_buffered_data(dl);
     }
 
+    stats_end(dl, stats_opened);
     return 0;
 }
 
-static char handle_prefix(void)
+static char handle_prefix(whisper_data_layer_t dl)
 {
-    if (array_buffer__size(_buf_recv) < LEN_PREFIX)
+    if (array_buffer__size(dl->buf_recv) < LEN_PREFIX)
         // stop processing if the prefix is not yet received
         return 0;
 
     uint8_t num_of_matches = 0;
 
-    while (array_buffer__size(_buf_recv) >= LEN_PREFIX &&
+    while (array_buffer__size(dl->buf_recv) >= LEN_PREFIX &&
            num_of_matches < LEN_PREFIX)
     {
-        if (*array_buffer__at(_buf_recv, num_of_matches) ==
+        if (*array_buffer__at(dl->buf_recv, num_of_matches) ==
             PACKET_PREFIX[num_of_matches])
         {
             // found matches, increase the counter
@@ -179,14 +528,15 @@ static char handle_prefix(void)
             // does not match, reset the counter and pop the buffer
             // drop the first byte and search from the beginning of the buffer
             num_of_matches = 0;
-            array_buffer__pop(_buf_recv, 1);
+            array_buffer__pop(dl->buf_recv, 1);
+            STATS_ADD(dl, resync_bytes, 1);
         }
     }
 
     if (num_of_matches == LEN_PREFIX)
     {
         // we found the whole prefix, move to the next state
-        transite(STATE_HEADER);
+        transite(dl, STATE_HEADER);
         // continue process the buffer
         return 1;
     }
@@ -197,240 +547,1158 @@ static char handle_prefix(void)
     }
 }
 
-static char handle_header(void)
+/**
+ * decode the compact header at the head of the receive buffer into rx_header,
+ * return 0 on success or -1 if it is invalid
+ */
+static char decode_header(whisper_data_layer_t dl)
+{
+    struct whisper_data_layer__packet_header *header = &dl->rx_header;
+    const uint8_t *wire = array_buffer__at(dl->buf_recv, header_offset(dl));
+    uint8_t first = wire[0];
+
+    if (first < COMPACT_ACK)
+    {
+        // the fast path, a short data frame
+        header->flags = FLAGS_DATA;
+        header->payload_len = first >> COMPACT_DATA_LEN_SHIFT;
+    }
+    else if (first < COMPACT_LONG_DATA)
+    {
+        // the rest of the acknowledged sequence no is the one of the pending frame, see on_ack
+        header->seq_no = first & COMPACT_ACK_SEQ;
+        header->flags = FLAGS_ACK;
+        header->payload_len = (first & COMPACT_ACK_CREDITS) != 0;
+        return 0;
+    }
+    else if ((first & ~COMPACT_DATA_SEQ) == COMPACT_LONG_DATA)
+    {
+        header->flags = FLAGS_DATA;
+        header->payload_len = wire[1];
+    }
+    else if (first == COMPACT_FULL)
+    {
+        memcpy(header, &wire[1], LEN_HEADER);
+        return 0;
+    }
+    else
+        return -1;
+
+    // the sender moved on by one frame from the latest one received, or by two skipping 0, or sends it again
+    uint16_t ahead = ((first - dl->receive_counter + 1) & COMPACT_DATA_SEQ) - 1;
+    header->seq_no = dl->receive_counter + ahead;
+    // not without a frame received since the peer started over
+    return dl->receive_window != 0 && header->seq_no != 0 ? 0 : -1;
+}
+
+/**
+ * correct the header with its parity and check its fields, return 0 if the
+ * frame can be received, otherwise the error is counted
+ */
+static char check_header(whisper_data_layer_t dl)
+{
+    struct whisper_data_layer__packet_header *header = dl->packet_header;
+    uint8_t *wire = array_buffer__at(dl->buf_recv, header_offset(dl));
+    int corrected = 0;
+
+    if (dl->compact && decode_header(dl) != 0)
+    {
+        TRACE(dl, HEADER_ERROR, *array_buffer__at(dl->buf_recv, header_offset(dl)), 0);
+        STATS_ADD(dl, header_errors, 1);
+        return -1;
+    }
+
+    if (dl->cfg.fec_parity)
+        corrected = whisper_fec__decode(wire, LEN_HEADER + dl->cfg.fec_parity, dl->cfg.fec_parity);
+    if (corrected > 0)
+    {
+        TRACE(dl, FEC_CORRECTED, 0, corrected);
+        STATS_ADD(dl, fec_corrected, corrected);
+    }
+    if (!dl->compact && (uint8_t *)header != wire)
+        memcpy(header, wire, LEN_HEADER);
+
+    // check the flags field, only data can be compressed and on a channel, and the payload length field
+    uint8_t type = header->flags & ~(FLAGS_COMPRESSED | FLAGS_CHANNEL);
+    if (corrected < 0 ||
+        (type != FLAGS_ACK && type != FLAGS_DATA && type != FLAGS_SEQ_RESET && type != (FLAGS_SEQ_RESET | FLAGS_ACK)) ||
+        (header->flags & (FLAGS_COMPRESSED | FLAGS_CHANNEL) && type != FLAGS_DATA) ||
+        header->payload_len >
+            array_buffer__capacity(dl->buf_recv) - payload_offset(dl) - trailer_len(dl, header->flags) -
+                dl->cfg.fec_parity)
+    {
+        TRACE(dl, HEADER_ERROR, header->flags, header->payload_len);
+        STATS_ADD(dl, header_errors, 1);
+        return -1;
+    }
+
+    return 0;
+}
+
+/** return the payload length the header at the head of the receive buffer reads, without checking it */
+static uint8_t raw_payload_len(whisper_data_layer_t dl)
+{
+    const uint8_t *wire = array_buffer__at(dl->buf_recv, header_offset(dl));
+
+    if (!dl->compact)
+        return wire[offsetof(struct whisper_data_layer__packet_header, payload_len)];
+    if (wire[0] < COMPACT_ACK)
+        return wire[0] >> COMPACT_DATA_LEN_SHIFT;
+    if (wire[0] < COMPACT_LONG_DATA)
+        return (wire[0] & COMPACT_ACK_CREDITS) != 0;
+    if (dl->rx_header_len == 2)
+        return wire[1];
+    return wire[1 + offsetof(struct whisper_data_layer__packet_header, payload_len)];
+}
+
+/** return the flags the header at the head of the receive buffer reads, without checking it, 0 for a compact one */
+static uint8_t raw_flags(whisper_data_layer_t dl)
+{
+    const uint8_t *wire = array_buffer__at(dl->buf_recv, header_offset(dl));
+
+    if (!dl->compact)
+        return wire[offsetof(struct whisper_data_layer__packet_header, flags)];
+    if (wire[0] == COMPACT_FULL)
+        return wire[1 + offsetof(struct whisper_data_layer__packet_header, flags)];
+    return 0;
+}
+
+/** skip the frame of another address at the head of the receive buffer, by the length its header reads */
+static void skip_frame(whisper_data_layer_t dl)
 {
+    STATS_ADD(dl, filtered, 1);
+    dl->skip = payload_offset(dl) + raw_payload_len(dl) + trailer_len(dl, raw_flags(dl)) + dl->cfg.fec_parity;
+    transite(dl, STATE_DISCARD);
+}
 
-    if (array_buffer__size(_buf_recv) < LEN_PREFIX + LEN_HEADER)
+static char handle_header(whisper_data_layer_t dl)
+{
+    // the first byte of a compact header tells its length
+    if (dl->compact && array_buffer__size(dl->buf_recv) > header_offset(dl))
+        dl->rx_header_len = COMPACT_HEADER_LEN[*array_buffer__at(dl->buf_recv, header_offset(dl)) >> 5];
+
+    if (array_buffer__size(dl->buf_recv) < payload_offset(dl))
         // stop processing if the header is not yet fully received
         return 0;
 
-    // check the flags field
-    if (packet_header->flags < FLAGS_ACK || packet_header->flags > FLAGS_DATA)
+    if (dl->cfg.address && *array_buffer__at(dl->buf_recv, header_offset(dl) - LEN_ADDRESS) != dl->rx_address)
     {
-        // invalid flags, reset the state and pop
-        reset();
-        // track back and go over again from the second byte
-        array_buffer__pop(_buf_recv, 1);
+        // on a multi-drop bus, a frame of another link, of which neither the header nor the checksum is checked
+        skip_frame(dl);
         return 1;
     }
 
-    // check the payload length field
-    if (packet_header->payload_len >
-        array_buffer__capacity(_buf_recv) - LEN_PREFIX - LEN_HEADER - LEN_CHECKSUM)
+    if (check_header(dl) != 0)
     {
-        reset();
-        array_buffer__pop(_buf_recv, 1);
+        // invalid header, reset the state and pop
+        reset(dl);
+        // track back and go over again from the second byte
+        array_buffer__pop(dl->buf_recv, 1);
+        STATS_ADD(dl, resync_bytes, 1);
         // continue processing the buffer
         return 1;
     }
 
     // transite to payload state
-    transite(STATE_PAYLOAD);
+    transite(dl, STATE_PAYLOAD);
     return 1;
 }
 
-static char handle_payload(void)
+static char handle_payload(whisper_data_layer_t dl)
 {
-    uint16_t data_size = array_buffer__size(_buf_recv);
-    assert(data_size >= LEN_PREFIX + LEN_HEADER);
+    uint16_t data_size = array_buffer__size(dl->buf_recv);
+    assert(data_size >= payload_offset(dl));
 
-    uint16_t expected_size = LEN_PREFIX + LEN_HEADER + packet_header->payload_len;
-
-    if (data_size < LEN_PREFIX + LEN_HEADER + packet_header->payload_len)
+    if (data_size < payload_offset(dl) + dl->packet_header->payload_len)
         // do not have enought data yet, stop processing
         return 0;
 
     // accumulated enough data, transite to checksum state
-    transite(STATE_CHECKSUM);
+    transite(dl, STATE_CHECKSUM);
 
     // continue processing the buffer
     return 1;
 }
 
-static void ack(void);
-static void on_ack(void);
+/** drop the bytes of a skipped frame as they arrive */
+static char handle_discard(whisper_data_layer_t dl)
+{
+    uint16_t len = array_buffer__size(dl->buf_recv);
+
+    if (len > dl->skip)
+        len = dl->skip;
+    array_buffer__pop(dl->buf_recv, len);
+    dl->skip -= len;
+    if (dl->skip > 0)
+        return 0;
 
-static void _frame_received(void)
+    reset(dl);
+    return 1;
+}
+
+static void ack(whisper_data_layer_t dl);
+static void send_ack(whisper_data_layer_t dl, uint16_t seq_no);
+static void on_ack(whisper_data_layer_t dl);
+static void on_handshake(whisper_data_layer_t dl);
+
+/** return 1 if the data frame was received already, as its acknowledgement got lost */
+static char is_duplicate(whisper_data_layer_t dl, uint16_t seq_no)
 {
-    // reset the packet according to the received packet
-    if (packet_header->flags & FLAGS_SEQ_RESET)
+    // the distance in sequence numbers, which wrap around
+    uint16_t behind = dl->receive_counter - seq_no;
+
+    return behind < RECEIVE_WINDOW && (dl->receive_window >> behind) & 1;
+}
+
+/** remember that the data frame is received */
+static void mark_received(whisper_data_layer_t dl, uint16_t seq_no)
+{
+    uint16_t ahead = seq_no - dl->receive_counter;
+    uint16_t behind = dl->receive_counter - seq_no;
+
+    if (dl->receive_window && behind < RECEIVE_WINDOW)
     {
-        counter = packet_header->seq_no - 1;
+        // late, as the sender moved on without it
+        dl->receive_window |= 1UL << behind;
+        return;
     }
-    counter = packet_header->seq_no;
+
+    // slide the window forward, unless the frame is far off, as the peer started over
+    if (dl->receive_window && ahead < RECEIVE_WINDOW)
+        dl->receive_window = dl->receive_window << ahead | 1;
+    else
+        dl->receive_window = 1;
+    dl->receive_counter = seq_no;
+}
+
+static void _frame_received(whisper_data_layer_t dl)
+{
+    struct whisper_data_layer__packet_header *packet_header = dl->packet_header;
 
     // hand the actual packet
-    if (packet_header->flags & FLAGS_ACK)
+    if (packet_header->flags & FLAGS_SEQ_RESET)
+    {
+        on_handshake(dl);
+    }
+    else if (packet_header->flags & FLAGS_ACK)
     {
-        on_ack();
+        on_ack(dl);
     }
     else if (packet_header->flags & FLAGS_DATA)
     {
-        if (packet_header->seq_no < receive_counter)
+        if (packet_header->seq_no == 0)
+        {
+            // a window probe, which is answered with the credits left
+            send_ack(dl, 0);
+            return;
+        }
+
+        if (is_duplicate(dl, packet_header->seq_no))
+        {
+            // a retransmission, acknowledged again but not delivered
+            TRACE(dl, DUPLICATE, 0, packet_header->seq_no);
+            STATS_ADD(dl, duplicates, 1);
+            ack(dl);
+            return;
+        }
+
+        if (dl->cfg.credits && dl->receive_credits == 0)
         {
-            // The packet is a re-transmission, just ignore it.
+            // the application is behind, the window update tells the sender to hold the frame
+            TRACE(dl, REFUSED, 0, packet_header->seq_no);
+            STATS_ADD(dl, refused, 1);
+            dl->window_closed = 1;
+            send_ack(dl, 0);
             return;
         }
 
-        if (cfg.packet_received_cb)
-            cfg.packet_received_cb(
-                array_buffer__at(_buf_recv, LEN_PREFIX + LEN_HEADER),
-                packet_header->payload_len);
+        uint8_t *payload = array_buffer__at(dl->buf_recv, payload_offset(dl));
+        uint8_t payload_len = packet_header->payload_len;
 
-        ack();
+        if (packet_header->flags & FLAGS_COMPRESSED)
+        {
+            int len = dl->cfg.decompress_buf
+                          ? whisper_lz__decompress(dl->cfg.compress_dict, dl->cfg.compress_dict_len, payload,
+                                                   payload_len, dl->cfg.decompress_buf, UCHAR_MAX)
+                          : -1;
+            if (len < 0)
+            {
+                // not acknowledged, so the sender gives the frame up rather than losing it silently
+                TRACE(dl, HEADER_ERROR, packet_header->flags, payload_len);
+                STATS_ADD(dl, header_errors, 1);
+                return;
+            }
+            payload = dl->cfg.decompress_buf;
+            payload_len = len;
+        }
+
+        mark_received(dl, packet_header->seq_no);
+        if (dl->cfg.credits && --dl->receive_credits == 0)
+            dl->window_closed = 1;
+
+        // a node on a multi-drop bus acknowledges first, so that its answer follows in the same transmission
+        uint8_t node = dl->cfg.address && !dl->cfg.master;
+        if (node)
+            ack(dl);
+        if (dl->cfg.packet_received_cb)
+            dl->cfg.packet_received_cb(dl, payload, payload_len);
+        if (!node)
+            ack(dl);
     }
 }
 
-static char handle_checksum(void)
+/**
+ * correct the payload and the checksum with their parity and verify the
+ * checksum, return 0 if the frame is intact, otherwise the error is counted
+ */
+static char check_frame(whisper_data_layer_t dl)
 {
-    // the expected frame length
-    uint8_t precedent_length = LEN_PREFIX + LEN_HEADER + packet_header->payload_len;
-    uint8_t expected_frame_length = precedent_length + LEN_CHECKSUM;
+    uint8_t *payload = array_buffer__at(dl->buf_recv, payload_offset(dl));
+    uint8_t payload_len = dl->packet_header->payload_len;
+    uint8_t checksum_len = trailer_len(dl, dl->packet_header->flags);
 
-    if (array_buffer__size(_buf_recv) < expected_frame_length)
-        // do not have enought data yet, stop processing
-        return 0;
+    if (dl->cfg.fec_parity)
+    {
+        int corrected = whisper_fec__decode(payload, payload_len + checksum_len + dl->cfg.fec_parity,
+                                            dl->cfg.fec_parity);
+        // beyond repair, the checksum tells
+        if (corrected > 0)
+        {
+            TRACE(dl, FEC_CORRECTED, 1, corrected);
+            STATS_ADD(dl, fec_corrected, corrected);
+        }
+    }
 
-    // calculate the checksum of the frame
-    uint16_t actual_checksum = update_crc_buf(array_buffer__at(_buf_recv, 0), precedent_length, CRC_INIT);
+    // calculate the checksum of the frame, which does not cover the parity of the header
+    uint8_t actual_checksum[MAX_LEN_CHECKSUM];
+    put_checksum(actual_checksum, checksum_len,
+                 checksum_of(dl, checksum_len, dl->rx_address, array_buffer__at(dl->buf_recv, header_offset(dl)),
+                             dl->rx_header_len, payload, payload_len));
 
     // read the crc and check against the calculated one
-    uint16_t *expected_checksum = (uint16_t *)array_buffer__at(_buf_recv, precedent_length);
+    if (memcmp(&payload[payload_len], actual_checksum, checksum_len) != 0)
+    {
+        TRACE(dl, CRC_ERROR, 0, dl->packet_header->seq_no);
+        STATS_ADD(dl, crc_errors, 1);
+        return -1;
+    }
+
+    STATS_ADD(dl, frames_ok, 1);
+    TRACE(dl, FRAME_RX, dl->packet_header->flags, dl->packet_header->seq_no);
+    return 0;
+}
+
+static char handle_checksum(whisper_data_layer_t dl)
+{
+    // the expected frame length
+    uint8_t expected_frame_length = payload_offset(dl) + dl->packet_header->payload_len +
+                                    trailer_len(dl, dl->packet_header->flags) + dl->cfg.fec_parity;
 
-    if (*expected_checksum != actual_checksum)
+    if (array_buffer__size(dl->buf_recv) < expected_frame_length)
+        // do not have enought data yet, stop processing
+        return 0;
+
+    if (check_frame(dl) != 0)
     {
         // checksum mismatch, reset the state and pop
-        reset();
-        array_buffer__pop(_buf_recv, 1);
+        reset(dl);
+        array_buffer__pop(dl->buf_recv, 1);
+        STATS_ADD(dl, resync_bytes, 1);
         // continue processing the buffer
         return 1;
     }
 
     // checksum matched, process the frame
-    _frame_received();
+    _frame_received(dl);
 
     // pop the entire frame from the buffer
-    array_buffer__pop(_buf_recv, expected_frame_length);
-    reset();
+    array_buffer__pop(dl->buf_recv, expected_frame_length);
+    reset(dl);
 
     return 1;
 }
 
-static void ack(void)
+/** receive the frame of the given length at the head of the receive buffer, encoded with COBS */
+static void take_cobs_frame(whisper_data_layer_t dl, uint8_t len)
+{
+    uint8_t *head = array_buffer__at(dl->buf_recv, 0);
+
+    // on a multi-drop bus, the address follows the code byte, as it is never 0, and is checked before decoding
+    if (dl->cfg.address && len > LEN_ADDRESS && head[LEN_ADDRESS] != dl->rx_address)
+    {
+        STATS_ADD(dl, filtered, 1);
+        return;
+    }
+
+    int frame_len = whisper_cobs__decode(head, len);
+
+    // the first byte of a compact header tells its length, behind the address on a multi-drop bus
+    if (dl->compact && frame_len > header_offset(dl))
+        dl->rx_header_len = COMPACT_HEADER_LEN[*array_buffer__at(dl->buf_recv, header_offset(dl)) >> 5];
+    // the delimiter tells the length of the frame, which the header must agree with
+    if (frame_len < payload_offset(dl) + LEN_CHECKSUM + dl->cfg.fec_parity)
+    {
+        TRACE(dl, HEADER_ERROR, 0, len);
+        STATS_ADD(dl, header_errors, 1);
+        return;
+    }
+    if (check_header(dl) != 0)
+        return;
+    if (frame_len != payload_offset(dl) + dl->packet_header->payload_len + trailer_len(dl, dl->packet_header->flags) +
+                         dl->cfg.fec_parity)
+    {
+        TRACE(dl, HEADER_ERROR, dl->packet_header->flags, dl->packet_header->payload_len);
+        STATS_ADD(dl, header_errors, 1);
+        return;
+    }
+    if (check_frame(dl) != 0)
+        return;
+
+    _frame_received(dl);
+}
+
+static void process_cobs_frames(whisper_data_layer_t dl)
+{
+    uint8_t size;
+
+    // frames end with the delimiter, which is searched for once in every byte
+    while ((size = array_buffer__size(dl->buf_recv)) > dl->scanned)
+    {
+        uint8_t *head = array_buffer__at(dl->buf_recv, 0);
+        uint8_t *delimiter = memchr(&head[dl->scanned], WHISPER_COBS__DELIMITER, size - dl->scanned);
+
+        if (!delimiter)
+        {
+            dl->scanned = size;
+            break;
+        }
+
+        uint8_t len = delimiter - head;
+        if (dl->state == STATE_DISCARD)
+        {
+            // the rest of a frame too long for the buffer
+            STATS_ADD(dl, resync_bytes, len + 1);
+            TRACE(dl, STATE, STATE_DISCARD, STATE_PREFIX);
+            dl->state = STATE_PREFIX;
+        }
+        else if (len > 0)
+            take_cobs_frame(dl, len);
+
+        array_buffer__pop(dl->buf_recv, len + 1);
+        dl->scanned = 0;
+    }
+
+    if (size == array_buffer__capacity(dl->buf_recv))
+    {
+        // no delimiter in a full buffer, skip to the next one
+        STATS_ADD(dl, resync_bytes, size);
+        array_buffer__clear(dl->buf_recv);
+        dl->scanned = 0;
+        if (dl->state != STATE_DISCARD)
+        {
+            TRACE(dl, STATE, dl->state, STATE_DISCARD);
+            dl->state = STATE_DISCARD;
+        }
+    }
+}
+
+/** write out bytes of a frame, through the capture if any */
+static void write_out(whisper_data_layer_t dl, const uint8_t *data, uint8_t len)
+{
+    if (dl->cfg.capture)
+        capture(dl, WHISPER_CAPTURE__TX, data, len);
+    dl->cfg.data_write(dl, data, len);
+}
+
+static void cobs_write(void *ctx, const uint8_t *data, uint8_t len)
+{
+    write_out(ctx, data, len);
+}
+
+/** write out a frame given in pieces, return the number of bytes written */
+static unsigned int write_frame(whisper_data_layer_t dl, const struct whisper_cobs__segment *segments,
+                                uint8_t num_segments)
 {
-    assert((packet_header->flags & FLAGS_ACK) == 0);
+    unsigned int len = LEN_PREFIX;
+    uint8_t i;
+
+    if (dl->cfg.framing == WHISPER_DATA_LAYER__FRAMING_COBS)
+        return whisper_cobs__encode(segments, num_segments, cobs_write, dl);
+
+    write_out(dl, PACKET_PREFIX, LEN_PREFIX);
+    for (i = 0; i < num_segments; i++)
+    {
+        // the parity is empty without forward error correction, the address on a point to point line
+        if (segments[i].len == 0)
+            continue;
+        write_out(dl, segments[i].data, segments[i].len);
+        len += segments[i].len;
+    }
+    return len;
+}
 
-    uint8_t buf[LEN_PREFIX + LEN_HEADER + sizeof(uint16_t) + LEN_CHECKSUM] = {
+/** acknowledge the frame at the head of the receive buffer */
+static void ack(whisper_data_layer_t dl)
+{
+    assert((dl->packet_header->flags & FLAGS_ACK) == 0);
+    send_ack(dl, dl->packet_header->seq_no);
+}
+
+/**
+ * write the header of a frame as it goes on the wire, return its length,
+ * with short_form a data frame takes a compact header if it can
+ */
+static uint8_t put_header(whisper_data_layer_t dl, const struct whisper_data_layer__packet_header *header,
+                          uint8_t short_form, uint8_t *wire)
+{
+    if (!dl->compact)
+    {
+        memcpy(wire, header, LEN_HEADER);
+        return LEN_HEADER;
+    }
+
+    // only data on channel 0, not compressed, and never a probe
+    if (short_form && header->flags == FLAGS_DATA && header->seq_no != 0)
+    {
+        if (header->payload_len <= COMPACT_DATA_MAX_LEN)
+        {
+            wire[0] = header->payload_len << COMPACT_DATA_LEN_SHIFT | (header->seq_no & COMPACT_DATA_SEQ);
+            return 1;
+        }
+        wire[0] = COMPACT_LONG_DATA | (header->seq_no & COMPACT_DATA_SEQ);
+        wire[1] = header->payload_len;
+        return 2;
+    }
+
+    wire[0] = COMPACT_FULL;
+    memcpy(&wire[1], header, LEN_HEADER);
+    return MAX_LEN_HEADER;
+}
+
+/** write an acknowledgement of the data frame, or a window update for seq_no 0, with the credits left */
+static void send_ack(whisper_data_layer_t dl, uint16_t seq_no)
+{
+    uint8_t buf[LEN_PREFIX + LEN_ADDRESS + MAX_LEN_HEADER + sizeof(uint16_t) + 1 + MAX_LEN_CHECKSUM +
+                2 * WHISPER_FEC__MAX_PARITY] = {
         PACKET_PREFIX[0],
         PACKET_PREFIX[1],
-        counter & 0x00ff,
-        (counter & 0xff00) >> 8,
-        FLAGS_ACK,
-        2,
-        packet_header->seq_no & 0x00ff,
-        packet_header->seq_no >> 8,
+        dl->tx_address,
+    };
+    uint8_t address_len = dl->cfg.address ? LEN_ADDRESS : 0;
+    uint8_t *header = &buf[LEN_PREFIX + address_len];
+    uint8_t header_len;
+    uint8_t payload_len;
+
+    if (dl->compact && seq_no != 0)
+    {
+        // the low bits of the acknowledged sequence no in the header, the credits as the payload
+        payload_len = dl->cfg.credits ? 1 : 0;
+        header[0] = COMPACT_ACK | (dl->cfg.credits ? COMPACT_ACK_CREDITS : 0) | (seq_no & COMPACT_ACK_SEQ);
+        header_len = LEN_COMPACT_HEADER;
+    }
+    else
+    {
+        // the credits follow the acknowledged sequence no with flow control
+        struct whisper_data_layer__packet_header ack_header = {
+            .seq_no = dl->counter,
+            .flags = FLAGS_ACK,
+            .payload_len = dl->cfg.credits ? sizeof(uint16_t) + 1 : sizeof(uint16_t),
+        };
+        payload_len = ack_header.payload_len;
+        header_len = put_header(dl, &ack_header, 0, header);
+    }
+
+    uint8_t parity = dl->cfg.fec_parity;
+    uint8_t *payload = &header[header_len + parity];
+    uint8_t len = LEN_PREFIX + address_len + header_len + payload_len + dl->checksum_len + 2 * parity;
+
+    if (header_len != LEN_COMPACT_HEADER)
+    {
+        payload[0] = seq_no & 0x00ff;
+        payload[1] = seq_no >> 8;
+    }
+    if (dl->cfg.credits)
+    {
+        payload[payload_len - 1] = dl->receive_credits;
+        if (dl->receive_credits > 0)
+            dl->window_closed = 0;
+    }
+
+    put_checksum(&payload[payload_len], dl->checksum_len,
+                 checksum_of(dl, dl->checksum_len, dl->tx_address, header, header_len, payload, payload_len));
+
+    if (parity)
+    {
+        // the parity buffers are zeroed by the initializer
+        whisper_fec__encode(dl->fec_generator, parity, header, LEN_HEADER, &header[LEN_HEADER]);
+        whisper_fec__encode(dl->fec_generator, parity, payload, payload_len + dl->checksum_len,
+                            &payload[payload_len + dl->checksum_len]);
+    }
+
+    TRACE(dl, ACK_TX, 0, seq_no);
+    if (dl->cfg.framing == WHISPER_DATA_LAYER__FRAMING_COBS)
+    {
+        struct whisper_cobs__segment frame = {&buf[LEN_PREFIX], len - LEN_PREFIX};
+        len = whisper_cobs__encode(&frame, 1, cobs_write, dl);
+    }
+    else
+        write_out(dl, buf, len);
+    STATS_ADD(dl, bytes_out, len);
+}
+
+void whisper_data_layer__grant(whisper_data_layer_t dl, uint8_t credits)
+{
+    char stats_opened = stats_begin(dl);
+
+    assert(dl->cfg.credits);
+    dl->receive_credits = credits > UCHAR_MAX - dl->receive_credits ? UCHAR_MAX : dl->receive_credits + credits;
+    // the peer holds its frame until it hears of the credits, or probes
+    if (dl->window_closed && dl->receive_credits > 0)
+        send_ack(dl, 0);
+    stats_end(dl, stats_opened);
+}
+
+/**
+ * write out a data frame, return the number of bytes written, with
+ * short_form it takes a compact header if it can
+ */
+static unsigned int write_data_frame(whisper_data_layer_t dl, struct whisper_data_layer__packet_header *header,
+                                     const uint8_t *payload, uint8_t short_form)
+{
+    uint8_t wire_header[MAX_LEN_HEADER];
+    uint8_t header_len = put_header(dl, header, short_form, wire_header);
+
+    // calculate the checksum of the frame
+    uint8_t parity_len = dl->cfg.fec_parity;
+    uint8_t header_parity[WHISPER_FEC__MAX_PARITY];
+    uint8_t parity[WHISPER_FEC__MAX_PARITY];
+    uint8_t checksum[MAX_LEN_CHECKSUM];
+    uint8_t checksum_len = trailer_len(dl, header->flags);
+    put_checksum(checksum, checksum_len,
+                 checksum_of(dl, checksum_len, dl->tx_address, wire_header, header_len, payload, header->payload_len));
+
+    // the parity of the header, and of the payload and the checksum
+    if (parity_len)
+    {
+        memset(header_parity, 0, parity_len);
+        whisper_fec__encode(dl->fec_generator, parity_len, wire_header, LEN_HEADER, header_parity);
+        memset(parity, 0, parity_len);
+        whisper_fec__encode(dl->fec_generator, parity_len, payload, header->payload_len, parity);
+        whisper_fec__encode(dl->fec_generator, parity_len, checksum, checksum_len, parity);
+    }
+
+    // PREFIX, ADDRESS, HEADER, PARITY, PAYLOAD, CHECKSUM, PARITY
+    struct whisper_cobs__segment segments[] = {
+        {&dl->tx_address, dl->cfg.address ? LEN_ADDRESS : 0},
+        {wire_header, header_len},
+        {header_parity, parity_len},
+        {payload, header->payload_len},
+        {checksum, checksum_len},
+        {parity, parity_len},
     };
+    return write_frame(dl, segments, sizeof(segments) / sizeof(segments[0]));
+}
 
-    uint16_t checksum = update_crc_buf(buf, LEN_PREFIX + LEN_HEADER + sizeof(uint16_t), CRC_INIT);
-    buf[LEN_PREFIX + LEN_HEADER + sizeof(uint16_t)] = checksum & 0x00ff;
-    buf[LEN_PREFIX + LEN_HEADER + sizeof(uint16_t) + 1] = checksum >> 8;
+/** bytes a frame takes on the line besides its payload */
+static uint8_t frame_overhead(whisper_data_layer_t dl)
+{
+    // the prefix, or the code byte and the delimiter of COBS
+    uint8_t framing = dl->cfg.framing == WHISPER_DATA_LAYER__FRAMING_COBS ? 2 : LEN_PREFIX;
+    // a compact header takes 1 or 2 bytes mostly
+    uint8_t header = dl->compact ? 2 : LEN_HEADER;
+    uint8_t address_len = dl->cfg.address ? LEN_ADDRESS : 0;
+    return framing + address_len + header + dl->checksum_len + 2 * dl->cfg.fec_parity;
+}
+
+static void _send_data(whisper_data_layer_t dl);
 
-    cfg.data_write(buf, LEN_PREFIX + LEN_HEADER + LEN_CHECKSUM + 2);
+/** the acknowledgement did not arrive in time, a transmission lost to errors */
+static void _timeout(whisper_data_layer_t dl)
+{
+    dl->sizing_failures += SIZING_SCALE;
+    _send_data(dl);
 }
 
-static void _send_data(void)
+static void _send_data(whisper_data_layer_t dl)
 {
-    if (send_buffer.empty)
+    struct buffered_packet *send_buffer = &dl->send_buffer;
+
+    if (send_buffer->empty)
         return;
 
-    if (send_buffer.num_transmissions >= MAX_RETRANSMISSIONS)
+    char stats_opened = stats_begin(dl);
+
+    if (send_buffer->num_transmissions > 0)
+        TRACE(dl, TIMER_EXPIRED, send_buffer->num_transmissions, send_buffer->header.seq_no);
+
+    if (send_buffer->num_transmissions >= MAX_RETRANSMISSIONS)
     {
         // too many retransmissions, drop the packet
-        send_buffer.empty = 1;
+        TRACE(dl, DROP, send_buffer->num_transmissions, send_buffer->header.seq_no);
+        send_buffer->empty = 1;
+        dl->blocked = 0;
+        // the peer may not have received the latest frame
+        dl->anchored = 0;
+        STATS_ADD(dl, drops, 1);
+        stats_end(dl, stats_opened);
+        if (dl->cfg.data_ack_cb)
+            dl->cfg.data_ack_cb(dl, send_buffer->header.seq_no, 0);
         return;
     }
 
-    // send out the data and calculate the checksum of the frame
-    uint16_t checksum = CRC_INIT;
+    if (send_buffer->num_transmissions > 0)
+        STATS_ADD(dl, retransmits, 1);
 
-    // PREFIX
-    checksum = update_crc_buf(PACKET_PREFIX, LEN_PREFIX, checksum);
-    cfg.data_write(PACKET_PREFIX, LEN_PREFIX);
+    TRACE(dl, FRAME_TX, send_buffer->num_transmissions + 1, send_buffer->header.seq_no);
 
-    // HEADER
-    checksum = update_crc_buf((uint8_t *)&send_buffer.header, LEN_HEADER, checksum);
-    cfg.data_write(PACKET_PREFIX, LEN_HEADER);
+    // the peer completes the sequence no of a compact header from the frame acknowledged before
+    unsigned int frame_len = write_data_frame(dl, &send_buffer->header, send_buffer->payload,
+                                              dl->anchored && send_buffer->num_transmissions == 0);
+    STATS_ADD(dl, bytes_out, frame_len);
 
-    // PAYLOAD
-    checksum = update_crc_buf(send_buffer.payload, send_buffer.header.payload_len, checksum);
-    cfg.data_write(send_buffer.payload, send_buffer.header.payload_len);
+    if (dl->cfg.now_us)
+        send_buffer->transmitted_at = dl->cfg.now_us(dl);
 
-    // CHECKSUM
-    cfg.data_write((uint8_t *)&checksum, LEN_CHECKSUM);
+    // the frame and its acknowledgement are exposed to errors
+    dl->sizing_bytes += frame_len + frame_overhead(dl) + sizeof(uint16_t);
+    if (dl->sizing_bytes > SIZING_WINDOW)
+    {
+        dl->sizing_bytes /= 2;
+        dl->sizing_failures /= 2;
+    }
 
     // increase the number of transmissions
-    ++send_buffer.num_transmissions;
+    ++send_buffer->num_transmissions;
+
+    // schedule the next transmission, or the drop after the last one
+    start_delay(dl, RETRANSMISSION_DELAY_MS, _timeout);
+    stats_end(dl, stats_opened);
+}
+
+/** ask the peer without credits for a window update, while the pending frame waits */
+static void _probe(whisper_data_layer_t dl)
+{
+    struct buffered_packet *send_buffer = &dl->send_buffer;
+
+    if (send_buffer->empty || !dl->blocked)
+        return;
+
+    if (dl->probes >= MAX_RETRANSMISSIONS)
+    {
+        // the peer stopped answering, the frame is given up as after its last retransmission
+        dl->blocked = 0;
+        send_buffer->num_transmissions = MAX_RETRANSMISSIONS;
+        _send_data(dl);
+        return;
+    }
+
+    char stats_opened = stats_begin(dl);
+
+    // an empty data frame of sequence no 0, which is never delivered
+    struct whisper_data_layer__packet_header probe = {
+        .seq_no = 0,
+        .flags = FLAGS_DATA,
+        .payload_len = 0,
+    };
+    TRACE(dl, FRAME_TX, 0, 0);
+    unsigned int frame_len = write_data_frame(dl, &probe, 0, 0);
+    STATS_ADD(dl, bytes_out, frame_len);
+    ++dl->probes;
+
+    start_delay(dl, PROBE_DELAY_MS << dl->backoff, _probe);
+    stats_end(dl, stats_opened);
+}
+
+/** hold the pending frame until the peer has credits, and probe for them */
+static void hold(whisper_data_layer_t dl)
+{
+    dl->blocked = 1;
+    start_delay(dl, PROBE_DELAY_MS << dl->backoff, _probe);
+    if (dl->backoff < MAX_PROBE_BACKOFF)
+        ++dl->backoff;
+}
+
+/** take the round trip of the acknowledged frame into the time per byte on the line */
+static void measure_byte_time(whisper_data_layer_t dl)
+{
+    unsigned long len = dl->send_buffer.header.payload_len + 2 * frame_overhead(dl) + sizeof(uint16_t);
+    unsigned long sample = (dl->cfg.now_us(dl) - dl->send_buffer.transmitted_at) * 256 / len;
+
+    // a moving average over the latest 8 or so
+    if (dl->byte_time == 0)
+        dl->byte_time = sample;
+    else if (sample > dl->byte_time)
+        dl->byte_time += (sample - dl->byte_time) / 8;
+    else
+        dl->byte_time -= (dl->byte_time - sample) / 8;
+}
+
+/** resume or hold the pending frame on a window update of the peer */
+static void on_window_update(whisper_data_layer_t dl)
+{
+    struct buffered_packet *send_buffer = &dl->send_buffer;
 
-    // schedule the next transmission
-    if (send_buffer.num_transmissions < MAX_RETRANSMISSIONS)
+    dl->probes = 0;
+    if (dl->peer_credits == 0)
     {
-        cfg.set_delay(RETRANSMISSION_DELAY_MS, _send_data);
+        // a refused transmission was not lost
+        if (!dl->blocked && send_buffer->num_transmissions > 0)
+            --send_buffer->num_transmissions;
+        hold(dl);
+    }
+    else if (dl->blocked)
+    {
+        dl->blocked = 0;
+        stop_delay(dl);
+        _send_data(dl);
     }
 }
 
-void on_ack(void)
+static void on_ack(whisper_data_layer_t dl)
 {
-    assert(packet_header->flags | FLAGS_ACK);
+    assert(dl->packet_header->flags | FLAGS_ACK);
+
+    // get the acked sequence number for the payload, and the credits of the peer if it advertises them
+    uint8_t *payload = array_buffer__at(dl->buf_recv, payload_offset(dl));
+    // a compact acknowledgement carries the low bits of the sequence number in its header, and no window update
+    uint8_t compact = dl->rx_header_len == LEN_COMPACT_HEADER;
+    uint8_t len_seq_no = compact ? 0 : sizeof(uint16_t);
+    uint16_t ack_seq_no = compact ? dl->packet_header->seq_no : payload[0] | payload[1] << 8;
+
+    if (dl->packet_header->payload_len > len_seq_no)
+    {
+        TRACE(dl, CREDITS, payload[len_seq_no], ack_seq_no);
+        dl->peer_credits = payload[len_seq_no];
+        if (dl->peer_credits > 0)
+            dl->backoff = 0;
+    }
+    else
+        // the peer runs no flow control
+        dl->peer_credits = 1;
 
     // only proceed if there are data waiting for acknowlegement
-    if (send_buffer.empty)
+    if (dl->send_buffer.empty)
+        return;
+
+    // sequence no 0 is never sent, it marks a window update
+    if (!compact && ack_seq_no == 0)
+    {
+        on_window_update(dl);
         return;
+    }
 
-    // get the acked sequence number for the payload
-    uint16_t *ack_seq_no = (uint16_t *)array_buffer__at(_buf_recv, LEN_PREFIX + LEN_HEADER);
+    // the pending frame is the only one acknowledged with the same low bits
+    if (compact)
+        ack_seq_no |= dl->send_buffer.header.seq_no & ~COMPACT_ACK_SEQ;
 
     // check if the acked sequence number is the same as the sending one
-    if (send_buffer.header.seq_no != *ack_seq_no)
+    if (dl->send_buffer.header.seq_no != ack_seq_no)
         return;
 
-    cfg.cancel_delay();
-    memset(&send_buffer, 0, sizeof(send_buffer));
-    send_buffer.empty = 1;
+    TRACE(dl, ACK_RX, 0, ack_seq_no);
+
+    stop_delay(dl);
+    if (dl->cfg.ack_latency && dl->cfg.now_us)
+        whisper_histogram__record(dl->cfg.ack_latency, dl->cfg.now_us(dl) - dl->send_buffer.sent_at);
+    if (dl->cfg.max_payload_len && dl->cfg.now_us && dl->send_buffer.num_transmissions == 1)
+        measure_byte_time(dl);
+
+    uint16_t seq_no = dl->send_buffer.header.seq_no;
+    memset(&dl->send_buffer, 0, sizeof(dl->send_buffer));
+    dl->send_buffer.empty = 1;
+    dl->blocked = 0;
+    dl->anchored = 1;
+
+    // the link is ready to send the next frame from the callback
+    if (dl->cfg.data_ack_cb)
+        dl->cfg.data_ack_cb(dl, seq_no, 1);
 }
 
-uint16_t whisper_data_layer__data_sent(uint8_t *data, uint8_t data_length, uint8_t act_required)
+/** send the pending frame, unless the peer has no room for it */
+static void send_pending(whisper_data_layer_t dl)
 {
-    if (!send_buffer.empty)
-        return 0;
+    dl->probes = 0;
+    if (dl->peer_credits == 0)
+        hold(dl);
+    else
+        _send_data(dl);
+}
 
-    // resever 0 for buffer full error
-    ++counter;
-    if (counter == 0)
-        ++counter;
+/** return the longest payload the receive buffer takes */
+static uint8_t max_receive_payload(whisper_data_layer_t dl)
+{
+    // with the longest header
+    int len = array_buffer__capacity(dl->buf_recv) - header_offset(dl) - (dl->compact ? MAX_LEN_HEADER : LEN_HEADER) -
+              2 * dl->cfg.fec_parity - dl->checksum_len;
+
+    // the code byte and the delimiter of COBS
+    if (dl->cfg.framing == WHISPER_DATA_LAYER__FRAMING_COBS)
+        len -= 2;
+    return len < 0 ? 0 : len > UCHAR_MAX ? UCHAR_MAX : len;
+}
 
-    // try to send out the frame
+/** write a handshake frame with the capabilities of the link, or the answer to one with FLAGS_ACK */
+static void send_handshake(whisper_data_layer_t dl, uint8_t flags)
+{
     struct whisper_data_layer__packet_header header = {
-        .seq_no = counter,
-        .flags = FLAGS_DATA,
-        .payload_len = data_length,
+        .seq_no = dl->counter,
+        .flags = flags,
+        .payload_len = LEN_HANDSHAKE,
+    };
+    uint8_t payload[LEN_HANDSHAKE] = {
+        HANDSHAKE_VERSION,
+        max_receive_payload(dl),
+        dl->receive_credits,
+        (dl->cfg.decompress_buf ? HANDSHAKE_DECOMPRESS : 0) | (dl->cfg.credits ? HANDSHAKE_CREDITS : 0),
+        accepted_checksums(dl),
+        dl->dict_crc & 0x00ff,
+        dl->dict_crc >> 8,
     };
 
-    // buffer the data and send
-    send_buffer.empty = 0;
-    send_buffer.ack_required = act_required;
-    send_buffer.header.seq_no = counter;
-    send_buffer.header.flags = FLAGS_DATA;
-    send_buffer.header.payload_len = data_length;
-    send_buffer.payload = data;
+    TRACE(dl, HANDSHAKE, 0, (flags & FLAGS_ACK) != 0);
+    unsigned int frame_len = write_data_frame(dl, &header, payload, 0);
+    STATS_ADD(dl, bytes_out, frame_len);
+}
+
+/** take the capabilities of the peer from its handshake frame */
+static void read_peer(whisper_data_layer_t dl, const uint8_t *payload, uint8_t payload_len)
+{
+    uint8_t field[LEN_HANDSHAKE];
+
+    // the fields missing from an older version are taken as not run, those of a newer one are ignored
+    memset(field, 0, sizeof(field));
+    memcpy(field, payload, payload_len < LEN_HANDSHAKE ? payload_len : LEN_HANDSHAKE);
+
+    dl->peer.max_payload_len = field[1];
+    dl->peer.credits = field[3] & HANDSHAKE_CREDITS ? field[2] : 0;
+    dl->peer.compression = (field[3] & HANDSHAKE_DECOMPRESS) && (field[5] | field[6] << 8) == dl->dict_crc;
+    dl->peer.checksums = field[4];
+    dl->peer_known = 1;
+    dl->peer_credits = field[3] & HANDSHAKE_CREDITS ? field[2] : 1;
+
+    // the best checksum both ends accept, the own configuration with a peer which tells none
+    uint8_t common = accepted_checksums(dl) & dl->peer.checksums;
+    if (common & WHISPER_DATA_LAYER__CHECKSUM_CRC32C)
+        dl->checksum_len = LEN_CRC32C;
+    else if (common & WHISPER_DATA_LAYER__CHECKSUM_CRC16)
+        dl->checksum_len = LEN_CHECKSUM;
+}
+
+/** transmit the handshake again, or give it up after the last transmission */
+static void _connect(whisper_data_layer_t dl)
+{
+    char stats_opened = stats_begin(dl);
+
+    if (dl->syncing >= MAX_RETRANSMISSIONS)
+    {
+        // the peer does not know the handshake, the link goes on with its configuration
+        TRACE(dl, HANDSHAKE, 3, 0);
+        dl->syncing = 0;
+        if (!dl->send_buffer.empty)
+            send_pending(dl);
+        stats_end(dl, stats_opened);
+        if (dl->cfg.connected_cb)
+            dl->cfg.connected_cb(dl, 0);
+        return;
+    }
+
+    ++dl->syncing;
+    send_handshake(dl, FLAGS_SEQ_RESET);
+    start_delay(dl, RETRANSMISSION_DELAY_MS, _connect);
+    stats_end(dl, stats_opened);
+}
+
+void whisper_data_layer__connect(whisper_data_layer_t dl)
+{
+    assert(dl->send_buffer.empty);
+
+    // the frames sent from now on are numbered from 1 again
+    dl->counter = 0;
+    dl->anchored = 0;
+    dl->syncing = 0;
+    _connect(dl);
+}
+
+char whisper_data_layer__peer(whisper_data_layer_t dl, struct whisper_data_layer__peer *peer)
+{
+    if (!dl->peer_known)
+        return -1;
+
+    memcpy(peer, &dl->peer, sizeof(struct whisper_data_layer__peer));
+    return 0;
+}
+
+/** answer the handshake of a peer starting over, or complete the own one */
+static void on_handshake(whisper_data_layer_t dl)
+{
+    uint8_t answer = dl->packet_header->flags & FLAGS_ACK;
+
+    if (answer && !dl->syncing)
+        // to a handshake transmitted again, which completed already
+        return;
+
+    read_peer(dl, array_buffer__at(dl->buf_recv, payload_offset(dl)), dl->packet_header->payload_len);
+    TRACE(dl, HANDSHAKE, answer ? 2 : 1, dl->peer.max_payload_len);
+
+    if (answer)
+    {
+        stop_delay(dl);
+        dl->syncing = 0;
+        // the frame sent meanwhile goes out right away
+        if (!dl->send_buffer.empty)
+            send_pending(dl);
+    }
+    else
+    {
+        // the peer started over, so did its sequence numbers, and it knows none of the own
+        dl->receive_window = 0;
+        dl->anchored = 0;
+        send_handshake(dl, FLAGS_SEQ_RESET | FLAGS_ACK);
+        if (dl->blocked && dl->peer_credits > 0)
+        {
+            dl->blocked = 0;
+            stop_delay(dl);
+            _send_data(dl);
+        }
+        if (dl->syncing)
+            // both ends connect, the own handshake is still to be answered
+            return;
+    }
+
+    if (dl->cfg.connected_cb)
+        dl->cfg.connected_cb(dl, 1);
+}
 
-    if (counter == 1)
+uint8_t whisper_data_layer__received_channel(whisper_data_layer_t dl)
+{
+    return dl->packet_header->flags >> FLAGS_CHANNEL_SHIFT;
+}
+
+/** return p^n of p in 1/65536 */
+static unsigned long power_q16(unsigned long p, unsigned int n)
+{
+    unsigned long result = 65536;
+
+    for (; n != 0; n >>= 1)
     {
-        // the counter wraps to the beginning
-        header.flags |= FLAGS_SEQ_RESET;
+        if (n & 1)
+            result = result * p >> 16;
+        p = p * p >> 16;
     }
+    return result;
+}
 
-    // send the frame
-    _send_data();
+/** return the payload length of the highest expected goodput within the configured bounds */
+static uint8_t adaptive_payload_len(whisper_data_layer_t dl)
+{
+    if (dl->sizing_failures == 0 || dl->cfg.min_payload_len >= dl->cfg.max_payload_len)
+        return dl->cfg.max_payload_len;
+
+    /*
+     * At the error rate e per byte, an attempt of n bytes, the payload L and
+     * the overhead of its frame and acknowledgement, gets through with
+     * p = (1 - e)^n and takes the time of n bytes, or times out after the
+     * time of r bytes. Per attempt, the expected goodput is then
+     * L p / (p n + (1 - p) r), which is evaluated for every L in the bounds.
+     * Without the time per byte measured, a timeout is taken to cost n.
+     */
+    unsigned long overhead = 2 * frame_overhead(dl) + sizeof(uint16_t);
+    unsigned long error = dl->sizing_failures * (65536 / SIZING_SCALE) / dl->sizing_bytes;
+    unsigned long timeout = dl->byte_time ? RETRANSMISSION_DELAY_MS * 1000UL * 256 / dl->byte_time : 0;
+    unsigned long success = error < 65536 ? 65536 - error : 0;
+    unsigned long p = power_q16(success, dl->cfg.min_payload_len + overhead);
+    unsigned long best_goodput = 0;
+    uint8_t best = dl->cfg.min_payload_len;
+    unsigned int len;
+
+    for (len = dl->cfg.min_payload_len; len <= dl->cfg.max_payload_len; len++)
+    {
+        unsigned long n = len + overhead;
+        unsigned long r = timeout > n ? timeout : n;
+        // in 1/256 bytes, which keeps the products within 32 bits for r up to 65535
+        unsigned long time = (p >> 8) * n + ((65536 - p) >> 8) * (r < 65535 ? r : 65535);
+        unsigned long goodput = time ? (len * p << 4) / time : 0;
+
+        // the longer payload on a tie, which takes fewer frames
+        if (goodput >= best_goodput)
+        {
+            best_goodput = goodput;
+            best = len;
+        }
+        p = p * success >> 16;
+    }
+    return best;
+}
 
-    return header.seq_no;
-}
\ No newline at end of file
+/** return the longest payload the peer can receive, the own receive buffer is taken to match until it tells */
+static uint8_t max_send_payload(whisper_data_layer_t dl)
+{
+    uint8_t peer_limit = dl->peer_known ? dl->peer.max_payload_len : 0;
+
+    return peer_limit ? peer_limit : max_receive_payload(dl);
+}
+
+uint8_t whisper_data_layer__payload_len(whisper_data_layer_t dl)
+{
+    uint8_t len = dl->cfg.max_payload_len ? adaptive_payload_len(dl) : UCHAR_MAX;
+
+    // no more than the peer can receive
+    if (len > max_send_payload(dl))
+        len = max_send_payload(dl);
+    return len;
+}
+
+uint16_t whisper_data_layer__data_sent(whisper_data_layer_t dl, uint8_t *data, uint8_t data_length, uint8_t act_required)
+{
+    return whisper_data_layer__channel_sent(dl, 0, data, data_length, act_required);
+}
+
+uint16_t whisper_data_layer__channel_sent(whisper_data_layer_t dl, uint8_t channel, uint8_t *data,
+                                          uint8_t data_length, uint8_t act_required)
+{
+    struct buffered_packet *send_buffer = &dl->send_buffer;
+
+    assert(channel < WHISPER_DATA_LAYER__MAX_CHANNELS);
+    if (!send_buffer->empty)
+        return 0;
+    // the peer would drop the frame in its header check, and it would be retransmitted until given up
+    if (data_length > max_send_payload(dl))
+        return 0;
+
+    // resever 0 for buffer full error
+    ++dl->counter;
+    if (dl->counter == 0)
+        ++dl->counter;
+    uint16_t seq_no = dl->counter;
+
+    // buffer the data and send
+    send_buffer->empty = 0;
+    send_buffer->ack_required = act_required;
+    send_buffer->header.seq_no = dl->counter;
+    send_buffer->header.flags = FLAGS_DATA | channel << FLAGS_CHANNEL_SHIFT;
+    send_buffer->header.payload_len = data_length;
+    send_buffer->payload = data;
+    send_buffer->num_transmissions = 0;
+    send_buffer->sent_at = dl->cfg.now_us ? dl->cfg.now_us(dl) : 0;
+
+    // compress the payload if it gets shorter, unless the peer told otherwise or is yet to tell while connecting
+    if (dl->cfg.compress_buf && data_length > WHISPER_LZ__MIN_MATCH && !dl->syncing &&
+        (!dl->peer_known || dl->peer.compression))
+    {
+        uint8_t compressed_len = whisper_lz__compress(dl->cfg.compress_dict, dl->cfg.compress_dict_len, data,
+                                                      data_length, dl->cfg.compress_buf, data_length - 1);
+        if (compressed_len > 0)
+        {
+            send_buffer->header.flags |= FLAGS_COMPRESSED;
+            send_buffer->header.payload_len = compressed_len;
+            send_buffer->payload = dl->cfg.compress_buf;
+        }
+    }
+
+    // the frame waits for the answer to the handshake
+    if (!dl->syncing)
+        send_pending(dl);
+
+    // a peer answering from within data_write clears the send buffer before the frame returns
+    return seq_no;
+}
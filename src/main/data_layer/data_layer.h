@@ -24,10 +24,41 @@
 #define DATA_LAYER_H
 
 #include <basic_data_type.h>
+#include "timer_wheel.h"
+#include "trace.h"
+#include "histogram.h"
+#include "capture.h"
+
+/** frames begin with a prefix, which is searched for byte by byte after corruption */
+#define WHISPER_DATA_LAYER__FRAMING_PREFIX 0
+/** frames are byte stuffed with COBS and end with a zero byte, which is skipped to after corruption */
+#define WHISPER_DATA_LAYER__FRAMING_COBS 1
+
+/** logical channels a data frame can be sent on, the channel is carried in its header */
+#define WHISPER_DATA_LAYER__MAX_CHANNELS 16
+
+/** checksums a link can run, as bits of whisper_data_layer__peer.checksums */
+#define WHISPER_DATA_LAYER__CHECKSUM_CRC16 0x01
+#define WHISPER_DATA_LAYER__CHECKSUM_CRC32C 0x02
+
+/** frames carry the sequence no, the flags and the payload length in a 4 byte header */
+#define WHISPER_DATA_LAYER__HEADER_FULL 0
+/** short data frames and acknowledgements carry them in 1 or 2 bytes, see the header field of the configuration */
+#define WHISPER_DATA_LAYER__HEADER_COMPACT 1
+
+/** highest address of a node on a multi-drop bus */
+#define WHISPER_DATA_LAYER__MAX_ADDRESS 127
+
+/** a link, which is the data layer of one end of a serial line */
+typedef struct whisper_data_layer *whisper_data_layer_t;
+
+extern const uint16_t SIZEOF_WHISPER_DATA_LAYER_T;
 
 /**
  * @brief configuration for the data layer
  *
+ * Every callback receives the link it is invoked for, the context of the
+ * integration can be retrieved with whisper_data_layer__ctx.
  */
 struct whisper_data_layer__config
 {
@@ -35,36 +66,311 @@ struct whisper_data_layer__config
     uint8_t *buf;
     /** length of the receive buffer */
     uint8_t buf_len;
+    /** context of the integration, opaque to the data layer */
+    void *ctx;
     /** callback for parsed packet */
-    void (*packet_received_cb)(uint8_t *payload, uint8_t payload_len);
+    void (*packet_received_cb)(whisper_data_layer_t dl, uint8_t *payload, uint8_t payload_len);
     /** function pointer for sending data out*/
-    void (*data_write)(const uint8_t *payload, uint8_t payload_len);
-    /** callback for data acknowledgement */
-    void (*data_ack_cb)(unsigned int seq_no, uint8_t sent);
-    void (*set_delay)(uint16_t delay_in_ms, void (*delay_cb)(void));
-    void (*cancel_delay)(void);
+    void (*data_write)(whisper_data_layer_t dl, const uint8_t *payload, uint8_t payload_len);
+    /** callback for the completion of a sent frame, sent is 1 if acknowledged and 0 if given up */
+    void (*data_ack_cb)(whisper_data_layer_t dl, unsigned int seq_no, uint8_t sent);
+    /** callback for a completed handshake, connected is 1 if synchronized with the peer and 0 if given up, optional */
+    void (*connected_cb)(whisper_data_layer_t dl, uint8_t connected);
+    /** schedule delay_cb to be called with the link after the delay, replacing the pending one */
+    void (*set_delay)(whisper_data_layer_t dl, uint16_t delay_in_ms, void (*delay_cb)(whisper_data_layer_t dl));
+    /** cancel the pending delay of the link */
+    void (*cancel_delay)(whisper_data_layer_t dl);
+    /** timer wheel ticking in milliseconds, replaces set_delay and cancel_delay if given */
+    whisper_timer_wheel_t timers;
+    /** trace of the link, only written if built with WHISPER_TRACE */
+    whisper_trace_t trace;
+    /** current time in microseconds, optional, wrapping around is fine */
+    unsigned long (*now_us)(whisper_data_layer_t dl);
+    /** histogram of the latency from data_sent to the acknowledgement in microseconds, requires now_us */
+    struct whisper_histogram *ack_latency;
+    /** capture of the bytes fed to and written by the link, timestamped by now_us if given, optional */
+    whisper_capture_t capture;
+    /**
+     * @brief memory of 255 bytes for compressed payloads, null to send the payloads as they are
+     *
+     * A payload is sent compressed if that makes it shorter, and is
+     * retransmitted from this memory.
+     */
+    uint8_t *compress_buf;
+    /** memory of 255 bytes to decompress payloads to before packet_received_cb, null to reject compressed frames */
+    uint8_t *decompress_buf;
+    /** sample payloads both ends compress with, optional, see lz.h */
+    const uint8_t *compress_dict;
+    /** length of the dictionary, up to WHISPER_LZ__MAX_DICT bytes */
+    uint16_t compress_dict_len;
+    /**
+     * @brief parity bytes of forward error correction per block, 0 for none
+     *
+     * With parity, the header and the rest of every frame are sent as two
+     * Reed-Solomon codewords, each correcting up to fec_parity / 2 corrupted
+     * bytes before the checksum is checked, see fec.h. A frame grows by twice
+     * fec_parity bytes, which the receive buffer must hold, so payloads are
+     * limited to its capacity less the prefix, the header, twice fec_parity
+     * and the checksum, below 247 - 2 * fec_parity bytes with CRC-16 and 2
+     * less with CRC-32C. Up to WHISPER_FEC__MAX_PARITY, both ends must agree.
+     */
+    uint8_t fec_parity;
+    /**
+     * @brief framing of the link, WHISPER_DATA_LAYER__FRAMING_PREFIX or _COBS
+     *
+     * With COBS framing, a frame loses the prefix and gains a byte per 254
+     * bytes and the delimiter, see cobs.h. The receive buffer must hold the
+     * encoded frame with its delimiter, a longer one is dropped. Both ends
+     * must agree.
+     */
+    uint8_t framing;
+    /**
+     * @brief checksum of the frames, WHISPER_DATA_LAYER__CHECKSUM_CRC16 or _CRC32C, 0 for the default of the build
+     *
+     * The default is CRC-16, or CRC-32C if built with WHISPER_CRC32C.
+     * CRC-32C takes 4 bytes rather than 2 per frame, and detects all errors
+     * of up to 5 bits in a frame rather than 3, and all but 1 in 2^32 of
+     * the others rather than 1 in 2^16. It runs on the crc32 instructions
+     * where the target has them. Both ends must agree, unless they connect:
+     * the handshake goes with CRC-16 and tells the checksums the link
+     * accepts, a link configured with CRC-32C accepts CRC-16 as well, and
+     * both ends run the best one they have in common from then on.
+     */
+    uint8_t checksum;
+    /**
+     * @brief header of the frames, WHISPER_DATA_LAYER__HEADER_FULL or _COMPACT
+     *
+     * With the compact header, a data frame on channel 0, not compressed,
+     * takes 1 header byte for payloads up to 31 bytes and 2 for longer ones
+     * rather than 4: the length and the low 2 bits of the sequence no,
+     * which the receiver completes from the latest frame it received. The
+     * sender uses it for the first transmission of a frame following an
+     * acknowledged one, anything else goes out with the full header behind
+     * an escape byte. An acknowledgement takes 1 header byte, which carries
+     * the low 5 bits of the acknowledged sequence no, followed by the
+     * credits if there are any. The full header is used with fec_parity.
+     * Both ends must agree.
+     */
+    uint8_t header;
+    /**
+     * @brief address of the node on a multi-drop bus, 1 to WHISPER_DATA_LAYER__MAX_ADDRESS, 0 for a point to point line
+     *
+     * With an address, every frame carries it in a byte behind the prefix,
+     * with the upper bit set on the frames of the node. The master runs a
+     * link per node, each with the address of its node and master set, see
+     * poll_scheduler.h. A link skips a frame of another address as soon as
+     * it has read its header, without checking it, see the filtered counter.
+     * The link of a node acknowledges a data frame before delivering it, so
+     * that an answer sent from packet_received_cb follows the acknowledgement
+     * on the bus. Both ends must agree.
+     */
+    uint8_t address;
+    /** 1 on the link of the master to the node of address, 0 on the one of the node */
+    uint8_t master;
+    /**
+     * @brief receive credits granted to the peer initially, 0 for no flow control
+     *
+     * A credit is a data frame the application can take. Every delivered
+     * frame takes one, the application returns it with
+     * whisper_data_layer__grant once it has drained the frame, and the
+     * acknowledgements advertise the credits left. A frame arriving without
+     * credits is refused rather than delivered, the peer holds the next one
+     * until credits are granted. Senders respect the credits of their peer
+     * regardless of this setting.
+     */
+    uint8_t credits;
+    /**
+     * @brief shortest payload adaptive payload sizing recommends
+     *
+     * The link measures how often its transmissions time out per byte on
+     * the line, and whisper_data_layer__payload_len recommends the payload
+     * length of the highest expected goodput at that rate, as long frames
+     * are hit by errors more often and short ones spend more on overhead.
+     * With now_us, it weighs a timeout by the time per byte measured from
+     * the acknowledgements.
+     */
+    uint8_t min_payload_len;
+    /** longest payload adaptive payload sizing recommends, 0 to disable it */
+    uint8_t max_payload_len;
 };
 
-/** intialize the data layer with provided backend buffer */
-void whisper_data_layer__init(struct whisper_data_layer__config *config);
+/** capabilities the peer announced in the latest handshake */
+struct whisper_data_layer__peer
+{
+    /** longest payload the peer can receive */
+    uint8_t max_payload_len;
+    /** receive credits the peer had left, 0 also without flow control */
+    uint8_t credits;
+    /** 1 if the peer decompresses payloads with the same dictionary */
+    uint8_t compression;
+    /** checksums the peer accepts, WHISPER_DATA_LAYER__CHECKSUM_ bits, the best one in common is run */
+    uint8_t checksums;
+};
+
+/**
+ * @brief counters of a link
+ *
+ * The counters are only maintained if the library is built with
+ * WHISPER_STATS, they wrap around on overflow.
+ */
+struct whisper_data_layer__stats
+{
+    /** bytes fed by whisper_data_layer__data_received */
+    unsigned long bytes_in;
+    /** bytes written by data_write, including the acknowledgements */
+    unsigned long bytes_out;
+    /** frames received with a valid checksum */
+    unsigned long frames_ok;
+    /** frames dropped for a checksum mismatch */
+    unsigned long crc_errors;
+    /** headers rejected for invalid flags or payload length */
+    unsigned long header_errors;
+    /** bytes skipped while searching for the next frame */
+    unsigned long resync_bytes;
+    /** frames transmitted again, as the acknowledgement did not arrive in time */
+    unsigned long retransmits;
+    /** frames given up after the last retransmission */
+    unsigned long drops;
+    /** data frames acknowledged again but not delivered, as retransmissions of delivered ones */
+    unsigned long duplicates;
+    /** bytes repaired by forward error correction */
+    unsigned long fec_corrected;
+    /** data frames refused for lack of receive credits */
+    unsigned long refused;
+    /** frames of other addresses skipped on a multi-drop bus */
+    unsigned long filtered;
+};
+
+/**
+ * @brief intialize a link with provided backend buffer
+ *
+ * @param dl memory of at least SIZEOF_WHISPER_DATA_LAYER_T bytes for the link
+ * @param config configuration of the link, copied into the link
+ */
+void whisper_data_layer__init(whisper_data_layer_t dl, struct whisper_data_layer__config *config);
+
+/** return the context of the integration, which is given in the configuration */
+void *whisper_data_layer__ctx(whisper_data_layer_t dl);
 
 /**
  * @brief feed data, which from the serial port, to the data layer
  *
+ * @param dl the link
  * @param data data from serial port
  * @param data_length the length of the passed data
  * @return char 0 success, otherwise error
  */
-char whisper_data_layer__data_received(const uint8_t *data, uint8_t data_length);
+char whisper_data_layer__data_received(whisper_data_layer_t dl, const uint8_t *data, uint8_t data_length);
+
+/**
+ * @brief synchronize with the peer in one round trip, after power-on
+ *
+ * The link starts its sequence numbers over and announces its capabilities
+ * in a handshake frame. The peer forgets the sequence numbers it received,
+ * so that none of the new ones is taken for a retransmission, and answers
+ * with its capabilities: from then on, the payloads are compressed only if
+ * the peer decompresses them with the same dictionary, and the credits of
+ * the peer apply from the first frame. Frames sent until the answer wait
+ * for it. Without an answer after 3 transmissions, from a peer that does
+ * not know the handshake, the link goes on with its configuration.
+ * A link answers handshakes whether it connects itself or not.
+ *
+ * @param dl the link, with no frame in flight
+ */
+void whisper_data_layer__connect(whisper_data_layer_t dl);
+
+/**
+ * @brief return the capabilities of the peer, once a handshake completed
+ *
+ * @param dl the link
+ * @param peer the capabilities announced by the peer
+ * @return char 0 success, otherwise no handshake completed
+ */
+char whisper_data_layer__peer(whisper_data_layer_t dl, struct whisper_data_layer__peer *peer);
 
 /**
  * @brief send data out
  *
+ * @param dl the link
  * @param data data to send
  * @param data_length the length of the data
  * @param ack_required whether the data is ack required
  * @return the sequence no of the sent packet
  */
-uint16_t whisper_data_layer__data_sent(uint8_t *data, uint8_t data_length, uint8_t ack_required);
+uint16_t whisper_data_layer__data_sent(whisper_data_layer_t dl, uint8_t *data, uint8_t data_length, uint8_t ack_required);
+
+/**
+ * @brief send data out on a logical channel
+ *
+ * The link does not schedule between the channels, it carries the channel
+ * to the peer, see mux.h for a scheduler. whisper_data_layer__data_sent
+ * sends on channel 0.
+ *
+ * @param dl the link
+ * @param channel the channel, less than WHISPER_DATA_LAYER__MAX_CHANNELS
+ * @param data data to send
+ * @param data_length the length of the data
+ * @param ack_required whether the data is ack required
+ * @return the sequence no of the sent packet, 0 if a frame is in flight or the
+ *         data is longer than the peer can receive, which is the length it
+ *         announced or else the longest payload the own receive buffer takes
+ */
+uint16_t whisper_data_layer__channel_sent(whisper_data_layer_t dl, uint8_t channel, uint8_t *data,
+                                          uint8_t data_length, uint8_t ack_required);
+
+/** return the channel of the payload being delivered, only valid within packet_received_cb */
+uint8_t whisper_data_layer__received_channel(whisper_data_layer_t dl);
+
+/**
+ * @brief return receive credits to the peer, once the application drained delivered frames
+ *
+ * If the peer was told that there are no credits left, it is sent a window
+ * update right away, otherwise the credits go with the next acknowledgement.
+ * The credits are capped at 255.
+ *
+ * @param dl the link, which has flow control configured
+ * @param credits the number of frames drained
+ */
+void whisper_data_layer__grant(whisper_data_layer_t dl, uint8_t credits);
+
+/**
+ * @brief return the payload length to send at, which maximizes the expected goodput at the measured error rate
+ *
+ * Without errors measured, this is the max_payload_len of the
+ * configuration, and never more than the peer announced it can receive in
+ * the handshake. Timeouts are taken for bit errors, so a line losing whole
+ * frames regardless of their length shortens them too. Data longer than
+ * the recommendation is up to the application to segment, see mux.h.
+ *
+ * @param dl the link
+ * @return uint8_t the payload length within the configured bounds, without adaptive payload sizing and handshake
+ * the longest payload the own receive buffer takes
+ */
+uint8_t whisper_data_layer__payload_len(whisper_data_layer_t dl);
+
+/**
+ * @brief take a consistent snapshot of the counters of the link
+ *
+ * The snapshot is lock-free and may be taken from another thread while the
+ * link is driven, it is retried if it races with an update of the counters.
+ * It must not be taken from the callbacks of the link.
+ *
+ * @param dl the link
+ * @param stats the snapshot, zeroed if the counters are compiled out
+ * @return char 0 success, otherwise the library is built without WHISPER_STATS
+ */
+char whisper_data_layer__stats(whisper_data_layer_t dl, struct whisper_data_layer__stats *stats);
+
+/**
+ * @brief take a consistent snapshot of the acknowledgement latency histogram
+ *
+ * Like whisper_data_layer__stats, the snapshot may be taken from another
+ * thread if the library is built with WHISPER_STATS.
+ *
+ * @param dl the link
+ * @param snapshot the copy of the histogram, see histogram.h for percentiles
+ * @return char 0 success, otherwise the link has no histogram configured
+ */
+char whisper_data_layer__ack_latency(whisper_data_layer_t dl, struct whisper_histogram *snapshot);
 
-#endif // DATA_LAYER_H
\ No newline at end of file
+#endif // DATA_LAYER_H
@@ -0,0 +1,240 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <string.h>
+#include "fec.h"
+
+/*
+ * Arithmetic in GF(2^8) with the primitive polynomial x^8 + x^4 + x^3 + x^2 + 1
+ * (0x11D), by tables. EXP holds alpha^i for i up to 510, so that the sum of
+ * two logarithms needs no reduction.
+ */
+static const uint8_t EXP[512] = {
+    0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1D, 0x3A, 0x74, 0xE8, 0xCD, 0x87, 0x13, 0x26,
+    0x4C, 0x98, 0x2D, 0x5A, 0xB4, 0x75, 0xEA, 0xC9, 0x8F, 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0xC0,
+    0x9D, 0x27, 0x4E, 0x9C, 0x25, 0x4A, 0x94, 0x35, 0x6A, 0xD4, 0xB5, 0x77, 0xEE, 0xC1, 0x9F, 0x23,
+    0x46, 0x8C, 0x05, 0x0A, 0x14, 0x28, 0x50, 0xA0, 0x5D, 0xBA, 0x69, 0xD2, 0xB9, 0x6F, 0xDE, 0xA1,
+    0x5F, 0xBE, 0x61, 0xC2, 0x99, 0x2F, 0x5E, 0xBC, 0x65, 0xCA, 0x89, 0x0F, 0x1E, 0x3C, 0x78, 0xF0,
+    0xFD, 0xE7, 0xD3, 0xBB, 0x6B, 0xD6, 0xB1, 0x7F, 0xFE, 0xE1, 0xDF, 0xA3, 0x5B, 0xB6, 0x71, 0xE2,
+    0xD9, 0xAF, 0x43, 0x86, 0x11, 0x22, 0x44, 0x88, 0x0D, 0x1A, 0x34, 0x68, 0xD0, 0xBD, 0x67, 0xCE,
+    0x81, 0x1F, 0x3E, 0x7C, 0xF8, 0xED, 0xC7, 0x93, 0x3B, 0x76, 0xEC, 0xC5, 0x97, 0x33, 0x66, 0xCC,
+    0x85, 0x17, 0x2E, 0x5C, 0xB8, 0x6D, 0xDA, 0xA9, 0x4F, 0x9E, 0x21, 0x42, 0x84, 0x15, 0x2A, 0x54,
+    0xA8, 0x4D, 0x9A, 0x29, 0x52, 0xA4, 0x55, 0xAA, 0x49, 0x92, 0x39, 0x72, 0xE4, 0xD5, 0xB7, 0x73,
+    0xE6, 0xD1, 0xBF, 0x63, 0xC6, 0x91, 0x3F, 0x7E, 0xFC, 0xE5, 0xD7, 0xB3, 0x7B, 0xF6, 0xF1, 0xFF,
+    0xE3, 0xDB, 0xAB, 0x4B, 0x96, 0x31, 0x62, 0xC4, 0x95, 0x37, 0x6E, 0xDC, 0xA5, 0x57, 0xAE, 0x41,
+    0x82, 0x19, 0x32, 0x64, 0xC8, 0x8D, 0x07, 0x0E, 0x1C, 0x38, 0x70, 0xE0, 0xDD, 0xA7, 0x53, 0xA6,
+    0x51, 0xA2, 0x59, 0xB2, 0x79, 0xF2, 0xF9, 0xEF, 0xC3, 0x9B, 0x2B, 0x56, 0xAC, 0x45, 0x8A, 0x09,
+    0x12, 0x24, 0x48, 0x90, 0x3D, 0x7A, 0xF4, 0xF5, 0xF7, 0xF3, 0xFB, 0xEB, 0xCB, 0x8B, 0x0B, 0x16,
+    0x2C, 0x58, 0xB0, 0x7D, 0xFA, 0xE9, 0xCF, 0x83, 0x1B, 0x36, 0x6C, 0xD8, 0xAD, 0x47, 0x8E, 0x01,
+    0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1D, 0x3A, 0x74, 0xE8, 0xCD, 0x87, 0x13, 0x26, 0x4C,
+    0x98, 0x2D, 0x5A, 0xB4, 0x75, 0xEA, 0xC9, 0x8F, 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0xC0, 0x9D,
+    0x27, 0x4E, 0x9C, 0x25, 0x4A, 0x94, 0x35, 0x6A, 0xD4, 0xB5, 0x77, 0xEE, 0xC1, 0x9F, 0x23, 0x46,
+    0x8C, 0x05, 0x0A, 0x14, 0x28, 0x50, 0xA0, 0x5D, 0xBA, 0x69, 0xD2, 0xB9, 0x6F, 0xDE, 0xA1, 0x5F,
+    0xBE, 0x61, 0xC2, 0x99, 0x2F, 0x5E, 0xBC, 0x65, 0xCA, 0x89, 0x0F, 0x1E, 0x3C, 0x78, 0xF0, 0xFD,
+    0xE7, 0xD3, 0xBB, 0x6B, 0xD6, 0xB1, 0x7F, 0xFE, 0xE1, 0xDF, 0xA3, 0x5B, 0xB6, 0x71, 0xE2, 0xD9,
+    0xAF, 0x43, 0x86, 0x11, 0x22, 0x44, 0x88, 0x0D, 0x1A, 0x34, 0x68, 0xD0, 0xBD, 0x67, 0xCE, 0x81,
+    0x1F, 0x3E, 0x7C, 0xF8, 0xED, 0xC7, 0x93, 0x3B, 0x76, 0xEC, 0xC5, 0x97, 0x33, 0x66, 0xCC, 0x85,
+    0x17, 0x2E, 0x5C, 0xB8, 0x6D, 0xDA, 0xA9, 0x4F, 0x9E, 0x21, 0x42, 0x84, 0x15, 0x2A, 0x54, 0xA8,
+    0x4D, 0x9A, 0x29, 0x52, 0xA4, 0x55, 0xAA, 0x49, 0x92, 0x39, 0x72, 0xE4, 0xD5, 0xB7, 0x73, 0xE6,
+    0xD1, 0xBF, 0x63, 0xC6, 0x91, 0x3F, 0x7E, 0xFC, 0xE5, 0xD7, 0xB3, 0x7B, 0xF6, 0xF1, 0xFF, 0xE3,
+    0xDB, 0xAB, 0x4B, 0x96, 0x31, 0x62, 0xC4, 0x95, 0x37, 0x6E, 0xDC, 0xA5, 0x57, 0xAE, 0x41, 0x82,
+    0x19, 0x32, 0x64, 0xC8, 0x8D, 0x07, 0x0E, 0x1C, 0x38, 0x70, 0xE0, 0xDD, 0xA7, 0x53, 0xA6, 0x51,
+    0xA2, 0x59, 0xB2, 0x79, 0xF2, 0xF9, 0xEF, 0xC3, 0x9B, 0x2B, 0x56, 0xAC, 0x45, 0x8A, 0x09, 0x12,
+    0x24, 0x48, 0x90, 0x3D, 0x7A, 0xF4, 0xF5, 0xF7, 0xF3, 0xFB, 0xEB, 0xCB, 0x8B, 0x0B, 0x16, 0x2C,
+    0x58, 0xB0, 0x7D, 0xFA, 0xE9, 0xCF, 0x83, 0x1B, 0x36, 0x6C, 0xD8, 0xAD, 0x47, 0x8E, 0x01, 0x02,
+};
+
+static const uint8_t LOG[256] = {
+    0x00, 0x00, 0x01, 0x19, 0x02, 0x32, 0x1A, 0xC6, 0x03, 0xDF, 0x33, 0xEE, 0x1B, 0x68, 0xC7, 0x4B,
+    0x04, 0x64, 0xE0, 0x0E, 0x34, 0x8D, 0xEF, 0x81, 0x1C, 0xC1, 0x69, 0xF8, 0xC8, 0x08, 0x4C, 0x71,
+    0x05, 0x8A, 0x65, 0x2F, 0xE1, 0x24, 0x0F, 0x21, 0x35, 0x93, 0x8E, 0xDA, 0xF0, 0x12, 0x82, 0x45,
+    0x1D, 0xB5, 0xC2, 0x7D, 0x6A, 0x27, 0xF9, 0xB9, 0xC9, 0x9A, 0x09, 0x78, 0x4D, 0xE4, 0x72, 0xA6,
+    0x06, 0xBF, 0x8B, 0x62, 0x66, 0xDD, 0x30, 0xFD, 0xE2, 0x98, 0x25, 0xB3, 0x10, 0x91, 0x22, 0x88,
+    0x36, 0xD0, 0x94, 0xCE, 0x8F, 0x96, 0xDB, 0xBD, 0xF1, 0xD2, 0x13, 0x5C, 0x83, 0x38, 0x46, 0x40,
+    0x1E, 0x42, 0xB6, 0xA3, 0xC3, 0x48, 0x7E, 0x6E, 0x6B, 0x3A, 0x28, 0x54, 0xFA, 0x85, 0xBA, 0x3D,
+    0xCA, 0x5E, 0x9B, 0x9F, 0x0A, 0x15, 0x79, 0x2B, 0x4E, 0xD4, 0xE5, 0xAC, 0x73, 0xF3, 0xA7, 0x57,
+    0x07, 0x70, 0xC0, 0xF7, 0x8C, 0x80, 0x63, 0x0D, 0x67, 0x4A, 0xDE, 0xED, 0x31, 0xC5, 0xFE, 0x18,
+    0xE3, 0xA5, 0x99, 0x77, 0x26, 0xB8, 0xB4, 0x7C, 0x11, 0x44, 0x92, 0xD9, 0x23, 0x20, 0x89, 0x2E,
+    0x37, 0x3F, 0xD1, 0x5B, 0x95, 0xBC, 0xCF, 0xCD, 0x90, 0x87, 0x97, 0xB2, 0xDC, 0xFC, 0xBE, 0x61,
+    0xF2, 0x56, 0xD3, 0xAB, 0x14, 0x2A, 0x5D, 0x9E, 0x84, 0x3C, 0x39, 0x53, 0x47, 0x6D, 0x41, 0xA2,
+    0x1F, 0x2D, 0x43, 0xD8, 0xB7, 0x7B, 0xA4, 0x76, 0xC4, 0x17, 0x49, 0xEC, 0x7F, 0x0C, 0x6F, 0xF6,
+    0x6C, 0xA1, 0x3B, 0x52, 0x29, 0x9D, 0x55, 0xAA, 0xFB, 0x60, 0x86, 0xB1, 0xBB, 0xCC, 0x3E, 0x5A,
+    0xCB, 0x59, 0x5F, 0xB0, 0x9C, 0xA9, 0xA0, 0x51, 0x0B, 0xF5, 0x16, 0xEB, 0x7A, 0x75, 0x2C, 0xD7,
+    0x4F, 0xAE, 0xD5, 0xE9, 0xE6, 0xE7, 0xAD, 0xE8, 0x74, 0xD6, 0xF4, 0xEA, 0xA8, 0x50, 0x58, 0xAF,
+};
+
+static uint8_t mul(uint8_t a, uint8_t b)
+{
+    return a && b ? EXP[LOG[a] + LOG[b]] : 0;
+}
+
+static uint8_t div(uint8_t a, uint8_t b)
+{
+    return a ? EXP[LOG[a] + 255 - LOG[b]] : 0;
+}
+
+/** alpha to the power of -i */
+static uint8_t alpha_inverse(uint8_t i)
+{
+    return EXP[255 - i];
+}
+
+void whisper_fec__generator(uint8_t *generator, uint8_t parity_len)
+{
+    uint8_t i;
+    uint8_t j;
+
+    // the product of (x - alpha^i) for i below parity_len, highest degree first
+    memset(generator, 0, parity_len + 1);
+    generator[0] = 1;
+    for (i = 0; i < parity_len; i++)
+        for (j = i + 1; j > 0; j--)
+            generator[j] ^= mul(generator[j - 1], EXP[i]);
+}
+
+void whisper_fec__encode(const uint8_t *generator, uint8_t parity_len, const uint8_t *data, uint8_t data_len,
+                         uint8_t *parity)
+{
+    uint8_t i;
+
+    // divide by the generator as the data goes by, the parity is the remainder
+    while (data_len--)
+    {
+        uint8_t feedback = *data++ ^ parity[0];
+
+        for (i = 0; i + 1 < parity_len; i++)
+            parity[i] = parity[i + 1] ^ mul(generator[i + 1], feedback);
+        parity[parity_len - 1] = mul(generator[parity_len], feedback);
+    }
+}
+
+int whisper_fec__decode(uint8_t *codeword, uint8_t len, uint8_t parity_len)
+{
+    // polynomials in ascending order from here on
+    uint8_t syndromes[WHISPER_FEC__MAX_PARITY];
+    uint8_t locator[WHISPER_FEC__MAX_PARITY + 1];
+    uint8_t previous[WHISPER_FEC__MAX_PARITY + 1];
+    uint8_t saved[WHISPER_FEC__MAX_PARITY + 1];
+    uint8_t evaluator[WHISPER_FEC__MAX_PARITY];
+    uint8_t positions[WHISPER_FEC__MAX_PARITY / 2];
+    uint8_t previous_discrepancy = 1;
+    uint8_t any = 0;
+    int num_errors = 0;
+    int num_found = 0;
+    int shift = 1;
+    int i;
+    int j;
+
+    // the codeword evaluated at the roots of the generator, all 0 if it is intact
+    for (i = 0; i < parity_len; i++)
+    {
+        uint8_t value = 0;
+
+        for (j = 0; j < len; j++)
+            value = mul(value, EXP[i]) ^ codeword[j];
+        syndromes[i] = value;
+        any |= value;
+    }
+    if (!any)
+        return 0;
+
+    // Berlekamp-Massey, the roots of the error locator are the inverses of the error positions
+    memset(locator, 0, sizeof(locator));
+    memset(previous, 0, sizeof(previous));
+    locator[0] = 1;
+    previous[0] = 1;
+    for (i = 0; i < parity_len; i++)
+    {
+        uint8_t discrepancy = syndromes[i];
+        uint8_t scale;
+
+        for (j = 1; j <= num_errors; j++)
+            discrepancy ^= mul(locator[j], syndromes[i - j]);
+        if (discrepancy == 0)
+        {
+            ++shift;
+            continue;
+        }
+
+        scale = div(discrepancy, previous_discrepancy);
+        memcpy(saved, locator, sizeof(saved));
+        for (j = shift; j <= parity_len; j++)
+            locator[j] ^= mul(scale, previous[j - shift]);
+
+        if (2 * num_errors <= i)
+        {
+            num_errors = i + 1 - num_errors;
+            memcpy(previous, saved, sizeof(previous));
+            previous_discrepancy = discrepancy;
+            shift = 1;
+        }
+        else
+            ++shift;
+    }
+    if (2 * num_errors > parity_len)
+        return -1;
+
+    // Chien search, the byte at index k of the codeword has the position len - 1 - k
+    for (i = 0; i < len; i++)
+    {
+        uint8_t value = 0;
+
+        for (j = num_errors; j >= 0; j--)
+            value = mul(value, alpha_inverse(i)) ^ locator[j];
+        if (value == 0)
+        {
+            if (num_found == num_errors)
+                return -1;
+            positions[num_found++] = i;
+        }
+    }
+    // fewer roots than the degree, more errors than the parity can locate
+    if (num_found != num_errors)
+        return -1;
+
+    // Forney, with the evaluator the syndromes times the locator up to the degree of the parity
+    for (i = 0; i < parity_len; i++)
+    {
+        evaluator[i] = 0;
+        for (j = 0; j <= i && j <= num_errors; j++)
+            evaluator[i] ^= mul(syndromes[i - j], locator[j]);
+    }
+
+    for (i = 0; i < num_errors; i++)
+    {
+        uint8_t inverse = alpha_inverse(positions[i]);
+        uint8_t numerator = 0;
+        uint8_t derivative = 0;
+
+        for (j = parity_len - 1; j >= 0; j--)
+            numerator = mul(numerator, inverse) ^ evaluator[j];
+        // the formal derivative of the locator keeps its odd terms
+        for (j = num_errors | 1; j >= 1; j -= 2)
+            derivative = mul(derivative, mul(inverse, inverse)) ^ locator[j];
+        if (derivative == 0)
+            return -1;
+
+        codeword[len - 1 - positions[i]] ^= mul(EXP[positions[i]], div(numerator, derivative));
+    }
+
+    return num_errors;
+}
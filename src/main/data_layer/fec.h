@@ -0,0 +1,76 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef FEC_H
+#define FEC_H
+
+#include "basic_data_type.h"
+
+/*
+ * Reed-Solomon forward error correction over GF(2^8), for noisy links on
+ * which a retransmission for every flipped bit costs more than a few extra
+ * bytes on every frame.
+ *
+ * A block of data followed by parity_len bytes of parity is a codeword of up
+ * to 255 bytes, in which any parity_len / 2 corrupted bytes are corrected,
+ * however many bits of each are flipped, so that a short burst costs no more
+ * than a single bit error. Encoding and decoding go by tables and take no
+ * memory but a few arrays of WHISPER_FEC__MAX_PARITY bytes on the stack.
+ */
+
+/** most parity bytes per codeword, correcting up to half as many bytes */
+#define WHISPER_FEC__MAX_PARITY 16
+
+/**
+ * @brief compute the generator polynomial of the code
+ *
+ * @param generator parity_len + 1 bytes for the polynomial
+ * @param parity_len the number of parity bytes, up to WHISPER_FEC__MAX_PARITY
+ */
+void whisper_fec__generator(uint8_t *generator, uint8_t parity_len);
+
+/**
+ * @brief compute the parity of data
+ *
+ * The data may come in pieces, the parity is updated with each one. It must
+ * be zeroed before the first piece.
+ *
+ * @param generator the generator polynomial of the code
+ * @param parity_len the number of parity bytes
+ * @param data the next piece of the data
+ * @param data_len the length of the piece
+ * @param parity parity_len bytes of parity to update
+ */
+void whisper_fec__encode(const uint8_t *generator, uint8_t parity_len, const uint8_t *data, uint8_t data_len,
+                         uint8_t *parity);
+
+/**
+ * @brief correct a codeword in place
+ *
+ * @param codeword the data followed by its parity
+ * @param len the length of the codeword including the parity, up to 255
+ * @param parity_len the number of parity bytes
+ * @return int the number of corrected bytes, -1 if there are more errors than the code corrects
+ */
+int whisper_fec__decode(uint8_t *codeword, uint8_t len, uint8_t parity_len);
+
+#endif // FEC_H
@@ -0,0 +1,134 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "histogram.h"
+#include <string.h>
+
+#define SUB_BUCKETS (1UL << WHISPER_HISTOGRAM__SUB_BITS)
+#define MAX_VALUE 0xFFFFFFFFUL
+
+static unsigned int highest_bit(unsigned long value)
+{
+#if defined(__GNUC__)
+    return sizeof(unsigned long) * 8 - 1 - __builtin_clzl(value);
+#else
+    unsigned int n = 0;
+    while (value >>= 1)
+        ++n;
+    return n;
+#endif
+}
+
+static unsigned int bucket_of(unsigned long value)
+{
+    unsigned int shift;
+
+    if (value < SUB_BUCKETS)
+        return value;
+
+    // the highest bits of the value, which are between SUB_BUCKETS and 2 * SUB_BUCKETS
+    shift = highest_bit(value) - WHISPER_HISTOGRAM__SUB_BITS;
+    return (shift << WHISPER_HISTOGRAM__SUB_BITS) + (value >> shift);
+}
+
+void whisper_histogram__init(struct whisper_histogram *histogram)
+{
+    memset(histogram, 0, sizeof(struct whisper_histogram));
+}
+
+void whisper_histogram__record(struct whisper_histogram *histogram, unsigned long value)
+{
+    if (value > MAX_VALUE)
+        value = MAX_VALUE;
+
+    if (histogram->count == 0 || value < histogram->min)
+        histogram->min = value;
+    if (value > histogram->max)
+        histogram->max = value;
+    ++histogram->count;
+    histogram->sum += value;
+    ++histogram->buckets[bucket_of(value)];
+}
+
+unsigned long whisper_histogram__bucket_low(unsigned int bucket)
+{
+    unsigned int shift;
+
+    if (bucket < SUB_BUCKETS)
+        return bucket;
+
+    shift = (bucket >> WHISPER_HISTOGRAM__SUB_BITS) - 1;
+    return (SUB_BUCKETS + (bucket & (SUB_BUCKETS - 1))) << shift;
+}
+
+unsigned long whisper_histogram__bucket_high(unsigned int bucket)
+{
+    if (bucket < SUB_BUCKETS)
+        return bucket;
+
+    return whisper_histogram__bucket_low(bucket) + (1UL << ((bucket >> WHISPER_HISTOGRAM__SUB_BITS) - 1)) - 1;
+}
+
+unsigned long whisper_histogram__percentile(const struct whisper_histogram *histogram, unsigned long ppm)
+{
+    unsigned long long rank;
+    unsigned long long seen = 0;
+    unsigned int bucket;
+
+    if (histogram->count == 0)
+        return 0;
+
+    // the rank of the value in the percentile, counting from 1
+    rank = ((unsigned long long)histogram->count * ppm + 999999) / 1000000;
+    if (rank == 0)
+        rank = 1;
+
+    for (bucket = 0; bucket < WHISPER_HISTOGRAM__NUM_BUCKETS; bucket++)
+    {
+        seen += histogram->buckets[bucket];
+        if (seen >= rank)
+        {
+            // the bucket may extend over the values seen
+            unsigned long high = whisper_histogram__bucket_high(bucket);
+            return high < histogram->max ? high : histogram->max;
+        }
+    }
+
+    return histogram->max;
+}
+
+void whisper_histogram__merge(struct whisper_histogram *into, const struct whisper_histogram *from)
+{
+    unsigned int bucket;
+
+    if (from->count == 0)
+        return;
+
+    if (into->count == 0 || from->min < into->min)
+        into->min = from->min;
+    if (from->max > into->max)
+        into->max = from->max;
+    into->count += from->count;
+    into->sum += from->sum;
+    for (bucket = 0; bucket < WHISPER_HISTOGRAM__NUM_BUCKETS; bucket++)
+        into->buckets[bucket] += from->buckets[bucket];
+}
@@ -0,0 +1,74 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include "basic_data_type.h"
+
+/*
+ * Log-linear histogram, in the manner of HdrHistogram.
+ *
+ * Values below 2^WHISPER_HISTOGRAM__SUB_BITS are counted exactly, every
+ * power of 2 above is split into 2^WHISPER_HISTOGRAM__SUB_BITS buckets, so a
+ * value is known within 1/16 of it. Recording is a few shifts and an
+ * increment, values up to 2^32 - 1 are covered, larger ones are clamped.
+ */
+
+#define WHISPER_HISTOGRAM__SUB_BITS 4
+#define WHISPER_HISTOGRAM__NUM_BUCKETS ((33 - WHISPER_HISTOGRAM__SUB_BITS) << WHISPER_HISTOGRAM__SUB_BITS)
+
+struct whisper_histogram
+{
+    unsigned long count;
+    unsigned long min;
+    unsigned long max;
+    /** sum of the values, for the mean */
+    unsigned long long sum;
+    unsigned long buckets[WHISPER_HISTOGRAM__NUM_BUCKETS];
+};
+
+/** reset the histogram to no values */
+void whisper_histogram__init(struct whisper_histogram *histogram);
+
+/** count a value */
+void whisper_histogram__record(struct whisper_histogram *histogram, unsigned long value);
+
+/**
+ * @brief Query a percentile.
+ *
+ * @param histogram the histogram
+ * @param ppm the percentile in parts per million, e.g. 999000 for p99.9
+ * @return the highest value of the bucket, the percentile falls into, 0 if the histogram is empty
+ */
+unsigned long whisper_histogram__percentile(const struct whisper_histogram *histogram, unsigned long ppm);
+
+/** return the lowest value counted in the bucket */
+unsigned long whisper_histogram__bucket_low(unsigned int bucket);
+
+/** return the highest value counted in the bucket */
+unsigned long whisper_histogram__bucket_high(unsigned int bucket);
+
+/** add the values of one histogram to another, e.g. to aggregate links */
+void whisper_histogram__merge(struct whisper_histogram *into, const struct whisper_histogram *from);
+
+#endif // HISTOGRAM_H
@@ -0,0 +1,173 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <string.h>
+#include "lz.h"
+
+// lengths up to MIN_MATCH + 14 fit into the match, longer ones take another byte
+#define LONG_LEN 15
+#define MAX_MATCH (WHISPER_LZ__MIN_MATCH + LONG_LEN + 255)
+
+/** the window of the compressor, the dictionary followed by the payload */
+struct window
+{
+    const uint8_t *dict;
+    uint16_t dict_len;
+    const uint8_t *in;
+};
+
+static uint8_t at(const struct window *window, uint16_t pos)
+{
+    return pos < window->dict_len ? window->dict[pos] : window->in[pos - window->dict_len];
+}
+
+static uint8_t hash(const struct window *window, uint16_t pos)
+{
+    unsigned long key = (unsigned long)at(window, pos) << 16 | at(window, pos + 1) << 8 | at(window, pos + 2);
+    return (key * 0x9E3779B1UL >> 16) & (WHISPER_LZ__HASH_LEN - 1);
+}
+
+uint8_t whisper_lz__compress(const uint8_t *dict, uint16_t dict_len, const uint8_t *in, uint8_t in_len,
+                             uint8_t *out, uint8_t out_max)
+{
+    const struct window window = {dict, dict_len, in};
+    // the position + 1 in the window of the latest occurrence of a hash, 0 for none
+    uint16_t recent[WHISPER_LZ__HASH_LEN];
+    uint16_t end = dict_len + in_len;
+    uint16_t pos;
+    uint16_t out_len = 0;
+    uint16_t control = 0;
+    uint8_t items = 8;
+
+    memset(recent, 0, sizeof(recent));
+    for (pos = 0; pos + WHISPER_LZ__MIN_MATCH <= dict_len; pos++)
+        recent[hash(&window, pos)] = pos + 1;
+
+    pos = dict_len;
+    while (pos < end)
+    {
+        uint16_t match_len = 0;
+        uint16_t distance = 0;
+
+        // a new group with a control byte every 8 items
+        if (items == 8)
+        {
+            if (out_len >= out_max)
+                return 0;
+            control = out_len++;
+            out[control] = 0;
+            items = 0;
+        }
+
+        if (pos + WHISPER_LZ__MIN_MATCH <= end)
+        {
+            uint8_t h = hash(&window, pos);
+
+            if (recent[h] && pos - (recent[h] - 1) <= WHISPER_LZ__MAX_DISTANCE)
+            {
+                uint16_t match_pos = recent[h] - 1;
+                uint16_t limit = end - pos < MAX_MATCH ? end - pos : MAX_MATCH;
+
+                while (match_len < limit && at(&window, match_pos + match_len) == at(&window, pos + match_len))
+                    ++match_len;
+                distance = pos - match_pos;
+            }
+            recent[h] = pos + 1;
+        }
+
+        if (match_len >= WHISPER_LZ__MIN_MATCH)
+        {
+            uint16_t len = match_len - WHISPER_LZ__MIN_MATCH;
+
+            if (out_len + (len < LONG_LEN ? 2 : 3) > out_max)
+                return 0;
+            out[control] |= 1 << items;
+            out[out_len++] = (len < LONG_LEN ? len : LONG_LEN) << 4 | (distance - 1) >> 8;
+            out[out_len++] = distance - 1;
+            if (len >= LONG_LEN)
+                out[out_len++] = len - LONG_LEN;
+
+            // remember the positions inside the match too, for the matches to come
+            for (++pos, --match_len; match_len > 0; ++pos, --match_len)
+                if (pos + WHISPER_LZ__MIN_MATCH <= end)
+                    recent[hash(&window, pos)] = pos + 1;
+        }
+        else
+        {
+            if (out_len + 1 > out_max)
+                return 0;
+            out[out_len++] = at(&window, pos++);
+        }
+        ++items;
+    }
+
+    return out_len;
+}
+
+int whisper_lz__decompress(const uint8_t *dict, uint16_t dict_len, const uint8_t *in, uint8_t in_len,
+                           uint8_t *out, uint8_t out_max)
+{
+    uint16_t pos = 0;
+    uint16_t out_len = 0;
+
+    while (pos < in_len)
+    {
+        uint8_t control = in[pos++];
+        uint8_t item;
+
+        for (item = 0; item < 8 && pos < in_len; item++)
+        {
+            if (control & (1 << item))
+            {
+                uint16_t distance;
+                uint16_t len;
+
+                if (pos + 2 > in_len)
+                    return -1;
+                len = in[pos] >> 4;
+                distance = ((in[pos] & 0x0F) << 8 | in[pos + 1]) + 1;
+                pos += 2;
+                if (len == LONG_LEN)
+                {
+                    if (pos >= in_len)
+                        return -1;
+                    len += in[pos++];
+                }
+                len += WHISPER_LZ__MIN_MATCH;
+                if (distance > out_len + dict_len || out_len + len > out_max)
+                    return -1;
+
+                // byte by byte, the match may overlap its own output
+                for (; len > 0; --len, ++out_len)
+                    out[out_len] = distance > out_len ? dict[dict_len - (distance - out_len)] : out[out_len - distance];
+            }
+            else
+            {
+                if (out_len >= out_max)
+                    return -1;
+                out[out_len++] = in[pos++];
+            }
+        }
+    }
+
+    return out_len;
+}
@@ -0,0 +1,87 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef LZ_H
+#define LZ_H
+
+#include "basic_data_type.h"
+
+/*
+ * LZ77 compression of payloads, for slow links on which the bytes on the
+ * wire set the message rate.
+ *
+ * The window is the payload itself, preceded by an optional dictionary of
+ * sample payloads, which both ends must agree on. A single short payload
+ * rarely repeats itself, the dictionary lets it refer to the phrases common
+ * to all payloads, such as the keys of a configuration or the fixed text of
+ * log lines. Compression takes no memory but a table of WHISPER_LZ__HASH_LEN
+ * positions on the stack, decompression none but the output.
+ *
+ * The compressed stream is a sequence of groups, each one a control byte
+ * followed by up to 8 items, a literal byte for a 0 bit of the control byte
+ * or a match for a 1 bit, least significant bit first. A match is 2 bytes,
+ * the length minus WHISPER_LZ__MIN_MATCH in the upper 4 bits and the
+ * distance back minus 1 in the lower 12 bits. A length field of 15 is
+ * followed by a byte with the rest of the length.
+ */
+
+/** shortest match encoded, a shorter one takes no fewer bytes than its literals */
+#define WHISPER_LZ__MIN_MATCH 3
+
+/** farthest a match reaches back, into the payload and the dictionary */
+#define WHISPER_LZ__MAX_DISTANCE 4096
+
+/** longest dictionary of which all bytes can be referred to */
+#define WHISPER_LZ__MAX_DICT (WHISPER_LZ__MAX_DISTANCE - 255)
+
+/** entries of the table of recent positions the compressor keeps on the stack */
+#define WHISPER_LZ__HASH_LEN 128
+
+/**
+ * @brief compress a payload
+ *
+ * @param dict the dictionary, null for none
+ * @param dict_len the length of the dictionary
+ * @param in the payload
+ * @param in_len the length of the payload
+ * @param out the buffer for the compressed payload
+ * @param out_max the most bytes to write, compression is given up beyond
+ * @return uint8_t the length of the compressed payload, 0 if it does not fit out_max
+ */
+uint8_t whisper_lz__compress(const uint8_t *dict, uint16_t dict_len, const uint8_t *in, uint8_t in_len,
+                             uint8_t *out, uint8_t out_max);
+
+/**
+ * @brief decompress a payload
+ *
+ * @param dict the dictionary the payload was compressed with, null for none
+ * @param dict_len the length of the dictionary
+ * @param in the compressed payload
+ * @param in_len the length of the compressed payload
+ * @param out the buffer for the payload
+ * @param out_max the length of the buffer
+ * @return int the length of the payload, -1 if the compressed payload is corrupt or does not fit
+ */
+int whisper_lz__decompress(const uint8_t *dict, uint16_t dict_len, const uint8_t *in, uint8_t in_len,
+                           uint8_t *out, uint8_t out_max);
+
+#endif // LZ_H
@@ -0,0 +1,224 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <limits.h>
+#include "mux.h"
+
+// the cost of a byte in virtual time, divided by the weight of the channel
+#define WEIGHT_SCALE 256
+
+struct whisper_mux
+{
+    struct whisper_mux__channel *channels;
+    uint8_t num_channels;
+    uint8_t scheduling;
+    // sequence no of the fragment in flight, 0 if none, its channel and length
+    uint16_t in_flight;
+    uint8_t in_flight_channel;
+    uint8_t in_flight_len;
+    // set while a fragment is handed to the link, which may complete it before it returns
+    uint8_t framing;
+    uint16_t completed;
+    uint8_t completed_sent;
+    // virtual time of weighted scheduling, the pass of the channel picked last
+    unsigned long pass;
+};
+
+const uint16_t SIZEOF_WHISPER_MUX_T = sizeof(struct whisper_mux);
+
+/** return 1 if the pass a is before b, passes wrap around */
+static char before(unsigned long a, unsigned long b)
+{
+    return (long)(a - b) < 0;
+}
+
+char whisper_mux__init(whisper_mux_t mux, struct whisper_mux__channel *channels, uint8_t num_channels,
+                       uint8_t scheduling)
+{
+    uint8_t i;
+
+    if (num_channels == 0 || num_channels > WHISPER_DATA_LAYER__MAX_CHANNELS || scheduling > WHISPER_MUX__WEIGHTED)
+        return -1;
+    for (i = 0; i < num_channels; i++)
+        if (!channels[i].queue || channels[i].capacity == 0)
+            return -1;
+
+    mux->channels = channels;
+    mux->num_channels = num_channels;
+    mux->scheduling = scheduling;
+    mux->in_flight = 0;
+    mux->framing = 0;
+    mux->completed = 0;
+    mux->pass = 0;
+    for (i = 0; i < num_channels; i++)
+    {
+        channels[i].head = 0;
+        channels[i].count = 0;
+        channels[i].offset = 0;
+        channels[i].pass = 0;
+    }
+    return 0;
+}
+
+char whisper_mux__submit(whisper_mux_t mux, uint8_t channel, const uint8_t *data, uint16_t data_length,
+                         uint8_t ack_required)
+{
+    struct whisper_mux__channel *ch;
+    struct whisper_mux__message *message;
+
+    if (channel >= mux->num_channels || mux->channels[channel].count == mux->channels[channel].capacity)
+        return -1;
+
+    ch = &mux->channels[channel];
+    // a channel idle until now does not catch up on the line time it did not use
+    if (ch->count == 0 && before(ch->pass, mux->pass))
+        ch->pass = mux->pass;
+
+    message = &ch->queue[(ch->head + ch->count) % ch->capacity];
+    message->data = data;
+    message->len = data_length;
+    message->ack_required = ack_required;
+    ++ch->count;
+    return 0;
+}
+
+/** return the channel to send the next fragment of, -1 if none has a message waiting */
+static int pick(whisper_mux_t mux)
+{
+    int best = -1;
+    uint8_t i;
+
+    for (i = 0; i < mux->num_channels; i++)
+    {
+        if (mux->channels[i].count == 0)
+            continue;
+        if (mux->scheduling == WHISPER_MUX__STRICT)
+            return i;
+        if (best < 0 || before(mux->channels[i].pass, mux->channels[best].pass))
+            best = i;
+    }
+    return best;
+}
+
+/** release the fragment in flight, and its message once done */
+static void release(whisper_mux_t mux, whisper_data_layer_t dl, uint8_t sent)
+{
+    struct whisper_mux__channel *ch;
+    struct whisper_mux__message *message;
+
+    mux->in_flight = 0;
+    ch = &mux->channels[mux->in_flight_channel];
+    message = &ch->queue[ch->head];
+    ch->offset += mux->in_flight_len;
+
+    if (!sent || ch->offset >= message->len)
+    {
+        // the message is done, a fragment given up fails the rest of it
+        const uint8_t *data = message->data;
+        uint16_t data_length = message->len;
+
+        ch->head = (ch->head + 1) % ch->capacity;
+        --ch->count;
+        ch->offset = 0;
+        if (ch->sent_cb)
+            ch->sent_cb(dl, mux->in_flight_channel, data, data_length, sent);
+    }
+}
+
+uint16_t whisper_mux__drain(whisper_mux_t mux, whisper_data_layer_t dl)
+{
+    int channel;
+    uint16_t last = 0;
+
+    while (!mux->in_flight && !mux->framing && (channel = pick(mux)) >= 0)
+    {
+        struct whisper_mux__channel *ch = &mux->channels[channel];
+        struct whisper_mux__message *message = &ch->queue[ch->head];
+        uint8_t fragment_len = ch->fragment_len ? ch->fragment_len : UCHAR_MAX;
+        // the rest of the message is cut at the length the link currently recommends
+        uint8_t recommended = whisper_data_layer__payload_len(dl);
+        uint16_t seq_no;
+
+        if (recommended < fragment_len)
+            fragment_len = recommended;
+        if (message->len - ch->offset < fragment_len)
+            fragment_len = message->len - ch->offset;
+
+        // the link only reads the payload, it is retransmitted from the message
+        mux->framing = 1;
+        mux->completed = 0;
+        seq_no = whisper_data_layer__channel_sent(dl, channel, (uint8_t *)&message->data[ch->offset], fragment_len,
+                                                  message->ack_required);
+        mux->framing = 0;
+        if (seq_no == 0)
+            // a frame sent around the multiplexer is in flight
+            break;
+
+        mux->in_flight_channel = channel;
+        mux->in_flight_len = fragment_len;
+
+        // the channel is due again once the others had their share, an empty fragment counts as a byte
+        mux->pass = ch->pass;
+        ch->pass += (unsigned long)(fragment_len ? fragment_len : 1) * WEIGHT_SCALE / (ch->weight ? ch->weight : 1);
+
+        last = seq_no;
+        // a peer answering from within data_write completes the fragment before the link returns
+        if (mux->completed != seq_no)
+            mux->in_flight = seq_no;
+        else
+            release(mux, dl, mux->completed_sent);
+    }
+    return last;
+}
+
+uint16_t whisper_mux__complete(whisper_mux_t mux, whisper_data_layer_t dl, unsigned int seq_no, uint8_t sent)
+{
+    // the fragment being sent, released by drain once the link returns its sequence no
+    if (mux->framing)
+    {
+        mux->completed = seq_no;
+        mux->completed_sent = sent;
+        return 0;
+    }
+
+    if (!mux->in_flight || mux->in_flight != seq_no)
+        return 0;
+
+    release(mux, dl, sent);
+    return whisper_mux__drain(mux, dl);
+}
+
+void whisper_mux__received(whisper_mux_t mux, whisper_data_layer_t dl, uint8_t *payload, uint8_t payload_len)
+{
+    uint8_t channel = whisper_data_layer__received_channel(dl);
+
+    // the peer may run more channels, theirs are dropped
+    if (channel >= mux->num_channels || !mux->channels[channel].received_cb)
+        return;
+
+    mux->channels[channel].received_cb(dl, channel, payload, payload_len);
+}
+
+uint8_t whisper_mux__count(whisper_mux_t mux, uint8_t channel)
+{
+    return channel < mux->num_channels ? mux->channels[channel].count : 0;
+}
@@ -0,0 +1,139 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef MUX_H
+#define MUX_H
+
+#include "basic_data_type.h"
+#include "data_layer.h"
+
+/*
+ * Logical channels multiplexed over the transmitter of a link.
+ *
+ * Every channel has a queue of messages of its own, which are sent in
+ * fragments of a frame each, carrying the channel in their header. Whenever
+ * the frame in flight completes, the next fragment is picked among the
+ * channels, so that a message on an urgent channel waits for the fragment
+ * in flight at most, not for the messages queued on the other channels.
+ * A fragment is cut when it is sent, so the rest of a message follows the
+ * payload length the link recommends at that time, see
+ * whisper_data_layer__payload_len.
+ *
+ * The receiving end delivers the fragments to the callback of their channel
+ * as they arrive, their reassembly is up to the application. Like the link,
+ * the multiplexer is driven by the owner of the link only.
+ */
+
+/** the channel of the lowest number with a message waiting goes first */
+#define WHISPER_MUX__STRICT 0
+/** the channels with messages waiting share the line in proportion to their weights */
+#define WHISPER_MUX__WEIGHTED 1
+
+/** a message queued on a channel, the data must stay intact until it is completed */
+struct whisper_mux__message
+{
+    const uint8_t *data;
+    uint16_t len;
+    uint8_t ack_required;
+};
+
+/** a logical channel, configured by the application and maintained by the multiplexer */
+struct whisper_mux__channel
+{
+    /** ring of the messages waiting, of capacity messages */
+    struct whisper_mux__message *queue;
+    uint8_t capacity;
+    /** longest payload of a fragment, 0 for as long as the link recommends, shorter while it recommends so */
+    uint8_t fragment_len;
+    /** share of the line with weighted scheduling, 0 counts as 1 */
+    uint8_t weight;
+    /** callback for a fragment received on the channel, optional */
+    void (*received_cb)(whisper_data_layer_t dl, uint8_t channel, uint8_t *payload, uint8_t payload_len);
+    /** callback for a completed message, sent is 1 if all its fragments were acknowledged, optional */
+    void (*sent_cb)(whisper_data_layer_t dl, uint8_t channel, const uint8_t *data, uint16_t data_length,
+                    uint8_t sent);
+
+    // state of the channel, initialized by whisper_mux__init
+    uint8_t head;
+    uint8_t count;
+    // bytes of the message at the head sent already
+    uint16_t offset;
+    // virtual time of weighted scheduling, at which the channel is due
+    unsigned long pass;
+};
+
+typedef struct whisper_mux *whisper_mux_t;
+
+extern const uint16_t SIZEOF_WHISPER_MUX_T;
+
+/**
+ * @brief initialize a multiplexer over the provided channels, with empty queues
+ *
+ * @param mux memory of at least SIZEOF_WHISPER_MUX_T bytes for the multiplexer
+ * @param channels the channels, channel i is sent as channel i of the link
+ * @param num_channels number of the channels, up to WHISPER_DATA_LAYER__MAX_CHANNELS
+ * @param scheduling WHISPER_MUX__STRICT or WHISPER_MUX__WEIGHTED
+ * @return char 0 success, otherwise the configuration is invalid
+ */
+char whisper_mux__init(whisper_mux_t mux, struct whisper_mux__channel *channels, uint8_t num_channels,
+                       uint8_t scheduling);
+
+/**
+ * @brief queue a message on a channel, sent by the next whisper_mux__drain
+ *
+ * @param mux the multiplexer
+ * @param channel the channel
+ * @param data the message, which is not copied
+ * @param data_length length of the message, an empty one is sent as an empty frame
+ * @param ack_required passed on to the link
+ * @return char 0 success, -1 the queue of the channel is full or there is no such channel
+ */
+char whisper_mux__submit(whisper_mux_t mux, uint8_t channel, const uint8_t *data, uint16_t data_length,
+                         uint8_t ack_required);
+
+/**
+ * @brief send the next fragment if the link is idle
+ *
+ * A fragment completed before the link returns, by a peer answering from
+ * within data_write, is released right away and the next one sent.
+ *
+ * @return uint16_t the sequence no of the last fragment sent, 0 if nothing was sent
+ */
+uint16_t whisper_mux__drain(whisper_mux_t mux, whisper_data_layer_t dl);
+
+/**
+ * @brief complete the fragment in flight and send the next one, from data_ack_cb
+ *
+ * A fragment given up fails the rest of its message. Completions of frames
+ * sent around the multiplexer are ignored.
+ *
+ * @return uint16_t the sequence no of the next fragment, 0 if nothing was sent
+ */
+uint16_t whisper_mux__complete(whisper_mux_t mux, whisper_data_layer_t dl, unsigned int seq_no, uint8_t sent);
+
+/** hand a received payload to the callback of its channel, from packet_received_cb */
+void whisper_mux__received(whisper_mux_t mux, whisper_data_layer_t dl, uint8_t *payload, uint8_t payload_len);
+
+/** return the number of messages waiting on the channel, including the one in flight */
+uint8_t whisper_mux__count(whisper_mux_t mux, uint8_t channel);
+
+#endif // MUX_H
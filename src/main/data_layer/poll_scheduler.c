@@ -0,0 +1,139 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <string.h>
+#include "poll_scheduler.h"
+
+struct whisper_poll
+{
+    struct whisper_poll__node *nodes;
+    uint8_t num_nodes;
+    unsigned long timeout_us;
+    // the node polled, and whether it is yet to answer since the turn started then
+    uint8_t polled;
+    uint8_t waiting;
+    unsigned long turn_started_us;
+    struct whisper_poll__stats stats;
+};
+
+const uint16_t SIZEOF_WHISPER_POLL_T = sizeof(struct whisper_poll);
+
+// payload of an empty poll, which the link only reads
+static uint8_t empty_poll[1];
+
+char whisper_poll__init(whisper_poll_t poll, struct whisper_poll__node *nodes, uint8_t num_nodes,
+                        unsigned long timeout_us)
+{
+    uint8_t i;
+
+    if (num_nodes == 0 || timeout_us == 0)
+        return -1;
+    for (i = 0; i < num_nodes; i++)
+        if (!nodes[i].dl)
+            return -1;
+
+    memset(poll, 0, sizeof(struct whisper_poll));
+    poll->nodes = nodes;
+    poll->num_nodes = num_nodes;
+    poll->timeout_us = timeout_us;
+    // the first turn is the one of the first node
+    poll->polled = num_nodes - 1;
+    for (i = 0; i < num_nodes; i++)
+    {
+        nodes[i].request = 0;
+        nodes[i].request_len = 0;
+    }
+    return 0;
+}
+
+char whisper_poll__submit(whisper_poll_t poll, uint8_t node, const uint8_t *data, uint8_t data_length)
+{
+    if (node >= poll->num_nodes || poll->nodes[node].request)
+        return -1;
+
+    poll->nodes[node].request = data;
+    poll->nodes[node].request_len = data_length;
+    return 0;
+}
+
+char whisper_poll__received(whisper_poll_t poll, whisper_data_layer_t dl)
+{
+    if (!poll->waiting || poll->nodes[poll->polled].dl != dl)
+        return 0;
+
+    poll->waiting = 0;
+    return 1;
+}
+
+void whisper_poll__data_received(whisper_poll_t poll, const uint8_t *data, uint8_t data_length)
+{
+    whisper_data_layer__data_received(poll->nodes[poll->polled].dl, data, data_length);
+}
+
+/** poll the next node, with the request queued for it */
+static void start_turn(whisper_poll_t poll, unsigned long now_us)
+{
+    struct whisper_poll__node *node;
+    uint16_t seq_no;
+
+    poll->polled = poll->polled + 1 < poll->num_nodes ? poll->polled + 1 : 0;
+    node = &poll->nodes[poll->polled];
+
+    // the link only reads the request, it is retransmitted from the application
+    if (node->request)
+        seq_no = whisper_data_layer__data_sent(node->dl, (uint8_t *)node->request, node->request_len, 1);
+    else
+        seq_no = whisper_data_layer__data_sent(node->dl, empty_poll, 0, 1);
+
+    if (seq_no == 0)
+        // the earlier poll is transmitted again by the link, the node may still answer it
+        ++poll->stats.busy;
+    else
+        node->request = 0;
+
+    ++poll->stats.turns;
+    poll->waiting = 1;
+    poll->turn_started_us = now_us;
+}
+
+unsigned long whisper_poll__run(whisper_poll_t poll, unsigned long now_us)
+{
+    unsigned long elapsed = now_us - poll->turn_started_us;
+
+    if (poll->waiting && elapsed < poll->timeout_us)
+        return poll->timeout_us - elapsed;
+
+    if (poll->waiting)
+        ++poll->stats.timeouts;
+    start_turn(poll, now_us);
+    return poll->timeout_us;
+}
+
+uint8_t whisper_poll__polled(whisper_poll_t poll)
+{
+    return poll->polled;
+}
+
+void whisper_poll__stats(whisper_poll_t poll, struct whisper_poll__stats *stats)
+{
+    memcpy(stats, &poll->stats, sizeof(struct whisper_poll__stats));
+}
@@ -0,0 +1,133 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef POLL_SCHEDULER_H
+#define POLL_SCHEDULER_H
+
+#include "basic_data_type.h"
+#include "data_layer.h"
+
+/*
+ * Poll scheduler of the master of a multi-drop bus.
+ *
+ * On a half-duplex bus such as RS-485, a node only talks when the master
+ * polls it. The master runs a link per node, with the address of the node
+ * and master set, all writing to the bus, and every node runs a link with
+ * its own address, see the address field of the data layer configuration.
+ * The scheduler gives the nodes a turn each, round robin:
+ *
+ *   master  request queued for node i, or an empty poll
+ *   node i  acknowledgement, and its answer                one transmission
+ *   master  acknowledgement of the answer, poll of node i+1  one transmission
+ *
+ * A node acknowledges a frame before delivering it, so its answer sent from
+ * packet_received_cb follows in the same transmission. It answers every
+ * poll, with an empty frame if it has nothing to say. The turn ends as soon
+ * as the answer is in, rather than after a fixed slot, and the next poll
+ * goes out behind the acknowledgement of the answer, so a turn takes two
+ * turnarounds of the bus and no idle time besides. A node that does not
+ * answer within the timeout loses its turn.
+ *
+ * The bytes from the bus go to the link of the node polled, as only that
+ * node talks. Frames lost on the bus are transmitted again by the links on
+ * their own timers. Like the links, the scheduler is driven by their owner.
+ */
+
+/** a node on the bus, configured by the application and maintained by the scheduler */
+struct whisper_poll__node
+{
+    /** link of the master to the node */
+    whisper_data_layer_t dl;
+
+    // state of the node, initialized by whisper_poll__init
+    // the request to send with the next poll, none if 0
+    const uint8_t *request;
+    uint8_t request_len;
+};
+
+/** counters of the scheduler */
+struct whisper_poll__stats
+{
+    /** turns given, one per poll */
+    unsigned long turns;
+    /** turns ended by the timeout, as the answer did not arrive */
+    unsigned long timeouts;
+    /** turns in which no poll was sent, as the link was still busy with an earlier one */
+    unsigned long busy;
+};
+
+typedef struct whisper_poll *whisper_poll_t;
+
+extern const uint16_t SIZEOF_WHISPER_POLL_T;
+
+/**
+ * @brief initialize a scheduler over the links to the provided nodes
+ *
+ * @param poll memory of at least SIZEOF_WHISPER_POLL_T bytes for the scheduler
+ * @param nodes the nodes, in the order they are polled
+ * @param num_nodes number of the nodes
+ * @param timeout_us time a node has to answer its poll, in microseconds
+ * @return char 0 success, otherwise the configuration is invalid
+ */
+char whisper_poll__init(whisper_poll_t poll, struct whisper_poll__node *nodes, uint8_t num_nodes,
+                        unsigned long timeout_us);
+
+/**
+ * @brief queue a request for a node, which is sent as its next poll
+ *
+ * @param poll the scheduler
+ * @param node index of the node
+ * @param data the request, which is not copied and must stay intact until the link completes it
+ * @param data_length length of the request
+ * @return char 0 success, -1 a request is queued for the node already or there is no such node
+ */
+char whisper_poll__submit(whisper_poll_t poll, uint8_t node, const uint8_t *data, uint8_t data_length);
+
+/**
+ * @brief end the turn of the node polled, from packet_received_cb of the links
+ *
+ * @return char 1 if the frame was the answer of the node polled, otherwise 0
+ */
+char whisper_poll__received(whisper_poll_t poll, whisper_data_layer_t dl);
+
+/** feed bytes from the bus to the link of the node polled, then call whisper_poll__run */
+void whisper_poll__data_received(whisper_poll_t poll, const uint8_t *data, uint8_t data_length);
+
+/**
+ * @brief poll the next node, if the turn of the current one is over
+ *
+ * Called after feeding bytes from the bus, whatever the link wrote in
+ * response goes out in the same transmission as the next poll.
+ *
+ * @param poll the scheduler
+ * @param now_us the current time in microseconds
+ * @return unsigned long microseconds until it is to be called again, at the latest
+ */
+unsigned long whisper_poll__run(whisper_poll_t poll, unsigned long now_us);
+
+/** return the index of the node polled, whose turn it is */
+uint8_t whisper_poll__polled(whisper_poll_t poll);
+
+/** copy the counters of the scheduler */
+void whisper_poll__stats(whisper_poll_t poll, struct whisper_poll__stats *stats);
+
+#endif // POLL_SCHEDULER_H
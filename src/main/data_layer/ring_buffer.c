@@ -53,11 +53,12 @@ unsigned char *ring_buffer_at(ring_buffer_t rb, unsigned short index)
 unsigned short ring_buffer_push(ring_buffer_t rb, const unsigned char *src,
                                 unsigned short count)
 {
+    unsigned short i;
     unsigned short bytes_to_copy = rb->buf_len - rb->size;
     if (bytes_to_copy > count)
         bytes_to_copy = count;
 
-    for (unsigned short i = 0; i < bytes_to_copy; ++i)
+    for (i = 0; i < bytes_to_copy; ++i)
     {
         *ring_buffer_at(rb, rb->size) = src[i];
         rb->size += 1;
@@ -94,10 +95,11 @@ unsigned short ring_buffer_batch_pop(ring_buffer_t rb, unsigned short count)
 
 unsigned char ring_buffer_read(unsigned char *dest, ring_buffer_t src, unsigned short offset, unsigned short count)
 {
+    unsigned short i;
     if (count > src->size)
         count = src->size;
 
-    for (unsigned short i = 0; i < count; ++i)
+    for (i = 0; i < count; ++i)
     {
         dest[i] = src->buf[(src->head + offset + i) % src->buf_len];
     }
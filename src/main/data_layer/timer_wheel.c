@@ -0,0 +1,271 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "timer_wheel.h"
+#include <string.h>
+
+#define LEVELS 4
+#define SLOT_BITS 6
+#define SLOTS (1 << SLOT_BITS)
+#define SLOT_MASK (SLOTS - 1)
+
+// shift of the tick to get the slot index of a level
+#define LEVEL_SHIFT(level) ((level) * SLOT_BITS)
+// timers further out are parked in the last level until they come closer
+#define MAX_DELTA ((1UL << (LEVELS * SLOT_BITS)) - 1)
+
+struct whisper_timer_wheel
+{
+    /** the last tick advanced to */
+    unsigned long now;
+    unsigned long count;
+    /** bitmap of the non-empty slots of each level */
+    unsigned long long occupied[LEVELS];
+    struct whisper_timer *slots[LEVELS * SLOTS];
+};
+
+const uint16_t SIZEOF_WHISPER_TIMER_WHEEL_T = sizeof(struct whisper_timer_wheel);
+
+static unsigned int lowest_bit(unsigned long long bits)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzll(bits);
+#else
+    unsigned int n = 0;
+    while (!(bits & 1))
+    {
+        bits >>= 1;
+        ++n;
+    }
+    return n;
+#endif
+}
+
+/** rotate the bitmap, so the given bit becomes the lowest one */
+static unsigned long long rotate(unsigned long long bits, unsigned int shift)
+{
+    shift &= SLOT_MASK;
+    return shift == 0 ? bits : (bits >> shift) | (bits << (SLOTS - shift));
+}
+
+void whisper_timer_wheel__init(whisper_timer_wheel_t wheel, unsigned long now)
+{
+    memset(wheel, 0, sizeof(struct whisper_timer_wheel));
+    wheel->now = now;
+}
+
+void whisper_timer__init(struct whisper_timer *timer, void (*cb)(struct whisper_timer *timer), void *arg)
+{
+    memset(timer, 0, sizeof(struct whisper_timer));
+    timer->cb = cb;
+    timer->arg = arg;
+}
+
+bool whisper_timer__pending(const struct whisper_timer *timer)
+{
+    return timer->pprev != 0;
+}
+
+/** link the timer into its slot, relative to the base, which is the next tick to process */
+static void place(whisper_timer_wheel_t wheel, struct whisper_timer *timer, unsigned long base)
+{
+    unsigned long expires = timer->expires;
+    unsigned long delta = expires - base;
+    unsigned int level = 0;
+    struct whisper_timer **head;
+
+    if ((long)delta < 0)
+    {
+        // overdue, expire on the next tick
+        expires = base;
+        delta = 0;
+    }
+    else if (delta > MAX_DELTA)
+    {
+        expires = base + MAX_DELTA;
+        delta = MAX_DELTA;
+    }
+
+    while (level < LEVELS - 1 && delta >= 1UL << LEVEL_SHIFT(level + 1))
+        ++level;
+
+    timer->slot = level * SLOTS + ((expires >> LEVEL_SHIFT(level)) & SLOT_MASK);
+    head = &wheel->slots[timer->slot];
+
+    timer->next = *head;
+    if (timer->next)
+        timer->next->pprev = &timer->next;
+    timer->pprev = head;
+    *head = timer;
+
+    wheel->occupied[level] |= 1ULL << (timer->slot & SLOT_MASK);
+}
+
+static void unlink_timer(whisper_timer_wheel_t wheel, struct whisper_timer *timer)
+{
+    *timer->pprev = timer->next;
+    if (timer->next)
+        timer->next->pprev = timer->pprev;
+    timer->next = 0;
+    timer->pprev = 0;
+
+    if (!wheel->slots[timer->slot])
+        wheel->occupied[timer->slot / SLOTS] &= ~(1ULL << (timer->slot & SLOT_MASK));
+}
+
+/** take all timers out of the slot, the returned list is terminated by a null pointer */
+static struct whisper_timer *detach(whisper_timer_wheel_t wheel, unsigned int level, unsigned int index)
+{
+    struct whisper_timer *list = wheel->slots[level * SLOTS + index];
+
+    wheel->slots[level * SLOTS + index] = 0;
+    wheel->occupied[level] &= ~(1ULL << index);
+    return list;
+}
+
+void whisper_timer_wheel__add(whisper_timer_wheel_t wheel, struct whisper_timer *timer, unsigned long expires)
+{
+    if (timer->pprev)
+        unlink_timer(wheel, timer);
+    else
+        ++wheel->count;
+
+    timer->expires = expires;
+    place(wheel, timer, wheel->now + 1);
+}
+
+void whisper_timer_wheel__cancel(whisper_timer_wheel_t wheel, struct whisper_timer *timer)
+{
+    if (!timer->pprev)
+        return;
+
+    unlink_timer(wheel, timer);
+    --wheel->count;
+}
+
+/** move the timers of the slot due at the tick down to the lower levels */
+static void cascade(whisper_timer_wheel_t wheel, unsigned int level, unsigned long tick)
+{
+    struct whisper_timer *timer = detach(wheel, level, (tick >> LEVEL_SHIFT(level)) & SLOT_MASK);
+
+    while (timer)
+    {
+        struct whisper_timer *next = timer->next;
+        place(wheel, timer, tick);
+        timer = next;
+    }
+}
+
+static void process(whisper_timer_wheel_t wheel, unsigned long tick)
+{
+    struct whisper_timer *expired;
+    unsigned int level;
+
+    for (level = 1; level < LEVELS; level++)
+    {
+        if (tick & ((1UL << LEVEL_SHIFT(level)) - 1))
+            break;
+        cascade(wheel, level, tick);
+    }
+
+    wheel->now = tick;
+
+    // the callbacks may cancel any of the expired timers, keep the list linked
+    expired = detach(wheel, 0, tick & SLOT_MASK);
+    if (expired)
+        expired->pprev = &expired;
+
+    while (expired)
+    {
+        struct whisper_timer *timer = expired;
+
+        unlink_timer(wheel, timer);
+        --wheel->count;
+        timer->cb(timer);
+    }
+}
+
+/** return the next tick, at which a timer expires or a slot cascades */
+static char next_work(whisper_timer_wheel_t wheel, unsigned long *tick)
+{
+    unsigned long base = wheel->now + 1;
+    unsigned long best = 0;
+    char found = -1;
+    unsigned int level;
+
+    if (wheel->count == 0)
+        return -1;
+
+    for (level = 0; level < LEVELS; level++)
+    {
+        unsigned long block = base >> LEVEL_SHIFT(level);
+        // the slot of the current block is still due, if the base is where it cascades
+        unsigned int first = (level == 0 || (base & ((1UL << LEVEL_SHIFT(level)) - 1)) == 0) ? 0 : 1;
+        unsigned long long bits = rotate(wheel->occupied[level], (block + first) & SLOT_MASK);
+        unsigned long candidate;
+
+        if (!bits)
+            continue;
+
+        candidate = (block + first + lowest_bit(bits)) << LEVEL_SHIFT(level);
+        if (found != 0 || (long)(candidate - best) < 0)
+        {
+            best = candidate;
+            found = 0;
+        }
+    }
+
+    *tick = best;
+    return found;
+}
+
+void whisper_timer_wheel__advance(whisper_timer_wheel_t wheel, unsigned long now)
+{
+    while ((long)(now - wheel->now) > 0)
+    {
+        unsigned long tick;
+
+        // jump over the ticks, at which nothing happens
+        if (next_work(wheel, &tick) != 0 || (long)(tick - now) > 0)
+        {
+            wheel->now = now;
+            return;
+        }
+
+        process(wheel, tick);
+    }
+}
+
+unsigned long whisper_timer_wheel__now(whisper_timer_wheel_t wheel)
+{
+    return wheel->now;
+}
+
+unsigned long whisper_timer_wheel__count(whisper_timer_wheel_t wheel)
+{
+    return wheel->count;
+}
+
+char whisper_timer_wheel__next_deadline(whisper_timer_wheel_t wheel, unsigned long *deadline)
+{
+    return next_work(wheel, deadline);
+}
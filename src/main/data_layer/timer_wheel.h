@@ -0,0 +1,101 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include "basic_data_type.h"
+
+/*
+ * Hierarchical timer wheel.
+ *
+ * Timers are stored in 4 levels of 64 slots, level n holding the timers due
+ * within 64^(n+1) ticks. Adding and cancelling a timer is O(1), timers of the
+ * higher levels cascade down as their slot comes due. The unit of a tick is
+ * up to the integration, the data layer assumes milliseconds.
+ *
+ * The timers are owned by the caller and linked into the wheel, so the wheel
+ * never allocates and holds any number of them.
+ */
+
+struct whisper_timer
+{
+    // links of the slot the timer is pending in, private to the wheel
+    struct whisper_timer *next;
+    struct whisper_timer **pprev;
+    uint16_t slot;
+    /** tick at which the timer expires */
+    unsigned long expires;
+    /** called when the timer expires, the timer may be added again from the callback */
+    void (*cb)(struct whisper_timer *timer);
+    /** argument of the callback, opaque to the wheel */
+    void *arg;
+};
+
+typedef struct whisper_timer_wheel *whisper_timer_wheel_t;
+
+extern const uint16_t SIZEOF_WHISPER_TIMER_WHEEL_T;
+
+/** initialize the wheel, with the given tick as current time */
+void whisper_timer_wheel__init(whisper_timer_wheel_t wheel, unsigned long now);
+
+/** initialize a timer, which is not pending */
+void whisper_timer__init(struct whisper_timer *timer, void (*cb)(struct whisper_timer *timer), void *arg);
+
+/** return whether the timer is pending in a wheel */
+bool whisper_timer__pending(const struct whisper_timer *timer);
+
+/**
+ * @brief Add the timer to the wheel, re-arming it if it is already pending.
+ *
+ * @param wheel the wheel
+ * @param timer an initialized timer
+ * @param expires tick at which the timer expires, a tick in the past expires on the next advance
+ */
+void whisper_timer_wheel__add(whisper_timer_wheel_t wheel, struct whisper_timer *timer, unsigned long expires);
+
+/** remove the timer from the wheel, nothing happens if it is not pending */
+void whisper_timer_wheel__cancel(whisper_timer_wheel_t wheel, struct whisper_timer *timer);
+
+/** advance the wheel to the given tick and call back every timer expired by then */
+void whisper_timer_wheel__advance(whisper_timer_wheel_t wheel, unsigned long now);
+
+/** return the current tick, which is the last one advanced to */
+unsigned long whisper_timer_wheel__now(whisper_timer_wheel_t wheel);
+
+/** return the number of pending timers */
+unsigned long whisper_timer_wheel__count(whisper_timer_wheel_t wheel);
+
+/**
+ * @brief Query the tick, at which the wheel must be advanced next.
+ *
+ * The deadline is never later than the earliest pending timer, it can be
+ * earlier when timers of the higher levels have to cascade. Sleep until the
+ * deadline, advance and query again.
+ *
+ * @param wheel the wheel
+ * @param deadline the tick to advance to next
+ * @return char 0 success, otherwise there is no pending timer
+ */
+char whisper_timer_wheel__next_deadline(whisper_timer_wheel_t wheel, unsigned long *deadline);
+
+#endif // TIMER_WHEEL_H
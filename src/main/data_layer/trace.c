@@ -0,0 +1,109 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "trace.h"
+#include <string.h>
+
+struct whisper_trace
+{
+    struct whisper_trace__record *records;
+    unsigned long mask;
+    /** number of records written, the next one goes to head & mask */
+    unsigned long head;
+    unsigned long (*clock)(void *clock_ctx);
+    void *clock_ctx;
+};
+
+const uint16_t SIZEOF_WHISPER_TRACE_T = sizeof(struct whisper_trace);
+
+char whisper_trace__init(whisper_trace_t trace, struct whisper_trace__record *records, unsigned long capacity,
+                         unsigned long (*clock)(void *clock_ctx), void *clock_ctx)
+{
+    if (capacity == 0 || (capacity & (capacity - 1)) != 0)
+        return -1;
+
+    trace->records = records;
+    trace->mask = capacity - 1;
+    trace->head = 0;
+    trace->clock = clock;
+    trace->clock_ctx = clock_ctx;
+    return 0;
+}
+
+void whisper_trace__write(whisper_trace_t trace, uint8_t event, uint8_t arg8, uint16_t arg)
+{
+    struct whisper_trace__record *record = &trace->records[trace->head & trace->mask];
+
+    record->timestamp = trace->clock ? trace->clock(trace->clock_ctx) : trace->head;
+    record->arg = arg;
+    record->event = event;
+    record->arg8 = arg8;
+    ++trace->head;
+}
+
+unsigned long whisper_trace__count(whisper_trace_t trace)
+{
+    return trace->head > trace->mask ? trace->mask + 1 : trace->head;
+}
+
+unsigned long whisper_trace__lost(whisper_trace_t trace)
+{
+    return trace->head - whisper_trace__count(trace);
+}
+
+const struct whisper_trace__record *whisper_trace__at(whisper_trace_t trace, unsigned long index)
+{
+    return &trace->records[(whisper_trace__lost(trace) + index) & trace->mask];
+}
+
+void whisper_trace__clear(whisper_trace_t trace)
+{
+    trace->head = 0;
+}
+
+unsigned long whisper_trace__dump(whisper_trace_t trace, uint8_t *buf, unsigned long buf_len)
+{
+    const uint8_t *start = buf;
+    unsigned long count = whisper_trace__count(trace);
+    unsigned long i = 0;
+
+    // keep the latest records if not all of them fit
+    if (count > buf_len / WHISPER_TRACE__DUMP_RECORD_LEN)
+        i = count - buf_len / WHISPER_TRACE__DUMP_RECORD_LEN;
+
+    for (; i < count; i++)
+    {
+        const struct whisper_trace__record *record = whisper_trace__at(trace, i);
+
+        buf[0] = record->timestamp & 0xff;
+        buf[1] = (record->timestamp >> 8) & 0xff;
+        buf[2] = (record->timestamp >> 16) & 0xff;
+        buf[3] = (record->timestamp >> 24) & 0xff;
+        buf[4] = record->event;
+        buf[5] = record->arg8;
+        buf[6] = record->arg & 0xff;
+        buf[7] = record->arg >> 8;
+        buf += WHISPER_TRACE__DUMP_RECORD_LEN;
+    }
+
+    return buf - start;
+}
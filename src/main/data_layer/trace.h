@@ -0,0 +1,137 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "basic_data_type.h"
+
+/*
+ * Binary trace ring.
+ *
+ * A trace is a fixed ring of compact records, each an event with two
+ * arguments and a timestamp. Once the ring is full the oldest record is
+ * overwritten, so the ring always holds the latest events leading to a
+ * failure. Writing a record takes a few ns, the records are decoded on the
+ * host from a dump of the ring, see src/trace/whisper_trace.c.
+ *
+ * The data layer writes its trace points only if built with WHISPER_TRACE,
+ * otherwise they compile out entirely.
+ */
+
+// events of the data layer, the arguments are given as (arg8, arg)
+/** the receive state machine changed the state (from, to) */
+#define WHISPER_TRACE__STATE 1
+/** bytes fed to the link (0, length) */
+#define WHISPER_TRACE__DATA_IN 2
+/** a frame with a valid checksum is received (flags, seq_no) */
+#define WHISPER_TRACE__FRAME_RX 3
+/** a data frame is written (number of the transmission, seq_no), (0, 0) for a window probe */
+#define WHISPER_TRACE__FRAME_TX 4
+/** an acknowledgement is written (0, acknowledged seq_no) */
+#define WHISPER_TRACE__ACK_TX 5
+/** an acknowledgement of the pending frame is received (0, seq_no) */
+#define WHISPER_TRACE__ACK_RX 6
+/** a frame is dropped for a checksum mismatch (0, seq_no) */
+#define WHISPER_TRACE__CRC_ERROR 7
+/** a header is rejected (flags, payload length) */
+#define WHISPER_TRACE__HEADER_ERROR 8
+/** the retransmission timer is started (0, delay in ms) */
+#define WHISPER_TRACE__TIMER_START 9
+/** the retransmission timer is stopped (0, 0) */
+#define WHISPER_TRACE__TIMER_STOP 10
+/** the retransmission timer expired (number of transmissions, seq_no) */
+#define WHISPER_TRACE__TIMER_EXPIRED 11
+/** the pending frame is given up (number of transmissions, seq_no) */
+#define WHISPER_TRACE__DROP 12
+/** forward error correction repaired a block, 0 the header or 1 the rest (block, corrected bytes) */
+#define WHISPER_TRACE__FEC_CORRECTED 13
+/** a retransmitted data frame is acknowledged again and not delivered (0, seq_no) */
+#define WHISPER_TRACE__DUPLICATE 14
+/** the peer advertised its receive credits, with an acknowledgement or a window update of seq_no 0 (credits, seq_no) */
+#define WHISPER_TRACE__CREDITS 15
+/** a data frame is refused for lack of receive credits, the sender probes again (0, seq_no) */
+#define WHISPER_TRACE__REFUSED 16
+/**
+ * a handshake frame is sent (0, 1 if an answer), received from a peer starting over (1, its longest payload),
+ * answered by the peer (2, its longest payload) or given up (3, 0)
+ */
+#define WHISPER_TRACE__HANDSHAKE 17
+
+/** length of a record in a dump */
+#define WHISPER_TRACE__DUMP_RECORD_LEN 8
+
+struct whisper_trace__record
+{
+    /** time of the event, in ticks of the clock of the trace */
+    unsigned long timestamp;
+    uint16_t arg;
+    uint8_t event;
+    uint8_t arg8;
+};
+
+typedef struct whisper_trace *whisper_trace_t;
+
+extern const uint16_t SIZEOF_WHISPER_TRACE_T;
+
+/**
+ * @brief initialize a trace on the provided records
+ *
+ * @param trace memory of at least SIZEOF_WHISPER_TRACE_T bytes for the trace
+ * @param records backend of the ring
+ * @param capacity number of the records, a power of 2
+ * @param clock returns the current time, the index of the record is taken as time if not given
+ * @param clock_ctx passed to the clock
+ * @return char 0 success, otherwise the capacity is not a power of 2
+ */
+char whisper_trace__init(whisper_trace_t trace, struct whisper_trace__record *records, unsigned long capacity,
+                         unsigned long (*clock)(void *clock_ctx), void *clock_ctx);
+
+/** write a record, overwriting the oldest one if the ring is full */
+void whisper_trace__write(whisper_trace_t trace, uint8_t event, uint8_t arg8, uint16_t arg);
+
+/** return the number of records held by the ring */
+unsigned long whisper_trace__count(whisper_trace_t trace);
+
+/** return the number of records overwritten since the trace was initialized or cleared */
+unsigned long whisper_trace__lost(whisper_trace_t trace);
+
+/** return the record at the index, 0 being the oldest one held */
+const struct whisper_trace__record *whisper_trace__at(whisper_trace_t trace, unsigned long index);
+
+/** drop all records */
+void whisper_trace__clear(whisper_trace_t trace);
+
+/**
+ * @brief Dump the records, oldest first, for the host side decoder.
+ *
+ * Every record takes WHISPER_TRACE__DUMP_RECORD_LEN bytes: the lower 32 bits
+ * of the timestamp, the event, arg8 and arg, all little endian.
+ *
+ * @param trace the trace
+ * @param buf the buffer to dump to
+ * @param buf_len the length of the buffer
+ * @return the number of bytes dumped, the latest whole records which fit
+ */
+unsigned long whisper_trace__dump(whisper_trace_t trace, uint8_t *buf, unsigned long buf_len);
+
+#endif // TRACE_H
@@ -0,0 +1,160 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <string.h>
+#include "tx_queue.h"
+
+#define LOAD(var, order) __atomic_load_n(&(var), order)
+#define STORE(var, value, order) __atomic_store_n(&(var), value, order)
+
+struct whisper_tx_queue
+{
+    struct whisper_tx_queue__cell *cells;
+    unsigned long mask;
+    // the producers and the owner on cache lines of their own
+    char producer_line[64];
+    unsigned long tail;
+    char owner_line[64];
+    unsigned long head;
+    // sequence no of the frame in flight, the one at the head, 0 if none
+    uint16_t in_flight;
+    // set while the frame at the head is handed to the link, which may complete it before it returns
+    uint8_t framing;
+    uint16_t completed;
+};
+
+const uint16_t SIZEOF_WHISPER_TX_QUEUE_T = sizeof(struct whisper_tx_queue);
+
+char whisper_tx_queue__init(whisper_tx_queue_t queue, struct whisper_tx_queue__cell *cells, unsigned long capacity)
+{
+    unsigned long i;
+
+    if (capacity == 0 || (capacity & (capacity - 1)) != 0)
+        return -1;
+
+    queue->cells = cells;
+    queue->mask = capacity - 1;
+    queue->tail = 0;
+    queue->head = 0;
+    queue->in_flight = 0;
+    queue->framing = 0;
+    queue->completed = 0;
+    // a cell is free for the producer of position seq
+    for (i = 0; i < capacity; i++)
+        cells[i].seq = i;
+    return 0;
+}
+
+char whisper_tx_queue__submit(whisper_tx_queue_t queue, const uint8_t *data, uint8_t data_length,
+                              uint8_t ack_required)
+{
+    struct whisper_tx_queue__cell *cell;
+    unsigned long pos = LOAD(queue->tail, __ATOMIC_RELAXED);
+
+    for (;;)
+    {
+        long diff;
+
+        cell = &queue->cells[pos & queue->mask];
+        diff = (long)(LOAD(cell->seq, __ATOMIC_ACQUIRE) - pos);
+        if (diff == 0)
+        {
+            // the cell is free, claim the position, a failure reloads it
+            if (__atomic_compare_exchange_n(&queue->tail, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        }
+        else if (diff < 0)
+            // the owner has not released the cell of the previous round
+            return -1;
+        else
+            // another producer claimed the position
+            pos = LOAD(queue->tail, __ATOMIC_RELAXED);
+    }
+
+    memcpy(cell->data, data, data_length);
+    cell->len = data_length;
+    cell->ack_required = ack_required;
+    // publish the cell to the owner
+    STORE(cell->seq, pos + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/** release the cell at the head for the producers of the next round */
+static void release(whisper_tx_queue_t queue)
+{
+    struct whisper_tx_queue__cell *cell = &queue->cells[queue->head & queue->mask];
+
+    queue->in_flight = 0;
+    STORE(cell->seq, queue->head + queue->mask + 1, __ATOMIC_RELEASE);
+    ++queue->head;
+}
+
+uint16_t whisper_tx_queue__drain(whisper_tx_queue_t queue, whisper_data_layer_t dl)
+{
+    uint16_t last = 0;
+
+    while (!queue->in_flight && !queue->framing)
+    {
+        struct whisper_tx_queue__cell *cell = &queue->cells[queue->head & queue->mask];
+        uint16_t seq_no;
+
+        if (LOAD(cell->seq, __ATOMIC_ACQUIRE) != queue->head + 1)
+            break;
+
+        // the cell stays claimed until the frame completes, it is retransmitted from there
+        queue->framing = 1;
+        queue->completed = 0;
+        seq_no = whisper_data_layer__data_sent(dl, cell->data, cell->len, cell->ack_required);
+        queue->framing = 0;
+        if (seq_no == 0)
+            break;
+
+        last = seq_no;
+        // a peer answering from within data_write completes the frame before the link returns
+        if (queue->completed != seq_no)
+            queue->in_flight = seq_no;
+        else
+            release(queue);
+    }
+    return last;
+}
+
+uint16_t whisper_tx_queue__complete(whisper_tx_queue_t queue, whisper_data_layer_t dl, unsigned int seq_no)
+{
+    // the frame being framed, released by drain once the link returns its sequence no
+    if (queue->framing)
+    {
+        queue->completed = seq_no;
+        return 0;
+    }
+
+    if (!queue->in_flight || queue->in_flight != seq_no)
+        return 0;
+
+    release(queue);
+    return whisper_tx_queue__drain(queue, dl);
+}
+
+unsigned long whisper_tx_queue__count(whisper_tx_queue_t queue)
+{
+    return LOAD(queue->tail, __ATOMIC_RELAXED) - queue->head;
+}
@@ -0,0 +1,100 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef TX_QUEUE_H
+#define TX_QUEUE_H
+
+#include "basic_data_type.h"
+#include "data_layer.h"
+
+/*
+ * Multi-producer submission queue in front of the transmitter of a link.
+ *
+ * The data layer is not thread safe, only the thread owning a link may call
+ * into it. Any thread may submit frames to the queue instead, without a
+ * lock: the payload is copied into a cell of a bounded ring, which the
+ * producers claim with a compare and swap on the tail. The owner of the
+ * link frames the submitted frames in order, the next one as soon as the
+ * previous one is acknowledged or given up, straight from data_ack_cb.
+ *
+ * A producer never waits for the frame in flight or for another producer,
+ * it only fails while the queue is full.
+ */
+
+/** a cell of the queue, the sequence tells the producers and the owner whose turn it is */
+struct whisper_tx_queue__cell
+{
+    unsigned long seq;
+    uint8_t len;
+    uint8_t ack_required;
+    uint8_t data[255];
+};
+
+typedef struct whisper_tx_queue *whisper_tx_queue_t;
+
+extern const uint16_t SIZEOF_WHISPER_TX_QUEUE_T;
+
+/**
+ * @brief initialize an empty queue on the provided cells
+ *
+ * @param queue memory of at least SIZEOF_WHISPER_TX_QUEUE_T bytes for the queue
+ * @param cells backend of the ring
+ * @param capacity number of the cells, a power of 2
+ * @return char 0 success, otherwise the capacity is not a power of 2
+ */
+char whisper_tx_queue__init(whisper_tx_queue_t queue, struct whisper_tx_queue__cell *cells, unsigned long capacity);
+
+/**
+ * @brief submit a frame, from any thread
+ *
+ * @param queue the queue
+ * @param data the payload, copied into the queue
+ * @param data_length length of the payload
+ * @param ack_required passed on to the link
+ * @return char 0 success, -1 the queue is full
+ */
+char whisper_tx_queue__submit(whisper_tx_queue_t queue, const uint8_t *data, uint8_t data_length,
+                              uint8_t ack_required);
+
+/**
+ * @brief frame the next submitted frame if the link is idle, by the owner of the link
+ *
+ * A frame completed before the link returns, by a peer answering from within
+ * data_write, is released right away and the next one framed.
+ *
+ * @return uint16_t the sequence no of the last frame framed, 0 if nothing was framed
+ */
+uint16_t whisper_tx_queue__drain(whisper_tx_queue_t queue, whisper_data_layer_t dl);
+
+/**
+ * @brief release the frame in flight and frame the next one, by the owner of the link from data_ack_cb
+ *
+ * Completions of frames sent around the queue are ignored.
+ *
+ * @return uint16_t the sequence no of the next frame, 0 if nothing was framed
+ */
+uint16_t whisper_tx_queue__complete(whisper_tx_queue_t queue, whisper_data_layer_t dl, unsigned int seq_no);
+
+/** return the number of frames submitted and not completed, exact only for the owner */
+unsigned long whisper_tx_queue__count(whisper_tx_queue_t queue);
+
+#endif // TX_QUEUE_H
@@ -0,0 +1,386 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include "gateway.h"
+
+#define MAX_EVENTS 64
+#define DEFAULT_REBALANCE_MS 10
+#define NO_WORKER -1
+
+struct link_slot
+{
+    whisper_serial_t serial;
+    // the owner, only changed by the owner when handing the link over
+    int owner;
+    // worker, which asked to get the link, NO_WORKER if none
+    int steal_to;
+    // events in the current period of the owner
+    unsigned long period_events;
+    unsigned long period;
+    struct link_slot *next;
+};
+
+struct worker
+{
+    whisper_gateway_t gateway;
+    int id;
+    int epoll_fd;
+    pthread_t thread;
+
+    // read by other workers
+    unsigned long links;
+    unsigned long events;
+    unsigned long steals;
+    unsigned long failures;
+    unsigned long load;
+    struct link_slot *hottest;
+
+    // private to the worker
+    unsigned long period;
+    unsigned long period_events;
+    struct link_slot *period_hottest;
+    unsigned long long period_end;
+};
+
+struct whisper_gateway
+{
+    struct whisper_gateway__config config;
+    unsigned int num_workers;
+    struct worker *workers;
+    int running;
+    int stopping;
+
+    // all links, only for adding and destroying
+    pthread_mutex_t lock;
+    struct link_slot *slots;
+};
+
+const uint16_t SIZEOF_WHISPER_GATEWAY_T = sizeof(struct whisper_gateway);
+
+#define LOAD(p) __atomic_load_n(p, __ATOMIC_RELAXED)
+#define STORE(p, v) __atomic_store_n(p, v, __ATOMIC_RELAXED)
+
+static unsigned long long now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+/** arm the link in the epoll of a worker, ctl is EPOLL_CTL_ADD or EPOLL_CTL_MOD */
+static int arm(struct worker *worker, struct link_slot *slot, int ctl)
+{
+    struct epoll_event event;
+
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN | EPOLLONESHOT;
+    event.data.ptr = slot;
+    return epoll_ctl(worker->epoll_fd, ctl, whisper_serial__fd(slot->serial), &event);
+}
+
+char whisper_gateway__init(whisper_gateway_t gateway, const struct whisper_gateway__config *config)
+{
+    unsigned int i;
+
+    memset(gateway, 0, sizeof(struct whisper_gateway));
+    gateway->config = *config;
+    if (gateway->config.rebalance_ms == 0)
+        gateway->config.rebalance_ms = DEFAULT_REBALANCE_MS;
+
+    gateway->num_workers = config->num_workers;
+    if (gateway->num_workers == 0)
+    {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        gateway->num_workers = cores > 0 ? cores : 1;
+    }
+
+    gateway->workers = calloc(gateway->num_workers, sizeof(struct worker));
+    if (!gateway->workers)
+        return -1;
+    pthread_mutex_init(&gateway->lock, 0);
+
+    for (i = 0; i < gateway->num_workers; i++)
+    {
+        struct worker *worker = &gateway->workers[i];
+
+        worker->gateway = gateway;
+        worker->id = i;
+        worker->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (worker->epoll_fd < 0)
+        {
+            while (i--)
+                close(gateway->workers[i].epoll_fd);
+            free(gateway->workers);
+            gateway->workers = 0;
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+unsigned int whisper_gateway__num_workers(whisper_gateway_t gateway)
+{
+    return gateway->num_workers;
+}
+
+char whisper_gateway__add(whisper_gateway_t gateway, whisper_serial_t serial, int worker)
+{
+    struct link_slot *slot = calloc(1, sizeof(struct link_slot));
+    unsigned int i;
+
+    if (!slot)
+        return -1;
+
+    if (worker < 0 || (unsigned int)worker >= gateway->num_workers)
+    {
+        worker = 0;
+        for (i = 1; i < gateway->num_workers; i++)
+            if (LOAD(&gateway->workers[i].links) < LOAD(&gateway->workers[worker].links))
+                worker = i;
+    }
+
+    slot->serial = serial;
+    slot->owner = worker;
+    slot->steal_to = NO_WORKER;
+
+    pthread_mutex_lock(&gateway->lock);
+    slot->next = gateway->slots;
+    gateway->slots = slot;
+    pthread_mutex_unlock(&gateway->lock);
+
+    __atomic_fetch_add(&gateway->workers[worker].links, 1, __ATOMIC_RELAXED);
+    if (arm(&gateway->workers[worker], slot, EPOLL_CTL_ADD) != 0)
+    {
+        __atomic_fetch_sub(&gateway->workers[worker].links, 1, __ATOMIC_RELAXED);
+        // leave the slot in the list, it is released with the gateway
+        slot->owner = NO_WORKER;
+        return -1;
+    }
+
+    return 0;
+}
+
+/** re-arm a processed link, or hand it over to the worker, which asked for it */
+static void rearm(struct worker *worker, struct link_slot *slot)
+{
+    int thief = __atomic_load_n(&slot->steal_to, __ATOMIC_ACQUIRE);
+
+    if (thief != NO_WORKER && thief != worker->id)
+    {
+        struct worker *to = &worker->gateway->workers[thief];
+
+        epoll_ctl(worker->epoll_fd, EPOLL_CTL_DEL, whisper_serial__fd(slot->serial), 0);
+        __atomic_fetch_sub(&worker->links, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&to->links, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&to->steals, 1, __ATOMIC_RELAXED);
+        slot->owner = thief;
+        STORE(&slot->period_events, 0);
+        if (worker->period_hottest == slot)
+            worker->period_hottest = 0;
+        __atomic_store_n(&slot->steal_to, NO_WORKER, __ATOMIC_RELEASE);
+        // the link is published to the thief with the epoll, the state of the link goes with it
+        arm(to, slot, EPOLL_CTL_ADD);
+        return;
+    }
+
+    arm(worker, slot, EPOLL_CTL_MOD);
+}
+
+/** publish the load of the period and steal from the busiest worker if underloaded */
+static void rebalance(struct worker *worker)
+{
+    whisper_gateway_t gateway = worker->gateway;
+    struct worker *busiest = 0;
+    struct link_slot *hottest;
+    unsigned long hottest_load;
+    unsigned int i;
+
+    STORE(&worker->load, worker->period_events);
+    __atomic_store_n(&worker->hottest, worker->period_hottest, __ATOMIC_RELEASE);
+    ++worker->period;
+    worker->period_events = 0;
+    worker->period_hottest = 0;
+
+    if (gateway->config.no_stealing)
+        return;
+
+    for (i = 0; i < gateway->num_workers; i++)
+        if (!busiest || LOAD(&gateway->workers[i].load) > LOAD(&busiest->load))
+            busiest = &gateway->workers[i];
+
+    if (busiest == worker || LOAD(&busiest->links) < 2)
+        return;
+
+    hottest = __atomic_load_n(&busiest->hottest, __ATOMIC_ACQUIRE);
+    if (!hottest)
+        return;
+
+    // only steal if it evens the load out, otherwise the link would bounce
+    hottest_load = LOAD(&hottest->period_events);
+    if (LOAD(&worker->load) + 2 * hottest_load > LOAD(&busiest->load))
+        return;
+
+    {
+        int expected = NO_WORKER;
+        __atomic_compare_exchange_n(&hottest->steal_to, &expected, worker->id, 0, __ATOMIC_RELEASE,
+                                    __ATOMIC_RELAXED);
+    }
+    // published only once, a new hottest is published at the end of the next period
+    __atomic_store_n(&busiest->hottest, (struct link_slot *)0, __ATOMIC_RELAXED);
+}
+
+static void *run_worker(void *arg)
+{
+    struct worker *worker = arg;
+    whisper_gateway_t gateway = worker->gateway;
+    struct epoll_event events[MAX_EVENTS];
+
+    if (gateway->config.pin_workers)
+    {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        cpu_set_t cpus;
+
+        CPU_ZERO(&cpus);
+        CPU_SET(worker->id % (cores > 0 ? cores : 1), &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+
+    worker->period_end = now_ms() + gateway->config.rebalance_ms;
+    while (!__atomic_load_n(&gateway->stopping, __ATOMIC_ACQUIRE))
+    {
+        int num_events = epoll_wait(worker->epoll_fd, events, MAX_EVENTS, gateway->config.rebalance_ms);
+        int i;
+
+        for (i = 0; i < num_events; i++)
+        {
+            struct link_slot *slot = events[i].data.ptr;
+
+            if (whisper_serial__poll(slot->serial, 0) < 0)
+            {
+                epoll_ctl(worker->epoll_fd, EPOLL_CTL_DEL, whisper_serial__fd(slot->serial), 0);
+                __atomic_fetch_sub(&worker->links, 1, __ATOMIC_RELAXED);
+                __atomic_fetch_add(&worker->failures, 1, __ATOMIC_RELAXED);
+                slot->owner = NO_WORKER;
+                continue;
+            }
+
+            if (slot->period != worker->period)
+            {
+                slot->period = worker->period;
+                STORE(&slot->period_events, 0);
+            }
+            STORE(&slot->period_events, slot->period_events + 1);
+            if (!worker->period_hottest || slot->period_events > worker->period_hottest->period_events)
+                worker->period_hottest = slot;
+            ++worker->period_events;
+
+            rearm(worker, slot);
+        }
+        if (num_events > 0)
+            __atomic_fetch_add(&worker->events, num_events, __ATOMIC_RELAXED);
+
+        if (now_ms() >= worker->period_end)
+        {
+            rebalance(worker);
+            worker->period_end = now_ms() + gateway->config.rebalance_ms;
+        }
+    }
+
+    return 0;
+}
+
+char whisper_gateway__start(whisper_gateway_t gateway)
+{
+    unsigned int i;
+
+    if (gateway->running)
+        return -1;
+
+    gateway->stopping = 0;
+    for (i = 0; i < gateway->num_workers; i++)
+    {
+        if (pthread_create(&gateway->workers[i].thread, 0, run_worker, &gateway->workers[i]) != 0)
+        {
+            __atomic_store_n(&gateway->stopping, 1, __ATOMIC_RELEASE);
+            while (i--)
+                pthread_join(gateway->workers[i].thread, 0);
+            return -1;
+        }
+    }
+
+    gateway->running = 1;
+    return 0;
+}
+
+void whisper_gateway__stop(whisper_gateway_t gateway)
+{
+    unsigned int i;
+
+    if (!gateway->running)
+        return;
+
+    __atomic_store_n(&gateway->stopping, 1, __ATOMIC_RELEASE);
+    for (i = 0; i < gateway->num_workers; i++)
+        pthread_join(gateway->workers[i].thread, 0);
+    gateway->running = 0;
+}
+
+void whisper_gateway__destroy(whisper_gateway_t gateway)
+{
+    unsigned int i;
+
+    whisper_gateway__stop(gateway);
+
+    while (gateway->slots)
+    {
+        struct link_slot *slot = gateway->slots;
+        gateway->slots = slot->next;
+        whisper_serial__close(slot->serial);
+        free(slot);
+    }
+
+    for (i = 0; i < gateway->num_workers; i++)
+        close(gateway->workers[i].epoll_fd);
+    free(gateway->workers);
+    gateway->workers = 0;
+    pthread_mutex_destroy(&gateway->lock);
+}
+
+void whisper_gateway__stats(whisper_gateway_t gateway, unsigned int worker, struct whisper_gateway__stats *stats)
+{
+    struct worker *w = &gateway->workers[worker];
+
+    stats->links = LOAD(&w->links);
+    stats->events = LOAD(&w->events);
+    stats->steals = LOAD(&w->steals);
+    stats->failures = LOAD(&w->failures);
+}
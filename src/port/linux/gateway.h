@@ -0,0 +1,108 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef GATEWAY_H
+#define GATEWAY_H
+
+#include "basic_data_type.h"
+#include "serial_transport.h"
+
+/*
+ * Gateway engine, which terminates many links on a pool of worker threads.
+ *
+ * Every worker runs its own epoll loop, ideally pinned to a core. A link is
+ * owned by exactly one worker at a time and armed one-shot in its epoll, so
+ * the callbacks of a link never run concurrently and the link is processed
+ * without any lock.
+ *
+ * Workers publish their load and their hottest link at the end of every
+ * rebalance period. An underloaded worker asks to steal the hottest link of
+ * the busiest one, the owner hands it over the next time it re-arms the link.
+ *
+ * The callbacks of the links run on the workers. Sending on a link is only
+ * safe from its own callbacks, or before the gateway is started.
+ */
+
+typedef struct whisper_gateway *whisper_gateway_t;
+
+extern const uint16_t SIZEOF_WHISPER_GATEWAY_T;
+
+struct whisper_gateway__config
+{
+    /** number of worker threads, 0 for one per online core */
+    unsigned int num_workers;
+    /** pin worker n to core n */
+    uint8_t pin_workers;
+    /** period of the rebalancing in ms, 0 for 10 ms */
+    unsigned int rebalance_ms;
+    /** do not move links between the workers */
+    uint8_t no_stealing;
+};
+
+/** statistics of a worker */
+struct whisper_gateway__stats
+{
+    /** links owned by the worker */
+    unsigned long links;
+    /** events of the links processed by the worker */
+    unsigned long events;
+    /** links stolen by the worker */
+    unsigned long steals;
+    /** links, which failed or hung up, removed by the worker */
+    unsigned long failures;
+};
+
+/**
+ * @brief initialize a gateway, the workers are not started yet
+ *
+ * @param gateway memory of at least SIZEOF_WHISPER_GATEWAY_T bytes for the gateway
+ * @param config configuration of the gateway
+ * @return char 0 success, otherwise out of resources
+ */
+char whisper_gateway__init(whisper_gateway_t gateway, const struct whisper_gateway__config *config);
+
+/** return the number of workers of the gateway */
+unsigned int whisper_gateway__num_workers(whisper_gateway_t gateway);
+
+/**
+ * @brief add a link to the gateway, also while it is running
+ *
+ * @param gateway the gateway
+ * @param serial an open transport, which is owned by the gateway from now on
+ * @param worker the worker to own the link first, -1 for the one with the least links
+ * @return char 0 success, otherwise the transport cannot be watched
+ */
+char whisper_gateway__add(whisper_gateway_t gateway, whisper_serial_t serial, int worker);
+
+/** start the workers */
+char whisper_gateway__start(whisper_gateway_t gateway);
+
+/** stop the workers and wait for them, the links stay with the gateway */
+void whisper_gateway__stop(whisper_gateway_t gateway);
+
+/** stop the gateway, close all links and release the resources */
+void whisper_gateway__destroy(whisper_gateway_t gateway);
+
+/** read the statistics of a worker, also while the gateway is running */
+void whisper_gateway__stats(whisper_gateway_t gateway, unsigned int worker, struct whisper_gateway__stats *stats);
+
+#endif // GATEWAY_H
@@ -0,0 +1,407 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/timerfd.h>
+#include "serial_transport.h"
+
+#define READ_LEN 4096
+#define WRITE_LEN 4096
+// the line speed assumed for the batching, if the speed of the port is kept
+#define DEFAULT_BAUD 115200
+
+struct whisper_serial
+{
+    whisper_data_layer_t dl;
+    void *ctx;
+    int fd;
+    int timer_fd;
+    int epoll_fd;
+    // events of the port, epoll is only told about changes
+    unsigned int port_events;
+
+    // the bytes to write, out_len of them from out_start on
+    uint8_t out[WRITE_LEN];
+    unsigned int out_start;
+    unsigned int out_len;
+
+    void (*delay_cb)(whisper_data_layer_t dl);
+
+    // a batch is being received, the port is read once the linger time is over
+    uint8_t read_batch;
+    uint8_t lingering;
+    int linger_ms;
+    unsigned long long linger_until;
+};
+
+const uint16_t SIZEOF_WHISPER_SERIAL_T = sizeof(struct whisper_serial);
+
+static const struct
+{
+    unsigned long baud;
+    speed_t speed;
+} SPEEDS[] = {
+    {1200, B1200}, {2400, B2400}, {4800, B4800}, {9600, B9600}, {19200, B19200}, {38400, B38400},
+    {57600, B57600}, {115200, B115200}, {230400, B230400}, {460800, B460800}, {921600, B921600},
+};
+
+static unsigned long long now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+static char configure_port(int fd, unsigned long baud)
+{
+    struct termios tio;
+    unsigned int i;
+
+    if (tcgetattr(fd, &tio) != 0)
+        return -1;
+
+    cfmakeraw(&tio);
+    tio.c_cflag |= CLOCAL | CREAD;
+    // epoll only reports the port readable at VMIN bytes if VTIME is 0, which
+    // would hold back the tail of a burst, so the batching is done by the poll
+    tio.c_cc[VMIN] = 1;
+    tio.c_cc[VTIME] = 0;
+
+    if (baud)
+    {
+        for (i = 0; i < sizeof(SPEEDS) / sizeof(SPEEDS[0]); i++)
+            if (SPEEDS[i].baud == baud)
+                break;
+        if (i == sizeof(SPEEDS) / sizeof(SPEEDS[0]))
+        {
+            errno = EINVAL;
+            return -1;
+        }
+        cfsetispeed(&tio, SPEEDS[i].speed);
+        cfsetospeed(&tio, SPEEDS[i].speed);
+    }
+
+    if (tcsetattr(fd, TCSANOW, &tio) != 0)
+        return -1;
+    return 0;
+}
+
+/** tell epoll about the events of the port, which are of interest now */
+static void watch_port(whisper_serial_t serial)
+{
+    struct epoll_event event;
+    unsigned int events = (serial->lingering ? 0 : EPOLLIN) | (serial->out_len ? EPOLLOUT : 0);
+
+    if (events == serial->port_events)
+        return;
+
+    memset(&event, 0, sizeof(event));
+    event.events = events;
+    event.data.fd = serial->fd;
+    epoll_ctl(serial->epoll_fd, EPOLL_CTL_MOD, serial->fd, &event);
+    serial->port_events = events;
+}
+
+/** write out the batched bytes, as far as the port takes them */
+static char flush(whisper_serial_t serial)
+{
+    while (serial->out_len > 0)
+    {
+        ssize_t written = write(serial->fd, &serial->out[serial->out_start], serial->out_len);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN)
+                return -1;
+
+            // the port is full, continue when it drained
+            watch_port(serial);
+            return 0;
+        }
+        serial->out_start += written;
+        serial->out_len -= written;
+    }
+
+    serial->out_start = 0;
+    watch_port(serial);
+    return 0;
+}
+
+static void data_write(whisper_data_layer_t dl, const uint8_t *data, uint8_t data_len)
+{
+    whisper_serial_t serial = whisper_serial__of(dl);
+
+    if (serial->out_start + serial->out_len + data_len > WRITE_LEN)
+    {
+        // make room, the bytes, which still do not fit, are lost like on the line
+        flush(serial);
+        memmove(serial->out, &serial->out[serial->out_start], serial->out_len);
+        serial->out_start = 0;
+        if (serial->out_len + data_len > WRITE_LEN)
+            return;
+    }
+
+    memcpy(&serial->out[serial->out_start + serial->out_len], data, data_len);
+    serial->out_len += data_len;
+}
+
+static void set_delay(whisper_data_layer_t dl, uint16_t delay_in_ms, void (*delay_cb)(whisper_data_layer_t dl))
+{
+    whisper_serial_t serial = whisper_serial__of(dl);
+    struct itimerspec spec;
+
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = delay_in_ms / 1000;
+    spec.it_value.tv_nsec = (delay_in_ms % 1000) * 1000000L;
+    if (delay_in_ms == 0)
+        // a zero value disarms the timer
+        spec.it_value.tv_nsec = 1;
+
+    serial->delay_cb = delay_cb;
+    timerfd_settime(serial->timer_fd, 0, &spec, 0);
+}
+
+static void cancel_delay(whisper_data_layer_t dl)
+{
+    whisper_serial_t serial = whisper_serial__of(dl);
+    struct itimerspec spec;
+
+    memset(&spec, 0, sizeof(spec));
+    serial->delay_cb = 0;
+    timerfd_settime(serial->timer_fd, 0, &spec, 0);
+}
+
+char whisper_serial__open(whisper_serial_t serial, const struct whisper_serial__config *config)
+{
+    struct whisper_data_layer__config link = config->link;
+    struct epoll_event event;
+    uint8_t read_batch = config->read_batch ? config->read_batch : 1;
+    int saved_errno;
+
+    memset(serial, 0, sizeof(struct whisper_serial));
+    serial->fd = -1;
+    serial->timer_fd = -1;
+    serial->epoll_fd = -1;
+
+    if (config->path)
+        serial->fd = open(config->path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    else
+        serial->fd = config->fd;
+    if (serial->fd < 0 || fcntl(serial->fd, F_SETFL, fcntl(serial->fd, F_GETFL) | O_NONBLOCK) != 0)
+        goto fail;
+    // other streams, e.g. sockets, carry links between processes or threads
+    if (isatty(serial->fd) && configure_port(serial->fd, config->baud) != 0)
+        goto fail;
+
+    // the time of a batch on the line, at least 1 ms
+    serial->read_batch = read_batch;
+    serial->linger_ms = read_batch * 10 * 1000 / (config->baud ? config->baud : DEFAULT_BAUD) + 1;
+
+    serial->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    serial->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (serial->timer_fd < 0 || serial->epoll_fd < 0)
+        goto fail;
+
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = serial->fd;
+    if (epoll_ctl(serial->epoll_fd, EPOLL_CTL_ADD, serial->fd, &event) != 0)
+        goto fail;
+    serial->port_events = EPOLLIN;
+    event.data.fd = serial->timer_fd;
+    if (epoll_ctl(serial->epoll_fd, EPOLL_CTL_ADD, serial->timer_fd, &event) != 0)
+        goto fail;
+
+    serial->ctx = link.ctx;
+    link.ctx = serial;
+    link.data_write = data_write;
+    link.set_delay = set_delay;
+    link.cancel_delay = cancel_delay;
+    link.timers = 0;
+    serial->dl = malloc(SIZEOF_WHISPER_DATA_LAYER_T);
+    if (!serial->dl)
+        goto fail;
+    whisper_data_layer__init(serial->dl, &link);
+    return 0;
+
+fail:
+    saved_errno = errno;
+    whisper_serial__close(serial);
+    errno = saved_errno;
+    return -1;
+}
+
+void whisper_serial__close(whisper_serial_t serial)
+{
+    if (serial->epoll_fd >= 0)
+        close(serial->epoll_fd);
+    if (serial->timer_fd >= 0)
+        close(serial->timer_fd);
+    if (serial->fd >= 0)
+        close(serial->fd);
+    free(serial->dl);
+    serial->epoll_fd = serial->timer_fd = serial->fd = -1;
+    serial->dl = 0;
+}
+
+whisper_data_layer_t whisper_serial__link(whisper_serial_t serial)
+{
+    return serial->dl;
+}
+
+whisper_serial_t whisper_serial__of(whisper_data_layer_t dl)
+{
+    return whisper_data_layer__ctx(dl);
+}
+
+void *whisper_serial__ctx(whisper_serial_t serial)
+{
+    return serial->ctx;
+}
+
+int whisper_serial__fd(whisper_serial_t serial)
+{
+    return serial->epoll_fd;
+}
+
+/** read everything, which is available, into the link */
+static char read_port(whisper_serial_t serial)
+{
+    uint8_t buf[READ_LEN];
+
+    while (1)
+    {
+        ssize_t len = read(serial->fd, buf, sizeof(buf));
+        ssize_t offset;
+
+        if (len < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN)
+                break;
+            return -1;
+        }
+        if (len == 0)
+            // hung up
+            return -1;
+
+        // feed in chunks, which fit the length of the link
+        for (offset = 0; offset < len; offset += 255)
+            whisper_data_layer__data_received(serial->dl, &buf[offset], len - offset < 255 ? len - offset : 255);
+        if (len < (ssize_t)sizeof(buf))
+            break;
+    }
+
+    return 0;
+}
+
+static void expire_timer(whisper_serial_t serial)
+{
+    unsigned long long expirations;
+    void (*delay_cb)(whisper_data_layer_t dl) = serial->delay_cb;
+
+    if (read(serial->timer_fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+        // spurious, or re-armed since it expired
+        return;
+
+    serial->delay_cb = 0;
+    if (delay_cb)
+        delay_cb(serial->dl);
+}
+
+int whisper_serial__poll(whisper_serial_t serial, int timeout_ms)
+{
+    struct epoll_event events[2];
+    int num_events;
+    int i;
+
+    if (serial->lingering)
+    {
+        unsigned long long now = now_ms();
+        int left = serial->linger_until > now ? serial->linger_until - now : 0;
+
+        if (timeout_ms < 0 || timeout_ms > left)
+            timeout_ms = left;
+    }
+
+    num_events = epoll_wait(serial->epoll_fd, events, 2, timeout_ms);
+    if (num_events < 0)
+        return errno == EINTR ? 0 : -1;
+
+    if (serial->lingering && now_ms() >= serial->linger_until)
+    {
+        // the batch is in, or the line went quiet
+        serial->lingering = 0;
+        watch_port(serial);
+        if (read_port(serial) != 0)
+            return -1;
+    }
+
+    for (i = 0; i < num_events; i++)
+    {
+        if (events[i].data.fd == serial->timer_fd)
+        {
+            expire_timer(serial);
+            continue;
+        }
+
+        if (events[i].events & EPOLLIN)
+        {
+            int available = 0;
+
+            if (serial->read_batch > 1 && ioctl(serial->fd, FIONREAD, &available) == 0 &&
+                available < serial->read_batch)
+            {
+                // the start of a burst, wait for the batch before reading
+                serial->lingering = 1;
+                serial->linger_until = now_ms() + serial->linger_ms;
+                watch_port(serial);
+            }
+            else if (read_port(serial) != 0)
+                return -1;
+        }
+        else if (events[i].events & (EPOLLERR | EPOLLHUP))
+            return -1;
+    }
+
+    if (flush(serial) != 0)
+        return -1;
+    return num_events;
+}
+
+uint16_t whisper_serial__send(whisper_serial_t serial, uint8_t *data, uint8_t data_length, uint8_t ack_required)
+{
+    uint16_t seq_no = whisper_data_layer__data_sent(serial->dl, data, data_length, ack_required);
+
+    flush(serial);
+    return seq_no;
+}
@@ -0,0 +1,116 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef SERIAL_TRANSPORT_H
+#define SERIAL_TRANSPORT_H
+
+#include "basic_data_type.h"
+#include "data_layer.h"
+
+/*
+ * Reference transport of a link over a Linux serial port.
+ *
+ * The port is put into raw mode, read in large chunks whenever epoll reports
+ * it readable and fed to the data layer. The bytes written by the data layer
+ * during one event are batched into a single write. The retransmission delay
+ * runs on a timerfd, so a link costs no CPU while it is idle.
+ *
+ * The transport owns an epoll instance with the port and the timer in it.
+ * Either drive it with whisper_serial__poll or add whisper_serial__fd to the
+ * event loop of the application and call whisper_serial__poll with a zero
+ * timeout when it is readable.
+ */
+
+typedef struct whisper_serial *whisper_serial_t;
+
+extern const uint16_t SIZEOF_WHISPER_SERIAL_T;
+
+struct whisper_serial__config
+{
+    /** path of the serial device, or null to take over fd */
+    const char *path;
+    /** open serial port or any other stream, used if there is no path and closed with the transport */
+    int fd;
+    /** line speed in bits per second, 0 keeps the current speed */
+    unsigned long baud;
+    /**
+     * @brief number of bytes to read at once
+     *
+     * With a batch above 1, the port is read when the batch is in or the
+     * time of the batch on the line has passed since the first byte arrived,
+     * which saves wakeups and reads on slow lines at the cost of latency.
+     * 0 is taken as 1, every byte is read as it arrives.
+     */
+    uint8_t read_batch;
+    /**
+     * @brief configuration of the link
+     *
+     * data_write, set_delay, cancel_delay and timers are provided by the
+     * transport, ctx is available through whisper_serial__ctx.
+     */
+    struct whisper_data_layer__config link;
+};
+
+/**
+ * @brief open the serial port and initialize the link on it
+ *
+ * @param serial memory of at least SIZEOF_WHISPER_SERIAL_T bytes for the transport
+ * @param config configuration of the transport
+ * @return char 0 success, otherwise the port cannot be opened or configured, see errno
+ */
+char whisper_serial__open(whisper_serial_t serial, const struct whisper_serial__config *config);
+
+/** close the port and release the resources of the transport */
+void whisper_serial__close(whisper_serial_t serial);
+
+/** return the link of the transport */
+whisper_data_layer_t whisper_serial__link(whisper_serial_t serial);
+
+/** return the transport of a link, e.g. in the callbacks of the link */
+whisper_serial_t whisper_serial__of(whisper_data_layer_t dl);
+
+/** return the context given in the configuration of the link */
+void *whisper_serial__ctx(whisper_serial_t serial);
+
+/** return the epoll descriptor of the transport, which is readable when there are events to process */
+int whisper_serial__fd(whisper_serial_t serial);
+
+/**
+ * @brief wait for and process the events of the port and the timer
+ *
+ * @param serial the transport
+ * @param timeout_ms longest time to wait, 0 to only process pending events, -1 to wait forever
+ * @return int number of events processed, -1 if the port failed or was hung up
+ */
+int whisper_serial__poll(whisper_serial_t serial, int timeout_ms);
+
+/**
+ * @brief send a frame on the link and write it out
+ *
+ * The payload is retransmitted from the given memory, so it must stay intact
+ * until data_ack_cb is called for the frame.
+ *
+ * @return the sequence no of the frame, 0 if a frame is still in flight
+ */
+uint16_t whisper_serial__send(whisper_serial_t serial, uint8_t *data, uint8_t data_length, uint8_t ack_required);
+
+#endif // SERIAL_TRANSPORT_H
@@ -0,0 +1,323 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "shm_transport.h"
+
+#define MAGIC 0x77687370UL
+#define CACHE_LINE 64
+
+/** a ring in the shared region, the indexes run freely and wrap with the ring length */
+struct ring
+{
+    // written by the consumer
+    unsigned int head;
+    char consumer_line[CACHE_LINE - sizeof(unsigned int)];
+    // written by the producer, the futex the consumer sleeps on
+    unsigned int tail;
+    char producer_line[CACHE_LINE - sizeof(unsigned int)];
+    // set by the consumer before it goes to sleep
+    unsigned int waiting;
+    char waiting_line[CACHE_LINE - sizeof(unsigned int)];
+};
+
+struct region
+{
+    unsigned long magic;
+    unsigned long ring_len;
+    char header_line[CACHE_LINE - 2 * sizeof(unsigned long)];
+    struct ring rings[2];
+    // the bytes of ring 0, then the ones of ring 1
+};
+
+struct whisper_shm
+{
+    whisper_data_layer_t dl;
+    void *ctx;
+    struct region *region;
+    unsigned long region_len;
+    unsigned int mask;
+
+    // the ring written by this side, with the bytes written but not published yet
+    struct ring *tx;
+    uint8_t *tx_data;
+    unsigned int tx_tail;
+    // the head of the tx ring seen last, refreshed when the ring looks full
+    unsigned int tx_head;
+
+    // the ring read by this side
+    struct ring *rx;
+    uint8_t *rx_data;
+
+    // the retransmission delay, on a wheel ticking in ms
+    whisper_timer_wheel_t timers;
+    // set while poll runs the callbacks of the link
+    char polling;
+};
+
+const uint16_t SIZEOF_WHISPER_SHM_T = sizeof(struct whisper_shm);
+
+static unsigned long now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000UL + ts.tv_nsec / 1000000;
+}
+
+static int futex(unsigned int *word, int op, unsigned int value, const struct timespec *timeout)
+{
+    return syscall(SYS_futex, word, op, value, timeout, 0, 0);
+}
+
+int whisper_shm__create(unsigned long ring_len)
+{
+    struct region header;
+    int fd;
+
+    if (ring_len < CACHE_LINE || (ring_len & (ring_len - 1)) != 0 || ring_len > UINT_MAX / 2 + 1)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    fd = memfd_create("whisper_shm", MFD_CLOEXEC);
+    if (fd < 0)
+        return -1;
+
+    memset(&header, 0, sizeof(header));
+    header.magic = MAGIC;
+    header.ring_len = ring_len;
+    if (ftruncate(fd, sizeof(struct region) + 2 * ring_len) != 0 ||
+        pwrite(fd, &header, sizeof(header), 0) != sizeof(header))
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static void data_write(whisper_data_layer_t dl, const uint8_t *data, uint8_t data_len)
+{
+    whisper_shm_t shm = whisper_shm__of(dl);
+    unsigned int offset;
+    unsigned int first;
+
+    if (shm->tx_tail - shm->tx_head + data_len > shm->mask + 1)
+    {
+        shm->tx_head = __atomic_load_n(&shm->tx->head, __ATOMIC_ACQUIRE);
+        if (shm->tx_tail - shm->tx_head + data_len > shm->mask + 1)
+            // the peer is behind, the bytes are lost like on a line
+            return;
+    }
+
+    // copy into the ring, in two pieces if it wraps
+    offset = shm->tx_tail & shm->mask;
+    first = shm->mask + 1 - offset;
+    if (first > data_len)
+        first = data_len;
+    memcpy(&shm->tx_data[offset], data, first);
+    memcpy(shm->tx_data, &data[first], data_len - first);
+    shm->tx_tail += data_len;
+}
+
+/** publish the written bytes and wake the peer if it sleeps */
+static void flush(whisper_shm_t shm)
+{
+    if (__atomic_load_n(&shm->tx->tail, __ATOMIC_RELAXED) == shm->tx_tail)
+        return;
+
+    __atomic_store_n(&shm->tx->tail, shm->tx_tail, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&shm->tx->waiting, __ATOMIC_SEQ_CST))
+    {
+        __atomic_store_n(&shm->tx->waiting, 0, __ATOMIC_RELAXED);
+        futex(&shm->tx->tail, FUTEX_WAKE, 1, 0);
+    }
+}
+
+char whisper_shm__open(whisper_shm_t shm, const struct whisper_shm__config *config)
+{
+    struct whisper_data_layer__config link = config->link;
+    struct region header;
+    uint8_t *data;
+
+    memset(shm, 0, sizeof(struct whisper_shm));
+    if (config->side > 1 || pread(config->fd, &header, sizeof(header), 0) != sizeof(header) ||
+        header.magic != MAGIC)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    shm->region_len = sizeof(struct region) + 2 * header.ring_len;
+    shm->region = mmap(0, shm->region_len, PROT_READ | PROT_WRITE, MAP_SHARED, config->fd, 0);
+    if (shm->region == MAP_FAILED)
+    {
+        shm->region = 0;
+        return -1;
+    }
+
+    shm->mask = header.ring_len - 1;
+    data = (uint8_t *)(shm->region + 1);
+    shm->tx = &shm->region->rings[config->side];
+    shm->tx_data = &data[config->side * header.ring_len];
+    shm->tx_tail = shm->tx_head = __atomic_load_n(&shm->tx->tail, __ATOMIC_ACQUIRE);
+    shm->rx = &shm->region->rings[!config->side];
+    shm->rx_data = &data[!config->side * header.ring_len];
+
+    shm->timers = malloc(SIZEOF_WHISPER_TIMER_WHEEL_T);
+    shm->dl = malloc(SIZEOF_WHISPER_DATA_LAYER_T);
+    if (!shm->timers || !shm->dl)
+    {
+        whisper_shm__close(shm);
+        errno = ENOMEM;
+        return -1;
+    }
+    whisper_timer_wheel__init(shm->timers, now_ms());
+
+    shm->ctx = link.ctx;
+    link.ctx = shm;
+    link.data_write = data_write;
+    link.set_delay = 0;
+    link.cancel_delay = 0;
+    link.timers = shm->timers;
+    whisper_data_layer__init(shm->dl, &link);
+    return 0;
+}
+
+void whisper_shm__close(whisper_shm_t shm)
+{
+    if (shm->region)
+        munmap(shm->region, shm->region_len);
+    free(shm->timers);
+    free(shm->dl);
+    shm->region = 0;
+    shm->timers = 0;
+    shm->dl = 0;
+}
+
+whisper_data_layer_t whisper_shm__link(whisper_shm_t shm)
+{
+    return shm->dl;
+}
+
+whisper_shm_t whisper_shm__of(whisper_data_layer_t dl)
+{
+    return whisper_data_layer__ctx(dl);
+}
+
+void *whisper_shm__ctx(whisper_shm_t shm)
+{
+    return shm->ctx;
+}
+
+/** hand the bytes of the peer from the ring to the link, which copies them into its receive buffer, return the number of bytes */
+static unsigned int receive(whisper_shm_t shm)
+{
+    unsigned int head = shm->rx->head;
+    unsigned int tail = __atomic_load_n(&shm->rx->tail, __ATOMIC_ACQUIRE);
+    unsigned int len = tail - head;
+
+    while (head != tail)
+    {
+        unsigned int offset = head & shm->mask;
+        unsigned int chunk = tail - head;
+
+        // up to the end of the ring and the length the link takes at once
+        if (chunk > shm->mask + 1 - offset)
+            chunk = shm->mask + 1 - offset;
+        if (chunk > 255)
+            chunk = 255;
+
+        whisper_data_layer__data_received(shm->dl, &shm->rx_data[offset], chunk);
+        head += chunk;
+    }
+
+    __atomic_store_n(&shm->rx->head, head, __ATOMIC_RELEASE);
+    return len;
+}
+
+/** sleep until the peer publishes bytes or the timeout passes */
+static void wait(whisper_shm_t shm, int timeout_ms)
+{
+    struct timespec timeout;
+    unsigned int tail = shm->rx->head;
+
+    __atomic_store_n(&shm->rx->waiting, 1, __ATOMIC_SEQ_CST);
+    // the peer may have published after the last look, see flush
+    if (__atomic_load_n(&shm->rx->tail, __ATOMIC_SEQ_CST) == tail)
+    {
+        timeout.tv_sec = timeout_ms / 1000;
+        timeout.tv_nsec = (timeout_ms % 1000) * 1000000L;
+        futex(&shm->rx->tail, FUTEX_WAIT, tail, timeout_ms < 0 ? 0 : &timeout);
+    }
+    __atomic_store_n(&shm->rx->waiting, 0, __ATOMIC_RELAXED);
+}
+
+int whisper_shm__poll(whisper_shm_t shm, int timeout_ms)
+{
+    unsigned int len;
+    unsigned long deadline;
+
+    if (__atomic_load_n(&shm->rx->tail, __ATOMIC_ACQUIRE) == shm->rx->head && timeout_ms != 0)
+    {
+        // sleep no longer than up to the next retransmission
+        if (whisper_timer_wheel__next_deadline(shm->timers, &deadline) == 0)
+        {
+            unsigned long now = now_ms();
+            int left = deadline > now ? deadline - now : 0;
+
+            if (timeout_ms < 0 || timeout_ms > left)
+                timeout_ms = left;
+        }
+        if (timeout_ms != 0)
+            wait(shm, timeout_ms);
+    }
+
+    // frames sent from the callbacks count their delay from now
+    shm->polling = 1;
+    whisper_timer_wheel__advance(shm->timers, now_ms());
+    len = receive(shm);
+    shm->polling = 0;
+    flush(shm);
+    return len;
+}
+
+uint16_t whisper_shm__send(whisper_shm_t shm, uint8_t *data, uint8_t data_length, uint8_t ack_required)
+{
+    uint16_t seq_no;
+
+    if (!shm->polling)
+        whisper_timer_wheel__advance(shm->timers, now_ms());
+    seq_no = whisper_data_layer__data_sent(shm->dl, data, data_length, ack_required);
+    flush(shm);
+    return seq_no;
+}
@@ -0,0 +1,114 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef SHM_TRANSPORT_H
+#define SHM_TRANSPORT_H
+
+#include "basic_data_type.h"
+#include "data_layer.h"
+
+/*
+ * Transport of a link between two processes on the same host, over a shared
+ * memory region.
+ *
+ * The region holds one single producer, single consumer byte ring per
+ * direction. The data layer writes its frames straight into the ring of its
+ * direction and the bytes are published once per event. The receiving side
+ * hands them from the ring to its link, which copies them into its receive
+ * buffer as it does with any transport, so only the send side saves a copy.
+ * A side waiting for bytes sleeps on a futex, which is only woken if the side
+ * is actually asleep, so a busy link makes no system calls at all.
+ *
+ * Create the region with whisper_shm__create, hand the descriptor to the
+ * other process, e.g. by fork or over a unix socket, and open one side of it
+ * in each process.
+ */
+
+typedef struct whisper_shm *whisper_shm_t;
+
+extern const uint16_t SIZEOF_WHISPER_SHM_T;
+
+struct whisper_shm__config
+{
+    /** the shared memory region, as returned by whisper_shm__create */
+    int fd;
+    /** side of the region, 0 or 1, the two processes take different sides */
+    uint8_t side;
+    /**
+     * @brief configuration of the link
+     *
+     * data_write and timers are provided by the transport, the delay of
+     * retransmissions runs on a wheel ticking in ms, ctx is available
+     * through whisper_shm__ctx.
+     */
+    struct whisper_data_layer__config link;
+};
+
+/**
+ * @brief create a shared memory region
+ *
+ * @param ring_len length of the ring of each direction, a power of 2
+ * @return int descriptor of the region, -1 if it can not be created
+ */
+int whisper_shm__create(unsigned long ring_len);
+
+/**
+ * @brief map a side of the region and initialize the link on it
+ *
+ * @param shm memory of at least SIZEOF_WHISPER_SHM_T bytes for the transport
+ * @param config configuration of the transport, the descriptor is not taken over
+ * @return char 0 success, otherwise the region is invalid
+ */
+char whisper_shm__open(whisper_shm_t shm, const struct whisper_shm__config *config);
+
+/** unmap the region and release the resources of the transport */
+void whisper_shm__close(whisper_shm_t shm);
+
+/** return the link of the transport */
+whisper_data_layer_t whisper_shm__link(whisper_shm_t shm);
+
+/** return the transport of a link, e.g. in the callbacks of the link */
+whisper_shm_t whisper_shm__of(whisper_data_layer_t dl);
+
+/** return the context given in the configuration of the link */
+void *whisper_shm__ctx(whisper_shm_t shm);
+
+/**
+ * @brief wait for and process the bytes of the peer and the retransmission timer
+ *
+ * @param shm the transport
+ * @param timeout_ms longest time to wait, 0 to only process pending bytes, -1 to wait forever
+ * @return int number of bytes processed
+ */
+int whisper_shm__poll(whisper_shm_t shm, int timeout_ms);
+
+/**
+ * @brief send a frame on the link and publish it to the peer
+ *
+ * The payload is retransmitted from the given memory, so it must stay intact
+ * until data_ack_cb is called for the frame.
+ *
+ * @return the sequence no of the frame, 0 if a frame is still in flight
+ */
+uint16_t whisper_shm__send(whisper_shm_t shm, uint8_t *data, uint8_t data_length, uint8_t ack_required);
+
+#endif // SHM_TRANSPORT_H
@@ -0,0 +1,446 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "udp_transport.h"
+
+#define DEFAULT_BATCH 64
+// the longest datagram received, and the most bytes of a link in one datagram
+#define DATAGRAM_LEN 2048
+// at most that many batches are received in one poll, so that the timers keep running
+#define MAX_BATCHES 16
+
+struct link
+{
+    struct whisper_udp *udp;
+    whisper_data_layer_t dl;
+    void *ctx;
+    struct sockaddr_in peer;
+    // the bytes written by the link since the last flush, one datagram
+    uint8_t out[DATAGRAM_LEN];
+    unsigned int out_len;
+};
+
+struct whisper_udp
+{
+    int fd;
+    unsigned int batch;
+    unsigned int max_links;
+    unsigned int num_links;
+    struct link **links;
+    // the links by peer, open addressing over index + 1 of the link, 0 is empty
+    unsigned int *peers;
+    unsigned int peers_mask;
+
+    // the batch received
+    struct mmsghdr *rx_msgs;
+    struct iovec *rx_iov;
+    struct sockaddr_in *rx_addrs;
+    uint8_t *rx_bufs;
+
+    // the batch to send, a datagram of each link with bytes written
+    struct mmsghdr *tx_msgs;
+    struct iovec *tx_iov;
+    struct link **tx_links;
+    unsigned int tx_len;
+
+    whisper_timer_wheel_t timers;
+    // set while poll runs the callbacks of the links
+    char polling;
+    struct whisper_udp__stats stats;
+};
+
+const uint16_t SIZEOF_WHISPER_UDP_T = sizeof(struct whisper_udp);
+
+static unsigned long now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000UL + ts.tv_nsec / 1000000;
+}
+
+static unsigned int peer_hash(const struct sockaddr_in *addr)
+{
+    unsigned long key = (unsigned long)addr->sin_addr.s_addr << 16 ^ addr->sin_port;
+    return (key * 0x9E3779B1UL) >> 7;
+}
+
+static struct link *find_link(whisper_udp_t udp, const struct sockaddr_in *addr)
+{
+    unsigned int i = peer_hash(addr) & udp->peers_mask;
+
+    for (;; i = (i + 1) & udp->peers_mask)
+    {
+        struct link *link;
+
+        if (udp->peers[i] == 0)
+            return 0;
+        link = udp->links[udp->peers[i] - 1];
+        if (link->peer.sin_addr.s_addr == addr->sin_addr.s_addr && link->peer.sin_port == addr->sin_port)
+            return link;
+    }
+}
+
+char whisper_udp__open(whisper_udp_t udp, const struct whisper_udp__config *config)
+{
+    struct sockaddr_in addr;
+    unsigned int i;
+
+    memset(udp, 0, sizeof(struct whisper_udp));
+    udp->fd = -1;
+    udp->batch = config->batch ? config->batch : DEFAULT_BATCH;
+    udp->max_links = config->max_links;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(config->port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (config->addr && inet_pton(AF_INET, config->addr, &addr.sin_addr) != 1)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // a table at most half full
+    for (udp->peers_mask = 1; udp->peers_mask < 2 * udp->max_links; udp->peers_mask <<= 1)
+        ;
+    udp->links = calloc(udp->max_links + 1, sizeof(struct link *));
+    udp->peers = calloc(udp->peers_mask, sizeof(unsigned int));
+    --udp->peers_mask;
+    udp->rx_msgs = calloc(udp->batch, sizeof(struct mmsghdr));
+    udp->rx_iov = calloc(udp->batch, sizeof(struct iovec));
+    udp->rx_addrs = calloc(udp->batch, sizeof(struct sockaddr_in));
+    udp->rx_bufs = malloc(udp->batch * DATAGRAM_LEN);
+    udp->tx_msgs = calloc(udp->batch, sizeof(struct mmsghdr));
+    udp->tx_iov = calloc(udp->batch, sizeof(struct iovec));
+    udp->tx_links = calloc(udp->batch, sizeof(struct link *));
+    udp->timers = malloc(SIZEOF_WHISPER_TIMER_WHEEL_T);
+    if (!udp->links || !udp->peers || !udp->rx_msgs || !udp->rx_iov || !udp->rx_addrs || !udp->rx_bufs ||
+        !udp->tx_msgs || !udp->tx_iov || !udp->tx_links || !udp->timers)
+    {
+        whisper_udp__close(udp);
+        errno = ENOMEM;
+        return -1;
+    }
+    whisper_timer_wheel__init(udp->timers, now_ms());
+
+    for (i = 0; i < udp->batch; i++)
+    {
+        udp->rx_iov[i].iov_base = &udp->rx_bufs[i * DATAGRAM_LEN];
+        udp->rx_iov[i].iov_len = DATAGRAM_LEN;
+        udp->rx_msgs[i].msg_hdr.msg_iov = &udp->rx_iov[i];
+        udp->rx_msgs[i].msg_hdr.msg_iovlen = 1;
+        udp->rx_msgs[i].msg_hdr.msg_name = &udp->rx_addrs[i];
+        udp->tx_msgs[i].msg_hdr.msg_iov = &udp->tx_iov[i];
+        udp->tx_msgs[i].msg_hdr.msg_iovlen = 1;
+        udp->tx_msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+    }
+
+    udp->fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (udp->fd < 0 || bind(udp->fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        int error = errno;
+        whisper_udp__close(udp);
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+void whisper_udp__close(whisper_udp_t udp)
+{
+    unsigned int i;
+
+    if (udp->fd >= 0)
+        close(udp->fd);
+    udp->fd = -1;
+    for (i = 0; i < udp->num_links; i++)
+    {
+        free(udp->links[i]->dl);
+        free(udp->links[i]);
+    }
+    udp->num_links = 0;
+    free(udp->links);
+    free(udp->peers);
+    free(udp->rx_msgs);
+    free(udp->rx_iov);
+    free(udp->rx_addrs);
+    free(udp->rx_bufs);
+    free(udp->tx_msgs);
+    free(udp->tx_iov);
+    free(udp->tx_links);
+    free(udp->timers);
+    udp->links = 0;
+    udp->peers = 0;
+    udp->rx_msgs = udp->tx_msgs = 0;
+    udp->rx_iov = udp->tx_iov = 0;
+    udp->rx_addrs = 0;
+    udp->rx_bufs = 0;
+    udp->tx_links = 0;
+    udp->timers = 0;
+}
+
+uint16_t whisper_udp__port(whisper_udp_t udp)
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+
+    if (getsockname(udp->fd, (struct sockaddr *)&addr, &len) != 0)
+        return 0;
+    return ntohs(addr.sin_port);
+}
+
+int whisper_udp__fd(whisper_udp_t udp)
+{
+    return udp->fd;
+}
+
+void whisper_udp__flush(whisper_udp_t udp)
+{
+    unsigned int sent = 0;
+    unsigned int i;
+
+    for (i = 0; i < udp->tx_len; i++)
+    {
+        struct link *link = udp->tx_links[i];
+
+        udp->tx_iov[i].iov_base = link->out;
+        udp->tx_iov[i].iov_len = link->out_len;
+        udp->tx_msgs[i].msg_hdr.msg_name = &link->peer;
+    }
+
+    while (sent < udp->tx_len)
+    {
+        int n = sendmmsg(udp->fd, &udp->tx_msgs[sent], udp->tx_len - sent, 0);
+
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            // the socket buffer is full or the peer unreachable, the links retransmit
+            udp->stats.send_drops += udp->tx_len - sent;
+            break;
+        }
+        sent += n;
+        udp->stats.datagrams_out += n;
+        ++udp->stats.send_calls;
+    }
+
+    for (i = 0; i < udp->tx_len; i++)
+        udp->tx_links[i]->out_len = 0;
+    udp->tx_len = 0;
+}
+
+static void data_write(whisper_data_layer_t dl, const uint8_t *data, uint8_t data_len)
+{
+    struct link *link = whisper_data_layer__ctx(dl);
+    whisper_udp_t udp = link->udp;
+
+    if (link->out_len + data_len > DATAGRAM_LEN)
+        whisper_udp__flush(udp);
+
+    if (link->out_len == 0)
+    {
+        // the first bytes of the link since the last flush, it takes a datagram of the batch
+        if (udp->tx_len == udp->batch)
+            whisper_udp__flush(udp);
+        udp->tx_links[udp->tx_len++] = link;
+    }
+
+    memcpy(&link->out[link->out_len], data, data_len);
+    link->out_len += data_len;
+}
+
+whisper_data_layer_t whisper_udp__add(whisper_udp_t udp, const char *addr, uint16_t port,
+                                      const struct whisper_data_layer__config *config)
+{
+    struct whisper_data_layer__config link_config = *config;
+    struct link *link;
+    unsigned int i;
+
+    if (udp->num_links == udp->max_links)
+        return 0;
+
+    link = calloc(1, sizeof(struct link));
+    if (!link)
+        return 0;
+    link->peer.sin_family = AF_INET;
+    link->peer.sin_port = htons(port);
+    if (inet_pton(AF_INET, addr, &link->peer.sin_addr) != 1 || find_link(udp, &link->peer))
+    {
+        free(link);
+        return 0;
+    }
+    link->dl = malloc(SIZEOF_WHISPER_DATA_LAYER_T);
+    if (!link->dl)
+    {
+        free(link);
+        return 0;
+    }
+
+    link->udp = udp;
+    link->ctx = config->ctx;
+    link_config.ctx = link;
+    link_config.data_write = data_write;
+    link_config.set_delay = 0;
+    link_config.cancel_delay = 0;
+    link_config.timers = udp->timers;
+    whisper_data_layer__init(link->dl, &link_config);
+
+    udp->links[udp->num_links++] = link;
+    for (i = peer_hash(&link->peer) & udp->peers_mask; udp->peers[i]; i = (i + 1) & udp->peers_mask)
+        ;
+    udp->peers[i] = udp->num_links;
+    return link->dl;
+}
+
+whisper_udp_t whisper_udp__of(whisper_data_layer_t dl)
+{
+    return ((struct link *)whisper_data_layer__ctx(dl))->udp;
+}
+
+void *whisper_udp__ctx(whisper_data_layer_t dl)
+{
+    return ((struct link *)whisper_data_layer__ctx(dl))->ctx;
+}
+
+/** receive the pending datagrams in batches and feed them to their links, return their number or -1 */
+static int receive(whisper_udp_t udp)
+{
+    int received = 0;
+    unsigned int batches;
+
+    for (batches = 0; batches < MAX_BATCHES; batches++)
+    {
+        int n;
+        int i;
+
+        for (i = 0; i < (int)udp->batch; i++)
+            udp->rx_msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+
+        n = recvmmsg(udp->fd, udp->rx_msgs, udp->batch, MSG_DONTWAIT, 0);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            return -1;
+        }
+        ++udp->stats.recv_calls;
+        udp->stats.datagrams_in += n;
+        received += n;
+
+        for (i = 0; i < n; i++)
+        {
+            struct link *link = find_link(udp, &udp->rx_addrs[i]);
+            uint8_t *data = udp->rx_iov[i].iov_base;
+            unsigned int len = udp->rx_msgs[i].msg_len;
+
+            if (!link)
+            {
+                ++udp->stats.unknown_peers;
+                continue;
+            }
+
+            // the data layer takes up to 255 bytes at once
+            while (len > 0)
+            {
+                uint8_t chunk = len > 255 ? 255 : len;
+
+                whisper_data_layer__data_received(link->dl, data, chunk);
+                data += chunk;
+                len -= chunk;
+            }
+        }
+
+        if (n < (int)udp->batch)
+            break;
+    }
+
+    return received;
+}
+
+int whisper_udp__poll(whisper_udp_t udp, int timeout_ms)
+{
+    int received;
+
+    udp->polling = 1;
+    whisper_timer_wheel__advance(udp->timers, now_ms());
+    received = receive(udp);
+
+    if (received == 0 && timeout_ms != 0)
+    {
+        struct pollfd pfd;
+        unsigned long deadline;
+        int ready;
+
+        // sleep no longer than up to the next retransmission
+        if (whisper_timer_wheel__next_deadline(udp->timers, &deadline) == 0)
+        {
+            unsigned long now = now_ms();
+            int left = deadline > now ? deadline - now : 0;
+
+            if (timeout_ms < 0 || timeout_ms > left)
+                timeout_ms = left;
+        }
+
+        // flush what the timers sent before going to sleep
+        whisper_udp__flush(udp);
+        pfd.fd = udp->fd;
+        pfd.events = POLLIN;
+        ready = timeout_ms != 0 ? poll(&pfd, 1, timeout_ms) : 0;
+        whisper_timer_wheel__advance(udp->timers, now_ms());
+        if (ready > 0)
+            received = receive(udp);
+        else if (ready < 0 && errno != EINTR)
+            received = -1;
+    }
+
+    udp->polling = 0;
+    whisper_udp__flush(udp);
+    return received;
+}
+
+uint16_t whisper_udp__send(whisper_data_layer_t dl, uint8_t *data, uint8_t data_length, uint8_t ack_required)
+{
+    whisper_udp_t udp = whisper_udp__of(dl);
+
+    // the delay of the frame counts from now
+    if (!udp->polling)
+        whisper_timer_wheel__advance(udp->timers, now_ms());
+    return whisper_data_layer__data_sent(dl, data, data_length, ack_required);
+}
+
+void whisper_udp__stats(whisper_udp_t udp, struct whisper_udp__stats *stats)
+{
+    *stats = udp->stats;
+}
@@ -0,0 +1,141 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef UDP_TRANSPORT_H
+#define UDP_TRANSPORT_H
+
+#include "basic_data_type.h"
+#include "data_layer.h"
+
+/*
+ * Transport of links over UDP, for serial over IP bridges.
+ *
+ * A socket carries any number of links, each one with a peer of its own,
+ * told apart by the IPv4 address and port the datagrams come from. The
+ * byte stream of a link is cut into datagrams at the end of every event, the
+ * boundaries carry no meaning, so a datagram may hold parts of frames.
+ *
+ * The datagrams of all links are received in batches with recvmmsg, and the
+ * ones written by the links during a poll go out in batches with sendmmsg,
+ * so a busy socket serving many links needs a few system calls per batch
+ * rather than two per frame. The retransmission delays run on a timer wheel
+ * ticking in ms.
+ */
+
+typedef struct whisper_udp *whisper_udp_t;
+
+extern const uint16_t SIZEOF_WHISPER_UDP_T;
+
+struct whisper_udp__config
+{
+    /** IPv4 address to bind to, null for any */
+    const char *addr;
+    /** port to bind to, 0 for an ephemeral port */
+    uint16_t port;
+    /** most links the socket carries */
+    unsigned int max_links;
+    /** most datagrams received or sent per system call, 0 for 64 */
+    unsigned int batch;
+};
+
+/** counters of the socket */
+struct whisper_udp__stats
+{
+    unsigned long datagrams_in;
+    unsigned long datagrams_out;
+    /** recvmmsg and sendmmsg calls, which moved at least one datagram */
+    unsigned long recv_calls;
+    unsigned long send_calls;
+    /** datagrams from addresses without a link */
+    unsigned long unknown_peers;
+    /** datagrams the socket did not take */
+    unsigned long send_drops;
+};
+
+/**
+ * @brief open and bind the socket
+ *
+ * @param udp memory of at least SIZEOF_WHISPER_UDP_T bytes for the transport
+ * @param config configuration of the transport
+ * @return char 0 success, otherwise the socket cannot be opened or bound, see errno
+ */
+char whisper_udp__open(whisper_udp_t udp, const struct whisper_udp__config *config);
+
+/** close the socket and release the links and the resources of the transport */
+void whisper_udp__close(whisper_udp_t udp);
+
+/** return the port the socket is bound to */
+uint16_t whisper_udp__port(whisper_udp_t udp);
+
+/** return the socket, which is readable when there are datagrams to process */
+int whisper_udp__fd(whisper_udp_t udp);
+
+/**
+ * @brief add a link to a peer
+ *
+ * @param udp the transport
+ * @param addr IPv4 address of the peer
+ * @param port port of the peer
+ * @param link configuration of the link, data_write and timers are provided
+ *             by the transport, ctx is available through whisper_udp__ctx
+ * @return whisper_data_layer_t the link, null if the address is invalid, taken or there are max_links
+ */
+whisper_data_layer_t whisper_udp__add(whisper_udp_t udp, const char *addr, uint16_t port,
+                                      const struct whisper_data_layer__config *link);
+
+/** return the transport of a link, e.g. in the callbacks of the link */
+whisper_udp_t whisper_udp__of(whisper_data_layer_t dl);
+
+/** return the context given in the configuration of the link */
+void *whisper_udp__ctx(whisper_data_layer_t dl);
+
+/**
+ * @brief wait for and process the datagrams and the retransmission timers of all links
+ *
+ * The frames the links send meanwhile, from their callbacks or the timers,
+ * are flushed at the end.
+ *
+ * @param udp the transport
+ * @param timeout_ms longest time to wait, 0 to only process pending datagrams, -1 to wait forever
+ * @return int number of datagrams processed, -1 if the socket failed
+ */
+int whisper_udp__poll(whisper_udp_t udp, int timeout_ms);
+
+/**
+ * @brief send a frame on a link
+ *
+ * The frame is queued with the ones of the other links, it goes out with
+ * the next whisper_udp__flush or at the end of whisper_udp__poll. The
+ * payload is retransmitted from the given memory, so it must stay intact
+ * until data_ack_cb is called for the frame.
+ *
+ * @return the sequence no of the frame, 0 if a frame is still in flight
+ */
+uint16_t whisper_udp__send(whisper_data_layer_t dl, uint8_t *data, uint8_t data_length, uint8_t ack_required);
+
+/** send the queued datagrams of all links */
+void whisper_udp__flush(whisper_udp_t udp);
+
+/** read the counters of the socket */
+void whisper_udp__stats(whisper_udp_t udp, struct whisper_udp__stats *stats);
+
+#endif // UDP_TRANSPORT_H
@@ -0,0 +1,259 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * whisper_replay feeds a capture, see capture.h, through the receiving side
+ * of a data layer and reports what the parser made of it: the frames, the
+ * errors and the time it took per byte. It replays the received bytes, or
+ * with --tx the written ones, as fast as possible, or with --timing at the
+ * pace they were captured at.
+ *
+ *   whisper_replay [--tx] [--timing] [--repeat N] [--cobs] [--crc32c] [--compact] [--fec N] [--buf-len N] CAPTURE
+ *
+ * The framing, the checksum, the header, the forward error correction and the receive
+ * buffer must match the ones of the captured link. The capture is memory mapped, so
+ * replaying a large one takes no copy. Build it in Release mode to get
+ * meaningful numbers, the counters of the link require WHISPER_STATS.
+ */
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "data_layer.h"
+#include "fec.h"
+
+#define NS_PER_US 1000ULL
+#define NS_PER_S 1000000000ULL
+
+struct replay
+{
+    unsigned long chunks;
+    unsigned long bytes;
+    unsigned long packets;
+    unsigned long payload_bytes;
+    /** time spent in the parser */
+    unsigned long long busy_ns;
+    /** time the replay lagged behind the capture at its worst, with --timing */
+    unsigned long long max_lag_ns;
+};
+
+static unsigned long long now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * NS_PER_S + ts.tv_nsec;
+}
+
+static void on_packet_received(whisper_data_layer_t dl, uint8_t *payload, uint8_t payload_len)
+{
+    struct replay *replay = whisper_data_layer__ctx(dl);
+
+    (void)payload;
+    ++replay->packets;
+    replay->payload_bytes += payload_len;
+}
+
+static void data_write(whisper_data_layer_t dl, const uint8_t *data, uint8_t data_len)
+{
+    // the acknowledgements go nowhere
+    (void)dl;
+    (void)data;
+    (void)data_len;
+}
+
+static void set_delay(whisper_data_layer_t dl, uint16_t delay_in_ms, void (*delay_cb)(whisper_data_layer_t dl))
+{
+    (void)dl;
+    (void)delay_in_ms;
+    (void)delay_cb;
+}
+
+static void cancel_delay(whisper_data_layer_t dl)
+{
+    (void)dl;
+}
+
+/** replay the chunks of the direction once, return 0 on success, -1 if the capture is corrupt */
+static char replay_once(whisper_data_layer_t dl, const uint8_t *data, unsigned long len, uint8_t direction,
+                        int timing, struct replay *replay)
+{
+    struct whisper_capture__chunk chunk = {0};
+    unsigned long pos = whisper_capture__begin(data, len);
+    unsigned long long started = now_ns();
+    unsigned long first_us = 0;
+    int first = 1;
+    char status;
+
+    while ((status = whisper_capture__next(data, len, &pos, &chunk)) == 0)
+    {
+        unsigned long long before;
+
+        if (chunk.direction != direction)
+            continue;
+
+        if (timing)
+        {
+            unsigned long long due;
+            unsigned long long lag;
+            struct timespec ts;
+
+            if (first)
+                first_us = chunk.timestamp_us;
+            due = started + (unsigned long long)(chunk.timestamp_us - first_us) * NS_PER_US;
+            ts.tv_sec = due / NS_PER_S;
+            ts.tv_nsec = due % NS_PER_S;
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, 0);
+            before = now_ns();
+            lag = before > due ? before - due : 0;
+            if (lag > replay->max_lag_ns)
+                replay->max_lag_ns = lag;
+            whisper_data_layer__data_received(dl, chunk.data, chunk.len);
+            replay->busy_ns += now_ns() - before;
+        }
+        else
+            whisper_data_layer__data_received(dl, chunk.data, chunk.len);
+
+        first = 0;
+        ++replay->chunks;
+        replay->bytes += chunk.len;
+    }
+
+    if (!timing)
+        replay->busy_ns += now_ns() - started;
+    return status < 0 ? -1 : 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [--tx] [--timing] [--repeat N] [--cobs] [--crc32c] [--compact] [--fec N] [--buf-len N] CAPTURE\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t recv_buf[255];
+    static uint8_t decompress_buf[255];
+    struct whisper_data_layer__config config = {
+        .buf = recv_buf,
+        .buf_len = sizeof(recv_buf),
+        .packet_received_cb = on_packet_received,
+        .data_write = data_write,
+        .set_delay = set_delay,
+        .cancel_delay = cancel_delay,
+        .decompress_buf = decompress_buf,
+    };
+    struct whisper_data_layer__stats stats;
+    struct replay replay;
+    whisper_data_layer_t dl = malloc(SIZEOF_WHISPER_DATA_LAYER_T);
+    const char *path = 0;
+    uint8_t direction = WHISPER_CAPTURE__RX;
+    unsigned long repeat = 1;
+    unsigned long round;
+    int timing = 0;
+    const uint8_t *data;
+    struct stat st;
+    int fd;
+    int arg;
+
+    for (arg = 1; arg < argc; arg++)
+    {
+        const char *value = arg + 1 < argc ? argv[arg + 1] : 0;
+
+        if (strcmp(argv[arg], "--tx") == 0)
+            direction = WHISPER_CAPTURE__TX;
+        else if (strcmp(argv[arg], "--timing") == 0)
+            timing = 1;
+        else if (strcmp(argv[arg], "--cobs") == 0)
+            config.framing = WHISPER_DATA_LAYER__FRAMING_COBS;
+        else if (strcmp(argv[arg], "--crc32c") == 0)
+            config.checksum = WHISPER_DATA_LAYER__CHECKSUM_CRC32C;
+        else if (strcmp(argv[arg], "--compact") == 0)
+            config.header = WHISPER_DATA_LAYER__HEADER_COMPACT;
+        else if (strcmp(argv[arg], "--repeat") == 0 && value)
+            repeat = strtoul(argv[++arg], 0, 10);
+        else if (strcmp(argv[arg], "--fec") == 0 && value)
+            config.fec_parity = atoi(argv[++arg]);
+        else if (strcmp(argv[arg], "--buf-len") == 0 && value)
+            config.buf_len = atoi(argv[++arg]);
+        else if (argv[arg][0] != '-' && !path)
+            path = argv[arg];
+        else
+        {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (!path || repeat == 0 || config.fec_parity > WHISPER_FEC__MAX_PARITY)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+        fprintf(stderr, "cannot read %s\n", path);
+        return 2;
+    }
+    data = st.st_size ? mmap(0, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0) : MAP_FAILED;
+    if (data == MAP_FAILED || whisper_capture__begin(data, st.st_size) == 0)
+    {
+        fprintf(stderr, "%s is not a capture\n", path);
+        return 2;
+    }
+    madvise((void *)data, st.st_size, MADV_SEQUENTIAL);
+
+    memset(&replay, 0, sizeof(replay));
+    config.ctx = &replay;
+    for (round = 0; round < repeat; round++)
+    {
+        // every round starts over, or the frames of the previous one would be duplicates
+        whisper_data_layer__init(dl, &config);
+        if (replay_once(dl, data, st.st_size, direction, timing, &replay) != 0)
+            fprintf(stderr, "%s is truncated or corrupt after %lu chunks\n", path, replay.chunks);
+    }
+    if (whisper_data_layer__stats(dl, &stats) != 0)
+        memset(&stats, 0, sizeof(stats));
+
+    printf("replayed    %lu chunks, %lu bytes %s\n", replay.chunks / repeat, replay.bytes / repeat,
+           direction == WHISPER_CAPTURE__RX ? "received" : "written");
+    printf("frames      %lu ok, %lu packets delivered with %lu payload bytes\n", stats.frames_ok,
+           replay.packets / repeat, replay.payload_bytes / repeat);
+    printf("errors      %lu checksum, %lu header, %lu resync bytes, %lu duplicates, %lu fec corrected\n",
+           stats.crc_errors, stats.header_errors, stats.resync_bytes, stats.duplicates, stats.fec_corrected);
+    printf("parser      %.3f ms, %.2f ns/byte, %.1f MB/s\n", replay.busy_ns / 1e6 / repeat,
+           replay.bytes ? (double)replay.busy_ns / replay.bytes : 0,
+           replay.busy_ns ? replay.bytes * 1e3 / replay.busy_ns : 0);
+    if (timing)
+        printf("timing      lagged behind the capture by up to %.1f us\n", replay.max_lag_ns / 1e3);
+
+    munmap((void *)data, st.st_size);
+    close(fd);
+    free(dl);
+    return 0;
+}
@@ -0,0 +1,625 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "bus_sim.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_STAGED 4096
+#define MAX_PAYLOAD_LEN 255
+#define CHUNK_LEN 16
+#define LEN_MESSAGE_ID 4
+#define MASTER 0
+
+#define NS_PER_US 1000ULL
+#define NS_PER_S 1000000000ULL
+#define NEVER (~0ULL)
+
+/** bytes arriving at a station at once */
+struct chunk
+{
+    unsigned long long at;
+    uint8_t len;
+    uint8_t data[CHUNK_LEN];
+    struct chunk *next;
+};
+
+/** samples of a time, of which the percentiles are reported */
+struct samples
+{
+    unsigned long long *values;
+    unsigned long len;
+    unsigned long capacity;
+};
+
+struct sim;
+
+/** the master or a node, each talking on the bus in turn */
+struct station
+{
+    // bytes written by the links of the station during the current dispatch
+    uint8_t staged[MAX_STAGED];
+    unsigned int staged_len;
+    // chunks on their way to this station, in order of arrival
+    struct chunk *rx_head;
+    struct chunk *rx_tail;
+};
+
+struct link
+{
+    struct sim *sim;
+    struct station *station;
+    // index of the node, the one of the master is the node it talks to
+    uint8_t node;
+    whisper_data_layer_t dl;
+    uint8_t recv_buf[MAX_PAYLOAD_LEN];
+    unsigned long long delay_at;
+    void (*delay_cb)(whisper_data_layer_t dl);
+};
+
+struct node
+{
+    struct link link;
+    struct bus_sim__node_stats *stats;
+    unsigned long long last_poll_at;
+    struct samples poll_intervals;
+    struct samples reading_latencies;
+    // the latest reading, not sent yet if pending, and the time each was taken
+    unsigned long reading_id;
+    uint8_t reading_pending;
+    unsigned long long next_reading_at;
+    unsigned long long *taken_at;
+    // the answer in flight must stay intact
+    uint8_t answer[2][MAX_PAYLOAD_LEN];
+    uint8_t answer_in_flight;
+    // the command queued by the master, which must stay intact until its link completes it
+    uint8_t command[2][MAX_PAYLOAD_LEN];
+    uint8_t command_queued;
+};
+
+struct sim
+{
+    const struct bus_sim__config *config;
+    unsigned long long now;
+    unsigned long long rng;
+    unsigned long long byte_ns;
+    unsigned long long turnaround_ns;
+    struct bus_sim__report *report;
+    // the bus is busy until then, with the last transmission of that station
+    unsigned long long bus_free_at;
+    struct station *talker;
+    unsigned long long busy_ns;
+    unsigned long turnarounds;
+    unsigned long payload_bytes;
+    // the master, with a link per node, and the nodes
+    struct station master;
+    struct station stations[BUS_SIM__MAX_NODES];
+    struct link master_links[BUS_SIM__MAX_NODES];
+    struct node nodes[BUS_SIM__MAX_NODES];
+    whisper_poll_t poll;
+    struct whisper_poll__node poll_nodes[BUS_SIM__MAX_NODES];
+    unsigned long long poll_at;
+    unsigned long long next_command_at;
+};
+
+static double random_double(struct sim *sim)
+{
+    // xorshift64*
+    sim->rng ^= sim->rng >> 12;
+    sim->rng ^= sim->rng << 25;
+    sim->rng ^= sim->rng >> 27;
+    return ((sim->rng * 0x2545F4914F6CDD1DULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static void fill_payload(uint8_t *payload, unsigned long id, uint8_t len)
+{
+    uint8_t i;
+
+    payload[0] = id & 0xff;
+    payload[1] = (id >> 8) & 0xff;
+    payload[2] = (id >> 16) & 0xff;
+    payload[3] = (id >> 24) & 0xff;
+    for (i = LEN_MESSAGE_ID; i < len; i++)
+        payload[i] = (uint8_t)(id * 31 + i);
+}
+
+static unsigned long payload_id(const uint8_t *payload)
+{
+    return payload[0] | (payload[1] << 8) | ((unsigned long)payload[2] << 16) | ((unsigned long)payload[3] << 24);
+}
+
+/** check a delivered payload against the one sent, a message id carries the index of the node in its upper byte */
+static char is_intact(const uint8_t *payload, uint8_t payload_len, uint8_t expected_len, uint8_t node)
+{
+    uint8_t expected[MAX_PAYLOAD_LEN];
+
+    if (payload_len != expected_len || payload_id(payload) >> 24 != node)
+        return 0;
+    fill_payload(expected, payload_id(payload), payload_len);
+    return memcmp(expected, payload, payload_len) == 0;
+}
+
+static void add_sample(struct samples *samples, unsigned long long value)
+{
+    if (samples->len == samples->capacity)
+    {
+        samples->capacity = samples->capacity ? samples->capacity * 2 : 64;
+        samples->values = realloc(samples->values, samples->capacity * sizeof(samples->values[0]));
+    }
+    samples->values[samples->len++] = value;
+}
+
+static int compare_samples(const void *a, const void *b)
+{
+    unsigned long long x = *(const unsigned long long *)a;
+    unsigned long long y = *(const unsigned long long *)b;
+    return x < y ? -1 : x > y;
+}
+
+/** sort the samples, and return the percentile in microseconds */
+static unsigned long percentile_us(struct samples *samples, unsigned int percent)
+{
+    if (samples->len == 0)
+        return 0;
+    qsort(samples->values, samples->len, sizeof(samples->values[0]), compare_samples);
+    if (percent >= 100)
+        return samples->values[samples->len - 1] / NS_PER_US;
+    return samples->values[samples->len * percent / 100] / NS_PER_US;
+}
+
+static void queue_chunk(struct station *station, struct chunk *chunk)
+{
+    struct chunk *copy = malloc(sizeof(struct chunk));
+
+    memcpy(copy, chunk, sizeof(struct chunk));
+    if (station->rx_tail)
+        station->rx_tail->next = copy;
+    else
+        station->rx_head = copy;
+    station->rx_tail = copy;
+}
+
+/** put the bytes written during the last dispatch on the bus, as soon as it is free */
+static void flush(struct sim *sim, struct station *talker)
+{
+    unsigned long long start = sim->now > sim->bus_free_at ? sim->now : sim->bus_free_at;
+    unsigned int offset;
+    unsigned int i;
+
+    if (talker->staged_len == 0)
+        return;
+
+    // another station takes over the bus, unless it has been idle long enough for the turnaround
+    if (talker != sim->talker)
+    {
+        if (start < sim->bus_free_at + sim->turnaround_ns)
+            start = sim->bus_free_at + sim->turnaround_ns;
+        ++sim->turnarounds;
+        sim->talker = talker;
+    }
+    sim->bus_free_at = start + talker->staged_len * sim->byte_ns;
+    sim->busy_ns += talker->staged_len * sim->byte_ns;
+
+    // every station hears the same bits
+    if (sim->config->bit_error_rate > 0)
+        for (i = 0; i < talker->staged_len * 8; i++)
+            if (random_double(sim) < sim->config->bit_error_rate)
+                talker->staged[i / 8] ^= 1 << (i % 8);
+
+    for (offset = 0; offset < talker->staged_len; offset += CHUNK_LEN)
+    {
+        struct chunk chunk;
+
+        chunk.len = talker->staged_len - offset < CHUNK_LEN ? talker->staged_len - offset : CHUNK_LEN;
+        memcpy(chunk.data, &talker->staged[offset], chunk.len);
+        chunk.at = start + (offset + chunk.len) * sim->byte_ns;
+        chunk.next = 0;
+
+        if (talker != &sim->master)
+            queue_chunk(&sim->master, &chunk);
+        for (i = 0; i < sim->config->num_nodes; i++)
+            if (&sim->stations[i] != talker)
+                queue_chunk(&sim->stations[i], &chunk);
+    }
+    talker->staged_len = 0;
+}
+
+static void flush_all(struct sim *sim)
+{
+    uint8_t i;
+
+    flush(sim, &sim->master);
+    for (i = 0; i < sim->config->num_nodes; i++)
+        flush(sim, &sim->stations[i]);
+}
+
+static void data_write(whisper_data_layer_t dl, const uint8_t *data, uint8_t data_len)
+{
+    struct link *link = whisper_data_layer__ctx(dl);
+    struct station *station = link->station;
+
+    if (station->staged_len + data_len > MAX_STAGED)
+        flush(link->sim, station);
+    memcpy(&station->staged[station->staged_len], data, data_len);
+    station->staged_len += data_len;
+}
+
+static void set_delay(whisper_data_layer_t dl, uint16_t delay_in_ms, void (*delay_cb)(whisper_data_layer_t dl))
+{
+    struct link *link = whisper_data_layer__ctx(dl);
+
+    link->delay_at = link->sim->now + delay_in_ms * 1000 * NS_PER_US;
+    link->delay_cb = delay_cb;
+}
+
+static void cancel_delay(whisper_data_layer_t dl)
+{
+    struct link *link = whisper_data_layer__ctx(dl);
+
+    link->delay_at = NEVER;
+}
+
+static unsigned long now_us(whisper_data_layer_t dl)
+{
+    struct link *link = whisper_data_layer__ctx(dl);
+    return link->sim->now / NS_PER_US;
+}
+
+/** a node answers its poll, with its latest reading or an empty frame */
+static void on_poll(whisper_data_layer_t dl, uint8_t *payload, uint8_t payload_len)
+{
+    struct link *link = whisper_data_layer__ctx(dl);
+    struct sim *sim = link->sim;
+    struct node *node = &sim->nodes[link->node];
+    uint8_t *answer = node->answer[!node->answer_in_flight];
+    uint8_t answer_len = 0;
+
+    if (payload_len > 0)
+    {
+        if (is_intact(payload, payload_len, sim->config->command_len, link->node))
+            ++node->stats->commands_delivered;
+        else
+            ++sim->report->corrupted;
+    }
+
+    ++node->stats->polls;
+    if (node->last_poll_at)
+        add_sample(&node->poll_intervals, sim->now - node->last_poll_at);
+    node->last_poll_at = sim->now;
+
+    if (node->reading_pending)
+    {
+        answer_len = sim->config->reading_len;
+        fill_payload(answer, (unsigned long)link->node << 24 | node->reading_id, answer_len);
+    }
+    // behind the acknowledgement of the poll, in the same transmission
+    if (whisper_data_layer__data_sent(dl, answer, answer_len, 1) != 0)
+    {
+        node->answer_in_flight = !node->answer_in_flight;
+        node->reading_pending = 0;
+    }
+}
+
+/** the master receives an answer */
+static void on_answer(whisper_data_layer_t dl, uint8_t *payload, uint8_t payload_len)
+{
+    struct link *link = whisper_data_layer__ctx(dl);
+    struct sim *sim = link->sim;
+    struct node *node = &sim->nodes[link->node];
+
+    whisper_poll__received(sim->poll, dl);
+    if (payload_len == 0)
+        return;
+
+    if (!is_intact(payload, payload_len, sim->config->reading_len, link->node))
+    {
+        ++sim->report->corrupted;
+        return;
+    }
+    ++node->stats->readings_delivered;
+    sim->payload_bytes += payload_len;
+    add_sample(&node->reading_latencies, sim->now - node->taken_at[payload_id(payload) & 0xffffff]);
+}
+
+static void command_ack(whisper_data_layer_t dl, unsigned int seq_no, uint8_t sent)
+{
+    struct link *link = whisper_data_layer__ctx(dl);
+
+    if (sent)
+        link->sim->payload_bytes += link->sim->config->command_len;
+}
+
+/** feed the bytes arriving at the master to the link of the node polled, and let the scheduler take its turn */
+static void master_receive(struct sim *sim, struct chunk *chunk)
+{
+    whisper_poll__data_received(sim->poll, chunk->data, chunk->len);
+    if (!sim->config->fixed_slots)
+        sim->poll_at = sim->now + whisper_poll__run(sim->poll, sim->now / NS_PER_US) * NS_PER_US;
+    flush_all(sim);
+}
+
+static void take_reading(struct sim *sim, struct node *node)
+{
+    const struct bus_sim__config *config = sim->config;
+
+    // the latest reading replaces the one not sent yet
+    if (node->stats->readings > 0)
+        ++node->reading_id;
+    node->taken_at[node->reading_id] = sim->now;
+    node->reading_pending = 1;
+    ++node->stats->readings;
+    node->next_reading_at += config->reading_interval_us * NS_PER_US;
+}
+
+static void queue_commands(struct sim *sim)
+{
+    const struct bus_sim__config *config = sim->config;
+    uint8_t i;
+
+    for (i = 0; i < config->num_nodes; i++)
+    {
+        struct node *node = &sim->nodes[i];
+        uint8_t *command = node->command[node->command_queued];
+
+        // the previous command is still queued, or its link may still transmit it
+        if (sim->poll_nodes[i].request)
+            continue;
+        fill_payload(command, (unsigned long)i << 24 | node->stats->commands, config->command_len);
+        whisper_poll__submit(sim->poll, i, command, config->command_len);
+        node->command_queued = !node->command_queued;
+        ++node->stats->commands;
+    }
+    sim->next_command_at += config->command_interval_us * NS_PER_US;
+}
+
+static void expire(struct sim *sim, struct link *link)
+{
+    if (link->delay_at != sim->now)
+        return;
+    link->delay_at = NEVER;
+    link->delay_cb(link->dl);
+    flush_all(sim);
+}
+
+static void receive(struct sim *sim, struct station *station, whisper_data_layer_t dl)
+{
+    while (station->rx_head && station->rx_head->at == sim->now)
+    {
+        struct chunk *chunk = station->rx_head;
+
+        station->rx_head = chunk->next;
+        if (!station->rx_head)
+            station->rx_tail = 0;
+        if (dl)
+        {
+            whisper_data_layer__data_received(dl, chunk->data, chunk->len);
+            flush_all(sim);
+        }
+        else
+            master_receive(sim, chunk);
+        free(chunk);
+    }
+}
+
+static unsigned long long next_event_at(struct sim *sim)
+{
+    const struct bus_sim__config *config = sim->config;
+    unsigned long long at = sim->poll_at;
+    uint8_t i;
+
+    if (config->command_interval_us && sim->next_command_at < at)
+        at = sim->next_command_at;
+    if (sim->master.rx_head && sim->master.rx_head->at < at)
+        at = sim->master.rx_head->at;
+    for (i = 0; i < config->num_nodes; i++)
+    {
+        struct node *node = &sim->nodes[i];
+
+        if (config->reading_interval_us && node->next_reading_at < at)
+            at = node->next_reading_at;
+        if (sim->stations[i].rx_head && sim->stations[i].rx_head->at < at)
+            at = sim->stations[i].rx_head->at;
+        if (node->link.delay_at < at)
+            at = node->link.delay_at;
+        if (sim->master_links[i].delay_at < at)
+            at = sim->master_links[i].delay_at;
+    }
+    return at;
+}
+
+static void dispatch(struct sim *sim)
+{
+    const struct bus_sim__config *config = sim->config;
+    uint8_t i;
+
+    for (i = 0; i < config->num_nodes; i++)
+    {
+        struct node *node = &sim->nodes[i];
+
+        if (config->reading_interval_us && node->next_reading_at == sim->now)
+            take_reading(sim, node);
+        receive(sim, &sim->stations[i], node->link.dl);
+        expire(sim, &node->link);
+        expire(sim, &sim->master_links[i]);
+    }
+
+    if (config->command_interval_us && sim->next_command_at == sim->now)
+        queue_commands(sim);
+    receive(sim, &sim->master, 0);
+
+    if (sim->poll_at <= sim->now)
+    {
+        unsigned long wait_us = whisper_poll__run(sim->poll, sim->now / NS_PER_US);
+
+        // with fixed slots, the next node is polled at the end of the slot, whether the answer is in or not
+        sim->poll_at = sim->now + (config->fixed_slots ? config->timeout_us : wait_us) * NS_PER_US;
+        flush_all(sim);
+    }
+}
+
+static void init_link(struct sim *sim, struct link *link, struct station *station, uint8_t node, uint8_t master)
+{
+    struct whisper_data_layer__config dl_config = {
+        .buf = link->recv_buf,
+        .buf_len = sizeof(link->recv_buf),
+        .ctx = link,
+        .packet_received_cb = master ? on_answer : on_poll,
+        .data_ack_cb = master ? command_ack : 0,
+        .data_write = data_write,
+        .set_delay = set_delay,
+        .cancel_delay = cancel_delay,
+        .now_us = now_us,
+        .header = sim->config->header,
+        .address = node + 1,
+        .master = master,
+    };
+
+    link->sim = sim;
+    link->station = station;
+    link->node = node;
+    link->delay_at = NEVER;
+    link->dl = malloc(SIZEOF_WHISPER_DATA_LAYER_T);
+    whisper_data_layer__init(link->dl, &dl_config);
+}
+
+static void summarize(struct sim *sim)
+{
+    const struct bus_sim__config *config = sim->config;
+    struct bus_sim__report *report = sim->report;
+    struct samples intervals = {0, 0, 0};
+    struct samples latencies = {0, 0, 0};
+    unsigned long i;
+    uint8_t n;
+
+    report->elapsed_us = sim->now / NS_PER_US;
+    if (sim->now > 0)
+    {
+        report->utilization = (double)sim->busy_ns / sim->now;
+        report->payload_utilization = (double)sim->payload_bytes * sim->byte_ns / sim->now;
+        report->turnaround_share = (double)sim->turnarounds * sim->turnaround_ns / sim->now;
+    }
+    whisper_poll__stats(sim->poll, &report->poll);
+
+    for (n = 0; n < config->num_nodes; n++)
+    {
+        struct node *node = &sim->nodes[n];
+        struct bus_sim__node_stats *stats = node->stats;
+        struct whisper_data_layer__stats link_stats;
+
+        for (i = 0; i < node->poll_intervals.len; i++)
+            add_sample(&intervals, node->poll_intervals.values[i]);
+        for (i = 0; i < node->reading_latencies.len; i++)
+            add_sample(&latencies, node->reading_latencies.values[i]);
+
+        stats->poll_interval_p50_us = percentile_us(&node->poll_intervals, 50);
+        stats->poll_interval_max_us = percentile_us(&node->poll_intervals, 100);
+        stats->reading_latency_p50_us = percentile_us(&node->reading_latencies, 50);
+        stats->reading_latency_max_us = percentile_us(&node->reading_latencies, 100);
+
+        whisper_data_layer__stats(node->link.dl, &link_stats);
+        report->filtered += link_stats.filtered;
+    }
+
+    report->poll_interval_p50_us = percentile_us(&intervals, 50);
+    report->poll_interval_max_us = percentile_us(&intervals, 100);
+    report->reading_latency_p50_us = percentile_us(&latencies, 50);
+    report->reading_latency_p99_us = percentile_us(&latencies, 99);
+    report->reading_latency_max_us = percentile_us(&latencies, 100);
+    free(intervals.values);
+    free(latencies.values);
+}
+
+static void free_station(struct station *station)
+{
+    while (station->rx_head)
+    {
+        struct chunk *chunk = station->rx_head;
+        station->rx_head = chunk->next;
+        free(chunk);
+    }
+}
+
+char bus_sim__run(const struct bus_sim__config *config, struct bus_sim__report *report)
+{
+    struct sim *sim;
+    uint8_t i;
+
+    if (config->baud == 0 || config->num_nodes == 0 || config->num_nodes > BUS_SIM__MAX_NODES ||
+        config->timeout_us == 0 || (config->reading_interval_us && config->reading_len < LEN_MESSAGE_ID) ||
+        (config->command_interval_us && config->command_len < LEN_MESSAGE_ID))
+        return -1;
+
+    sim = calloc(1, sizeof(struct sim));
+    sim->config = config;
+    sim->report = report;
+    sim->rng = config->seed * 2 + 1;
+    sim->byte_ns = 10 * NS_PER_S / config->baud;
+    sim->turnaround_ns = config->turnaround_us * NS_PER_US;
+    sim->next_command_at = config->command_interval_us * NS_PER_US;
+    memset(report, 0, sizeof(struct bus_sim__report));
+
+    for (i = 0; i < config->num_nodes; i++)
+    {
+        struct node *node = &sim->nodes[i];
+
+        init_link(sim, &sim->master_links[i], &sim->master, i, 1);
+        init_link(sim, &node->link, &sim->stations[i], i, 0);
+        sim->poll_nodes[i].dl = sim->master_links[i].dl;
+
+        node->stats = &report->node[i];
+        // the nodes take their readings evenly spread over the interval
+        node->next_reading_at = config->reading_interval_us * NS_PER_US * i / config->num_nodes;
+        if (config->reading_interval_us)
+            node->taken_at = calloc(config->duration_us / config->reading_interval_us + 2, sizeof(node->taken_at[0]));
+    }
+    sim->poll = malloc(SIZEOF_WHISPER_POLL_T);
+    whisper_poll__init(sim->poll, sim->poll_nodes, config->num_nodes, config->timeout_us);
+
+    while (1)
+    {
+        unsigned long long next = next_event_at(sim);
+
+        if (next > config->duration_us * NS_PER_US)
+            break;
+        sim->now = next;
+        dispatch(sim);
+    }
+    sim->now = config->duration_us * NS_PER_US;
+    summarize(sim);
+
+    free_station(&sim->master);
+    for (i = 0; i < config->num_nodes; i++)
+    {
+        struct node *node = &sim->nodes[i];
+
+        free_station(&sim->stations[i]);
+        free(node->poll_intervals.values);
+        free(node->reading_latencies.values);
+        free(node->taken_at);
+        free(node->link.dl);
+        free(sim->master_links[i].dl);
+    }
+    free(sim->poll);
+    free(sim);
+
+    return 0;
+}
@@ -0,0 +1,136 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef BUS_SIM_H
+#define BUS_SIM_H
+
+#include "basic_data_type.h"
+#include "data_layer.h"
+#include "poll_scheduler.h"
+
+/*
+ * Deterministic simulator of a multi-drop bus.
+ *
+ * A master and up to BUS_SIM__MAX_NODES nodes share a half-duplex bus, on
+ * which one station talks at a time and the transceivers take a while to
+ * turn the bus around whenever another station starts talking. The master
+ * polls the nodes with the scheduler of poll_scheduler.h, and carries its commands to
+ * them with the polls. The nodes take readings at an interval, and answer
+ * their next poll with the latest one. Every station hears every byte on
+ * the bus, the links of the nodes skip the frames of the others by their
+ * address.
+ *
+ * Like link_sim, time is virtual and a run only depends on its
+ * configuration and seed.
+ */
+
+#define BUS_SIM__MAX_NODES 32
+
+struct bus_sim__config
+{
+    /** line speed in bits per second, every byte takes 10 bits on the line */
+    unsigned long baud;
+    /** time the bus takes to turn around, whenever another station starts talking, in microseconds */
+    unsigned long turnaround_us;
+    /** probability that a bit on the bus is flipped */
+    double bit_error_rate;
+    /** number of the nodes, up to BUS_SIM__MAX_NODES, with the addresses 1 to num_nodes */
+    uint8_t num_nodes;
+    /** interval between the readings of a node in microseconds, 0 for none */
+    unsigned long reading_interval_us;
+    /** payload length of the readings, at least 4 bytes */
+    uint8_t reading_len;
+    /** interval between the commands of the master to every node in microseconds, 0 for none */
+    unsigned long command_interval_us;
+    /** payload length of the commands, at least 4 bytes */
+    uint8_t command_len;
+    /** header of all links, WHISPER_DATA_LAYER__HEADER_FULL or _COMPACT */
+    uint8_t header;
+    /** time a node has to answer its poll in microseconds */
+    unsigned long timeout_us;
+    /**
+     * @brief poll a node every timeout_us, rather than as soon as the previous one answered
+     *
+     * The way a master polls in fixed slots, every node taking the same
+     * time on the bus whether it has something to say or not.
+     */
+    uint8_t fixed_slots;
+    /** virtual time of the run in microseconds */
+    unsigned long long duration_us;
+    /** seed of the random generator, the same seed reproduces the same run */
+    unsigned long seed;
+};
+
+/** statistics of one node */
+struct bus_sim__node_stats
+{
+    /** polls the node received */
+    unsigned long polls;
+    /** time between two polls of the node */
+    unsigned long poll_interval_p50_us;
+    unsigned long poll_interval_max_us;
+    /** readings the node took, and of which the master received the latest one before the next */
+    unsigned long readings;
+    unsigned long readings_delivered;
+    /** time from taking a reading to the master receiving it */
+    unsigned long reading_latency_p50_us;
+    unsigned long reading_latency_max_us;
+    /** commands the master queued for the node, and the node received */
+    unsigned long commands;
+    unsigned long commands_delivered;
+};
+
+struct bus_sim__report
+{
+    /** virtual time of the run in microseconds */
+    unsigned long long elapsed_us;
+    /** share of the time the bus carries bytes */
+    double utilization;
+    /** share of the time the bus carries the payload of readings and commands delivered */
+    double payload_utilization;
+    /** share of the time the bus turns around */
+    double turnaround_share;
+    /** the same over all nodes */
+    unsigned long poll_interval_p50_us;
+    unsigned long poll_interval_max_us;
+    unsigned long reading_latency_p50_us;
+    unsigned long reading_latency_p99_us;
+    unsigned long reading_latency_max_us;
+    /** readings and commands delivered with a payload not matching the one sent */
+    unsigned long corrupted;
+    /** frames of other addresses skipped by the links of the nodes, zero without WHISPER_STATS */
+    unsigned long filtered;
+    /** counters of the scheduler of the master */
+    struct whisper_poll__stats poll;
+    struct bus_sim__node_stats node[BUS_SIM__MAX_NODES];
+};
+
+/**
+ * @brief Run a simulation for the configured time.
+ *
+ * @param config configuration of the run
+ * @param report statistics of the run
+ * @return char 0 success, otherwise the configuration is invalid
+ */
+char bus_sim__run(const struct bus_sim__config *config, struct bus_sim__report *report);
+
+#endif // BUS_SIM_H
@@ -0,0 +1,552 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "link_sim.h"
+#include <stdlib.h>
+#include <string.h>
+#include "data_layer.h"
+#include "fec.h"
+
+#define MAX_STAGED 4096
+#define MAX_FIFO 4096
+#define MAX_CHUNK_LEN 255
+#define LEN_MESSAGE_ID 4
+
+#define NS_PER_US 1000ULL
+#define NS_PER_MS 1000000ULL
+#define NS_PER_S 1000000000ULL
+#define NEVER (~0ULL)
+
+/** bytes arriving at an endpoint at once */
+struct chunk
+{
+    unsigned long long at;
+    uint8_t len;
+    uint8_t data[MAX_CHUNK_LEN];
+    struct chunk *next;
+};
+
+struct sim;
+
+struct endpoint
+{
+    struct sim *sim;
+    struct endpoint *peer;
+    whisper_data_layer_t dl;
+    struct whisper_data_layer__config dl_config;
+    uint8_t recv_buf[MAX_CHUNK_LEN];
+
+    // bytes written by the data layer during the current dispatch
+    uint8_t staged[MAX_STAGED];
+    unsigned int staged_len;
+    // the line towards the peer is busy until then
+    unsigned long long line_free_at;
+    // chunks on their way to this endpoint, in order of arrival
+    struct chunk *rx_head;
+    struct chunk *rx_tail;
+
+    // the pending delay
+    unsigned long long delay_at;
+    void (*delay_cb)(whisper_data_layer_t dl);
+
+    // the application is busy with a delivered message until then
+    unsigned long long busy_until;
+    // messages queued for the application, with credits
+    unsigned int app_queued;
+    // bytes arrived and not yet read, as the application is busy, without credits
+    uint8_t fifo[MAX_FIFO];
+    unsigned int fifo_len;
+
+    // application sending the workload, the in flight payload must stay intact
+    const struct link_sim__workload *workload;
+    uint8_t payload[2][MAX_CHUNK_LEN];
+    uint8_t payload_in_flight;
+    unsigned long long *sent_at;
+    uint8_t *delivered;
+    unsigned long long *latencies;
+    struct link_sim__stats *stats;
+    // the data layer started then, with the message of that id, none of the messages since is delivered yet
+    unsigned long long started_at;
+    unsigned long started_id;
+    uint8_t awaiting_delivery;
+};
+
+struct sim
+{
+    const struct link_sim__config *config;
+    unsigned long long now;
+    unsigned long long rng;
+    unsigned long long byte_ns;
+    // A restarts then, NEVER once it did
+    unsigned long long restart_at;
+    struct endpoint ep[2];
+};
+
+static double random_double(struct sim *sim)
+{
+    // xorshift64*
+    sim->rng ^= sim->rng >> 12;
+    sim->rng ^= sim->rng << 25;
+    sim->rng ^= sim->rng >> 27;
+    return ((sim->rng * 0x2545F4914F6CDD1DULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static void fill_payload(uint8_t *payload, unsigned long id, uint8_t len)
+{
+    uint8_t i;
+
+    payload[0] = id & 0xff;
+    payload[1] = (id >> 8) & 0xff;
+    payload[2] = (id >> 16) & 0xff;
+    payload[3] = (id >> 24) & 0xff;
+    for (i = LEN_MESSAGE_ID; i < len; i++)
+        payload[i] = (uint8_t)(id * 31 + i);
+}
+
+static unsigned long payload_id(const uint8_t *payload)
+{
+    return payload[0] | (payload[1] << 8) | ((unsigned long)payload[2] << 16) | ((unsigned long)payload[3] << 24);
+}
+
+/** put the bytes written during the last dispatch on the wire */
+static void flush(struct endpoint *ep)
+{
+    struct sim *sim = ep->sim;
+    const struct link_sim__wire *wire = &sim->config->wire;
+    unsigned long long start = sim->now > ep->line_free_at ? sim->now : ep->line_free_at;
+    unsigned int offset;
+    unsigned int i;
+
+    if (ep->staged_len == 0)
+        return;
+
+    ep->stats->bytes_on_wire += ep->staged_len;
+    ep->line_free_at = start + ep->staged_len * sim->byte_ns;
+
+    if (random_double(sim) < wire->loss_rate)
+    {
+        // the whole transmission is lost, but it still occupied the line
+        ++ep->stats->transmissions_lost;
+        ep->staged_len = 0;
+        return;
+    }
+
+    if (wire->bit_error_rate > 0)
+        for (i = 0; i < ep->staged_len * 8; i++)
+            if (random_double(sim) < wire->bit_error_rate)
+                ep->staged[i / 8] ^= 1 << (i % 8);
+
+    // hand over the bytes in chunks, each arrives with its last byte
+    for (offset = 0; offset < ep->staged_len; offset += wire->chunk_len)
+    {
+        struct chunk *chunk = malloc(sizeof(struct chunk));
+        struct endpoint *peer = ep->peer;
+
+        chunk->len = ep->staged_len - offset < wire->chunk_len ? ep->staged_len - offset : wire->chunk_len;
+        memcpy(chunk->data, &ep->staged[offset], chunk->len);
+        chunk->at = start + (offset + chunk->len) * sim->byte_ns + wire->delay_us * NS_PER_US;
+        chunk->next = 0;
+
+        if (peer->rx_tail)
+            peer->rx_tail->next = chunk;
+        else
+            peer->rx_head = chunk;
+        peer->rx_tail = chunk;
+    }
+    ep->staged_len = 0;
+}
+
+static void flush_all(struct sim *sim)
+{
+    flush(&sim->ep[LINK_SIM__A]);
+    flush(&sim->ep[LINK_SIM__B]);
+}
+
+static void on_packet_received(whisper_data_layer_t dl, uint8_t *payload, uint8_t payload_len)
+{
+    struct endpoint *ep = whisper_data_layer__ctx(dl);
+    struct endpoint *sender = ep->peer;
+    const struct link_sim__workload *workload = sender->workload;
+    uint8_t expected[MAX_CHUNK_LEN];
+    unsigned long id;
+
+    if (ep->sim->config->max_payload_len ? payload_len < LEN_MESSAGE_ID : payload_len != workload->payload_len)
+    {
+        ++sender->stats->corrupted;
+        return;
+    }
+
+    id = payload_id(payload);
+    fill_payload(expected, id, payload_len);
+    if (id >= sender->stats->messages_sent || memcmp(expected, payload, payload_len) != 0)
+    {
+        ++sender->stats->corrupted;
+        return;
+    }
+
+    if (sender->delivered[id])
+    {
+        ++sender->stats->duplicates;
+        return;
+    }
+
+    sender->delivered[id] = 1;
+    sender->latencies[sender->stats->messages_delivered++] = ep->sim->now - sender->sent_at[id];
+    sender->stats->bytes_delivered += payload_len;
+    if (sender->awaiting_delivery && id >= sender->started_id)
+    {
+        sender->stats->first_delivery_us = (ep->sim->now - sender->started_at) / NS_PER_US;
+        sender->awaiting_delivery = 0;
+    }
+
+    if (ep->sim->config->process_us == 0)
+        return;
+    if (ep->sim->config->credits)
+    {
+        // queued for the application, which works through the queue in the background
+        if (ep->app_queued++ == 0)
+            ep->busy_until = ep->sim->now + ep->sim->config->process_us * NS_PER_US;
+        return;
+    }
+    // processed right away, the acknowledgement goes out once the callback returns
+    ep->busy_until = ep->sim->now + ep->sim->config->process_us * NS_PER_US;
+    if (ep->line_free_at < ep->busy_until)
+        ep->line_free_at = ep->busy_until;
+}
+
+static void data_write(whisper_data_layer_t dl, const uint8_t *data, uint8_t data_len)
+{
+    struct endpoint *ep = whisper_data_layer__ctx(dl);
+
+    if (ep->staged_len + data_len > MAX_STAGED)
+        flush(ep);
+    memcpy(&ep->staged[ep->staged_len], data, data_len);
+    ep->staged_len += data_len;
+}
+
+static void set_delay(whisper_data_layer_t dl, uint16_t delay_in_ms, void (*delay_cb)(whisper_data_layer_t dl))
+{
+    struct endpoint *ep = whisper_data_layer__ctx(dl);
+
+    ep->delay_at = ep->sim->now + delay_in_ms * NS_PER_MS;
+    ep->delay_cb = delay_cb;
+}
+
+static void cancel_delay(whisper_data_layer_t dl)
+{
+    struct endpoint *ep = whisper_data_layer__ctx(dl);
+
+    ep->delay_at = NEVER;
+}
+
+static unsigned long now_us(whisper_data_layer_t dl)
+{
+    struct endpoint *ep = whisper_data_layer__ctx(dl);
+    return ep->sim->now / NS_PER_US;
+}
+
+/** time at which the application generates the next message, NEVER if it has one */
+static unsigned long long next_message_at(struct endpoint *ep)
+{
+    const struct link_sim__workload *workload = ep->workload;
+    unsigned long long at = ep->stats->messages_sent * workload->interval_us * NS_PER_US;
+
+    if (ep->stats->messages_sent >= workload->num_messages || at <= ep->sim->now)
+        return NEVER;
+    return at;
+}
+
+static void try_send(struct endpoint *ep)
+{
+    const struct link_sim__workload *workload = ep->workload;
+    unsigned long id = ep->stats->messages_sent;
+    uint8_t *payload = ep->payload[!ep->payload_in_flight];
+    uint8_t payload_len = workload->payload_len;
+
+    if (id >= workload->num_messages || next_message_at(ep) != NEVER)
+        return;
+
+    if (ep->sim->config->max_payload_len)
+        payload_len = whisper_data_layer__payload_len(ep->dl);
+    fill_payload(payload, id, payload_len);
+    if (whisper_data_layer__data_sent(ep->dl, payload, payload_len, 1) != 0)
+    {
+        ep->payload_in_flight = !ep->payload_in_flight;
+        ep->sent_at[id] = ep->sim->now;
+        ++ep->stats->messages_sent;
+    }
+    flush_all(ep->sim);
+}
+
+/** read the bytes waiting in the FIFO, while the application is not busy */
+static void read_fifo(struct endpoint *ep)
+{
+    struct sim *sim = ep->sim;
+
+    while (ep->fifo_len > 0 && ep->busy_until <= sim->now)
+    {
+        uint8_t len = ep->fifo_len < sim->config->wire.chunk_len ? ep->fifo_len : sim->config->wire.chunk_len;
+
+        whisper_data_layer__data_received(ep->dl, ep->fifo, len);
+        flush_all(sim);
+        ep->fifo_len -= len;
+        memmove(ep->fifo, &ep->fifo[len], ep->fifo_len);
+    }
+}
+
+/** start the data layer of the endpoint over, as after a power cycle */
+static void start(struct endpoint *ep)
+{
+    whisper_data_layer__init(ep->dl, &ep->dl_config);
+    ep->delay_at = NEVER;
+    ep->started_at = ep->sim->now;
+    ep->started_id = ep->stats->messages_sent;
+    ep->awaiting_delivery = 1;
+    if (ep->sim->config->connect)
+        whisper_data_layer__connect(ep->dl);
+}
+
+static unsigned long long next_event_at(struct endpoint *ep)
+{
+    unsigned long long at = next_message_at(ep);
+
+    if (ep == &ep->sim->ep[LINK_SIM__A] && ep->sim->restart_at < at)
+        at = ep->sim->restart_at;
+
+    if ((ep->fifo_len > 0 || ep->app_queued > 0) && ep->busy_until < at)
+        at = ep->busy_until;
+
+    if (ep->rx_head && ep->rx_head->at < at)
+        at = ep->rx_head->at;
+    if (ep->delay_at < at)
+        at = ep->delay_at;
+    return at;
+}
+
+static void dispatch(struct endpoint *ep)
+{
+    struct sim *sim = ep->sim;
+
+    if (ep == &sim->ep[LINK_SIM__A] && sim->restart_at == sim->now)
+    {
+        sim->restart_at = NEVER;
+        start(ep);
+        flush_all(sim);
+    }
+
+    while (ep->rx_head && ep->rx_head->at == sim->now)
+    {
+        struct chunk *chunk = ep->rx_head;
+
+        ep->rx_head = chunk->next;
+        if (!ep->rx_head)
+            ep->rx_tail = 0;
+
+        if (sim->config->process_us && !sim->config->credits)
+        {
+            // through the FIFO, which holds the bytes while the application is busy
+            unsigned int limit = sim->config->rx_fifo_len ? sim->config->rx_fifo_len : MAX_FIFO;
+            unsigned int len = ep->fifo_len + chunk->len > limit ? limit - ep->fifo_len : chunk->len;
+
+            ep->peer->stats->overrun_bytes += chunk->len - len;
+            memcpy(&ep->fifo[ep->fifo_len], chunk->data, len);
+            ep->fifo_len += len;
+            read_fifo(ep);
+        }
+        else
+        {
+            whisper_data_layer__data_received(ep->dl, chunk->data, chunk->len);
+            flush_all(sim);
+        }
+        free(chunk);
+    }
+
+    if (ep->busy_until == sim->now)
+    {
+        read_fifo(ep);
+        if (ep->app_queued > 0)
+        {
+            // the application is done with a message, and takes the next one
+            --ep->app_queued;
+            whisper_data_layer__grant(ep->dl, 1);
+            flush_all(sim);
+            if (ep->app_queued > 0)
+                ep->busy_until = sim->now + sim->config->process_us * NS_PER_US;
+        }
+    }
+
+    if (ep->delay_at == sim->now)
+    {
+        ep->delay_at = NEVER;
+        ++ep->stats->timeouts;
+        ep->delay_cb(ep->dl);
+        flush_all(sim);
+    }
+}
+
+static int compare_latencies(const void *a, const void *b)
+{
+    unsigned long long x = *(const unsigned long long *)a;
+    unsigned long long y = *(const unsigned long long *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void summarize(struct sim *sim, struct endpoint *ep)
+{
+    struct link_sim__stats *stats = ep->stats;
+    double elapsed_s = (double)sim->now / NS_PER_S;
+    unsigned long n = stats->messages_delivered;
+
+    if (elapsed_s > 0)
+    {
+        stats->goodput_bps = stats->bytes_delivered * 8.0 / elapsed_s;
+        // every byte takes 10 bits on the line
+        stats->efficiency = stats->goodput_bps / (sim->config->wire.baud * 0.8);
+    }
+
+    if (n == 0)
+        return;
+
+    qsort(ep->latencies, n, sizeof(ep->latencies[0]), compare_latencies);
+    stats->latency_p50_us = ep->latencies[n / 2] / NS_PER_US;
+    stats->latency_p99_us = ep->latencies[n * 99 / 100] / NS_PER_US;
+    stats->latency_max_us = ep->latencies[n - 1] / NS_PER_US;
+}
+
+// the simulation in progress, for the clock of the traces
+static struct sim *running;
+
+unsigned long link_sim__clock_us(void *ctx)
+{
+    return running ? running->now / NS_PER_US : 0;
+}
+
+char link_sim__run(const struct link_sim__config *config, struct link_sim__report *report)
+{
+    struct sim *sim;
+    unsigned int i;
+
+    if (config->wire.baud == 0 || config->wire.chunk_len == 0 || config->fec_parity > WHISPER_FEC__MAX_PARITY ||
+        config->rx_fifo_len > MAX_FIFO || (config->max_payload_len && config->min_payload_len < LEN_MESSAGE_ID))
+        return -1;
+    for (i = 0; i < 2; i++)
+        if (config->workload[i].num_messages > 0 && config->workload[i].payload_len < LEN_MESSAGE_ID)
+            return -1;
+
+    sim = calloc(1, sizeof(struct sim));
+    sim->config = config;
+    sim->rng = config->seed * 2 + 1;
+    sim->byte_ns = 10 * NS_PER_S / config->wire.baud;
+    sim->restart_at = config->restart_us ? config->restart_us * NS_PER_US : NEVER;
+    memset(report, 0, sizeof(struct link_sim__report));
+    running = sim;
+
+    for (i = 0; i < 2; i++)
+    {
+        struct endpoint *ep = &sim->ep[i];
+        unsigned long num_messages = config->workload[i].num_messages;
+        struct whisper_data_layer__config *dl_config = &ep->dl_config;
+
+        *dl_config = (struct whisper_data_layer__config){
+            .buf = ep->recv_buf,
+            .buf_len = config->buf_len ? config->buf_len : MAX_CHUNK_LEN,
+            .ctx = ep,
+            .packet_received_cb = on_packet_received,
+            .data_write = data_write,
+            .set_delay = set_delay,
+            .cancel_delay = cancel_delay,
+            .trace = config->trace[i],
+            .capture = config->capture[i],
+            .now_us = now_us,
+            .ack_latency = &report->ack_latency[i],
+            .fec_parity = config->fec_parity,
+            .framing = config->framing,
+            .checksum = config->checksum,
+            .header = config->header,
+            .credits = config->credits,
+            .min_payload_len = config->min_payload_len,
+            .max_payload_len = config->max_payload_len,
+        };
+
+        ep->sim = sim;
+        ep->peer = &sim->ep[!i];
+        ep->delay_at = NEVER;
+        ep->workload = &config->workload[i];
+        ep->stats = &report->dir[i];
+        ep->sent_at = calloc(num_messages + 1, sizeof(ep->sent_at[0]));
+        ep->delivered = calloc(num_messages + 1, sizeof(ep->delivered[0]));
+        ep->latencies = calloc(num_messages + 1, sizeof(ep->latencies[0]));
+        ep->dl = malloc(SIZEOF_WHISPER_DATA_LAYER_T);
+        whisper_histogram__init(&report->ack_latency[i]);
+    }
+    for (i = 0; i < 2; i++)
+        start(&sim->ep[i]);
+    flush_all(sim);
+
+    while (1)
+    {
+        unsigned long long next = NEVER;
+
+        for (i = 0; i < 2; i++)
+            try_send(&sim->ep[i]);
+
+        for (i = 0; i < 2; i++)
+        {
+            unsigned long long at = next_event_at(&sim->ep[i]);
+            if (at < next)
+                next = at;
+        }
+
+        if (next == NEVER)
+            // all messages are delivered or given up
+            break;
+        if (config->time_limit_us && next > config->time_limit_us * NS_PER_US)
+            break;
+
+        sim->now = next;
+        for (i = 0; i < 2; i++)
+            dispatch(&sim->ep[i]);
+    }
+
+    report->elapsed_us = sim->now / NS_PER_US;
+    for (i = 0; i < 2; i++)
+    {
+        struct endpoint *ep = &sim->ep[i];
+
+        summarize(sim, ep);
+        whisper_data_layer__stats(ep->dl, &report->link[i]);
+        while (ep->rx_head)
+        {
+            struct chunk *chunk = ep->rx_head;
+            ep->rx_head = chunk->next;
+            free(chunk);
+        }
+        free(ep->sent_at);
+        free(ep->delivered);
+        free(ep->latencies);
+        free(ep->dl);
+    }
+    free(sim);
+    running = 0;
+
+    return 0;
+}
@@ -0,0 +1,181 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef LINK_SIM_H
+#define LINK_SIM_H
+
+#include "basic_data_type.h"
+#include "data_layer.h"
+
+/*
+ * Deterministic loopback simulator of a link.
+ *
+ * Two data layer endpoints, A and B, are connected through a virtual wire.
+ * Time is virtual: the simulator jumps from event to event, where an event is
+ * a chunk of bytes arriving at an endpoint, a delay of set_delay expiring or
+ * the application generating a message. A run only depends on its
+ * configuration and seed, and takes a fraction of the simulated time.
+ *
+ * Every message carries its id in the first 4 bytes of the payload and a
+ * pattern derived from the id in the rest, which lets the simulator detect
+ * duplicates, measure the latency and catch corrupted deliveries.
+ */
+
+#define LINK_SIM__A 0
+#define LINK_SIM__B 1
+
+/** characteristics of the virtual wire, the same in both directions */
+struct link_sim__wire
+{
+    /** line speed in bits per second, every byte takes 10 bits on the line */
+    unsigned long baud;
+    /** propagation delay in microseconds */
+    unsigned long delay_us;
+    /** probability that a transmission, all bytes written in one go, is lost */
+    double loss_rate;
+    /** probability that a bit on the line is flipped */
+    double bit_error_rate;
+    /** maximum number of bytes handed to whisper_data_layer__data_received at once */
+    uint8_t chunk_len;
+};
+
+/** traffic offered by the application of an endpoint */
+struct link_sim__workload
+{
+    /** number of messages to send */
+    unsigned long num_messages;
+    /** payload length of the messages, at least 4 bytes */
+    uint8_t payload_len;
+    /** interval between two messages in microseconds, 0 to send back to back */
+    unsigned long interval_us;
+};
+
+struct link_sim__config
+{
+    struct link_sim__wire wire;
+    /** traffic sent by A towards B and by B towards A */
+    struct link_sim__workload workload[2];
+    /** size of the receive buffer of the endpoints */
+    uint8_t buf_len;
+    /** parity bytes of forward error correction of both endpoints, 0 for none */
+    uint8_t fec_parity;
+    /** framing of both endpoints, WHISPER_DATA_LAYER__FRAMING_PREFIX or _COBS */
+    uint8_t framing;
+    /** checksum of both endpoints, WHISPER_DATA_LAYER__CHECKSUM_CRC16 or _CRC32C, 0 for the default */
+    uint8_t checksum;
+    /** header of both endpoints, WHISPER_DATA_LAYER__HEADER_FULL or _COMPACT */
+    uint8_t header;
+    /**
+     * @brief time the application takes for a delivered message in microseconds, 0 for none
+     *
+     * Without credits, the application processes the message in
+     * packet_received_cb, and the endpoint reads no bytes meanwhile: they
+     * wait in a FIFO of rx_fifo_len bytes, which overruns. With credits, it
+     * queues the message and processes one after the other in the
+     * background, granting a credit for each.
+     */
+    unsigned long process_us;
+    /** bytes the endpoint holds while its application is busy, 0 for no limit */
+    uint16_t rx_fifo_len;
+    /** receive credits of both endpoints, 0 for no flow control */
+    uint8_t credits;
+    /**
+     * @brief bounds of adaptive payload sizing of both endpoints, max_payload_len 0 for none
+     *
+     * With adaptive payload sizing, the messages are as long as the sending
+     * data layer recommends at the time, rather than payload_len of the
+     * workload, at least 4 bytes.
+     */
+    uint8_t min_payload_len;
+    uint8_t max_payload_len;
+    /** both endpoints start with a handshake, and A again on its restart, see whisper_data_layer__connect */
+    uint8_t connect;
+    /** A restarts its data layer at the virtual time in microseconds, losing the frame in flight, 0 for never */
+    unsigned long long restart_us;
+    /** seed of the random generator, the same seed reproduces the same run */
+    unsigned long seed;
+    /** stop the run at the virtual time in microseconds, 0 for no limit */
+    unsigned long long time_limit_us;
+    /** traces of the data layers of A and B, optional, see link_sim__clock_us */
+    whisper_trace_t trace[2];
+    /** captures of the byte streams of A and B, optional, timestamped by the virtual time */
+    whisper_capture_t capture[2];
+};
+
+/** statistics of one direction of the link */
+struct link_sim__stats
+{
+    /** messages accepted by the sending data layer */
+    unsigned long messages_sent;
+    /** messages delivered to the receiver for the first time */
+    unsigned long messages_delivered;
+    /** payload bytes of the messages delivered for the first time */
+    unsigned long bytes_delivered;
+    /** messages delivered again */
+    unsigned long duplicates;
+    /** deliveries, of which the payload does not match the sent one */
+    unsigned long corrupted;
+    /** expired retransmission delays of the sender */
+    unsigned long timeouts;
+    /** transmissions lost on the wire */
+    unsigned long transmissions_lost;
+    /** bytes lost as the FIFO of the receiver overran */
+    unsigned long overrun_bytes;
+    /** bytes put on the wire by the sender, including the acknowledgements */
+    unsigned long bytes_on_wire;
+    /** delivered payload bits per second */
+    double goodput_bps;
+    /** delivered payload bits over the capacity of the line */
+    double efficiency;
+    /** time from the start of the sender, or its restart, to its first message delivered after it */
+    unsigned long first_delivery_us;
+    /** latency from being accepted by the sender to the first delivery */
+    unsigned long latency_p50_us;
+    unsigned long latency_p99_us;
+    unsigned long latency_max_us;
+};
+
+struct link_sim__report
+{
+    /** virtual time of the run in microseconds */
+    unsigned long long elapsed_us;
+    /** statistics of the traffic sent by A and by B */
+    struct link_sim__stats dir[2];
+    /** counters of the data layers of A and B, zero without WHISPER_STATS */
+    struct whisper_data_layer__stats link[2];
+    /** latency from data_sent to the acknowledgement of the frames sent by A and by B */
+    struct whisper_histogram ack_latency[2];
+};
+
+/**
+ * @brief Run a simulation until all messages are delivered or given up.
+ *
+ * @param config configuration of the run
+ * @param report statistics of the run
+ * @return char 0 success, otherwise the configuration is invalid
+ */
+char link_sim__run(const struct link_sim__config *config, struct link_sim__report *report);
+
+/** clock of the traces, returns the virtual time of the running simulation in microseconds */
+unsigned long link_sim__clock_us(void *ctx);
+
+#endif // LINK_SIM_H
@@ -0,0 +1,133 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * whisper_bus_sim runs the bus simulator from the command line, to size a
+ * multi-drop bus and its polling.
+ *
+ *   whisper_bus_sim [--baud N] [--turnaround-us N] [--ber P] [--nodes N]
+ *                   [--reading-us N] [--reading-len N] [--command-us N] [--command-len N]
+ *                   [--compact] [--timeout-us N] [--fixed-slots] [--duration-us N] [--seed N]
+ *
+ * With --fixed-slots, the master polls a node every --timeout-us, as a
+ * master without the scheduler would, to compare against.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bus_sim.h"
+
+int main(int argc, char **argv)
+{
+    struct bus_sim__config config = {
+        .baud = 115200,
+        .turnaround_us = 100,
+        .bit_error_rate = 0,
+        .num_nodes = 8,
+        .reading_interval_us = 50000,
+        .reading_len = 8,
+        .command_interval_us = 0,
+        .command_len = 8,
+        .timeout_us = 10000,
+        .duration_us = 10000000,
+        .seed = 1,
+    };
+    struct bus_sim__report report;
+    int arg;
+    int i;
+
+    for (arg = 1; arg < argc; arg++)
+    {
+        const char *value = arg + 1 < argc ? argv[arg + 1] : 0;
+
+        if (strcmp(argv[arg], "--compact") == 0)
+        {
+            config.header = WHISPER_DATA_LAYER__HEADER_COMPACT;
+            continue;
+        }
+        if (strcmp(argv[arg], "--fixed-slots") == 0)
+        {
+            config.fixed_slots = 1;
+            continue;
+        }
+        if (!value)
+        {
+            fprintf(stderr, "missing value of %s\n", argv[arg]);
+            return 2;
+        }
+
+        if (strcmp(argv[arg], "--baud") == 0)
+            config.baud = strtoul(value, 0, 10);
+        else if (strcmp(argv[arg], "--turnaround-us") == 0)
+            config.turnaround_us = strtoul(value, 0, 10);
+        else if (strcmp(argv[arg], "--ber") == 0)
+            config.bit_error_rate = atof(value);
+        else if (strcmp(argv[arg], "--nodes") == 0)
+            config.num_nodes = atoi(value);
+        else if (strcmp(argv[arg], "--reading-us") == 0)
+            config.reading_interval_us = strtoul(value, 0, 10);
+        else if (strcmp(argv[arg], "--reading-len") == 0)
+            config.reading_len = atoi(value);
+        else if (strcmp(argv[arg], "--command-us") == 0)
+            config.command_interval_us = strtoul(value, 0, 10);
+        else if (strcmp(argv[arg], "--command-len") == 0)
+            config.command_len = atoi(value);
+        else if (strcmp(argv[arg], "--timeout-us") == 0)
+            config.timeout_us = strtoul(value, 0, 10);
+        else if (strcmp(argv[arg], "--duration-us") == 0)
+            config.duration_us = strtoull(value, 0, 10);
+        else if (strcmp(argv[arg], "--seed") == 0)
+            config.seed = strtoul(value, 0, 10);
+        else
+        {
+            fprintf(stderr, "unknown option %s\n", argv[arg]);
+            return 2;
+        }
+        ++arg;
+    }
+
+    if (bus_sim__run(&config, &report) != 0)
+    {
+        fprintf(stderr, "invalid configuration\n");
+        return 2;
+    }
+
+    printf("simulated %.3f s\n", report.elapsed_us / 1e6);
+    printf("bus         %.1f%% busy, %.1f%% payload, %.1f%% turnaround\n", report.utilization * 100,
+           report.payload_utilization * 100, report.turnaround_share * 100);
+    printf("polling     %lu turns, %lu timeouts, %lu busy, %lu frames filtered, %lu corrupted\n", report.poll.turns,
+           report.poll.timeouts, report.poll.busy, report.filtered, report.corrupted);
+    printf("interval    p50 %lu us, max %lu us\n", report.poll_interval_p50_us, report.poll_interval_max_us);
+    printf("latency     p50 %lu us, p99 %lu us, max %lu us\n", report.reading_latency_p50_us,
+           report.reading_latency_p99_us, report.reading_latency_max_us);
+    printf("node  polls  interval p50/max us  readings  delivered  latency p50/max us  commands  delivered\n");
+    for (i = 0; i < config.num_nodes; i++)
+    {
+        const struct bus_sim__node_stats *node = &report.node[i];
+
+        printf("%4d  %5lu  %8lu / %-8lu  %8lu  %9lu  %8lu / %-8lu  %8lu  %9lu\n", i + 1, node->polls,
+               node->poll_interval_p50_us, node->poll_interval_max_us, node->readings, node->readings_delivered,
+               node->reading_latency_p50_us, node->reading_latency_max_us, node->commands, node->commands_delivered);
+    }
+
+    return 0;
+}
@@ -0,0 +1,285 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * whisper_sim runs the link simulator from the command line, to size links
+ * and tune the protocol.
+ *
+ *   whisper_sim [--baud N] [--delay-us N] [--loss P] [--ber P] [--chunk N]
+ *               [--messages N] [--payload N] [--interval-us N] [--duplex]
+ *               [--buf-len N] [--fec N] [--cobs] [--crc32c] [--compact] [--process-us N] [--fifo N]
+ *               [--credits N] [--adapt MIN,MAX] [--connect] [--restart-us N]
+ *               [--seed N] [--trace PREFIX] [--capture PREFIX]
+ *
+ * With --process-us, the receiving application takes that long for every
+ * message. Without --credits, it blocks the endpoint meanwhile, which
+ * buffers up to --fifo bytes; with it, the link runs flow control.
+ *
+ * With --adapt, the data layers pick the payload length between MIN and MAX
+ * by the errors they measure, which replaces --payload.
+ *
+ * With --restart-us, the data layer of A starts over at that time, as after
+ * a power cycle. With --connect, the data layers synchronize with a
+ * handshake on start.
+ *
+ * With --trace, the latest events of the data layers of A and B are dumped
+ * to PREFIX-a.trace and PREFIX-b.trace, for whisper_trace to decode. The
+ * library must be built with WHISPER_TRACE.
+ *
+ * With --capture, the byte streams of A and B are captured to PREFIX-a.cap
+ * and PREFIX-b.cap, for whisper_replay to replay.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "link_sim.h"
+
+#define TRACE_CAPACITY 4096
+
+static void print_stats(const char *direction, const struct link_sim__stats *stats,
+                        const struct whisper_histogram *ack_latency, const struct whisper_data_layer__stats *sender,
+                        const struct whisper_data_layer__stats *receiver)
+{
+    printf("%s\n", direction);
+    printf("  messages    sent %lu, delivered %lu, duplicates %lu, corrupted %lu\n",
+           stats->messages_sent, stats->messages_delivered, stats->duplicates, stats->corrupted);
+    printf("  wire        %lu bytes, %lu transmissions lost, %lu timeouts, %lu bytes overrun\n",
+           stats->bytes_on_wire, stats->transmissions_lost, stats->timeouts, stats->overrun_bytes);
+    printf("  link        %lu retransmits, %lu drops, %lu refused\n", sender->retransmits, sender->drops,
+           receiver->refused);
+    printf("  goodput     %.0f bit/s, %.1f%% of the line, %lu payload bytes per message\n", stats->goodput_bps,
+           stats->efficiency * 100, stats->messages_delivered ? stats->bytes_delivered / stats->messages_delivered : 0);
+    printf("  startup     first delivery after %lu us\n", stats->first_delivery_us);
+    printf("  latency     p50 %lu us, p99 %lu us, max %lu us\n",
+           stats->latency_p50_us, stats->latency_p99_us, stats->latency_max_us);
+    printf("  ack         p50 %lu us, p99 %lu us, p99.9 %lu us, max %lu us\n",
+           whisper_histogram__percentile(ack_latency, 500000), whisper_histogram__percentile(ack_latency, 990000),
+           whisper_histogram__percentile(ack_latency, 999000), ack_latency->max);
+}
+
+static void dump_trace(whisper_trace_t trace, const char *prefix, const char *end)
+{
+    unsigned long len = TRACE_CAPACITY * WHISPER_TRACE__DUMP_RECORD_LEN;
+    uint8_t *buf = malloc(len);
+    char *path = malloc(strlen(prefix) + strlen(end) + 1);
+    FILE *file;
+
+    sprintf(path, "%s%s", prefix, end);
+    len = whisper_trace__dump(trace, buf, len);
+    file = fopen(path, "wb");
+    if (file)
+    {
+        fwrite(buf, 1, len, file);
+        fclose(file);
+    }
+    else
+        fprintf(stderr, "cannot write %s\n", path);
+
+    printf("trace       %lu events to %s, %lu overwritten\n", len / WHISPER_TRACE__DUMP_RECORD_LEN, path,
+           whisper_trace__lost(trace));
+    free(path);
+    free(buf);
+}
+
+static void write_capture(void *ctx, const uint8_t *data, unsigned int len)
+{
+    fwrite(data, 1, len, ctx);
+}
+
+static FILE *open_capture(whisper_capture_t capture, const char *prefix, const char *end)
+{
+    char *path = malloc(strlen(prefix) + strlen(end) + 1);
+    FILE *file;
+
+    sprintf(path, "%s%s", prefix, end);
+    file = fopen(path, "wb");
+    if (file)
+        whisper_capture__init(capture, write_capture, file);
+    else
+        fprintf(stderr, "cannot write %s\n", path);
+    free(path);
+    return file;
+}
+
+static void close_capture(whisper_capture_t capture, FILE *file, const char *prefix, const char *end)
+{
+    printf("capture     %lu bytes to %s%s\n", whisper_capture__size(capture), prefix, end);
+    fclose(file);
+}
+
+int main(int argc, char **argv)
+{
+    struct link_sim__config config = {
+        .wire = {
+            .baud = 115200,
+            .delay_us = 0,
+            .loss_rate = 0,
+            .bit_error_rate = 0,
+            .chunk_len = 16,
+        },
+        .workload = {{1000, 32, 0}, {0, 32, 0}},
+        .buf_len = 255,
+        .seed = 1,
+    };
+    struct link_sim__report report;
+    const char *trace_prefix = 0;
+    const char *capture_prefix = 0;
+    FILE *capture_files[2];
+    int duplex = 0;
+    int arg;
+    int i;
+
+    for (arg = 1; arg < argc; arg++)
+    {
+        const char *value = arg + 1 < argc ? argv[arg + 1] : 0;
+
+        if (strcmp(argv[arg], "--duplex") == 0)
+        {
+            duplex = 1;
+            continue;
+        }
+        if (strcmp(argv[arg], "--cobs") == 0)
+        {
+            config.framing = WHISPER_DATA_LAYER__FRAMING_COBS;
+            continue;
+        }
+        if (strcmp(argv[arg], "--crc32c") == 0)
+        {
+            config.checksum = WHISPER_DATA_LAYER__CHECKSUM_CRC32C;
+            continue;
+        }
+        if (strcmp(argv[arg], "--compact") == 0)
+        {
+            config.header = WHISPER_DATA_LAYER__HEADER_COMPACT;
+            continue;
+        }
+        if (strcmp(argv[arg], "--connect") == 0)
+        {
+            config.connect = 1;
+            continue;
+        }
+        if (!value)
+        {
+            fprintf(stderr, "missing value of %s\n", argv[arg]);
+            return 2;
+        }
+
+        if (strcmp(argv[arg], "--baud") == 0)
+            config.wire.baud = strtoul(value, 0, 10);
+        else if (strcmp(argv[arg], "--delay-us") == 0)
+            config.wire.delay_us = strtoul(value, 0, 10);
+        else if (strcmp(argv[arg], "--loss") == 0)
+            config.wire.loss_rate = atof(value);
+        else if (strcmp(argv[arg], "--ber") == 0)
+            config.wire.bit_error_rate = atof(value);
+        else if (strcmp(argv[arg], "--chunk") == 0)
+            config.wire.chunk_len = atoi(value);
+        else if (strcmp(argv[arg], "--messages") == 0)
+            config.workload[0].num_messages = strtoul(value, 0, 10);
+        else if (strcmp(argv[arg], "--payload") == 0)
+            config.workload[0].payload_len = atoi(value);
+        else if (strcmp(argv[arg], "--interval-us") == 0)
+            config.workload[0].interval_us = strtoul(value, 0, 10);
+        else if (strcmp(argv[arg], "--buf-len") == 0)
+            config.buf_len = atoi(value);
+        else if (strcmp(argv[arg], "--fec") == 0)
+            config.fec_parity = atoi(value);
+        else if (strcmp(argv[arg], "--process-us") == 0)
+            config.process_us = strtoul(value, 0, 10);
+        else if (strcmp(argv[arg], "--fifo") == 0)
+            config.rx_fifo_len = atoi(value);
+        else if (strcmp(argv[arg], "--credits") == 0)
+            config.credits = atoi(value);
+        else if (strcmp(argv[arg], "--adapt") == 0)
+        {
+            const char *max = strchr(value, ',');
+
+            config.min_payload_len = atoi(value);
+            config.max_payload_len = max ? atoi(max + 1) : 0;
+        }
+        else if (strcmp(argv[arg], "--restart-us") == 0)
+            config.restart_us = strtoull(value, 0, 10);
+        else if (strcmp(argv[arg], "--seed") == 0)
+            config.seed = strtoul(value, 0, 10);
+        else if (strcmp(argv[arg], "--trace") == 0)
+            trace_prefix = value;
+        else if (strcmp(argv[arg], "--capture") == 0)
+            capture_prefix = value;
+        else
+        {
+            fprintf(stderr, "unknown option %s\n", argv[arg]);
+            return 2;
+        }
+        ++arg;
+    }
+
+    if (duplex)
+        config.workload[1] = config.workload[0];
+
+    if (trace_prefix)
+    {
+        for (i = 0; i < 2; i++)
+        {
+            config.trace[i] = malloc(SIZEOF_WHISPER_TRACE_T);
+            whisper_trace__init(config.trace[i], malloc(TRACE_CAPACITY * sizeof(struct whisper_trace__record)),
+                                TRACE_CAPACITY, link_sim__clock_us, 0);
+        }
+    }
+
+    if (capture_prefix)
+    {
+        for (i = 0; i < 2; i++)
+        {
+            config.capture[i] = malloc(SIZEOF_WHISPER_CAPTURE_T);
+            capture_files[i] = open_capture(config.capture[i], capture_prefix, i == LINK_SIM__A ? "-a.cap" : "-b.cap");
+            if (!capture_files[i])
+                return 2;
+        }
+    }
+
+    if (link_sim__run(&config, &report) != 0)
+    {
+        fprintf(stderr, "invalid configuration\n");
+        return 2;
+    }
+
+    printf("simulated %.3f s\n", report.elapsed_us / 1e6);
+    print_stats("A -> B", &report.dir[LINK_SIM__A], &report.ack_latency[LINK_SIM__A], &report.link[LINK_SIM__A],
+                &report.link[LINK_SIM__B]);
+    if (duplex)
+        print_stats("B -> A", &report.dir[LINK_SIM__B], &report.ack_latency[LINK_SIM__B], &report.link[LINK_SIM__B],
+                    &report.link[LINK_SIM__A]);
+
+    if (trace_prefix)
+    {
+        dump_trace(config.trace[LINK_SIM__A], trace_prefix, "-a.trace");
+        dump_trace(config.trace[LINK_SIM__B], trace_prefix, "-b.trace");
+    }
+
+    if (capture_prefix)
+    {
+        close_capture(config.capture[LINK_SIM__A], capture_files[LINK_SIM__A], capture_prefix, "-a.cap");
+        close_capture(config.capture[LINK_SIM__B], capture_files[LINK_SIM__B], capture_prefix, "-b.cap");
+    }
+
+    return 0;
+}
@@ -0,0 +1,213 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "delta.h"
+
+// a status snapshot of the toilet controller
+static const uint8_t status_fields[] = {
+    2, // seat temperature
+    2, // water temperature
+    1, // water level
+    1, // seat occupied, lid open, etc.
+    1, // mode
+    4, // flush counter
+    2, // error code
+    4, // uptime
+};
+static const struct whisper_delta__schema status_schema = {sizeof(status_fields), status_fields};
+#define STATUS_SIZE 17
+#define OFFSET_WATER_LEVEL 4
+#define OFFSET_UPTIME 13
+
+static whisper_delta_t sender;
+static whisper_delta_t receiver;
+static uint8_t sender_buf[2 * STATUS_SIZE];
+static uint8_t receiver_buf[STATUS_SIZE];
+
+static uint8_t snapshot[STATUS_SIZE];
+static uint8_t msg[64];
+
+static void test_snapshot_size(void)
+{
+    TEST_ASSERT_EQUAL(STATUS_SIZE, whisper_delta__snapshot_size(&status_schema));
+}
+
+static void test_first_message_is_full(void)
+{
+    uint16_t len = whisper_delta__encode(sender, snapshot, msg, sizeof(msg));
+    TEST_ASSERT_EQUAL(2 + STATUS_SIZE, len);
+    TEST_ASSERT_EQUAL(WHISPER_DELTA__FULL, msg[0]);
+
+    TEST_ASSERT_EQUAL(0, whisper_delta__apply(receiver, msg, len));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(snapshot, whisper_delta__snapshot(receiver), STATUS_SIZE);
+    TEST_ASSERT_EQUAL(msg[1], whisper_delta__version(receiver));
+}
+
+static void test_delta_after_ack(void)
+{
+    uint16_t len = whisper_delta__encode(sender, snapshot, msg, sizeof(msg));
+    whisper_delta__apply(receiver, msg, len);
+    whisper_delta__acked(sender, msg[1]);
+
+    snapshot[OFFSET_WATER_LEVEL] = 0x42;
+    len = whisper_delta__encode(sender, snapshot, msg, sizeof(msg));
+
+    // header, one byte of bitmap and the changed field only
+    TEST_ASSERT_EQUAL(3 + 1 + 1, len);
+    TEST_ASSERT_EQUAL(WHISPER_DELTA__DELTA, msg[0]);
+    TEST_ASSERT_EQUAL(0x04, msg[3]);
+    TEST_ASSERT_EQUAL(0x42, msg[4]);
+
+    TEST_ASSERT_EQUAL(0, whisper_delta__apply(receiver, msg, len));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(snapshot, whisper_delta__snapshot(receiver), STATUS_SIZE);
+}
+
+static void test_delta_against_acknowledged_snapshot(void)
+{
+    uint16_t len = whisper_delta__encode(sender, snapshot, msg, sizeof(msg));
+    whisper_delta__apply(receiver, msg, len);
+    whisper_delta__acked(sender, msg[1]);
+
+    // the first change is never acknowledged
+    snapshot[OFFSET_WATER_LEVEL] = 0x42;
+    whisper_delta__encode(sender, snapshot, msg, sizeof(msg));
+
+    snapshot[OFFSET_UPTIME] = 0x01;
+    len = whisper_delta__encode(sender, snapshot, msg, sizeof(msg));
+
+    // both changes are carried
+    TEST_ASSERT_EQUAL(3 + 1 + 1 + 4, len);
+    TEST_ASSERT_EQUAL(0, whisper_delta__apply(receiver, msg, len));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(snapshot, whisper_delta__snapshot(receiver), STATUS_SIZE);
+}
+
+static void test_resync_on_mismatch(void)
+{
+    uint16_t len = whisper_delta__encode(sender, snapshot, msg, sizeof(msg));
+    whisper_delta__acked(sender, msg[1]);
+
+    // the receiver never got the full snapshot
+    snapshot[OFFSET_WATER_LEVEL] = 0x42;
+    len = whisper_delta__encode(sender, snapshot, msg, sizeof(msg));
+    TEST_ASSERT_EQUAL(WHISPER_DELTA__DELTA, msg[0]);
+    TEST_ASSERT_EQUAL(WHISPER_DELTA__ERR_RESYNC, whisper_delta__apply(receiver, msg, len));
+
+    // the receiver asks for a resync
+    whisper_delta__resync(sender);
+    len = whisper_delta__encode(sender, snapshot, msg, sizeof(msg));
+    TEST_ASSERT_EQUAL(WHISPER_DELTA__FULL, msg[0]);
+    TEST_ASSERT_EQUAL(0, whisper_delta__apply(receiver, msg, len));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(snapshot, whisper_delta__snapshot(receiver), STATUS_SIZE);
+}
+
+static void test_malformed_delta(void)
+{
+    uint16_t len = whisper_delta__encode(sender, snapshot, msg, sizeof(msg));
+    whisper_delta__apply(receiver, msg, len);
+    whisper_delta__acked(sender, msg[1]);
+
+    snapshot[OFFSET_UPTIME] = 0x01;
+    len = whisper_delta__encode(sender, snapshot, msg, sizeof(msg));
+    TEST_ASSERT_EQUAL(WHISPER_DELTA__ERR_MALFORMED, whisper_delta__apply(receiver, msg, len - 1));
+
+    // the cached copy is untouched
+    TEST_ASSERT_EQUAL(0x00, whisper_delta__snapshot(receiver)[OFFSET_UPTIME]);
+}
+
+static void test_compression_ratio_on_trace(void)
+{
+    // a status snapshot every 200 ms for 10 minutes
+    unsigned long raw_bytes = 0;
+    unsigned long encoded_bytes = 0;
+    unsigned int uptime = 0;
+    char report[96];
+    int i;
+
+    srand(26);
+    for (i = 0; i < 3000; i++)
+    {
+        uint16_t len;
+
+        uptime += 200;
+        memcpy(&snapshot[OFFSET_UPTIME], &uptime, 4);
+        if (rand() % 20 == 0)
+            ++snapshot[0];
+        if (rand() % 10 == 0)
+            ++snapshot[2];
+        if (rand() % 50 == 0)
+            snapshot[5] ^= 1 << (rand() % 8);
+
+        len = whisper_delta__encode(sender, snapshot, msg, sizeof(msg));
+        encoded_bytes += len;
+        if (whisper_delta__apply(receiver, msg, len) == WHISPER_DELTA__ERR_RESYNC)
+        {
+            // the receiver asks for the full snapshot
+            whisper_delta__resync(sender);
+            len = whisper_delta__encode(sender, snapshot, msg, sizeof(msg));
+            encoded_bytes += 1 + len;
+            TEST_ASSERT_EQUAL(0, whisper_delta__apply(receiver, msg, len));
+        }
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(snapshot, whisper_delta__snapshot(receiver), STATUS_SIZE);
+        // one in a hundred acknowledgements gets lost
+        if (rand() % 100 != 0)
+            whisper_delta__acked(sender, msg[1]);
+
+        raw_bytes += 2 + STATUS_SIZE;
+    }
+
+    sprintf(report, "compression ratio %.3f (%lu / %lu bytes)",
+            (double)encoded_bytes / raw_bytes, encoded_bytes, raw_bytes);
+    TEST_MESSAGE(report);
+    TEST_ASSERT_LESS_THAN(raw_bytes / 2, encoded_bytes);
+}
+
+void setUp(void)
+{
+    memset(snapshot, 0, sizeof(snapshot));
+    sender = malloc(SIZEOF_WHISPER_DELTA_T);
+    receiver = malloc(SIZEOF_WHISPER_DELTA_T);
+    whisper_delta__init(sender, &status_schema, sender_buf, sizeof(sender_buf));
+    whisper_delta__init(receiver, &status_schema, receiver_buf, sizeof(receiver_buf));
+}
+
+void tearDown(void)
+{
+    free(sender);
+    free(receiver);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_snapshot_size);
+    RUN_TEST(test_first_message_is_full);
+    RUN_TEST(test_delta_after_ack);
+    RUN_TEST(test_delta_against_acknowledged_snapshot);
+    RUN_TEST(test_resync_on_mismatch);
+    RUN_TEST(test_malformed_delta);
+    RUN_TEST(test_compression_ratio_on_trace);
+    return UNITY_END();
+}
@@ -0,0 +1,269 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <unity.h>
+#include <string.h>
+#include <stdlib.h>
+#include "capture.h"
+#include "data_layer.h"
+
+#define CAPTURE_LEN 65536
+#define BUF_LEN 255
+#define CHUNK_LEN 7
+#define NUM_MESSAGES 20
+
+/** a capture in memory */
+struct file
+{
+    uint8_t data[CAPTURE_LEN];
+    unsigned long len;
+};
+
+static struct file file;
+static whisper_capture_t capture;
+
+static whisper_data_layer_t sender;
+static whisper_data_layer_t receiver;
+static uint8_t sender_buf[BUF_LEN];
+static uint8_t receiver_buf[BUF_LEN];
+/** the bytes on the wire towards the receiver and towards the sender */
+static uint8_t wire[2][BUF_LEN * 2];
+static unsigned int wire_len[2];
+static unsigned long clock_us;
+static unsigned int num_delivered;
+static uint8_t delivered[NUM_MESSAGES][32];
+
+static void write_file(void *ctx, const uint8_t *data, unsigned int len)
+{
+    struct file *file = ctx;
+
+    TEST_ASSERT_LESS_OR_EQUAL(CAPTURE_LEN, file->len + len);
+    memcpy(&file->data[file->len], data, len);
+    file->len += len;
+}
+
+static void test_records_round_trip(void)
+{
+    static const unsigned long timestamps[] = {0, 1, 130, 130, 20000000, 0x7FFFFFFFUL, 5};
+    uint8_t data[255];
+    struct whisper_capture__chunk chunk = {0};
+    unsigned long pos;
+    unsigned long len;
+    unsigned int i;
+
+    for (i = 0; i < sizeof(data); i++)
+        data[i] = i;
+
+    whisper_capture__init(capture, write_file, &file);
+    TEST_ASSERT_EQUAL(WHISPER_CAPTURE__HEADER_LEN, file.len);
+    // the last timestamp wraps around
+    for (i = 0; i < sizeof(timestamps) / sizeof(timestamps[0]); i++)
+        whisper_capture__record(capture, i & 1, timestamps[i], data, i == 3 ? 255 : 1 + i * 30);
+    // an empty chunk is not recorded
+    whisper_capture__record(capture, WHISPER_CAPTURE__RX, 6, data, 0);
+    TEST_ASSERT_EQUAL(file.len, whisper_capture__size(capture));
+
+    pos = whisper_capture__begin(file.data, file.len);
+    TEST_ASSERT_EQUAL(WHISPER_CAPTURE__HEADER_LEN, pos);
+    for (i = 0; i < sizeof(timestamps) / sizeof(timestamps[0]); i++)
+    {
+        TEST_ASSERT_EQUAL(0, whisper_capture__next(file.data, file.len, &pos, &chunk));
+        TEST_ASSERT_EQUAL(timestamps[i], chunk.timestamp_us);
+        TEST_ASSERT_EQUAL(i & 1, chunk.direction);
+        TEST_ASSERT_EQUAL(i == 3 ? 255 : 1 + i * 30, chunk.len);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(data, chunk.data, chunk.len);
+    }
+    TEST_ASSERT_EQUAL(1, whisper_capture__next(file.data, file.len, &pos, &chunk));
+
+    // a chunk of a byte a microsecond after the previous one takes 3 bytes
+    len = file.len;
+    whisper_capture__record(capture, WHISPER_CAPTURE__RX, 6, data, 1);
+    TEST_ASSERT_EQUAL(len + 3, file.len);
+}
+
+static void test_truncated_capture_is_detected(void)
+{
+    uint8_t data[200];
+    unsigned long len;
+
+    memset(data, 0x55, sizeof(data));
+    whisper_capture__init(capture, write_file, &file);
+    whisper_capture__record(capture, WHISPER_CAPTURE__RX, 1000, data, 10);
+    whisper_capture__record(capture, WHISPER_CAPTURE__TX, 300000, data, 200);
+
+    // cut anywhere in the second record
+    for (len = file.len - 1; len > WHISPER_CAPTURE__HEADER_LEN + 13; len--)
+    {
+        struct whisper_capture__chunk chunk = {0};
+        unsigned long pos = whisper_capture__begin(file.data, len);
+
+        TEST_ASSERT_EQUAL(0, whisper_capture__next(file.data, len, &pos, &chunk));
+        TEST_ASSERT_EQUAL(-1, whisper_capture__next(file.data, len, &pos, &chunk));
+    }
+
+    // a length out of range, and a header of something else
+    file.data[WHISPER_CAPTURE__HEADER_LEN + 2] = 0xFF;
+    {
+        struct whisper_capture__chunk chunk = {0};
+        unsigned long pos = WHISPER_CAPTURE__HEADER_LEN;
+
+        TEST_ASSERT_EQUAL(-1, whisper_capture__next(file.data, file.len, &pos, &chunk));
+    }
+    TEST_ASSERT_EQUAL(0, whisper_capture__begin(file.data, 3));
+    file.data[WHISPER_CAPTURE__HEADER_LEN - 1] = WHISPER_CAPTURE__VERSION + 1;
+    TEST_ASSERT_EQUAL(0, whisper_capture__begin(file.data, file.len));
+    file.data[0] = 'w';
+    TEST_ASSERT_EQUAL(0, whisper_capture__begin(file.data, file.len));
+}
+
+static void data_write(whisper_data_layer_t dl, const uint8_t *data, uint8_t data_len)
+{
+    unsigned int to = dl == receiver;
+
+    TEST_ASSERT_LESS_OR_EQUAL(sizeof(wire[to]), wire_len[to] + data_len);
+    memcpy(&wire[to][wire_len[to]], data, data_len);
+    wire_len[to] += data_len;
+}
+
+static void set_delay(whisper_data_layer_t dl, uint16_t delay_in_ms, void (*cb)(whisper_data_layer_t dl)) {}
+
+static void cancel_delay(whisper_data_layer_t dl) {}
+
+static unsigned long now_us(whisper_data_layer_t dl)
+{
+    return clock_us;
+}
+
+static void on_packet_received(whisper_data_layer_t dl, uint8_t *payload, uint8_t payload_len)
+{
+    TEST_ASSERT_LESS_THAN(NUM_MESSAGES, num_delivered);
+    memcpy(delivered[num_delivered++], payload, payload_len);
+}
+
+/** feed the bytes on the wire towards the link in chunks, a microsecond apart */
+static void feed(whisper_data_layer_t to)
+{
+    unsigned int i = to == sender;
+    unsigned int pos;
+
+    for (pos = 0; pos < wire_len[i]; pos += CHUNK_LEN)
+    {
+        ++clock_us;
+        whisper_data_layer__data_received(to, &wire[i][pos], wire_len[i] - pos < CHUNK_LEN ? wire_len[i] - pos : CHUNK_LEN);
+    }
+    wire_len[i] = 0;
+}
+
+static void init_link(whisper_data_layer_t dl, uint8_t *buf, whisper_capture_t link_capture)
+{
+    struct whisper_data_layer__config config = {
+        .buf = buf,
+        .buf_len = BUF_LEN,
+        .packet_received_cb = on_packet_received,
+        .data_write = data_write,
+        .set_delay = set_delay,
+        .cancel_delay = cancel_delay,
+        .now_us = now_us,
+        .capture = link_capture,
+    };
+    whisper_data_layer__init(dl, &config);
+}
+
+static void test_capture_of_a_link_replays(void)
+{
+    struct whisper_capture__chunk chunk = {0};
+    uint8_t message[32];
+    unsigned long pos;
+    unsigned long rx_bytes = 0;
+    unsigned long tx_bytes = 0;
+    unsigned long last_us = 0;
+    unsigned int i;
+
+    init_link(sender, sender_buf, 0);
+    init_link(receiver, receiver_buf, capture);
+    whisper_capture__init(capture, write_file, &file);
+
+    for (i = 0; i < NUM_MESSAGES; i++)
+    {
+        memset(message, i, sizeof(message));
+        whisper_data_layer__data_sent(sender, message, sizeof(message), 1);
+        feed(receiver);
+        feed(sender);
+    }
+    TEST_ASSERT_EQUAL(NUM_MESSAGES, num_delivered);
+
+    // the received chunks in order, and the acknowledgements written in between
+    pos = whisper_capture__begin(file.data, file.len);
+    while (whisper_capture__next(file.data, file.len, &pos, &chunk) == 0)
+    {
+        TEST_ASSERT_GREATER_OR_EQUAL(last_us, chunk.timestamp_us);
+        if (chunk.direction == WHISPER_CAPTURE__RX)
+            rx_bytes += chunk.len;
+        else
+            tx_bytes += chunk.len;
+        last_us = chunk.timestamp_us;
+    }
+    TEST_ASSERT_EQUAL(file.len, pos);
+    TEST_ASSERT_GREATER_THAN(NUM_MESSAGES * sizeof(message), rx_bytes);
+    TEST_ASSERT_GREATER_THAN(0, tx_bytes);
+
+    // replayed through a fresh link, the same messages come out
+    num_delivered = 0;
+    memset(delivered, 0, sizeof(delivered));
+    init_link(receiver, receiver_buf, 0);
+    pos = whisper_capture__begin(file.data, file.len);
+    memset(&chunk, 0, sizeof(chunk));
+    while (whisper_capture__next(file.data, file.len, &pos, &chunk) == 0)
+        if (chunk.direction == WHISPER_CAPTURE__RX)
+            whisper_data_layer__data_received(receiver, chunk.data, chunk.len);
+    TEST_ASSERT_EQUAL(NUM_MESSAGES, num_delivered);
+    for (i = 0; i < NUM_MESSAGES; i++)
+    {
+        memset(message, i, sizeof(message));
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(message, delivered[i], sizeof(message));
+    }
+}
+
+void setUp(void)
+{
+    memset(&file, 0, sizeof(file));
+    wire_len[0] = wire_len[1] = 0;
+    clock_us = 0;
+    num_delivered = 0;
+}
+
+void tearDown(void)
+{
+}
+
+int main(void)
+{
+    sender = malloc(SIZEOF_WHISPER_DATA_LAYER_T);
+    receiver = malloc(SIZEOF_WHISPER_DATA_LAYER_T);
+    capture = malloc(SIZEOF_WHISPER_CAPTURE_T);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_records_round_trip);
+    RUN_TEST(test_truncated_capture_is_detected);
+    RUN_TEST(test_capture_of_a_link_replays);
+    return UNITY_END();
+}
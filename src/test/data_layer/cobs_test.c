@@ -0,0 +1,176 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <unity.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cobs.h"
+
+static uint8_t encoded[600];
+static unsigned int encoded_len;
+static unsigned int num_writes;
+
+static void write_encoded(void *ctx, const uint8_t *data, uint8_t len)
+{
+    memcpy(&encoded[encoded_len], data, len);
+    encoded_len += len;
+    ++num_writes;
+}
+
+static unsigned int encode(const uint8_t *data, uint8_t len)
+{
+    struct whisper_cobs__segment segment = {data, len};
+    return whisper_cobs__encode(&segment, 1, write_encoded, 0);
+}
+
+static void test_known_encodings(void)
+{
+    static const uint8_t zero[] = {0x00};
+    static const uint8_t zero_encoded[] = {0x01, 0x01, 0x00};
+    static const uint8_t mixed[] = {0x11, 0x22, 0x00, 0x33};
+    static const uint8_t mixed_encoded[] = {0x03, 0x11, 0x22, 0x02, 0x33, 0x00};
+    static const uint8_t zero_at_end[] = {0x11, 0x00};
+    static const uint8_t zero_at_end_encoded[] = {0x02, 0x11, 0x01, 0x00};
+    static const uint8_t empty_encoded[] = {0x01, 0x00};
+
+    TEST_ASSERT_EQUAL(sizeof(zero_encoded), encode(zero, sizeof(zero)));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(zero_encoded, encoded, sizeof(zero_encoded));
+
+    encoded_len = 0;
+    TEST_ASSERT_EQUAL(sizeof(mixed_encoded), encode(mixed, sizeof(mixed)));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(mixed_encoded, encoded, sizeof(mixed_encoded));
+
+    encoded_len = 0;
+    TEST_ASSERT_EQUAL(sizeof(zero_at_end_encoded), encode(zero_at_end, sizeof(zero_at_end)));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(zero_at_end_encoded, encoded, sizeof(zero_at_end_encoded));
+
+    encoded_len = 0;
+    TEST_ASSERT_EQUAL(sizeof(empty_encoded), encode(0, 0));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(empty_encoded, encoded, sizeof(empty_encoded));
+}
+
+static void test_long_runs(void)
+{
+    uint8_t data[255];
+    int len;
+
+    // a run of 254 takes a code of its own, with no zero after it
+    memset(data, 0x42, sizeof(data));
+    TEST_ASSERT_EQUAL(1 + 254 + 1 + 1 + 1, encode(data, 255));
+    TEST_ASSERT_EQUAL_HEX8(0xFF, encoded[0]);
+    TEST_ASSERT_EQUAL_HEX8(0x02, encoded[255]);
+    len = whisper_cobs__decode(encoded, encoded_len - 1);
+    TEST_ASSERT_EQUAL(255, len);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(data, encoded, 255);
+
+    encoded_len = 0;
+    data[254] = 0;
+    encode(data, 255);
+    TEST_ASSERT_EQUAL(255, whisper_cobs__decode(encoded, encoded_len - 1));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(data, encoded, 255);
+}
+
+static void test_segments(void)
+{
+    static const uint8_t a[] = {0x01, 0x02};
+    static const uint8_t b[] = {0x03, 0x00, 0x04};
+    static const uint8_t c[] = {0x00};
+    struct whisper_cobs__segment segments[] = {{a, sizeof(a)}, {0, 0}, {b, sizeof(b)}, {c, sizeof(c)}, {0, 0}};
+    static const uint8_t expected[] = {0x04, 0x01, 0x02, 0x03, 0x02, 0x04, 0x01, 0x00};
+
+    TEST_ASSERT_EQUAL(sizeof(expected), whisper_cobs__encode(segments, 5, write_encoded, 0));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, encoded, sizeof(expected));
+    // a run spanning two segments is written from both, with no copy
+    TEST_ASSERT_EQUAL(7, num_writes);
+}
+
+static void test_random_frames_round_trip(void)
+{
+    uint8_t data[255];
+    unsigned int round;
+
+    srand(41);
+    for (round = 0; round < 10000; round++)
+    {
+        struct whisper_cobs__segment segments[3];
+        uint8_t len = rand() % 256;
+        uint8_t split1 = len ? rand() % (len + 1) : 0;
+        uint8_t split2 = split1 + (len > split1 ? rand() % (len - split1 + 1) : 0);
+        unsigned int written;
+        unsigned int i;
+
+        // mostly zeros, mostly not, or anything
+        for (i = 0; i < len; i++)
+            data[i] = rand() % (round % 3 == 0 ? 2 : round % 3 == 1 ? 256 : 40) ? rand() % 256 : 0;
+
+        segments[0].data = data;
+        segments[0].len = split1;
+        segments[1].data = &data[split1];
+        segments[1].len = split2 - split1;
+        segments[2].data = &data[split2];
+        segments[2].len = len - split2;
+
+        encoded_len = 0;
+        written = whisper_cobs__encode(segments, 3, write_encoded, 0);
+        TEST_ASSERT_EQUAL(encoded_len, written);
+        TEST_ASSERT_LESS_OR_EQUAL(len + 2 + len / 254, encoded_len);
+        // the only zero is the delimiter at the end
+        TEST_ASSERT_NULL(memchr(encoded, 0, encoded_len - 1));
+        TEST_ASSERT_EQUAL_HEX8(WHISPER_COBS__DELIMITER, encoded[encoded_len - 1]);
+
+        TEST_ASSERT_EQUAL(len, whisper_cobs__decode(encoded, encoded_len - 1));
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(data, encoded, len);
+    }
+}
+
+static void test_corrupt_encoding_is_rejected(void)
+{
+    uint8_t zero_in_run[] = {0x03, 0x11, 0x00};
+    uint8_t run_past_end[] = {0x05, 0x11, 0x22};
+    uint8_t zero_code[] = {0x02, 0x11, 0x00, 0x22};
+
+    TEST_ASSERT_EQUAL(-1, whisper_cobs__decode(zero_in_run, sizeof(zero_in_run)));
+    TEST_ASSERT_EQUAL(-1, whisper_cobs__decode(run_past_end, sizeof(run_past_end)));
+    TEST_ASSERT_EQUAL(-1, whisper_cobs__decode(zero_code, sizeof(zero_code)));
+}
+
+void setUp(void)
+{
+    memset(encoded, 0, sizeof(encoded));
+    encoded_len = 0;
+    num_writes = 0;
+}
+
+void tearDown(void)
+{
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_known_encodings);
+    RUN_TEST(test_long_runs);
+    RUN_TEST(test_segments);
+    RUN_TEST(test_random_frames_round_trip);
+    RUN_TEST(test_corrupt_encoding_is_rejected);
+    return UNITY_END();
+}
@@ -28,12 +28,13 @@
 
 #define _BUF_LEN 128
 static uint8_t _buf[_BUF_LEN];
+static whisper_data_layer_t dl;
 static uint16_t _buf_p = 0;
 
 struct set_delay_invocation
 {
     unsigned short delay;
-    void (*callback)(void);
+    void (*callback)(whisper_data_layer_t dl);
     struct set_delay_invocation *next;
 };
 struct set_delay_invocation set_delay_head;
@@ -47,101 +48,101 @@ static unsigned char output_buf_p = 0;
 
 static void test_init(void)
 {
-    TEST_ASSERT_EQUAL(STATE_PREFIX, state);
+    TEST_ASSERT_EQUAL(STATE_PREFIX, dl->state);
 }
 
 static void test_basic_prefix_handling(void)
 {
     // First trunk
-    state = STATE_PREFIX;
-    array_buffer__clear(_buf_recv);
+    dl->state = STATE_PREFIX;
+    array_buffer__clear(dl->buf_recv);
     uint8_t data[] = {0x00, 0x01, 0x02, 0x0A};
-    char actual = whisper_data_layer__data_received(data, sizeof(data));
+    char actual = whisper_data_layer__data_received(dl, data, sizeof(data));
     TEST_ASSERT_EQUAL(0, actual);
-    TEST_ASSERT_EQUAL(STATE_PREFIX, state);
-    TEST_ASSERT_EQUAL(1, array_buffer__size(_buf_recv));
+    TEST_ASSERT_EQUAL(STATE_PREFIX, dl->state);
+    TEST_ASSERT_EQUAL(1, array_buffer__size(dl->buf_recv));
 
     // Another trunk
     data[0] = 0x0D;
-    actual = whisper_data_layer__data_received(data, 1);
+    actual = whisper_data_layer__data_received(dl, data, 1);
     TEST_ASSERT_EQUAL(0, actual);
-    TEST_ASSERT_EQUAL(STATE_HEADER, state);
+    TEST_ASSERT_EQUAL(STATE_HEADER, dl->state);
 }
 
 static void test_prefix_handling_with_incomplete_data(void)
 {
-    state = STATE_PREFIX;
-    array_buffer__clear(_buf_recv);
+    dl->state = STATE_PREFIX;
+    array_buffer__clear(dl->buf_recv);
     uint8_t data[] = {0x00, 0x0A, 0x02, 0x0D};
-    char actual = whisper_data_layer__data_received(data, sizeof(data));
+    char actual = whisper_data_layer__data_received(dl, data, sizeof(data));
     TEST_ASSERT_EQUAL(0, actual);
-    TEST_ASSERT_EQUAL(STATE_PREFIX, state);
-    TEST_ASSERT_EQUAL(1, array_buffer__size(_buf_recv));
+    TEST_ASSERT_EQUAL(STATE_PREFIX, dl->state);
+    TEST_ASSERT_EQUAL(1, array_buffer__size(dl->buf_recv));
 }
 
 static void test_prefix_handling_with_repeated_data(void)
 {
-    state = STATE_PREFIX;
-    array_buffer__clear(_buf_recv);
+    dl->state = STATE_PREFIX;
+    array_buffer__clear(dl->buf_recv);
     uint8_t data[] = {0x0A, 0x0A, 0x0D};
-    char actual = whisper_data_layer__data_received(data, sizeof(data));
+    char actual = whisper_data_layer__data_received(dl, data, sizeof(data));
     TEST_ASSERT_EQUAL(0, actual);
-    TEST_ASSERT_EQUAL(STATE_HEADER, state);
-    TEST_ASSERT_EQUAL(2, array_buffer__size(_buf_recv));
+    TEST_ASSERT_EQUAL(STATE_HEADER, dl->state);
+    TEST_ASSERT_EQUAL(2, array_buffer__size(dl->buf_recv));
 }
 
 static void test_header_handling(void)
 {
-    state = STATE_HEADER;
+    dl->state = STATE_HEADER;
     uint8_t data[] = {0x0A, 0x0D, 0x07, 0x00, 0x02, 0x03};
-    array_buffer__clear(_buf_recv);
-    array_buffer__push(_buf_recv, data, 2);
+    array_buffer__clear(dl->buf_recv);
+    array_buffer__push(dl->buf_recv, data, 2);
 
-    char actual = whisper_data_layer__data_received(&data[2], 3);
-    TEST_ASSERT_EQUAL(STATE_HEADER, state);
-    TEST_ASSERT_EQUAL(5, array_buffer__size(_buf_recv));
+    char actual = whisper_data_layer__data_received(dl, &data[2], 3);
+    TEST_ASSERT_EQUAL(STATE_HEADER, dl->state);
+    TEST_ASSERT_EQUAL(5, array_buffer__size(dl->buf_recv));
 
-    actual = whisper_data_layer__data_received(&data[5], 1);
-    TEST_ASSERT_EQUAL(STATE_PAYLOAD, state);
-    TEST_ASSERT_EQUAL(FLAGS_DATA, packet_header->flags);
-    TEST_ASSERT_EQUAL(0x07, packet_header->seq_no);
-    TEST_ASSERT_EQUAL(0x03, packet_header->payload_len);
+    actual = whisper_data_layer__data_received(dl, &data[5], 1);
+    TEST_ASSERT_EQUAL(STATE_PAYLOAD, dl->state);
+    TEST_ASSERT_EQUAL(FLAGS_DATA, dl->packet_header->flags);
+    TEST_ASSERT_EQUAL(0x07, dl->packet_header->seq_no);
+    TEST_ASSERT_EQUAL(0x03, dl->packet_header->payload_len);
 }
 
 static void test_payload_handling(void)
 {
-    state = STATE_PAYLOAD;
+    dl->state = STATE_PAYLOAD;
     uint8_t data[] = {0x0A, 0x0D, 0x07, 0x00, 0x02, 0x04, 0x01, 0x02, 0x04, 0x03};
-    array_buffer__push(_buf_recv, data, LEN_PREFIX + LEN_HEADER);
-    TEST_ASSERT_EQUAL(4, packet_header->payload_len);
+    array_buffer__push(dl->buf_recv, data, LEN_PREFIX + LEN_HEADER);
+    TEST_ASSERT_EQUAL(4, dl->packet_header->payload_len);
 
-    char actual = whisper_data_layer__data_received(&data[LEN_PREFIX + LEN_HEADER], 2);
+    char actual = whisper_data_layer__data_received(dl, &data[LEN_PREFIX + LEN_HEADER], 2);
     TEST_ASSERT_EQUAL(0, actual);
-    TEST_ASSERT_EQUAL(STATE_PAYLOAD, state);
+    TEST_ASSERT_EQUAL(STATE_PAYLOAD, dl->state);
 
     // Second trunk
-    actual = whisper_data_layer__data_received(&data[LEN_PREFIX + LEN_HEADER + 2], 2);
+    actual = whisper_data_layer__data_received(dl, &data[LEN_PREFIX + LEN_HEADER + 2], 2);
     TEST_ASSERT_EQUAL(0, actual);
-    TEST_ASSERT_EQUAL(STATE_CHECKSUM, state);
+    TEST_ASSERT_EQUAL(STATE_CHECKSUM, dl->state);
 }
 
 static void test_checksum_handling(void)
 {
-    state = STATE_CHECKSUM;
+    dl->state = STATE_CHECKSUM;
     data_received_length = 0;
     uint8_t data[] = {0x0A, 0x0D, 0x0D, 0x00, 0x02, 0x02, 0x02, 0x03};
-    array_buffer__push(_buf_recv, data, sizeof(data));
-    TEST_ASSERT_EQUAL(0x0D, packet_header->seq_no);
-    TEST_ASSERT_EQUAL(2, packet_header->payload_len);
-    TEST_ASSERT_EQUAL(FLAGS_DATA, packet_header->flags);
+    array_buffer__push(dl->buf_recv, data, sizeof(data));
+    TEST_ASSERT_EQUAL(0x0D, dl->packet_header->seq_no);
+    TEST_ASSERT_EQUAL(2, dl->packet_header->payload_len);
+    TEST_ASSERT_EQUAL(FLAGS_DATA, dl->packet_header->flags);
     TEST_ASSERT_EQUAL(0, data_received_length);
 
     uint16_t checksum = update_crc_buf(data, sizeof(data), CRC_INIT);
 
     output_buf_len = 0;
-    char actual = whisper_data_layer__data_received((uint8_t *)&checksum, 2);
+    char actual = whisper_data_layer__data_received(dl, (uint8_t *)&checksum, 2);
     TEST_ASSERT_EQUAL(0, actual);
-    TEST_ASSERT_EQUAL(STATE_PREFIX, state);
+    TEST_ASSERT_EQUAL(STATE_PREFIX, dl->state);
     // the callback should be called, which indicates that the integrity of the packet is verified
     TEST_ASSERT_EQUAL(2, data_received_length);
     // the packet should be acknowledged
@@ -152,19 +153,26 @@ static void test_checksum_handling(void)
     TEST_ASSERT_EQUAL(0x00, output_buf[LEN_PREFIX + LEN_HEADER + 1]);
 }
 
-static void on_packet_received(uint8_t *payload, uint8_t payload_len)
+static uint8_t *data_received_payload;
+static uint8_t data_received_channel;
+static unsigned char output_at_delivery;
+
+static void on_packet_received(whisper_data_layer_t dl, uint8_t *payload, uint8_t payload_len)
 {
+    output_at_delivery = output_buf_p;
     data_received_length = payload_len;
+    data_received_payload = payload;
+    data_received_channel = whisper_data_layer__received_channel(dl);
 }
 
-static void data_write(const uint8_t *data, uint8_t data_len)
+static void data_write(whisper_data_layer_t dl, const uint8_t *data, uint8_t data_len)
 {
     memcpy(&output_buf[output_buf_p], data, data_len);
     output_buf_len = data_len;
     output_buf_p += data_len;
 }
 
-static void set_delay(unsigned short delay, void (*callback)(void))
+static void set_delay(whisper_data_layer_t dl, unsigned short delay, void (*callback)(whisper_data_layer_t dl))
 {
     struct set_delay_invocation *next = malloc(sizeof(struct set_delay_invocation));
     next->delay = delay;
@@ -173,7 +181,7 @@ static void set_delay(unsigned short delay, void (*callback)(void))
     set_delay_tail = next;
 }
 
-static void cancel_delay(void)
+static void cancel_delay(whisper_data_layer_t dl)
 {
     ++num_cancel_delay_invocations;
 }
@@ -181,37 +189,1101 @@ static void cancel_delay(void)
 static void test_data_send(void)
 {
     uint8_t data[] = "Hello, World!";
-    unsigned short seq_no = whisper_data_layer__data_sent(data, sizeof(data), 0);
+    unsigned short seq_no = whisper_data_layer__data_sent(dl, data, sizeof(data), 0);
     TEST_ASSERT_NOT_EQUAL(0, seq_no);
 
     TEST_ASSERT_EQUAL_UINT8_ARRAY(data, &output_buf[LEN_PREFIX + LEN_HEADER], sizeof(data));
     TEST_ASSERT_EQUAL(RETRANSMISSION_DELAY_MS, set_delay_head.next->delay);
-    TEST_ASSERT_EQUAL_PTR(_send_data, set_delay_head.next->callback);
+    TEST_ASSERT_EQUAL_PTR(_timeout, set_delay_head.next->callback);
 }
 
 static void test_cancel_retransmission_on_ack(void)
 {
     TEST_ASSERT_EQUAL(0, num_cancel_delay_invocations);
 
-    send_buffer.ack_required = 1;
-    send_buffer.empty = 0;
-    send_buffer.header.seq_no = 7;
+    dl->send_buffer.ack_required = 1;
+    dl->send_buffer.empty = 0;
+    dl->send_buffer.header.seq_no = 7;
 
-    packet_header->flags = FLAGS_ACK;
-    packet_header->seq_no = 21;
-    packet_header->payload_len = 2;
+    dl->packet_header->flags = FLAGS_ACK;
+    dl->packet_header->seq_no = 21;
+    dl->packet_header->payload_len = 2;
 
     uint8_t data[] = {0x0A, 0x0D, 0x0D, 0x00, 0x01, 0x02, 0x07, 0x00};
-    array_buffer__push(_buf_recv, data, sizeof(data));
+    array_buffer__push(dl->buf_recv, data, sizeof(data));
 
-    on_ack();
+    on_ack(dl);
 
     TEST_ASSERT_EQUAL(1, num_cancel_delay_invocations);
-    TEST_ASSERT_EQUAL(1, send_buffer.empty);
+    TEST_ASSERT_EQUAL(1, dl->send_buffer.empty);
+}
+
+static void test_retransmission_on_timer_wheel(void)
+{
+    whisper_timer_wheel_t wheel = malloc(SIZEOF_WHISPER_TIMER_WHEEL_T);
+    whisper_timer_wheel__init(wheel, 1000);
+
+    struct whisper_data_layer__config cfg = {
+        .buf = _buf,
+        .buf_len = _BUF_LEN,
+        .packet_received_cb = on_packet_received,
+        .data_write = data_write,
+        .timers = wheel,
+    };
+    whisper_data_layer__init(dl, &cfg);
+
+    uint8_t data[] = {0x01, 0x02};
+    whisper_data_layer__data_sent(dl, data, sizeof(data), 1);
+    uint8_t frame_len = output_buf_p;
+    TEST_ASSERT_EQUAL(LEN_PREFIX + LEN_HEADER + sizeof(data) + LEN_CHECKSUM, frame_len);
+    TEST_ASSERT_EQUAL(1, whisper_timer_wheel__count(wheel));
+
+    whisper_timer_wheel__advance(wheel, 1000 + RETRANSMISSION_DELAY_MS - 1);
+    TEST_ASSERT_EQUAL(frame_len, output_buf_p);
+
+    // retransmitted once the delay expires
+    whisper_timer_wheel__advance(wheel, 1000 + RETRANSMISSION_DELAY_MS);
+    TEST_ASSERT_EQUAL(2 * frame_len, output_buf_p);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(output_buf, &output_buf[frame_len], frame_len);
+
+    // the acknowledgement stops the timer
+    uint8_t ack_frame[] = {0x0A, 0x0D, 0x01, 0x00, FLAGS_ACK, 0x02, 0x01, 0x00, 0x00, 0x00};
+    uint16_t checksum = update_crc_buf(ack_frame, sizeof(ack_frame) - LEN_CHECKSUM, CRC_INIT);
+    memcpy(&ack_frame[sizeof(ack_frame) - LEN_CHECKSUM], &checksum, LEN_CHECKSUM);
+    whisper_data_layer__data_received(dl, ack_frame, sizeof(ack_frame));
+    TEST_ASSERT_EQUAL(1, dl->send_buffer.empty);
+    TEST_ASSERT_EQUAL(0, whisper_timer_wheel__count(wheel));
+
+    free(wheel);
+}
+
+static void test_stats(void)
+{
+    struct whisper_data_layer__stats stats;
+    if (whisper_data_layer__stats(dl, &stats) != 0)
+        TEST_IGNORE_MESSAGE("built without WHISPER_STATS");
+    TEST_ASSERT_EQUAL(0, stats.bytes_in);
+
+    // noise followed by a valid frame
+    uint8_t data[] = {0x00, 0x01, 0x02, 0x0A, 0x0D, 0x05, 0x00, FLAGS_DATA, 0x02, 0x01, 0x02, 0x00, 0x00};
+    uint16_t checksum = update_crc_buf(&data[3], sizeof(data) - 3 - LEN_CHECKSUM, CRC_INIT);
+    memcpy(&data[sizeof(data) - LEN_CHECKSUM], &checksum, LEN_CHECKSUM);
+    whisper_data_layer__data_received(dl, data, sizeof(data));
+
+    // the same frame with a broken checksum
+    data[sizeof(data) - 1] ^= 0xFF;
+    whisper_data_layer__data_received(dl, &data[3], sizeof(data) - 3);
+
+    whisper_data_layer__stats(dl, &stats);
+    TEST_ASSERT_EQUAL(2 * sizeof(data) - 3, stats.bytes_in);
+    TEST_ASSERT_EQUAL(1, stats.frames_ok);
+    TEST_ASSERT_EQUAL(1, stats.crc_errors);
+    TEST_ASSERT_EQUAL(0, stats.header_errors);
+    // the noise, the first byte of the broken frame and the rest of it but the last byte
+    TEST_ASSERT_EQUAL(3 + 1 + sizeof(data) - 3 - 2, stats.resync_bytes);
+    // the acknowledgement of the valid frame
+    TEST_ASSERT_EQUAL(LEN_PREFIX + LEN_HEADER + 2 + LEN_CHECKSUM, stats.bytes_out);
+
+    // a frame, which is never acknowledged
+    uint8_t payload[] = {0x01, 0x02, 0x03};
+    whisper_data_layer__data_sent(dl, payload, sizeof(payload), 1);
+    while (!dl->send_buffer.empty)
+        _send_data(dl);
+
+    whisper_data_layer__stats(dl, &stats);
+    TEST_ASSERT_EQUAL(MAX_RETRANSMISSIONS - 1, stats.retransmits);
+    TEST_ASSERT_EQUAL(1, stats.drops);
+    TEST_ASSERT_EQUAL(LEN_PREFIX + LEN_HEADER + 2 + LEN_CHECKSUM +
+                          MAX_RETRANSMISSIONS * (LEN_PREFIX + LEN_HEADER + sizeof(payload) + LEN_CHECKSUM),
+                      stats.bytes_out);
+}
+
+static void test_trace(void)
+{
+    static const uint8_t expected[][3] = {
+        {WHISPER_TRACE__DATA_IN, 0, 10},
+        {WHISPER_TRACE__STATE, STATE_PREFIX, STATE_HEADER},
+        {WHISPER_TRACE__STATE, STATE_HEADER, STATE_PAYLOAD},
+        {WHISPER_TRACE__STATE, STATE_PAYLOAD, STATE_CHECKSUM},
+        {WHISPER_TRACE__FRAME_RX, FLAGS_DATA, 5},
+        {WHISPER_TRACE__ACK_TX, 0, 5},
+        {WHISPER_TRACE__STATE, STATE_CHECKSUM, STATE_PREFIX},
+    };
+    struct whisper_trace__record records[16];
+    whisper_trace_t trace = malloc(SIZEOF_WHISPER_TRACE_T);
+    unsigned int i;
+
+    whisper_trace__init(trace, records, 16, 0, 0);
+    dl->cfg.trace = trace;
+
+    uint8_t data[] = {0x0A, 0x0D, 0x05, 0x00, FLAGS_DATA, 0x02, 0x01, 0x02, 0x00, 0x00};
+    uint16_t checksum = update_crc_buf(data, sizeof(data) - LEN_CHECKSUM, CRC_INIT);
+    memcpy(&data[sizeof(data) - LEN_CHECKSUM], &checksum, LEN_CHECKSUM);
+    whisper_data_layer__data_received(dl, data, sizeof(data));
+
+    TEST_ASSERT_EQUAL(sizeof(expected) / sizeof(expected[0]), whisper_trace__count(trace));
+    for (i = 0; i < sizeof(expected) / sizeof(expected[0]); i++)
+    {
+        TEST_ASSERT_EQUAL(expected[i][0], whisper_trace__at(trace, i)->event);
+        TEST_ASSERT_EQUAL(expected[i][1], whisper_trace__at(trace, i)->arg8);
+        TEST_ASSERT_EQUAL(expected[i][2], whisper_trace__at(trace, i)->arg);
+    }
+
+    // a frame, which is never acknowledged
+    whisper_trace__clear(trace);
+    whisper_data_layer__data_sent(dl, data, 2, 1);
+    _send_data(dl);
+    TEST_ASSERT_EQUAL(WHISPER_TRACE__FRAME_TX, whisper_trace__at(trace, 0)->event);
+    TEST_ASSERT_EQUAL(1, whisper_trace__at(trace, 0)->arg8);
+    TEST_ASSERT_EQUAL(WHISPER_TRACE__TIMER_START, whisper_trace__at(trace, 1)->event);
+    TEST_ASSERT_EQUAL(RETRANSMISSION_DELAY_MS, whisper_trace__at(trace, 1)->arg);
+    TEST_ASSERT_EQUAL(WHISPER_TRACE__TIMER_EXPIRED, whisper_trace__at(trace, 2)->event);
+    TEST_ASSERT_EQUAL(WHISPER_TRACE__FRAME_TX, whisper_trace__at(trace, 3)->event);
+    TEST_ASSERT_EQUAL(2, whisper_trace__at(trace, 3)->arg8);
+
+    free(trace);
+}
+
+static unsigned long now;
+static int num_completions;
+static unsigned int completed_seq_no;
+static uint8_t completed_sent;
+
+static unsigned long now_us(whisper_data_layer_t dl)
+{
+    return now;
+}
+
+static void on_data_ack(whisper_data_layer_t dl, unsigned int seq_no, uint8_t sent)
+{
+    ++num_completions;
+    completed_seq_no = seq_no;
+    completed_sent = sent;
+}
+
+static void test_ack_completion(void)
+{
+    struct whisper_histogram histogram;
+    struct whisper_histogram snapshot;
+
+    whisper_histogram__init(&histogram);
+    dl->cfg.now_us = now_us;
+    dl->cfg.data_ack_cb = on_data_ack;
+    dl->cfg.ack_latency = &histogram;
+    num_completions = 0;
+
+    // acknowledged after 1234 us
+    now = 10000;
+    uint8_t payload[] = {0x01, 0x02};
+    uint16_t seq_no = whisper_data_layer__data_sent(dl, payload, sizeof(payload), 1);
+    now += 1234;
+    uint8_t ack_frame[] = {0x0A, 0x0D, 0x01, 0x00, FLAGS_ACK, 0x02, seq_no & 0xff, seq_no >> 8, 0x00, 0x00};
+    uint16_t checksum = update_crc_buf(ack_frame, sizeof(ack_frame) - LEN_CHECKSUM, CRC_INIT);
+    memcpy(&ack_frame[sizeof(ack_frame) - LEN_CHECKSUM], &checksum, LEN_CHECKSUM);
+    whisper_data_layer__data_received(dl, ack_frame, sizeof(ack_frame));
+
+    TEST_ASSERT_EQUAL(1, num_completions);
+    TEST_ASSERT_EQUAL(seq_no, completed_seq_no);
+    TEST_ASSERT_EQUAL(1, completed_sent);
+    TEST_ASSERT_EQUAL(0, whisper_data_layer__ack_latency(dl, &snapshot));
+    TEST_ASSERT_EQUAL(1, snapshot.count);
+    TEST_ASSERT_EQUAL(1234, snapshot.max);
+
+    // given up after the last retransmission
+    seq_no = whisper_data_layer__data_sent(dl, payload, sizeof(payload), 1);
+    while (!dl->send_buffer.empty)
+        _send_data(dl);
+
+    TEST_ASSERT_EQUAL(2, num_completions);
+    TEST_ASSERT_EQUAL(seq_no, completed_seq_no);
+    TEST_ASSERT_EQUAL(0, completed_sent);
+    whisper_data_layer__ack_latency(dl, &snapshot);
+    TEST_ASSERT_EQUAL(1, snapshot.count);
+
+    dl->cfg.ack_latency = 0;
+    TEST_ASSERT_NOT_EQUAL(0, whisper_data_layer__ack_latency(dl, &snapshot));
+}
+
+static void test_compression(void)
+{
+    static uint8_t compress_buf[255];
+    static uint8_t decompress_buf[255];
+    uint8_t text[] = "temp 21.5 C, temp 21.5 C, temp 21.6 C, temp 21.6 C, temp 21.7 C";
+    uint8_t frame[sizeof(output_buf)];
+    uint8_t frame_len;
+
+    dl->cfg.compress_buf = compress_buf;
+    whisper_data_layer__data_sent(dl, text, sizeof(text), 1);
+    frame_len = output_buf_p;
+    TEST_ASSERT_EQUAL(FLAGS_DATA | FLAGS_COMPRESSED, output_buf[4]);
+    TEST_ASSERT_LESS_THAN(LEN_PREFIX + LEN_HEADER + sizeof(text) + LEN_CHECKSUM, frame_len);
+    memcpy(frame, output_buf, frame_len);
+
+    // decompressed before the callback, and acknowledged
+    dl->cfg.decompress_buf = decompress_buf;
+    output_buf_p = 0;
+    whisper_data_layer__data_received(dl, frame, frame_len);
+    TEST_ASSERT_EQUAL(sizeof(text), data_received_length);
+    TEST_ASSERT_EQUAL_PTR(decompress_buf, data_received_payload);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(text, data_received_payload, sizeof(text));
+    TEST_ASSERT_EQUAL(LEN_PREFIX + LEN_HEADER + 2 + LEN_CHECKSUM, output_buf_p);
+
+    // rejected without the memory to decompress to, as if it had not been received before
+    dl->cfg.decompress_buf = 0;
+    dl->receive_window = 0;
+    data_received_length = 0;
+    output_buf_p = 0;
+    whisper_data_layer__data_received(dl, frame, frame_len);
+    TEST_ASSERT_EQUAL(0, data_received_length);
+    TEST_ASSERT_EQUAL(0, output_buf_p);
+
+    // sent as it is if it does not get shorter
+    uint8_t short_payload[] = {0x01, 0x02, 0x03, 0x04, 0x05};
+    dl->send_buffer.empty = 1;
+    output_buf_p = 0;
+    whisper_data_layer__data_sent(dl, short_payload, sizeof(short_payload), 1);
+    TEST_ASSERT_EQUAL(FLAGS_DATA, output_buf[4]);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(short_payload, &output_buf[LEN_PREFIX + LEN_HEADER], sizeof(short_payload));
+}
+
+static void test_forward_error_correction(void)
+{
+    struct whisper_data_layer__config cfg = dl->cfg;
+    struct whisper_data_layer__stats stats;
+    uint8_t payload[] = {0x10, 0x20, 0x30, 0x40, 0x50, 0x60, 0x70, 0x80};
+    uint8_t frame[sizeof(output_buf)];
+    uint8_t frame_len;
+
+    cfg.buf = _buf;
+    cfg.buf_len = _BUF_LEN;
+    cfg.fec_parity = 4;
+    whisper_data_layer__init(dl, &cfg);
+
+    // both blocks carry their parity
+    whisper_data_layer__data_sent(dl, payload, sizeof(payload), 1);
+    frame_len = output_buf_p;
+    TEST_ASSERT_EQUAL(LEN_PREFIX + LEN_HEADER + sizeof(payload) + LEN_CHECKSUM + 2 * 4, frame_len);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(payload, &output_buf[LEN_PREFIX + LEN_HEADER + 4], sizeof(payload));
+    memcpy(frame, output_buf, frame_len);
+
+    // 2 bytes of the header and 2 of the rest are repaired
+    frame[LEN_PREFIX + 1] ^= 0xFF;
+    frame[LEN_PREFIX + LEN_HEADER] ^= 0x01;
+    frame[LEN_PREFIX + LEN_HEADER + 4 + 3] ^= 0x18;
+    frame[frame_len - 1] ^= 0x80;
+    output_buf_p = 0;
+    whisper_data_layer__data_received(dl, frame, frame_len);
+    TEST_ASSERT_EQUAL(sizeof(payload), data_received_length);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(payload, data_received_payload, sizeof(payload));
+    whisper_data_layer__stats(dl, &stats);
+    TEST_ASSERT_EQUAL(4, stats.fec_corrected);
+    TEST_ASSERT_EQUAL(0, stats.crc_errors);
+
+    // the acknowledgement is protected the same way
+    TEST_ASSERT_EQUAL(LEN_PREFIX + LEN_HEADER + 2 + LEN_CHECKSUM + 2 * 4, output_buf_p);
+    memcpy(frame, output_buf, output_buf_p);
+    frame[LEN_PREFIX + LEN_HEADER + 4] ^= 0x55;
+    whisper_data_layer__data_received(dl, frame, LEN_PREFIX + LEN_HEADER + 2 + LEN_CHECKSUM + 2 * 4);
+    TEST_ASSERT_EQUAL(1, dl->send_buffer.empty);
+
+    // 3 bytes in a block are too many for 4 bytes of parity, the checksum catches them
+    data_received_length = 0;
+    output_buf_p = 0;
+    whisper_data_layer__data_sent(dl, payload, sizeof(payload), 1);
+    memcpy(frame, output_buf, frame_len);
+    frame[LEN_PREFIX + LEN_HEADER + 4] ^= 0x01;
+    frame[LEN_PREFIX + LEN_HEADER + 4 + 1] ^= 0x01;
+    frame[LEN_PREFIX + LEN_HEADER + 4 + 2] ^= 0x01;
+    whisper_data_layer__data_received(dl, frame, frame_len);
+    TEST_ASSERT_EQUAL(0, data_received_length);
+    whisper_data_layer__stats(dl, &stats);
+    TEST_ASSERT_EQUAL(1, stats.crc_errors);
+}
+
+static void test_payload_limit(void)
+{
+    struct whisper_data_layer__config cfg = dl->cfg;
+    static uint8_t payload[_BUF_LEN];
+    uint8_t frame[sizeof(output_buf)];
+    uint8_t frame_len;
+    uint8_t limit = _BUF_LEN - SIZEOF_ARRAY_BUFFER_T - LEN_PREFIX - LEN_HEADER - 2 * 4 - LEN_CHECKSUM;
+
+    cfg.buf = _buf;
+    cfg.buf_len = _BUF_LEN;
+    cfg.fec_parity = 4;
+    whisper_data_layer__init(dl, &cfg);
+
+    // a frame the receive buffer does not take is refused rather than retransmitted until given up
+    output_buf_p = 0;
+    TEST_ASSERT_EQUAL(0, whisper_data_layer__data_sent(dl, payload, limit + 1, 1));
+    TEST_ASSERT_EQUAL(0, output_buf_p);
+    TEST_ASSERT_EQUAL(1, dl->send_buffer.empty);
+
+    // the longest one fits
+    TEST_ASSERT_NOT_EQUAL(0, whisper_data_layer__data_sent(dl, payload, limit, 1));
+    frame_len = output_buf_p;
+    memcpy(frame, output_buf, frame_len);
+    output_buf_p = 0;
+    whisper_data_layer__data_received(dl, frame, frame_len);
+    TEST_ASSERT_EQUAL(limit, data_received_length);
+}
+
+static void test_crc32c_checksum(void)
+{
+    struct whisper_data_layer__config cfg = dl->cfg;
+    struct whisper_data_layer__stats stats;
+    const char *check = "123456789";
+    uint8_t payload[] = {0x10, 0x20, 0x30, 0x40, 0x50, 0x60, 0x70, 0x80};
+    uint8_t frame[sizeof(output_buf)];
+    uint8_t frame_len;
+    unsigned long crc;
+
+    TEST_ASSERT_EQUAL_HEX32(0xE3069283, update_crc32c_buf((const uint8_t *)check, 9, CRC32C_INIT) ^ 0xFFFFFFFFUL);
+
+    cfg.buf = _buf;
+    cfg.buf_len = _BUF_LEN;
+    cfg.checksum = WHISPER_DATA_LAYER__CHECKSUM_CRC32C;
+    whisper_data_layer__init(dl, &cfg);
+
+    // the complement of the register, least significant byte first, over the prefix, the header and the payload
+    whisper_data_layer__data_sent(dl, payload, sizeof(payload), 1);
+    frame_len = output_buf_p;
+    TEST_ASSERT_EQUAL(LEN_PREFIX + LEN_HEADER + sizeof(payload) + LEN_CRC32C, frame_len);
+    crc = ~update_crc32c_buf(output_buf, frame_len - LEN_CRC32C, CRC32C_INIT);
+    TEST_ASSERT_EQUAL(crc & 0xFF, output_buf[frame_len - 4]);
+    TEST_ASSERT_EQUAL((crc >> 24) & 0xFF, output_buf[frame_len - 1]);
+    memcpy(frame, output_buf, frame_len);
+
+    // looped back, the frame is delivered and acknowledged with the same trailer
+    output_buf_p = 0;
+    whisper_data_layer__data_received(dl, frame, frame_len);
+    TEST_ASSERT_EQUAL(sizeof(payload), data_received_length);
+    TEST_ASSERT_EQUAL(LEN_PREFIX + LEN_HEADER + 2 + LEN_CRC32C, output_buf_p);
+    memcpy(frame, output_buf, output_buf_p);
+    whisper_data_layer__data_received(dl, frame, output_buf_p);
+    TEST_ASSERT_EQUAL(1, dl->send_buffer.empty);
+
+    // a broken trailer is caught
+    data_received_length = 0;
+    output_buf_p = 0;
+    whisper_data_layer__data_sent(dl, payload, sizeof(payload), 1);
+    memcpy(frame, output_buf, frame_len);
+    frame[frame_len - 3] ^= 0x04;
+    whisper_data_layer__data_received(dl, frame, frame_len);
+    TEST_ASSERT_EQUAL(0, data_received_length);
+    if (whisper_data_layer__stats(dl, &stats) == 0)
+        TEST_ASSERT_EQUAL(1, stats.crc_errors);
+
+    // with COBS framing, which leaves the prefix out of the checksum
+    cfg.framing = WHISPER_DATA_LAYER__FRAMING_COBS;
+    whisper_data_layer__init(dl, &cfg);
+    output_buf_p = 0;
+    whisper_data_layer__data_sent(dl, payload, sizeof(payload), 1);
+    memcpy(frame, output_buf, output_buf_p);
+    whisper_data_layer__data_received(dl, frame, output_buf_p);
+    TEST_ASSERT_EQUAL(sizeof(payload), data_received_length);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(payload, data_received_payload, sizeof(payload));
+}
+
+static void test_cobs_framing(void)
+{
+    struct whisper_data_layer__config cfg = dl->cfg;
+    struct whisper_data_layer__stats stats;
+    uint8_t payload[] = {0x00, 0x0A, 0x0D, 0x00, 0x00, 0x7F};
+    uint8_t garbage[] = {0x0A, 0x0D, 0x01, 0x02, 0x05, 0x12, 0x00};
+    uint8_t frame[sizeof(output_buf)];
+    uint8_t frame_len;
+
+    cfg.buf = _buf;
+    cfg.buf_len = _BUF_LEN;
+    cfg.framing = WHISPER_DATA_LAYER__FRAMING_COBS;
+    whisper_data_layer__init(dl, &cfg);
+
+    // the only zero of the frame is the delimiter, the prefix is gone
+    whisper_data_layer__data_sent(dl, payload, sizeof(payload), 1);
+    frame_len = output_buf_p;
+    TEST_ASSERT_EQUAL(LEN_HEADER + sizeof(payload) + LEN_CHECKSUM + 2, frame_len);
+    TEST_ASSERT_NULL(memchr(output_buf, 0, frame_len - 1));
+    TEST_ASSERT_EQUAL(0, output_buf[frame_len - 1]);
+    memcpy(frame, output_buf, frame_len);
+
+    // garbage ending in a delimiter costs one failed frame, not a search of every byte
+    output_buf_p = 0;
+    whisper_data_layer__data_received(dl, garbage, sizeof(garbage));
+    whisper_data_layer__data_received(dl, frame, frame_len);
+    TEST_ASSERT_EQUAL(sizeof(payload), data_received_length);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(payload, data_received_payload, sizeof(payload));
+    whisper_data_layer__stats(dl, &stats);
+    TEST_ASSERT_EQUAL(1, stats.frames_ok);
+    TEST_ASSERT_EQUAL(1, stats.header_errors + stats.crc_errors);
+    TEST_ASSERT_EQUAL(0, stats.resync_bytes);
+
+    // the acknowledgement is stuffed the same way, and completes the frame
+    TEST_ASSERT_EQUAL(0, output_buf[output_buf_p - 1]);
+    memcpy(frame, output_buf, output_buf_p);
+    whisper_data_layer__data_received(dl, frame, output_buf_p);
+    TEST_ASSERT_EQUAL(1, dl->send_buffer.empty);
+
+    // a frame too long for the buffer is skipped up to its delimiter
+    memset(frame, 0x55, sizeof(frame));
+    frame[sizeof(frame) - 1] = 0;
+    data_received_length = 0;
+    output_buf_p = 0;
+    whisper_data_layer__data_sent(dl, payload, sizeof(payload), 1);
+    whisper_data_layer__data_received(dl, frame, sizeof(frame));
+    whisper_data_layer__data_received(dl, frame, sizeof(frame));
+    whisper_data_layer__data_received(dl, output_buf, output_buf_p);
+    TEST_ASSERT_EQUAL(sizeof(payload), data_received_length);
+    whisper_data_layer__stats(dl, &stats);
+    TEST_ASSERT_EQUAL(2 * sizeof(frame), stats.resync_bytes);
+}
+
+/** feed a data frame with a payload of its sequence no, return 1 if it was delivered */
+static char receive_data_frame(uint16_t seq_no)
+{
+    uint8_t frame[] = {0x0A, 0x0D, seq_no & 0xff, seq_no >> 8, FLAGS_DATA, 2, seq_no & 0xff, seq_no >> 8, 0, 0};
+    uint16_t checksum = update_crc_buf(frame, sizeof(frame) - LEN_CHECKSUM, CRC_INIT);
+
+    memcpy(&frame[sizeof(frame) - LEN_CHECKSUM], &checksum, LEN_CHECKSUM);
+    data_received_length = 0;
+    output_buf_p = 0;
+    whisper_data_layer__data_received(dl, frame, sizeof(frame));
+
+    // every data frame is acknowledged, delivered or not, refused ones with a window update
+    TEST_ASSERT_EQUAL(LEN_PREFIX + LEN_HEADER + (dl->cfg.credits ? 3 : 2) + LEN_CHECKSUM, output_buf_p);
+    if (data_received_length > 0 || !dl->window_closed)
+        TEST_ASSERT_EQUAL(seq_no, output_buf[LEN_PREFIX + LEN_HEADER] | output_buf[LEN_PREFIX + LEN_HEADER + 1] << 8);
+    return data_received_length > 0;
+}
+
+/** feed an acknowledgement of the peer, advertising its receive credits */
+static void receive_ack(uint16_t seq_no, uint8_t credits)
+{
+    uint8_t frame[] = {0x0A, 0x0D, 0x01, 0x00, FLAGS_ACK, 3, seq_no & 0xff, seq_no >> 8, credits, 0, 0};
+    uint16_t checksum = update_crc_buf(frame, sizeof(frame) - LEN_CHECKSUM, CRC_INIT);
+
+    memcpy(&frame[sizeof(frame) - LEN_CHECKSUM], &checksum, LEN_CHECKSUM);
+    whisper_data_layer__data_received(dl, frame, sizeof(frame));
+}
+
+static void test_duplicate_suppression(void)
+{
+    struct whisper_data_layer__stats stats;
+
+    // a retransmission, of which the acknowledgement got lost
+    TEST_ASSERT_EQUAL(1, receive_data_frame(10));
+    TEST_ASSERT_EQUAL(0, receive_data_frame(10));
+
+    // a frame the sender gave up on, and then retransmitted late
+    TEST_ASSERT_EQUAL(1, receive_data_frame(12));
+    TEST_ASSERT_EQUAL(1, receive_data_frame(11));
+    TEST_ASSERT_EQUAL(0, receive_data_frame(11));
+    TEST_ASSERT_EQUAL(0, receive_data_frame(12));
+
+    // across the wrap around of the sequence numbers
+    TEST_ASSERT_EQUAL(1, receive_data_frame(65535));
+    TEST_ASSERT_EQUAL(1, receive_data_frame(1));
+    TEST_ASSERT_EQUAL(0, receive_data_frame(65535));
+    TEST_ASSERT_EQUAL(1, receive_data_frame(65534));
+
+    // the peer started over, far behind the window
+    TEST_ASSERT_EQUAL(1, receive_data_frame(1000));
+    TEST_ASSERT_EQUAL(1, receive_data_frame(1));
+    TEST_ASSERT_EQUAL(0, receive_data_frame(1));
+
+    whisper_data_layer__stats(dl, &stats);
+    TEST_ASSERT_EQUAL(5, stats.duplicates);
+}
+
+static void test_channels(void)
+{
+    struct whisper_data_layer__stats stats;
+    uint8_t payload[] = {0x01, 0x02, 0x03};
+    uint8_t frame[sizeof(output_buf)];
+    uint8_t frame_len;
+
+    // carried in the upper bits of the flags
+    whisper_data_layer__channel_sent(dl, 5, payload, sizeof(payload), 1);
+    frame_len = output_buf_p;
+    TEST_ASSERT_EQUAL(FLAGS_DATA | 5 << FLAGS_CHANNEL_SHIFT, output_buf[4]);
+    memcpy(frame, output_buf, frame_len);
+
+    output_buf_p = 0;
+    whisper_data_layer__data_received(dl, frame, frame_len);
+    TEST_ASSERT_EQUAL(sizeof(payload), data_received_length);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(payload, data_received_payload, sizeof(payload));
+    TEST_ASSERT_EQUAL(5, data_received_channel);
+
+    // acknowledgements are on no channel
+    uint8_t ack_frame[] = {0x0A, 0x0D, 0x01, 0x00, FLAGS_ACK | 1 << FLAGS_CHANNEL_SHIFT, 2, 0x01, 0x00, 0, 0};
+    uint16_t checksum = update_crc_buf(ack_frame, sizeof(ack_frame) - LEN_CHECKSUM, CRC_INIT);
+    memcpy(&ack_frame[sizeof(ack_frame) - LEN_CHECKSUM], &checksum, LEN_CHECKSUM);
+    whisper_data_layer__data_received(dl, ack_frame, sizeof(ack_frame));
+    whisper_data_layer__stats(dl, &stats);
+    TEST_ASSERT_EQUAL(1, stats.header_errors);
+    TEST_ASSERT_EQUAL(0, stats.crc_errors);
+}
+
+static void test_receive_credits(void)
+{
+    struct whisper_data_layer__stats stats;
+    uint8_t *ack_payload = &output_buf[LEN_PREFIX + LEN_HEADER];
+
+    dl->cfg.credits = 2;
+    dl->receive_credits = 2;
+
+    // the acknowledgements advertise the credits left
+    TEST_ASSERT_EQUAL(1, receive_data_frame(1));
+    TEST_ASSERT_EQUAL(1, ack_payload[2]);
+    TEST_ASSERT_EQUAL(1, receive_data_frame(2));
+    TEST_ASSERT_EQUAL(0, ack_payload[2]);
+
+    // refused without credits, with a window update
+    TEST_ASSERT_EQUAL(0, receive_data_frame(3));
+    TEST_ASSERT_EQUAL(0, ack_payload[0] | ack_payload[1] << 8);
+    TEST_ASSERT_EQUAL(0, ack_payload[2]);
+    whisper_data_layer__stats(dl, &stats);
+    TEST_ASSERT_EQUAL(1, stats.refused);
+    TEST_ASSERT_EQUAL(0, stats.duplicates);
+
+    // the credits granted are announced right away, once
+    output_buf_p = 0;
+    whisper_data_layer__grant(dl, 1);
+    TEST_ASSERT_EQUAL(LEN_PREFIX + LEN_HEADER + 3 + LEN_CHECKSUM, output_buf_p);
+    TEST_ASSERT_EQUAL(0, ack_payload[0] | ack_payload[1] << 8);
+    TEST_ASSERT_EQUAL(1, ack_payload[2]);
+    output_buf_p = 0;
+    whisper_data_layer__grant(dl, 1);
+    TEST_ASSERT_EQUAL(0, output_buf_p);
+
+    // the refused frame is taken once it comes again
+    TEST_ASSERT_EQUAL(1, receive_data_frame(3));
+    TEST_ASSERT_EQUAL(1, ack_payload[2]);
+
+    // probes are answered with a window update, and not delivered
+    uint8_t probe[] = {0x0A, 0x0D, 0x00, 0x00, FLAGS_DATA, 0, 0, 0};
+    uint16_t checksum = update_crc_buf(probe, sizeof(probe) - LEN_CHECKSUM, CRC_INIT);
+    memcpy(&probe[sizeof(probe) - LEN_CHECKSUM], &checksum, LEN_CHECKSUM);
+    data_received_length = 0;
+    output_buf_p = 0;
+    whisper_data_layer__data_received(dl, probe, sizeof(probe));
+    TEST_ASSERT_EQUAL(0, data_received_length);
+    TEST_ASSERT_EQUAL(LEN_PREFIX + LEN_HEADER + 3 + LEN_CHECKSUM, output_buf_p);
+    TEST_ASSERT_EQUAL(0, ack_payload[0] | ack_payload[1] << 8);
+    TEST_ASSERT_EQUAL(1, ack_payload[2]);
+}
+
+static void test_peer_credits(void)
+{
+    uint8_t payload[] = {0x01, 0x02};
+    uint8_t frame_len = LEN_PREFIX + LEN_HEADER + sizeof(payload) + LEN_CHECKSUM;
+    uint8_t probe_len = LEN_PREFIX + LEN_HEADER + LEN_CHECKSUM;
+    uint16_t seq_no;
+    int i;
+
+    // the peer has no room left after the first frame
+    seq_no = whisper_data_layer__data_sent(dl, payload, sizeof(payload), 1);
+    receive_ack(seq_no, 0);
+    TEST_ASSERT_EQUAL(1, dl->send_buffer.empty);
+
+    // the next frame is held, and probed for later
+    output_buf_p = 0;
+    seq_no = whisper_data_layer__data_sent(dl, payload, sizeof(payload), 1);
+    TEST_ASSERT_NOT_EQUAL(0, seq_no);
+    TEST_ASSERT_EQUAL(0, output_buf_p);
+    TEST_ASSERT_EQUAL(PROBE_DELAY_MS, set_delay_tail->delay);
+    TEST_ASSERT_EQUAL_PTR(_probe, set_delay_tail->callback);
+
+    // and sent as soon as the peer grants credits
+    receive_ack(0, 1);
+    TEST_ASSERT_EQUAL(frame_len, output_buf_p);
+    TEST_ASSERT_EQUAL(1, dl->send_buffer.num_transmissions);
+
+    // a refusal is no loss, the peer is probed with an empty frame of sequence no 0 instead
+    receive_ack(0, 0);
+    TEST_ASSERT_EQUAL(0, dl->send_buffer.num_transmissions);
+    TEST_ASSERT_EQUAL(PROBE_DELAY_MS, set_delay_tail->delay);
+    output_buf_p = 0;
+    set_delay_tail->callback(dl);
+    TEST_ASSERT_EQUAL(probe_len, output_buf_p);
+    TEST_ASSERT_EQUAL(0, output_buf[LEN_PREFIX] | output_buf[LEN_PREFIX + 1] << 8);
+    TEST_ASSERT_EQUAL(0, output_buf[LEN_PREFIX + 3]);
+
+    // backing off while the answers have no credits
+    receive_ack(0, 0);
+    TEST_ASSERT_EQUAL(2 * PROBE_DELAY_MS, set_delay_tail->delay);
+    output_buf_p = 0;
+    receive_ack(0, 1);
+    TEST_ASSERT_EQUAL(frame_len, output_buf_p);
+    receive_ack(seq_no, 3);
+    TEST_ASSERT_EQUAL(1, dl->send_buffer.empty);
+    TEST_ASSERT_EQUAL(3, dl->peer_credits);
+
+    // given up once the probes go unanswered
+    receive_ack(0, 0);
+    whisper_data_layer__data_sent(dl, payload, sizeof(payload), 1);
+    for (i = 0; i < MAX_RETRANSMISSIONS; i++)
+        set_delay_tail->callback(dl);
+    TEST_ASSERT_EQUAL(0, dl->send_buffer.empty);
+    set_delay_tail->callback(dl);
+    TEST_ASSERT_EQUAL(1, dl->send_buffer.empty);
+}
+
+static void test_adaptive_payload_len(void)
+{
+    static uint8_t payload[100];
+    uint16_t seq_no;
+    int i;
+
+    // no longer than the own receive buffer takes
+    TEST_ASSERT_EQUAL(_BUF_LEN - SIZEOF_ARRAY_BUFFER_T - LEN_PREFIX - LEN_HEADER - LEN_CHECKSUM,
+                      whisper_data_layer__payload_len(dl));
+    // within the receive buffer, the peer is taken to match
+    dl->cfg.min_payload_len = 64;
+    dl->cfg.max_payload_len = 100;
+
+    // the longest payload on a clean line
+    for (i = 0; i < 10; i++)
+    {
+        output_buf_p = 0;
+        receive_ack(whisper_data_layer__data_sent(dl, payload, sizeof(payload), 1), 255);
+    }
+    TEST_ASSERT_EQUAL(100, whisper_data_layer__payload_len(dl));
+
+    // every other transmission of 100 bytes and the overhead of 18 bytes times out
+    for (i = 0; i < 10; i++)
+    {
+        output_buf_p = 0;
+        seq_no = whisper_data_layer__data_sent(dl, payload, sizeof(payload), 1);
+        output_buf_p = 0;
+        set_delay_tail->callback(dl);
+        receive_ack(seq_no, 255);
+    }
+    // with the clean ones before, 10 of 30, so p is 1 / 354 per byte and L^2 + 18 L = 18 * 354
+    TEST_ASSERT_UINT_WITHIN(1, 71, whisper_data_layer__payload_len(dl));
+
+    // two of three time out, which would take 56 bytes, but no shorter than the bound
+    for (i = 0; i < 10; i++)
+    {
+        output_buf_p = 0;
+        seq_no = whisper_data_layer__data_sent(dl, payload, sizeof(payload), 1);
+        output_buf_p = 0;
+        set_delay_tail->callback(dl);
+        output_buf_p = 0;
+        set_delay_tail->callback(dl);
+        receive_ack(seq_no, 255);
+    }
+    TEST_ASSERT_EQUAL(64, whisper_data_layer__payload_len(dl));
+
+    // and back to the longest once the errors fade out of the measurement
+    for (i = 0; i < 2000; i++)
+    {
+        output_buf_p = 0;
+        receive_ack(whisper_data_layer__data_sent(dl, payload, sizeof(payload), 1), 255);
+    }
+    TEST_ASSERT_EQUAL(100, whisper_data_layer__payload_len(dl));
+}
+
+static int connected;
+
+static void on_connected(whisper_data_layer_t dl, uint8_t is_connected)
+{
+    connected = is_connected;
+}
+
+/** feed a handshake frame of the peer, or its answer to ours with FLAGS_ACK */
+static void receive_handshake(uint8_t flags, uint8_t max_payload_len, uint8_t caps, uint8_t credits)
+{
+    uint8_t frame[] = {0x0A, 0x0D, 0x00, 0x00, flags, LEN_HANDSHAKE, HANDSHAKE_VERSION, max_payload_len, credits, caps,
+                       WHISPER_DATA_LAYER__CHECKSUM_CRC16, 0, 0, 0, 0};
+    uint16_t checksum = update_crc_buf(frame, sizeof(frame) - LEN_CHECKSUM, CRC_INIT);
+
+    memcpy(&frame[sizeof(frame) - LEN_CHECKSUM], &checksum, LEN_CHECKSUM);
+    output_buf_p = 0;
+    whisper_data_layer__data_received(dl, frame, sizeof(frame));
+}
+
+static void test_handshake(void)
+{
+    static uint8_t compress_buf[255];
+    uint8_t payload[32];
+    struct whisper_data_layer__peer peer;
+    uint16_t seq_no;
+
+    dl->cfg.connected_cb = on_connected;
+    dl->cfg.compress_buf = compress_buf;
+    TEST_ASSERT_EQUAL(-1, whisper_data_layer__peer(dl, &peer));
+
+    // the capabilities of the link, the receive buffer is the limit of the payload
+    whisper_data_layer__connect(dl);
+    TEST_ASSERT_EQUAL(LEN_PREFIX + LEN_HEADER + LEN_HANDSHAKE + LEN_CHECKSUM, output_buf_p);
+    TEST_ASSERT_EQUAL(FLAGS_SEQ_RESET, output_buf[LEN_PREFIX + 2]);
+    TEST_ASSERT_EQUAL(HANDSHAKE_VERSION, output_buf[LEN_PREFIX + LEN_HEADER]);
+    TEST_ASSERT_EQUAL(_BUF_LEN - SIZEOF_ARRAY_BUFFER_T - LEN_PREFIX - LEN_HEADER - LEN_CHECKSUM,
+                      output_buf[LEN_PREFIX + LEN_HEADER + 1]);
+    TEST_ASSERT_EQUAL_PTR(_connect, set_delay_tail->callback);
+
+    // a frame sent meanwhile waits for the answer
+    output_buf_p = 0;
+    memset(payload, 'a', sizeof(payload));
+    seq_no = whisper_data_layer__data_sent(dl, payload, sizeof(payload), 1);
+    TEST_ASSERT_EQUAL(1, seq_no);
+    TEST_ASSERT_EQUAL(0, output_buf_p);
+
+    // and goes out with it, uncompressed for a peer which does not decompress
+    receive_handshake(FLAGS_SEQ_RESET | FLAGS_ACK, 40, HANDSHAKE_CREDITS, 4);
+    TEST_ASSERT_EQUAL(1, connected);
+    TEST_ASSERT_EQUAL(LEN_PREFIX + LEN_HEADER + sizeof(payload) + LEN_CHECKSUM, output_buf_p);
+    TEST_ASSERT_EQUAL(FLAGS_DATA, output_buf[LEN_PREFIX + 2]);
+    TEST_ASSERT_EQUAL(0, whisper_data_layer__peer(dl, &peer));
+    TEST_ASSERT_EQUAL(40, peer.max_payload_len);
+    TEST_ASSERT_EQUAL(4, peer.credits);
+    TEST_ASSERT_EQUAL(0, peer.compression);
+    TEST_ASSERT_EQUAL(WHISPER_DATA_LAYER__CHECKSUM_CRC16, peer.checksums);
+    TEST_ASSERT_EQUAL(40, whisper_data_layer__payload_len(dl));
+    TEST_ASSERT_EQUAL(4, dl->peer_credits);
+
+    // the answer to a handshake transmitted again is ignored
+    connected = -1;
+    receive_handshake(FLAGS_SEQ_RESET | FLAGS_ACK, 40, HANDSHAKE_CREDITS, 4);
+    TEST_ASSERT_EQUAL(-1, connected);
+    TEST_ASSERT_EQUAL(0, output_buf_p);
+}
+
+/** hand the bytes written to the other link */
+static void pass_output(whisper_data_layer_t to)
+{
+    uint8_t frame[sizeof(output_buf)];
+    uint8_t frame_len = output_buf_p;
+
+    memcpy(frame, output_buf, frame_len);
+    output_buf_p = 0;
+    whisper_data_layer__data_received(to, frame, frame_len);
+}
+
+static void test_checksum_negotiation(void)
+{
+    static uint8_t other_buf[_BUF_LEN];
+    struct whisper_data_layer__config cfg = dl->cfg;
+    struct whisper_data_layer__peer peer;
+    whisper_data_layer_t other = malloc(SIZEOF_WHISPER_DATA_LAYER_T);
+    uint8_t payload[] = {0x10, 0x20, 0x30, 0x40, 0x50, 0x60, 0x70, 0x80};
+    uint8_t checksum;
+
+    cfg.buf_len = _BUF_LEN;
+    for (checksum = WHISPER_DATA_LAYER__CHECKSUM_CRC16; checksum <= WHISPER_DATA_LAYER__CHECKSUM_CRC32C; checksum++)
+    {
+        uint8_t accepted = checksum == WHISPER_DATA_LAYER__CHECKSUM_CRC32C
+                               ? WHISPER_DATA_LAYER__CHECKSUM_CRC16 | WHISPER_DATA_LAYER__CHECKSUM_CRC32C
+                               : WHISPER_DATA_LAYER__CHECKSUM_CRC16;
+        uint8_t len = checksum == WHISPER_DATA_LAYER__CHECKSUM_CRC32C ? LEN_CRC32C : LEN_CHECKSUM;
+
+        // a link capable of CRC-32C connects to one configured with the checksum
+        cfg.buf = _buf;
+        cfg.checksum = WHISPER_DATA_LAYER__CHECKSUM_CRC32C;
+        whisper_data_layer__init(dl, &cfg);
+        cfg.buf = other_buf;
+        cfg.checksum = checksum;
+        whisper_data_layer__init(other, &cfg);
+
+        // the handshake and its answer go with CRC-16, and tell the checksums accepted
+        output_buf_p = 0;
+        whisper_data_layer__connect(dl);
+        TEST_ASSERT_EQUAL(LEN_PREFIX + LEN_HEADER + LEN_HANDSHAKE + LEN_CHECKSUM, output_buf_p);
+        TEST_ASSERT_EQUAL(WHISPER_DATA_LAYER__CHECKSUM_CRC16 | WHISPER_DATA_LAYER__CHECKSUM_CRC32C,
+                          output_buf[LEN_PREFIX + LEN_HEADER + 4]);
+        pass_output(other);
+        TEST_ASSERT_EQUAL(LEN_PREFIX + LEN_HEADER + LEN_HANDSHAKE + LEN_CHECKSUM, output_buf_p);
+        TEST_ASSERT_EQUAL(accepted, output_buf[LEN_PREFIX + LEN_HEADER + 4]);
+        pass_output(dl);
+        TEST_ASSERT_EQUAL(0, whisper_data_layer__peer(dl, &peer));
+        TEST_ASSERT_EQUAL(accepted, peer.checksums);
+
+        // the data goes both ways with the best checksum in common
+        whisper_data_layer__data_sent(dl, payload, sizeof(payload), 1);
+        TEST_ASSERT_EQUAL(LEN_PREFIX + LEN_HEADER + sizeof(payload) + len, output_buf_p);
+        data_received_length = 0;
+        pass_output(other);
+        TEST_ASSERT_EQUAL(sizeof(payload), data_received_length);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(payload, data_received_payload, sizeof(payload));
+        pass_output(dl);
+        TEST_ASSERT_EQUAL(1, dl->send_buffer.empty);
+
+        whisper_data_layer__data_sent(other, payload, sizeof(payload), 1);
+        TEST_ASSERT_EQUAL(LEN_PREFIX + LEN_HEADER + sizeof(payload) + len, output_buf_p);
+        data_received_length = 0;
+        pass_output(dl);
+        TEST_ASSERT_EQUAL(sizeof(payload), data_received_length);
+        pass_output(other);
+        TEST_ASSERT_EQUAL(1, other->send_buffer.empty);
+    }
+    free(other);
+}
+
+static void test_handshake_of_restarted_peer(void)
+{
+    struct whisper_data_layer__peer peer;
+
+    dl->cfg.connected_cb = on_connected;
+    TEST_ASSERT_EQUAL(1, receive_data_frame(5));
+    TEST_ASSERT_EQUAL(0, receive_data_frame(5));
+
+    // the peer starts over, which is answered
+    receive_handshake(FLAGS_SEQ_RESET, 100, HANDSHAKE_DECOMPRESS, 0);
+    TEST_ASSERT_EQUAL(1, connected);
+    TEST_ASSERT_EQUAL(LEN_PREFIX + LEN_HEADER + LEN_HANDSHAKE + LEN_CHECKSUM, output_buf_p);
+    TEST_ASSERT_EQUAL(FLAGS_SEQ_RESET | FLAGS_ACK, output_buf[LEN_PREFIX + 2]);
+
+    // and its sequence numbers are new
+    TEST_ASSERT_EQUAL(1, receive_data_frame(5));
+
+    // without flow control, and with the same dictionary, none
+    TEST_ASSERT_EQUAL(0, whisper_data_layer__peer(dl, &peer));
+    TEST_ASSERT_EQUAL(0, peer.credits);
+    TEST_ASSERT_EQUAL(1, peer.compression);
+    TEST_ASSERT_EQUAL(1, dl->peer_credits);
+}
+
+static void test_handshake_given_up(void)
+{
+    uint8_t payload[] = {0x01, 0x02};
+    int i;
+
+    dl->cfg.connected_cb = on_connected;
+    connected = -1;
+    whisper_data_layer__connect(dl);
+    whisper_data_layer__data_sent(dl, payload, sizeof(payload), 1);
+
+    // transmitted like a frame, then the link goes on without
+    for (i = 1; i < MAX_RETRANSMISSIONS; i++)
+    {
+        output_buf_p = 0;
+        set_delay_tail->callback(dl);
+        TEST_ASSERT_EQUAL(FLAGS_SEQ_RESET, output_buf[LEN_PREFIX + 2]);
+    }
+    TEST_ASSERT_EQUAL(-1, connected);
+    output_buf_p = 0;
+    set_delay_tail->callback(dl);
+    TEST_ASSERT_EQUAL(0, connected);
+    TEST_ASSERT_EQUAL(FLAGS_DATA, output_buf[LEN_PREFIX + 2]);
+    TEST_ASSERT_EQUAL(1, output_buf[LEN_PREFIX]);
+    TEST_ASSERT_EQUAL(max_receive_payload(dl), whisper_data_layer__payload_len(dl));
+}
+
+static void test_compact_header(void)
+{
+    struct whisper_data_layer__config cfg = dl->cfg;
+    struct whisper_data_layer__stats stats;
+    uint8_t payload[40];
+    uint8_t frame[sizeof(output_buf)];
+    uint8_t frame_len;
+    uint16_t seq_no;
+
+    memset(payload, 0x5A, sizeof(payload));
+    cfg.buf = _buf;
+    cfg.buf_len = _BUF_LEN;
+    cfg.header = WHISPER_DATA_LAYER__HEADER_COMPACT;
+    whisper_data_layer__init(dl, &cfg);
+
+    // the first frame goes with the full header, the peer knows no sequence no yet
+    seq_no = whisper_data_layer__data_sent(dl, payload, 8, 1);
+    TEST_ASSERT_EQUAL(LEN_PREFIX + MAX_LEN_HEADER + 8 + LEN_CHECKSUM, output_buf_p);
+    TEST_ASSERT_EQUAL(COMPACT_FULL, output_buf[LEN_PREFIX]);
+    memcpy(frame, output_buf, output_buf_p);
+    frame_len = output_buf_p;
+    output_buf_p = 0;
+    whisper_data_layer__data_received(dl, frame, frame_len);
+    TEST_ASSERT_EQUAL(8, data_received_length);
+
+    // acknowledged with the low bits of the sequence no alone
+    TEST_ASSERT_EQUAL(LEN_PREFIX + LEN_COMPACT_HEADER + LEN_CHECKSUM, output_buf_p);
+    TEST_ASSERT_EQUAL(COMPACT_ACK | (seq_no & COMPACT_ACK_SEQ), output_buf[LEN_PREFIX]);
+    memcpy(frame, output_buf, output_buf_p);
+    whisper_data_layer__data_received(dl, frame, output_buf_p);
+    TEST_ASSERT_EQUAL(1, dl->send_buffer.empty);
+
+    // the next frame takes a single header byte, its retransmission is recognized
+    output_buf_p = 0;
+    seq_no = whisper_data_layer__data_sent(dl, payload, 8, 1);
+    TEST_ASSERT_EQUAL(LEN_PREFIX + 1 + 8 + LEN_CHECKSUM, output_buf_p);
+    TEST_ASSERT_EQUAL(8 << COMPACT_DATA_LEN_SHIFT | (seq_no & COMPACT_DATA_SEQ), output_buf[LEN_PREFIX]);
+    memcpy(frame, output_buf, output_buf_p);
+    frame_len = output_buf_p;
+    data_received_length = 0;
+    whisper_data_layer__data_received(dl, frame, frame_len);
+    TEST_ASSERT_EQUAL(8, data_received_length);
+    TEST_ASSERT_EQUAL(seq_no, dl->receive_counter);
+    data_received_length = 0;
+    output_buf_p = 0;
+    whisper_data_layer__data_received(dl, frame, frame_len);
+    TEST_ASSERT_EQUAL(0, data_received_length);
+    whisper_data_layer__stats(dl, &stats);
+    TEST_ASSERT_EQUAL(1, stats.duplicates);
+    memcpy(frame, output_buf, output_buf_p);
+    whisper_data_layer__data_received(dl, frame, output_buf_p);
+    TEST_ASSERT_EQUAL(1, dl->send_buffer.empty);
+
+    // a longer payload takes the length byte
+    output_buf_p = 0;
+    whisper_data_layer__data_sent(dl, payload, sizeof(payload), 1);
+    TEST_ASSERT_EQUAL(LEN_PREFIX + 2 + sizeof(payload) + LEN_CHECKSUM, output_buf_p);
+    memcpy(frame, output_buf, output_buf_p);
+    frame_len = output_buf_p;
+    output_buf_p = 0;
+    whisper_data_layer__data_received(dl, frame, frame_len);
+    TEST_ASSERT_EQUAL(sizeof(payload), data_received_length);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(payload, data_received_payload, sizeof(payload));
+
+    // the retransmission goes with the full header, in case the peer lost track
+    output_buf_p = 0;
+    set_delay_tail->callback(dl);
+    TEST_ASSERT_EQUAL(LEN_PREFIX + MAX_LEN_HEADER + sizeof(payload) + LEN_CHECKSUM, output_buf_p);
+    TEST_ASSERT_EQUAL(COMPACT_FULL, output_buf[LEN_PREFIX]);
+
+    // a receiver started over cannot complete the sequence no
+    data_received_length = 0;
+    whisper_data_layer__init(dl, &cfg);
+    whisper_data_layer__data_received(dl, frame, frame_len);
+    TEST_ASSERT_EQUAL(0, data_received_length);
+    whisper_data_layer__stats(dl, &stats);
+    TEST_ASSERT_EQUAL(1, stats.header_errors);
+}
+
+static void test_multi_drop_address(void)
+{
+    struct whisper_data_layer__config cfg = dl->cfg;
+    struct whisper_data_layer__stats stats;
+    uint8_t payload[] = {0x01, 0x02, 0x03, 0x04};
+    uint8_t frame[sizeof(output_buf)];
+    uint8_t frame_len;
+    uint8_t framing;
+
+    cfg.buf = _buf;
+    cfg.buf_len = _BUF_LEN;
+    for (framing = WHISPER_DATA_LAYER__FRAMING_PREFIX; framing <= WHISPER_DATA_LAYER__FRAMING_COBS; framing++)
+    {
+        cfg.framing = framing;
+
+        // the master polls node 3
+        cfg.address = 3;
+        cfg.master = 1;
+        whisper_data_layer__init(dl, &cfg);
+        output_buf_p = 0;
+        whisper_data_layer__data_sent(dl, payload, sizeof(payload), 1);
+        memcpy(frame, output_buf, output_buf_p);
+        frame_len = output_buf_p;
+        if (framing == WHISPER_DATA_LAYER__FRAMING_PREFIX)
+            TEST_ASSERT_EQUAL(3, frame[LEN_PREFIX]);
+
+        // node 4 skips it, without checking it
+        cfg.address = 4;
+        cfg.master = 0;
+        whisper_data_layer__init(dl, &cfg);
+        data_received_length = 0;
+        output_buf_p = 0;
+        whisper_data_layer__data_received(dl, frame, frame_len);
+        TEST_ASSERT_EQUAL(0, data_received_length);
+        TEST_ASSERT_EQUAL(0, output_buf_p);
+        whisper_data_layer__stats(dl, &stats);
+        TEST_ASSERT_EQUAL(1, stats.filtered);
+        TEST_ASSERT_EQUAL(0, stats.header_errors + stats.crc_errors + stats.frames_ok);
+
+        // node 3 acknowledges it before delivering it, so that its answer follows in the same transmission
+        cfg.address = 3;
+        whisper_data_layer__init(dl, &cfg);
+        whisper_data_layer__data_received(dl, frame, frame_len);
+        TEST_ASSERT_EQUAL(sizeof(payload), data_received_length);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(payload, data_received_payload, sizeof(payload));
+        TEST_ASSERT_GREATER_THAN(0, output_at_delivery);
+        TEST_ASSERT_EQUAL(output_buf_p, output_at_delivery);
+        if (framing == WHISPER_DATA_LAYER__FRAMING_PREFIX)
+            TEST_ASSERT_EQUAL(3 | ADDRESS_FROM_NODE, output_buf[LEN_PREFIX]);
+        memcpy(frame, output_buf, output_buf_p);
+        frame_len = output_buf_p;
+
+        // the acknowledgement is for the master of node 3, and not for the one of node 4
+        cfg.address = 4;
+        cfg.master = 1;
+        whisper_data_layer__init(dl, &cfg);
+        whisper_data_layer__data_sent(dl, payload, sizeof(payload), 1);
+        whisper_data_layer__data_received(dl, frame, frame_len);
+        TEST_ASSERT_EQUAL(0, dl->send_buffer.empty);
+        whisper_data_layer__stats(dl, &stats);
+        TEST_ASSERT_EQUAL(1, stats.filtered);
+
+        cfg.address = 3;
+        whisper_data_layer__init(dl, &cfg);
+        whisper_data_layer__data_sent(dl, payload, sizeof(payload), 1);
+        whisper_data_layer__data_received(dl, frame, frame_len);
+        TEST_ASSERT_EQUAL(1, dl->send_buffer.empty);
+    }
+}
+
+static void test_multi_drop_compact_header(void)
+{
+    static uint8_t node_buf[_BUF_LEN];
+    struct whisper_data_layer__config cfg = dl->cfg;
+    struct whisper_data_layer__stats stats;
+    whisper_data_layer_t node = malloc(SIZEOF_WHISPER_DATA_LAYER_T);
+    uint8_t payload[40];
+    // the first frame goes with the full header, then a short one and one too long for the single header byte
+    uint8_t lens[] = {4, 4, sizeof(payload)};
+    uint8_t frame[sizeof(output_buf)];
+    uint8_t frame_len;
+    uint8_t framing;
+    uint8_t i;
+
+    memset(payload, 0x5A, sizeof(payload));
+    cfg.header = WHISPER_DATA_LAYER__HEADER_COMPACT;
+    cfg.address = 3;
+    for (framing = WHISPER_DATA_LAYER__FRAMING_PREFIX; framing <= WHISPER_DATA_LAYER__FRAMING_COBS; framing++)
+    {
+        cfg.framing = framing;
+        cfg.buf = _buf;
+        cfg.master = 1;
+        whisper_data_layer__init(dl, &cfg);
+        cfg.buf = node_buf;
+        cfg.master = 0;
+        whisper_data_layer__init(node, &cfg);
+
+        for (i = 0; i < sizeof(lens); i++)
+        {
+            output_buf_p = 0;
+            whisper_data_layer__data_sent(dl, payload, lens[i], 1);
+            if (framing == WHISPER_DATA_LAYER__FRAMING_PREFIX)
+            {
+                uint8_t first = output_buf[LEN_PREFIX + LEN_ADDRESS];
+
+                if (i == 0)
+                    TEST_ASSERT_EQUAL(COMPACT_FULL, first);
+                else if (i == 1)
+                    TEST_ASSERT_LESS_THAN(COMPACT_ACK, first);
+                else
+                    TEST_ASSERT_EQUAL(COMPACT_LONG_DATA, first & ~COMPACT_DATA_SEQ);
+            }
+            memcpy(frame, output_buf, output_buf_p);
+            frame_len = output_buf_p;
+            output_buf_p = 0;
+            data_received_length = 0;
+            whisper_data_layer__data_received(node, frame, frame_len);
+            TEST_ASSERT_EQUAL(lens[i], data_received_length);
+            TEST_ASSERT_EQUAL_UINT8_ARRAY(payload, data_received_payload, lens[i]);
+
+            // the compact acknowledgement completes the frame, and lets the next one go with a compact header
+            memcpy(frame, output_buf, output_buf_p);
+            frame_len = output_buf_p;
+            whisper_data_layer__data_received(dl, frame, frame_len);
+            TEST_ASSERT_EQUAL(1, dl->send_buffer.empty);
+        }
+        whisper_data_layer__stats(node, &stats);
+        TEST_ASSERT_EQUAL(0, stats.header_errors + stats.crc_errors);
+    }
+    free(node);
 }
 
 void setUp()
 {
+    dl = malloc(SIZEOF_WHISPER_DATA_LAYER_T);
     memset(_buf, 0, _BUF_LEN);
     memset(output_buf, 0, sizeof(output_buf));
     output_buf_p = 0;
@@ -224,12 +1296,16 @@ void setUp()
         .set_delay = set_delay,
         .cancel_delay = cancel_delay,
     };
-    whisper_data_layer__init(&cfg);
+    whisper_data_layer__init(dl, &cfg);
 
     set_delay_tail = &set_delay_head;
     num_cancel_delay_invocations = 0;
+    connected = -1;
+}
+void tearDown()
+{
+    free(dl);
 }
-void tearDown() {}
 
 int main(void)
 {
@@ -246,5 +1322,27 @@ int main(void)
 
     RUN_TEST(test_data_send);
     RUN_TEST(test_cancel_retransmission_on_ack);
+    RUN_TEST(test_retransmission_on_timer_wheel);
+
+    RUN_TEST(test_stats);
+    RUN_TEST(test_trace);
+    RUN_TEST(test_ack_completion);
+    RUN_TEST(test_compression);
+    RUN_TEST(test_forward_error_correction);
+    RUN_TEST(test_payload_limit);
+    RUN_TEST(test_crc32c_checksum);
+    RUN_TEST(test_cobs_framing);
+    RUN_TEST(test_duplicate_suppression);
+    RUN_TEST(test_channels);
+    RUN_TEST(test_receive_credits);
+    RUN_TEST(test_peer_credits);
+    RUN_TEST(test_adaptive_payload_len);
+    RUN_TEST(test_handshake);
+    RUN_TEST(test_handshake_of_restarted_peer);
+    RUN_TEST(test_handshake_given_up);
+    RUN_TEST(test_checksum_negotiation);
+    RUN_TEST(test_compact_header);
+    RUN_TEST(test_multi_drop_address);
+    RUN_TEST(test_multi_drop_compact_header);
     return UNITY_END();
 }
\ No newline at end of file
@@ -0,0 +1,157 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <unity.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fec.h"
+
+static uint8_t generator[WHISPER_FEC__MAX_PARITY + 1];
+static uint8_t codeword[255];
+
+/** encode len - parity_len random bytes into the codeword */
+static void encode_random(uint8_t len, uint8_t parity_len)
+{
+    uint8_t data_len = len - parity_len;
+    unsigned int i;
+
+    for (i = 0; i < data_len; i++)
+        codeword[i] = rand();
+    whisper_fec__generator(generator, parity_len);
+    memset(&codeword[data_len], 0, parity_len);
+    whisper_fec__encode(generator, parity_len, codeword, data_len, &codeword[data_len]);
+}
+
+static void test_intact_codeword(void)
+{
+    uint8_t copy[255];
+
+    srand(40);
+    encode_random(100, 8);
+    memcpy(copy, codeword, 100);
+
+    TEST_ASSERT_EQUAL(0, whisper_fec__decode(codeword, 100, 8));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(copy, codeword, 100);
+}
+
+static void test_parity_in_pieces(void)
+{
+    uint8_t parity[8];
+
+    srand(41);
+    encode_random(64, 8);
+
+    // the same parity as the data at once
+    memset(parity, 0, sizeof(parity));
+    whisper_fec__encode(generator, 8, codeword, 10, parity);
+    whisper_fec__encode(generator, 8, &codeword[10], 1, parity);
+    whisper_fec__encode(generator, 8, &codeword[11], 45, parity);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(&codeword[56], parity, 8);
+}
+
+static void test_corrects_up_to_half_the_parity(void)
+{
+    static const uint8_t parity_lens[] = {2, 4, 8, 16};
+    uint8_t copy[255];
+    unsigned int p;
+    unsigned int round;
+
+    srand(42);
+    for (p = 0; p < sizeof(parity_lens); p++)
+    {
+        uint8_t parity_len = parity_lens[p];
+
+        for (round = 0; round < 500; round++)
+        {
+            uint8_t len = parity_len + 1 + rand() % (255 - parity_len);
+            uint8_t errors = 1 + rand() % (parity_len / 2);
+            unsigned int i;
+
+            encode_random(len, parity_len);
+            memcpy(copy, codeword, len);
+            // errors in any bytes, parity included, may hit the same byte twice
+            for (i = 0; i < errors; i++)
+                codeword[rand() % len] ^= 1 + rand() % 255;
+
+            TEST_ASSERT_LESS_OR_EQUAL(errors, whisper_fec__decode(codeword, len, parity_len));
+            TEST_ASSERT_EQUAL_UINT8_ARRAY(copy, codeword, len);
+        }
+    }
+}
+
+static void test_burst_of_bits(void)
+{
+    uint8_t copy[255];
+
+    // 12 consecutive bits flipped across 3 bytes
+    srand(43);
+    encode_random(200, 8);
+    memcpy(copy, codeword, 200);
+    codeword[50] ^= 0x0F;
+    codeword[51] ^= 0xFF;
+    codeword[52] ^= 0x80;
+
+    TEST_ASSERT_EQUAL(3, whisper_fec__decode(codeword, 200, 8));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(copy, codeword, 200);
+}
+
+static void test_too_many_errors_are_detected(void)
+{
+    unsigned int detected = 0;
+    unsigned int round;
+
+    srand(44);
+    for (round = 0; round < 1000; round++)
+    {
+        unsigned int i;
+
+        encode_random(120, 8);
+        // 6 errors in distinct bytes, 2 more than 8 parity bytes correct
+        for (i = 0; i < 6; i++)
+            codeword[i * 20 + rand() % 20] ^= 1 + rand() % 255;
+        if (whisper_fec__decode(codeword, 120, 8) < 0)
+            ++detected;
+    }
+
+    // a few are miscorrected into another codeword, which the CRC of the frame catches
+    TEST_ASSERT_GREATER_THAN(990, detected);
+}
+
+void setUp(void)
+{
+    memset(codeword, 0, sizeof(codeword));
+}
+
+void tearDown(void)
+{
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_intact_codeword);
+    RUN_TEST(test_parity_in_pieces);
+    RUN_TEST(test_corrects_up_to_half_the_parity);
+    RUN_TEST(test_burst_of_bits);
+    RUN_TEST(test_too_many_errors_are_detected);
+    return UNITY_END();
+}
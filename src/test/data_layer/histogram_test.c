@@ -0,0 +1,142 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <unity.h>
+#include <stdlib.h>
+#include "histogram.h"
+
+static struct whisper_histogram histogram;
+
+static void test_empty(void)
+{
+    TEST_ASSERT_EQUAL(0, histogram.count);
+    TEST_ASSERT_EQUAL(0, whisper_histogram__percentile(&histogram, 500000));
+}
+
+static void test_small_values_are_exact(void)
+{
+    unsigned long value;
+
+    for (value = 0; value < 16; value++)
+        whisper_histogram__record(&histogram, value);
+
+    TEST_ASSERT_EQUAL(16, histogram.count);
+    TEST_ASSERT_EQUAL(0, histogram.min);
+    TEST_ASSERT_EQUAL(15, histogram.max);
+    TEST_ASSERT_EQUAL(0, whisper_histogram__percentile(&histogram, 0));
+    TEST_ASSERT_EQUAL(7, whisper_histogram__percentile(&histogram, 500000));
+    TEST_ASSERT_EQUAL(15, whisper_histogram__percentile(&histogram, 1000000));
+}
+
+static void test_buckets_are_contiguous(void)
+{
+    unsigned int bucket;
+
+    TEST_ASSERT_EQUAL(0, whisper_histogram__bucket_low(0));
+    for (bucket = 1; bucket < WHISPER_HISTOGRAM__NUM_BUCKETS; bucket++)
+    {
+        TEST_ASSERT_EQUAL(whisper_histogram__bucket_high(bucket - 1) + 1, whisper_histogram__bucket_low(bucket));
+        TEST_ASSERT_GREATER_OR_EQUAL(whisper_histogram__bucket_low(bucket), whisper_histogram__bucket_high(bucket));
+    }
+    TEST_ASSERT_EQUAL(0xFFFFFFFFUL, whisper_histogram__bucket_high(WHISPER_HISTOGRAM__NUM_BUCKETS - 1));
+}
+
+static void test_relative_error(void)
+{
+    unsigned long value;
+
+    // every value is reported within 1/16 above it
+    for (value = 1; value < 0x10000000UL; value += value / 7 + 1)
+    {
+        unsigned long reported;
+
+        whisper_histogram__init(&histogram);
+        whisper_histogram__record(&histogram, value);
+        histogram.max = 0xFFFFFFFFUL;
+        reported = whisper_histogram__percentile(&histogram, 500000);
+        TEST_ASSERT_GREATER_OR_EQUAL(value, reported);
+        TEST_ASSERT_LESS_OR_EQUAL(value + value / 16, reported);
+    }
+}
+
+static void test_percentiles(void)
+{
+    unsigned long value;
+
+    // 1 ms for most frames and a tail of retransmissions at 50 and 100 ms
+    for (value = 0; value < 9890; value++)
+        whisper_histogram__record(&histogram, 1000);
+    for (value = 0; value < 100; value++)
+        whisper_histogram__record(&histogram, 51000);
+    for (value = 0; value < 10; value++)
+        whisper_histogram__record(&histogram, 101000);
+
+    TEST_ASSERT_UINT_WITHIN(1000 / 16, 1000, whisper_histogram__percentile(&histogram, 500000));
+    TEST_ASSERT_UINT_WITHIN(1000 / 16, 1000, whisper_histogram__percentile(&histogram, 989000));
+    TEST_ASSERT_UINT_WITHIN(51000 / 16, 51000, whisper_histogram__percentile(&histogram, 990000));
+    TEST_ASSERT_UINT_WITHIN(101000 / 16, 101000, whisper_histogram__percentile(&histogram, 999500));
+    TEST_ASSERT_EQUAL(101000, whisper_histogram__percentile(&histogram, 1000000));
+    TEST_ASSERT_EQUAL(9890 * 1000ULL + 100 * 51000ULL + 10 * 101000ULL, histogram.sum);
+}
+
+static void test_large_values_are_clamped(void)
+{
+    whisper_histogram__record(&histogram, 0xFFFFFFFFUL);
+    whisper_histogram__record(&histogram, (unsigned long)-1);
+    TEST_ASSERT_EQUAL(2, histogram.buckets[WHISPER_HISTOGRAM__NUM_BUCKETS - 1]);
+}
+
+static void test_merge(void)
+{
+    struct whisper_histogram other;
+
+    whisper_histogram__init(&other);
+    whisper_histogram__record(&histogram, 10);
+    whisper_histogram__record(&other, 5);
+    whisper_histogram__record(&other, 1000);
+    whisper_histogram__merge(&histogram, &other);
+
+    TEST_ASSERT_EQUAL(3, histogram.count);
+    TEST_ASSERT_EQUAL(5, histogram.min);
+    TEST_ASSERT_EQUAL(1000, histogram.max);
+    TEST_ASSERT_EQUAL(10, whisper_histogram__percentile(&histogram, 500000));
+}
+
+void setUp(void)
+{
+    whisper_histogram__init(&histogram);
+}
+
+void tearDown(void) {}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_empty);
+    RUN_TEST(test_small_values_are_exact);
+    RUN_TEST(test_buckets_are_contiguous);
+    RUN_TEST(test_relative_error);
+    RUN_TEST(test_percentiles);
+    RUN_TEST(test_large_values_are_clamped);
+    RUN_TEST(test_merge);
+    return UNITY_END();
+}
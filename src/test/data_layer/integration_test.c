@@ -23,15 +23,323 @@
 #include <unity.h>
 #include <string.h>
 #include <stdlib.h>
+#include <pthread.h>
+#include "link_sim.h"
+#include "data_layer.h"
 #include "crc.h"
-#include "data_layer.c"
+
+static struct link_sim__config config;
+static struct link_sim__report report;
 
 static void common_test(void)
 {
-    
+    TEST_ASSERT_EQUAL(0, link_sim__run(&config, &report));
+
+    TEST_ASSERT_EQUAL(100, report.dir[LINK_SIM__A].messages_sent);
+    TEST_ASSERT_EQUAL(100, report.dir[LINK_SIM__A].messages_delivered);
+    TEST_ASSERT_EQUAL(0, report.dir[LINK_SIM__A].duplicates);
+    TEST_ASSERT_EQUAL(0, report.dir[LINK_SIM__A].corrupted);
+    TEST_ASSERT_EQUAL(0, report.dir[LINK_SIM__A].timeouts);
+
+    // 100 frames of 40 bytes and 100 acknowledgements of 10 bytes at 115200 baud
+    TEST_ASSERT_UINT_WITHIN(1000, 100 * 50 * 10 * 1000000ULL / 115200, report.elapsed_us);
+    TEST_ASSERT_GREATER_THAN(0, report.dir[LINK_SIM__A].latency_p50_us);
+}
+
+static void test_duplex(void)
+{
+    config.workload[LINK_SIM__B] = config.workload[LINK_SIM__A];
+    TEST_ASSERT_EQUAL(0, link_sim__run(&config, &report));
+
+    TEST_ASSERT_EQUAL(100, report.dir[LINK_SIM__A].messages_delivered);
+    TEST_ASSERT_EQUAL(100, report.dir[LINK_SIM__B].messages_delivered);
+}
+
+static void test_chunking(void)
+{
+    config.wire.chunk_len = 1;
+    TEST_ASSERT_EQUAL(0, link_sim__run(&config, &report));
+    TEST_ASSERT_EQUAL(100, report.dir[LINK_SIM__A].messages_delivered);
+
+    config.wire.chunk_len = 255;
+    TEST_ASSERT_EQUAL(0, link_sim__run(&config, &report));
+    TEST_ASSERT_EQUAL(100, report.dir[LINK_SIM__A].messages_delivered);
+}
+
+static void test_loss_triggers_retransmission(void)
+{
+    config.wire.loss_rate = 0.1;
+    TEST_ASSERT_EQUAL(0, link_sim__run(&config, &report));
+
+    TEST_ASSERT_GREATER_THAN(0, report.dir[LINK_SIM__A].timeouts);
+    TEST_ASSERT_GREATER_THAN(0, report.dir[LINK_SIM__A].transmissions_lost);
+    TEST_ASSERT_GREATER_THAN(90, report.dir[LINK_SIM__A].messages_delivered);
+    TEST_ASSERT_EQUAL(0, report.dir[LINK_SIM__A].corrupted);
+    // frames of which the acknowledgement got lost are acknowledged again, but not delivered twice
+    TEST_ASSERT_EQUAL(0, report.dir[LINK_SIM__A].duplicates);
+#ifdef WHISPER_STATS
+    TEST_ASSERT_GREATER_THAN(0, report.link[LINK_SIM__B].duplicates);
+#endif
+    // a retransmission takes at least the retransmission delay
+    TEST_ASSERT_GREATER_OR_EQUAL(50000, report.dir[LINK_SIM__A].latency_max_us);
+    // which shows in the tail of the acknowledgement latency
+    TEST_ASSERT_LESS_THAN(50000, whisper_histogram__percentile(&report.ack_latency[LINK_SIM__A], 500000));
+    TEST_ASSERT_GREATER_OR_EQUAL(50000, whisper_histogram__percentile(&report.ack_latency[LINK_SIM__A], 990000));
+}
+
+static void test_bit_errors_are_caught(void)
+{
+    config.wire.bit_error_rate = 1e-3;
+    TEST_ASSERT_EQUAL(0, link_sim__run(&config, &report));
+
+    TEST_ASSERT_GREATER_THAN(0, report.dir[LINK_SIM__A].timeouts);
+    TEST_ASSERT_EQUAL(0, report.dir[LINK_SIM__A].corrupted);
+#ifdef WHISPER_STATS
+    TEST_ASSERT_GREATER_THAN(0, report.link[LINK_SIM__B].crc_errors + report.link[LINK_SIM__B].header_errors);
+    TEST_ASSERT_GREATER_THAN(0, report.link[LINK_SIM__A].retransmits);
+#endif
+}
+
+static void test_bit_errors_are_corrected(void)
+{
+    struct link_sim__report without;
+
+    config.wire.bit_error_rate = 1e-3;
+    TEST_ASSERT_EQUAL(0, link_sim__run(&config, &without));
+    config.fec_parity = 4;
+    TEST_ASSERT_EQUAL(0, link_sim__run(&config, &report));
+
+    // most frames arrive with at most 2 bytes hit, and are repaired rather than retransmitted
+    TEST_ASSERT_EQUAL(100, report.dir[LINK_SIM__A].messages_delivered);
+    TEST_ASSERT_EQUAL(0, report.dir[LINK_SIM__A].corrupted);
+    TEST_ASSERT_LESS_THAN(without.dir[LINK_SIM__A].timeouts, report.dir[LINK_SIM__A].timeouts);
+#ifdef WHISPER_STATS
+    TEST_ASSERT_GREATER_THAN(0, report.link[LINK_SIM__B].fec_corrected);
+    TEST_ASSERT_GREATER_THAN(0, report.link[LINK_SIM__A].fec_corrected);
+#endif
+}
+
+static void test_crc32c_catches_what_crc16_misses(void)
+{
+    struct link_sim__report crc16;
+
+    // so many errors that some frames hit by them pass CRC-16 by chance
+    config.wire.bit_error_rate = 3e-3;
+    config.workload[LINK_SIM__A].num_messages = 20000;
+    config.workload[LINK_SIM__A].payload_len = 128;
+    config.seed = 3;
+    TEST_ASSERT_EQUAL(0, link_sim__run(&config, &crc16));
+    TEST_ASSERT_GREATER_THAN(0, crc16.dir[LINK_SIM__A].corrupted);
+
+    config.checksum = WHISPER_DATA_LAYER__CHECKSUM_CRC32C;
+    TEST_ASSERT_EQUAL(0, link_sim__run(&config, &report));
+    TEST_ASSERT_EQUAL(0, report.dir[LINK_SIM__A].corrupted);
+    TEST_ASSERT_GREATER_THAN(crc16.dir[LINK_SIM__A].messages_delivered * 9 / 10,
+                             report.dir[LINK_SIM__A].messages_delivered);
+}
+
+static void test_compact_header(void)
+{
+    struct link_sim__report full;
+
+    // 4 byte messages both ways, which the header and the acknowledgements dwarf
+    config.workload[LINK_SIM__A].payload_len = 4;
+    config.workload[LINK_SIM__B] = config.workload[LINK_SIM__A];
+    TEST_ASSERT_EQUAL(0, link_sim__run(&config, &full));
+    config.header = WHISPER_DATA_LAYER__HEADER_COMPACT;
+    TEST_ASSERT_EQUAL(0, link_sim__run(&config, &report));
+
+    // frames of 12 and acknowledgements of 10 bytes shrink to 9 and 5, but the first frame
+    TEST_ASSERT_EQUAL(100, report.dir[LINK_SIM__A].messages_delivered);
+    TEST_ASSERT_EQUAL(100, report.dir[LINK_SIM__B].messages_delivered);
+    TEST_ASSERT_EQUAL(100 * 22, full.dir[LINK_SIM__A].bytes_on_wire);
+    TEST_ASSERT_UINT_WITHIN(10, 100 * 14, report.dir[LINK_SIM__A].bytes_on_wire);
+    TEST_ASSERT_LESS_THAN(full.elapsed_us, report.elapsed_us);
+
+    // the sequence numbers stay in step through lost frames, lost acknowledgements and a restart
+    config.wire.bit_error_rate = 1e-3;
+    config.restart_us = 40000;
+    config.connect = 1;
+    TEST_ASSERT_EQUAL(0, link_sim__run(&config, &report));
+    TEST_ASSERT_GREATER_THAN(0, report.dir[LINK_SIM__A].timeouts);
+    TEST_ASSERT_EQUAL(100, report.dir[LINK_SIM__A].messages_delivered);
+    TEST_ASSERT_EQUAL(100, report.dir[LINK_SIM__B].messages_delivered);
+    TEST_ASSERT_EQUAL(0, report.dir[LINK_SIM__A].duplicates + report.dir[LINK_SIM__B].duplicates);
+    TEST_ASSERT_EQUAL(0, report.dir[LINK_SIM__A].corrupted + report.dir[LINK_SIM__B].corrupted);
+}
+
+static void test_flow_control(void)
+{
+    struct link_sim__report without;
+
+    // the application of B takes longer per message than the line takes to bring the next
+    config.workload[LINK_SIM__A].payload_len = 64;
+    config.process_us = 60000;
+    config.rx_fifo_len = 32;
+    TEST_ASSERT_EQUAL(0, link_sim__run(&config, &without));
+    config.credits = 4;
+    TEST_ASSERT_EQUAL(0, link_sim__run(&config, &report));
+
+    // without credits the FIFO overruns and every frame times out once
+    TEST_ASSERT_GREATER_THAN(0, without.dir[LINK_SIM__A].overrun_bytes);
+    TEST_ASSERT_GREATER_THAN(0, without.dir[LINK_SIM__A].timeouts);
+
+    // with them, the sender waits for the application instead
+    TEST_ASSERT_EQUAL(100, report.dir[LINK_SIM__A].messages_delivered);
+    TEST_ASSERT_EQUAL(0, report.dir[LINK_SIM__A].corrupted);
+    TEST_ASSERT_EQUAL(0, report.dir[LINK_SIM__A].overrun_bytes);
+    TEST_ASSERT_EQUAL(0, report.dir[LINK_SIM__A].timeouts);
+    TEST_ASSERT_LESS_THAN(without.elapsed_us, report.elapsed_us);
+#ifdef WHISPER_STATS
+    TEST_ASSERT_EQUAL(0, report.link[LINK_SIM__A].retransmits);
+#endif
+}
+
+static void test_adaptive_payload_len(void)
+{
+    struct link_sim__report longest;
+    struct link_sim__report shortest;
+
+    config.wire.bit_error_rate = 1e-3;
+    config.workload[LINK_SIM__A].num_messages = 1000;
+    config.workload[LINK_SIM__A].payload_len = 224;
+    TEST_ASSERT_EQUAL(0, link_sim__run(&config, &longest));
+    config.workload[LINK_SIM__A].payload_len = 16;
+    TEST_ASSERT_EQUAL(0, link_sim__run(&config, &shortest));
+    config.min_payload_len = 16;
+    config.max_payload_len = 224;
+    TEST_ASSERT_EQUAL(0, link_sim__run(&config, &report));
+
+    // frames in between, which beat both bounds
+    TEST_ASSERT_EQUAL(0, report.dir[LINK_SIM__A].corrupted);
+    TEST_ASSERT_GREATER_THAN(longest.dir[LINK_SIM__A].goodput_bps, report.dir[LINK_SIM__A].goodput_bps);
+    TEST_ASSERT_GREATER_THAN(shortest.dir[LINK_SIM__A].goodput_bps, report.dir[LINK_SIM__A].goodput_bps);
+
+    // and the longest on a clean line
+    config.wire.bit_error_rate = 0;
+    TEST_ASSERT_EQUAL(0, link_sim__run(&config, &report));
+    TEST_ASSERT_EQUAL(1000 * 224, report.dir[LINK_SIM__A].bytes_delivered);
+}
+
+static void test_restart(void)
+{
+    struct link_sim__report without;
+
+    // A starts over after about 10 messages, which B takes for retransmissions without a handshake
+    config.restart_us = 40000;
+    TEST_ASSERT_EQUAL(0, link_sim__run(&config, &without));
+    config.connect = 1;
+    TEST_ASSERT_EQUAL(0, link_sim__run(&config, &report));
+
+    TEST_ASSERT_LESS_THAN(100, without.dir[LINK_SIM__A].messages_delivered);
+    TEST_ASSERT_EQUAL(100, report.dir[LINK_SIM__A].messages_delivered);
+    TEST_ASSERT_EQUAL(0, report.dir[LINK_SIM__A].duplicates);
+    TEST_ASSERT_LESS_THAN(without.dir[LINK_SIM__A].first_delivery_us, report.dir[LINK_SIM__A].first_delivery_us);
+}
+
+static void test_handshake_takes_a_round_trip(void)
+{
+    struct link_sim__report without;
+
+    TEST_ASSERT_EQUAL(0, link_sim__run(&config, &without));
+    config.connect = 1;
+    TEST_ASSERT_EQUAL(0, link_sim__run(&config, &report));
+
+    // the handshake and its answer of 15 bytes each at 115200 baud, ahead of the first frame
+    TEST_ASSERT_EQUAL(100, report.dir[LINK_SIM__A].messages_delivered);
+    TEST_ASSERT_UINT_WITHIN(10, without.dir[LINK_SIM__A].first_delivery_us + 2 * 15 * 10 * 1000000UL / 115200,
+                            report.dir[LINK_SIM__A].first_delivery_us);
+}
+
+static void test_deterministic(void)
+{
+    struct link_sim__report first;
+
+    config.wire.loss_rate = 0.05;
+    config.wire.bit_error_rate = 1e-4;
+    link_sim__run(&config, &first);
+    link_sim__run(&config, &report);
+
+    TEST_ASSERT_EQUAL_MEMORY(&first, &report, sizeof(report));
+}
+
+static void test_time_limit(void)
+{
+    config.workload[LINK_SIM__A].interval_us = 100000;
+    config.time_limit_us = 1000000;
+    TEST_ASSERT_EQUAL(0, link_sim__run(&config, &report));
+
+    TEST_ASSERT_LESS_OR_EQUAL(1000000, report.elapsed_us);
+    TEST_ASSERT_EQUAL(10, report.dir[LINK_SIM__A].messages_delivered);
+}
+
+#define STATS_FRAME_LEN 12
+
+static volatile int stats_writer_done;
+
+static void stats_data_write(whisper_data_layer_t dl, const uint8_t *data, uint8_t data_len) {}
+
+static void *stats_writer(void *arg)
+{
+    whisper_data_layer_t dl = arg;
+    uint8_t frame[STATS_FRAME_LEN] = {0x0A, 0x0D, 0x01, 0x00, 0x02, 0x04, 0x01, 0x02, 0x03, 0x04};
+    uint16_t checksum = update_crc_buf(frame, STATS_FRAME_LEN - 2, CRC_INIT);
+    unsigned long i;
+
+    memcpy(&frame[STATS_FRAME_LEN - 2], &checksum, 2);
+    for (i = 0; i < 200000; i++)
+        whisper_data_layer__data_received(dl, frame, STATS_FRAME_LEN);
+
+    stats_writer_done = 1;
+    return 0;
+}
+
+static void test_stats_snapshot_is_consistent(void)
+{
+    uint8_t buf[128];
+    struct whisper_data_layer__config dl_config = {
+        .buf = buf,
+        .buf_len = sizeof(buf),
+        .data_write = stats_data_write,
+    };
+    whisper_data_layer_t dl = malloc(SIZEOF_WHISPER_DATA_LAYER_T);
+    struct whisper_data_layer__stats stats;
+    pthread_t writer;
+    unsigned long snapshots = 0;
+
+    whisper_data_layer__init(dl, &dl_config);
+    if (whisper_data_layer__stats(dl, &stats) != 0)
+        TEST_IGNORE_MESSAGE("built without WHISPER_STATS");
+
+    stats_writer_done = 0;
+    pthread_create(&writer, 0, stats_writer, dl);
+    while (!stats_writer_done)
+    {
+        whisper_data_layer__stats(dl, &stats);
+        // every call feeds a complete frame, which is acknowledged by a frame of 10 bytes
+        TEST_ASSERT_EQUAL(stats.frames_ok * STATS_FRAME_LEN, stats.bytes_in);
+        TEST_ASSERT_EQUAL(stats.frames_ok * 10, stats.bytes_out);
+        ++snapshots;
+    }
+    pthread_join(writer, 0);
+
+    whisper_data_layer__stats(dl, &stats);
+    TEST_ASSERT_EQUAL(200000, stats.frames_ok);
+    TEST_ASSERT_GREATER_THAN(0, snapshots);
+    free(dl);
+}
+
+void setUp(void)
+{
+    memset(&config, 0, sizeof(config));
+    config.wire.baud = 115200;
+    config.wire.chunk_len = 16;
+    config.workload[LINK_SIM__A].num_messages = 100;
+    config.workload[LINK_SIM__A].payload_len = 32;
+    config.buf_len = 255;
+    config.seed = 29;
 }
 
-void setUp(void) {}
 void tearDown(void) {}
 
 int main()
@@ -39,6 +347,20 @@ int main()
     UNITY_BEGIN();
 
     RUN_TEST(common_test);
+    RUN_TEST(test_duplex);
+    RUN_TEST(test_chunking);
+    RUN_TEST(test_loss_triggers_retransmission);
+    RUN_TEST(test_bit_errors_are_caught);
+    RUN_TEST(test_bit_errors_are_corrected);
+    RUN_TEST(test_crc32c_catches_what_crc16_misses);
+    RUN_TEST(test_compact_header);
+    RUN_TEST(test_flow_control);
+    RUN_TEST(test_adaptive_payload_len);
+    RUN_TEST(test_restart);
+    RUN_TEST(test_handshake_takes_a_round_trip);
+    RUN_TEST(test_deterministic);
+    RUN_TEST(test_time_limit);
+    RUN_TEST(test_stats_snapshot_is_consistent);
 
     return UNITY_END();
-}
\ No newline at end of file
+}
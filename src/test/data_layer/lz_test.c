@@ -0,0 +1,180 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <unity.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lz.h"
+
+static uint8_t compressed[255];
+static uint8_t decompressed[255];
+
+static void test_text_round_trips(void)
+{
+    const char *text = "2026-10-18 12:00:01 link 3 up, rssi -71 dBm; 2026-10-18 12:00:02 link 3 up, rssi -70 dBm";
+    uint8_t len = strlen(text);
+    uint8_t compressed_len = whisper_lz__compress(0, 0, (const uint8_t *)text, len, compressed, len - 1);
+
+    TEST_ASSERT_GREATER_THAN(0, compressed_len);
+    TEST_ASSERT_LESS_THAN(len * 3 / 4, compressed_len);
+    TEST_ASSERT_EQUAL(len, whisper_lz__decompress(0, 0, compressed, compressed_len, decompressed, sizeof(decompressed)));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(text, decompressed, len);
+}
+
+static void test_run_round_trips(void)
+{
+    uint8_t run[255];
+    uint8_t compressed_len;
+
+    // a match overlapping its own output
+    memset(run, 'a', sizeof(run));
+    compressed_len = whisper_lz__compress(0, 0, run, sizeof(run), compressed, sizeof(compressed));
+    TEST_ASSERT_LESS_OR_EQUAL(8, compressed_len);
+    TEST_ASSERT_EQUAL(sizeof(run), whisper_lz__decompress(0, 0, compressed, compressed_len, decompressed, sizeof(decompressed)));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(run, decompressed, sizeof(run));
+}
+
+static void test_random_data_does_not_fit(void)
+{
+    uint8_t data[200];
+    unsigned int i;
+
+    srand(39);
+    for (i = 0; i < sizeof(data); i++)
+        data[i] = rand();
+
+    TEST_ASSERT_EQUAL(0, whisper_lz__compress(0, 0, data, sizeof(data), compressed, sizeof(data) - 1));
+    TEST_ASSERT_EQUAL(0, whisper_lz__compress(0, 0, data, 0, compressed, sizeof(compressed)));
+}
+
+static void test_random_inputs_round_trip(void)
+{
+    uint8_t data[255];
+    unsigned int round;
+
+    srand(390);
+    for (round = 0; round < 10000; round++)
+    {
+        // from a small alphabet, so that there are matches of all lengths and distances
+        uint8_t len = rand() % 256;
+        uint8_t alphabet = 1 + rand() % 8;
+        uint8_t compressed_len;
+        unsigned int i;
+
+        for (i = 0; i < len; i++)
+            data[i] = rand() % alphabet;
+
+        compressed_len = whisper_lz__compress(0, 0, data, len, compressed, sizeof(compressed));
+        if (compressed_len == 0)
+            continue;
+        TEST_ASSERT_EQUAL(len, whisper_lz__decompress(0, 0, compressed, compressed_len, decompressed, sizeof(decompressed)));
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(data, decompressed, len);
+    }
+}
+
+static void test_dictionary(void)
+{
+    const char *dict = "{\"port\":0,\"baud\":9600,\"parity\":\"none\",\"enabled\":true}";
+    const char *config = "{\"port\":2,\"baud\":19200,\"parity\":\"even\",\"enabled\":false}";
+    uint8_t len = strlen(config);
+    uint8_t dict_len = strlen(dict);
+    uint8_t compressed_len;
+
+    TEST_ASSERT_EQUAL(0, whisper_lz__compress(0, 0, (const uint8_t *)config, len, compressed, len - 1));
+
+    // the keys come from the dictionary
+    compressed_len = whisper_lz__compress((const uint8_t *)dict, dict_len, (const uint8_t *)config, len, compressed,
+                                          len - 1);
+    TEST_ASSERT_GREATER_THAN(0, compressed_len);
+    TEST_ASSERT_LESS_THAN(len * 2 / 3, compressed_len);
+    TEST_ASSERT_EQUAL(len, whisper_lz__decompress((const uint8_t *)dict, dict_len, compressed, compressed_len,
+                                                  decompressed, sizeof(decompressed)));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(config, decompressed, len);
+
+    // not without it
+    TEST_ASSERT_EQUAL(-1, whisper_lz__decompress(0, 0, compressed, compressed_len, decompressed, sizeof(decompressed)));
+}
+
+static void test_far_match_into_the_dictionary(void)
+{
+    static uint8_t dict[WHISPER_LZ__MAX_DICT];
+    uint8_t data[255];
+    uint8_t compressed_len;
+    unsigned int i;
+
+    // a phrase at the very beginning of the dictionary, the rest does not match it
+    srand(391);
+    memset(dict, 0, sizeof(dict));
+    for (i = 0; i < 64; i++)
+        dict[i] = 1 + rand() % 255;
+
+    // the phrase at the end of the payload, as far from it as it gets
+    memset(data, 0xAA, sizeof(data));
+    memcpy(&data[sizeof(data) - 64], dict, 64);
+
+    compressed_len = whisper_lz__compress(dict, sizeof(dict), data, sizeof(data), compressed, sizeof(compressed));
+    TEST_ASSERT_GREATER_THAN(0, compressed_len);
+    TEST_ASSERT_LESS_THAN(16, compressed_len);
+    TEST_ASSERT_EQUAL(sizeof(data), whisper_lz__decompress(dict, sizeof(dict), compressed, compressed_len,
+                                                           decompressed, sizeof(decompressed)));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(data, decompressed, sizeof(data));
+}
+
+static void test_corrupt_input_is_rejected(void)
+{
+    // a match reaching back before the output
+    uint8_t before_start[] = {0x02, 'a', 0x00, 0x01};
+    // a match cut off, and its long length
+    uint8_t truncated[] = {0x02, 'a', 0x00};
+    uint8_t truncated_len[] = {0x02, 'a', 0xF0, 0x00};
+    // a match running past the output
+    uint8_t too_long[] = {0x02, 'a', 0xF0, 0x00, 0xFF};
+
+    TEST_ASSERT_EQUAL(-1, whisper_lz__decompress(0, 0, before_start, sizeof(before_start), decompressed, sizeof(decompressed)));
+    TEST_ASSERT_EQUAL(-1, whisper_lz__decompress(0, 0, truncated, sizeof(truncated), decompressed, sizeof(decompressed)));
+    TEST_ASSERT_EQUAL(-1, whisper_lz__decompress(0, 0, truncated_len, sizeof(truncated_len), decompressed,
+                                                 sizeof(decompressed)));
+    TEST_ASSERT_EQUAL(-1, whisper_lz__decompress(0, 0, too_long, sizeof(too_long), decompressed, 16));
+}
+
+void setUp(void)
+{
+    memset(compressed, 0, sizeof(compressed));
+    memset(decompressed, 0, sizeof(decompressed));
+}
+
+void tearDown(void)
+{
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_text_round_trips);
+    RUN_TEST(test_run_round_trips);
+    RUN_TEST(test_random_data_does_not_fit);
+    RUN_TEST(test_random_inputs_round_trip);
+    RUN_TEST(test_dictionary);
+    RUN_TEST(test_far_match_into_the_dictionary);
+    RUN_TEST(test_corrupt_input_is_rejected);
+    return UNITY_END();
+}
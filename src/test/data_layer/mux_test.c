@@ -0,0 +1,445 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <unity.h>
+#include <string.h>
+#include <stdlib.h>
+#include "mux.h"
+
+#define BUF_LEN 255
+#define CAPACITY 4
+#define NUM_CHANNELS 2
+#define PIPE_LEN 4096
+#define MAX_DELIVERIES 128
+
+/** a direction of the loopback, the bytes written by a link and not yet fed to the other one */
+struct pipe
+{
+    uint8_t data[PIPE_LEN];
+    unsigned int len;
+};
+
+/** a fragment delivered to the receiving application */
+struct delivery
+{
+    uint8_t channel;
+    uint8_t len;
+    uint8_t first;
+};
+
+static struct whisper_mux__message queues[2][NUM_CHANNELS][CAPACITY];
+static struct whisper_mux__channel channels[2][NUM_CHANNELS];
+static whisper_mux_t muxes[2];
+static whisper_data_layer_t sender;
+static whisper_data_layer_t receiver;
+static uint8_t sender_buf[BUF_LEN];
+static uint8_t receiver_buf[BUF_LEN];
+static struct pipe pipes[2];
+// hand the bytes straight to the other link instead of buffering them for pump
+static char direct;
+static void (*delay_cb)(whisper_data_layer_t dl);
+
+static uint8_t max_payload_len;
+
+static struct delivery deliveries[MAX_DELIVERIES];
+static unsigned int num_deliveries;
+static unsigned int num_completions;
+static uint8_t completed_sent;
+
+static void data_write(whisper_data_layer_t dl, const uint8_t *data, uint8_t data_len)
+{
+    struct pipe *pipe = &pipes[dl == receiver];
+
+    if (direct)
+    {
+        whisper_data_layer__data_received(dl == receiver ? sender : receiver, data, data_len);
+        return;
+    }
+    TEST_ASSERT_LESS_OR_EQUAL(PIPE_LEN, pipe->len + data_len);
+    memcpy(&pipe->data[pipe->len], data, data_len);
+    pipe->len += data_len;
+}
+
+static void set_delay(whisper_data_layer_t dl, uint16_t delay_in_ms, void (*cb)(whisper_data_layer_t dl))
+{
+    delay_cb = cb;
+}
+
+static void cancel_delay(whisper_data_layer_t dl) { delay_cb = 0; }
+
+static void on_packet_received(whisper_data_layer_t dl, uint8_t *payload, uint8_t payload_len)
+{
+    whisper_mux__received(muxes[dl == receiver], dl, payload, payload_len);
+}
+
+static void on_fragment(whisper_data_layer_t dl, uint8_t channel, uint8_t *payload, uint8_t payload_len)
+{
+    TEST_ASSERT_LESS_THAN(MAX_DELIVERIES, num_deliveries);
+    deliveries[num_deliveries].channel = channel;
+    deliveries[num_deliveries].len = payload_len;
+    deliveries[num_deliveries].first = payload_len ? payload[0] : 0;
+    ++num_deliveries;
+}
+
+static void on_data_ack(whisper_data_layer_t dl, unsigned int seq_no, uint8_t sent)
+{
+    whisper_mux__complete(muxes[dl == receiver], dl, seq_no, sent);
+}
+
+static void on_message_sent(whisper_data_layer_t dl, uint8_t channel, const uint8_t *data, uint16_t data_length,
+                            uint8_t sent)
+{
+    ++num_completions;
+    completed_sent = sent;
+}
+
+/** feed the bytes of each direction to the other link, return the number of bytes moved */
+static unsigned int pump(void)
+{
+    static uint8_t data[PIPE_LEN];
+    unsigned int moved = 0;
+    unsigned int i;
+
+    for (i = 0; i < 2; i++)
+    {
+        whisper_data_layer_t to = i == 0 ? receiver : sender;
+        unsigned int len = pipes[i].len;
+        unsigned int offset;
+
+        // the link may write to the other direction while it is fed
+        memcpy(data, pipes[i].data, len);
+        pipes[i].len = 0;
+        for (offset = 0; offset < len; offset += 255)
+            whisper_data_layer__data_received(to, &data[offset], len - offset > 255 ? 255 : len - offset);
+        moved += len;
+    }
+    return moved;
+}
+
+static void init_link(whisper_data_layer_t dl, uint8_t *buf)
+{
+    struct whisper_data_layer__config config;
+
+    memset(&config, 0, sizeof(config));
+    config.buf = buf;
+    config.buf_len = BUF_LEN;
+    config.data_write = data_write;
+    config.set_delay = set_delay;
+    config.cancel_delay = cancel_delay;
+    config.data_ack_cb = on_data_ack;
+    config.packet_received_cb = on_packet_received;
+    config.max_payload_len = max_payload_len;
+    whisper_data_layer__init(dl, &config);
+}
+
+static void init_mux(unsigned int side, uint8_t scheduling)
+{
+    unsigned int i;
+
+    memset(channels[side], 0, sizeof(channels[side]));
+    for (i = 0; i < NUM_CHANNELS; i++)
+    {
+        channels[side][i].queue = queues[side][i];
+        channels[side][i].capacity = CAPACITY;
+        channels[side][i].fragment_len = 100;
+        channels[side][i].received_cb = on_fragment;
+        channels[side][i].sent_cb = on_message_sent;
+    }
+    TEST_ASSERT_EQUAL(0, whisper_mux__init(muxes[side], channels[side], NUM_CHANNELS, scheduling));
+}
+
+static void test_init_checks_config(void)
+{
+    TEST_ASSERT_NOT_EQUAL(0, whisper_mux__init(muxes[0], channels[0], 0, WHISPER_MUX__STRICT));
+    TEST_ASSERT_NOT_EQUAL(0, whisper_mux__init(muxes[0], channels[0], WHISPER_DATA_LAYER__MAX_CHANNELS + 1,
+                                               WHISPER_MUX__STRICT));
+    TEST_ASSERT_NOT_EQUAL(0, whisper_mux__init(muxes[0], channels[0], NUM_CHANNELS, WHISPER_MUX__WEIGHTED + 1));
+    channels[0][1].capacity = 0;
+    TEST_ASSERT_NOT_EQUAL(0, whisper_mux__init(muxes[0], channels[0], NUM_CHANNELS, WHISPER_MUX__STRICT));
+}
+
+static void test_fragments(void)
+{
+    static uint8_t message[250];
+    unsigned int i;
+
+    for (i = 0; i < sizeof(message); i++)
+        message[i] = i;
+
+    TEST_ASSERT_EQUAL(0, whisper_mux__submit(muxes[0], 1, message, sizeof(message), 1));
+    TEST_ASSERT_EQUAL(0, whisper_mux__submit(muxes[0], 1, message, 0, 1));
+    TEST_ASSERT_EQUAL(2, whisper_mux__count(muxes[0], 1));
+    TEST_ASSERT_NOT_EQUAL(0, whisper_mux__drain(muxes[0], sender));
+    while (pump() > 0)
+        ;
+
+    // in fragments of 100 bytes on the channel, and the empty message as an empty frame
+    TEST_ASSERT_EQUAL(4, num_deliveries);
+    TEST_ASSERT_EQUAL(1, deliveries[0].channel);
+    TEST_ASSERT_EQUAL(100, deliveries[0].len);
+    TEST_ASSERT_EQUAL(0, deliveries[0].first);
+    TEST_ASSERT_EQUAL(100, deliveries[1].len);
+    TEST_ASSERT_EQUAL(100, deliveries[1].first);
+    TEST_ASSERT_EQUAL(50, deliveries[2].len);
+    TEST_ASSERT_EQUAL(200, deliveries[2].first);
+    TEST_ASSERT_EQUAL(0, deliveries[3].len);
+    TEST_ASSERT_EQUAL(2, num_completions);
+    TEST_ASSERT_EQUAL(1, completed_sent);
+    TEST_ASSERT_EQUAL(0, whisper_mux__count(muxes[0], 1));
+}
+
+static void test_completed_within_the_link(void)
+{
+    static uint8_t message[250];
+    unsigned int i;
+
+    for (i = 0; i < sizeof(message); i++)
+        message[i] = i;
+
+    // the receiver acknowledges each fragment before the sender returns from the link
+    direct = 1;
+    TEST_ASSERT_EQUAL(0, whisper_mux__submit(muxes[0], 1, message, sizeof(message), 1));
+    TEST_ASSERT_EQUAL(0, whisper_mux__submit(muxes[0], 0, message, 10, 1));
+    TEST_ASSERT_NOT_EQUAL(0, whisper_mux__drain(muxes[0], sender));
+
+    TEST_ASSERT_EQUAL(4, num_deliveries);
+    TEST_ASSERT_EQUAL(10, deliveries[0].len);
+    TEST_ASSERT_EQUAL(100, deliveries[1].len);
+    TEST_ASSERT_EQUAL(100, deliveries[2].len);
+    TEST_ASSERT_EQUAL(50, deliveries[3].len);
+    TEST_ASSERT_EQUAL(200, deliveries[3].first);
+    TEST_ASSERT_EQUAL(2, num_completions);
+    TEST_ASSERT_EQUAL(1, completed_sent);
+    TEST_ASSERT_EQUAL(0, whisper_mux__count(muxes[0], 0));
+    TEST_ASSERT_EQUAL(0, whisper_mux__count(muxes[0], 1));
+}
+
+static void test_fragments_follow_the_link(void)
+{
+    static uint8_t message[250];
+
+    // adaptive payload sizing of the link recommends shorter fragments than the channel allows
+    max_payload_len = 60;
+    init_link(sender, sender_buf);
+    TEST_ASSERT_EQUAL(0, whisper_mux__submit(muxes[0], 0, message, sizeof(message), 1));
+    whisper_mux__drain(muxes[0], sender);
+    while (pump() > 0)
+        ;
+
+    TEST_ASSERT_EQUAL(5, num_deliveries);
+    TEST_ASSERT_EQUAL(60, deliveries[0].len);
+    TEST_ASSERT_EQUAL(60, deliveries[3].len);
+    TEST_ASSERT_EQUAL(10, deliveries[4].len);
+    TEST_ASSERT_EQUAL(1, num_completions);
+}
+
+static void test_default_fragment_len_fits_the_link(void)
+{
+    static uint8_t message[600];
+    uint8_t fragment_len = whisper_data_layer__payload_len(sender);
+    unsigned int i;
+
+    // without a limit of the channel, the link, or the peer, the fragments fit the receive buffer
+    channels[0][0].fragment_len = 0;
+    TEST_ASSERT_LESS_THAN(255, fragment_len);
+    TEST_ASSERT_EQUAL(0, whisper_mux__submit(muxes[0], 0, message, sizeof(message), 1));
+    whisper_mux__drain(muxes[0], sender);
+    while (pump() > 0)
+        ;
+
+    TEST_ASSERT_EQUAL((sizeof(message) + fragment_len - 1) / fragment_len, num_deliveries);
+    for (i = 0; i + 1 < num_deliveries; i++)
+        TEST_ASSERT_EQUAL(fragment_len, deliveries[i].len);
+    TEST_ASSERT_EQUAL(sizeof(message) % fragment_len, deliveries[num_deliveries - 1].len);
+    TEST_ASSERT_EQUAL(1, num_completions);
+    TEST_ASSERT_EQUAL(1, completed_sent);
+}
+
+static void test_strict_priority_preempts_between_fragments(void)
+{
+    static uint8_t bulk[1000];
+    uint8_t control[] = {0xC0};
+    unsigned int i;
+
+    memset(bulk, 0xB0, sizeof(bulk));
+    TEST_ASSERT_EQUAL(0, whisper_mux__submit(muxes[0], 1, bulk, sizeof(bulk), 1));
+    whisper_mux__drain(muxes[0], sender);
+    pump();
+
+    // queued while the second fragment of the bulk message is in flight
+    TEST_ASSERT_EQUAL(0, whisper_mux__submit(muxes[0], 0, control, sizeof(control), 1));
+    while (pump() > 0)
+        ;
+
+    TEST_ASSERT_EQUAL(11, num_deliveries);
+    TEST_ASSERT_EQUAL(1, deliveries[0].channel);
+    TEST_ASSERT_EQUAL(1, deliveries[1].channel);
+    TEST_ASSERT_EQUAL(0, deliveries[2].channel);
+    TEST_ASSERT_EQUAL(0xC0, deliveries[2].first);
+    for (i = 3; i < num_deliveries; i++)
+        TEST_ASSERT_EQUAL(1, deliveries[i].channel);
+}
+
+static void test_weighted_share(void)
+{
+    static uint8_t bulk[1000];
+    unsigned int i;
+    unsigned int on_first = 0;
+
+    init_mux(0, WHISPER_MUX__WEIGHTED);
+    channels[0][0].weight = 3;
+    channels[0][1].weight = 1;
+
+    // both channels backlogged with fragments of the same length
+    for (i = 0; i < NUM_CHANNELS; i++)
+        TEST_ASSERT_EQUAL(0, whisper_mux__submit(muxes[0], i, bulk, sizeof(bulk), 1));
+    whisper_mux__drain(muxes[0], sender);
+    while (num_deliveries < 12 && pump() > 0)
+        ;
+
+    for (i = 0; i < 12; i++)
+        on_first += deliveries[i].channel == 0;
+    TEST_ASSERT_EQUAL(9, on_first);
+
+    while (pump() > 0)
+        ;
+    TEST_ASSERT_EQUAL(0, whisper_mux__count(muxes[0], 0));
+    TEST_ASSERT_EQUAL(0, whisper_mux__count(muxes[0], 1));
+}
+
+static void test_idle_channel_does_not_catch_up(void)
+{
+    static uint8_t bulk[1000];
+
+    init_mux(0, WHISPER_MUX__WEIGHTED);
+
+    // the line to channel 0 alone
+    TEST_ASSERT_EQUAL(0, whisper_mux__submit(muxes[0], 0, bulk, sizeof(bulk), 1));
+    whisper_mux__drain(muxes[0], sender);
+    while (pump() > 0)
+        ;
+
+    // channel 1 shares it from now on, rather than taking it for the time it was idle
+    num_deliveries = 0;
+    TEST_ASSERT_EQUAL(0, whisper_mux__submit(muxes[0], 0, bulk, 400, 1));
+    TEST_ASSERT_EQUAL(0, whisper_mux__submit(muxes[0], 1, bulk, 400, 1));
+    whisper_mux__drain(muxes[0], sender);
+    while (pump() > 0)
+        ;
+    TEST_ASSERT_EQUAL(8, num_deliveries);
+    TEST_ASSERT_EQUAL(1, deliveries[0].channel);
+    TEST_ASSERT_EQUAL(0, deliveries[1].channel);
+    TEST_ASSERT_EQUAL(1, deliveries[2].channel);
+    TEST_ASSERT_EQUAL(0, deliveries[3].channel);
+}
+
+static void test_given_up_fragment_fails_the_message(void)
+{
+    static uint8_t message[300];
+    uint8_t next[] = {0x01};
+
+    TEST_ASSERT_EQUAL(0, whisper_mux__submit(muxes[0], 1, message, sizeof(message), 1));
+    TEST_ASSERT_EQUAL(0, whisper_mux__submit(muxes[0], 1, next, sizeof(next), 1));
+    whisper_mux__drain(muxes[0], sender);
+
+    // the first fragment is never acknowledged
+    while (num_completions == 0)
+    {
+        TEST_ASSERT_NOT_NULL(delay_cb);
+        pipes[0].len = 0;
+        delay_cb(sender);
+    }
+    TEST_ASSERT_EQUAL(0, completed_sent);
+
+    // the next message is sent right away
+    TEST_ASSERT_EQUAL(1, whisper_mux__count(muxes[0], 1));
+    while (pump() > 0)
+        ;
+    TEST_ASSERT_EQUAL(1, num_deliveries);
+    TEST_ASSERT_EQUAL(1, deliveries[0].len);
+    TEST_ASSERT_EQUAL(2, num_completions);
+    TEST_ASSERT_EQUAL(1, completed_sent);
+}
+
+static void test_submit_and_receive_checks_channel(void)
+{
+    uint8_t payload[] = {0x01};
+    unsigned int i;
+
+    TEST_ASSERT_EQUAL(-1, whisper_mux__submit(muxes[0], NUM_CHANNELS, payload, sizeof(payload), 1));
+    for (i = 0; i < CAPACITY; i++)
+        TEST_ASSERT_EQUAL(0, whisper_mux__submit(muxes[0], 0, payload, sizeof(payload), 1));
+    TEST_ASSERT_EQUAL(-1, whisper_mux__submit(muxes[0], 0, payload, sizeof(payload), 1));
+
+    // a channel the receiver does not run is dropped, but acknowledged
+    TEST_ASSERT_NOT_EQUAL(0, whisper_data_layer__channel_sent(sender, NUM_CHANNELS, payload, sizeof(payload), 1));
+    while (pump() > 0)
+        ;
+    TEST_ASSERT_EQUAL(0, num_deliveries);
+    TEST_ASSERT_EQUAL(CAPACITY, whisper_mux__count(muxes[0], 0));
+}
+
+void setUp(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < 2; i++)
+    {
+        muxes[i] = malloc(SIZEOF_WHISPER_MUX_T);
+        init_mux(i, WHISPER_MUX__STRICT);
+    }
+    max_payload_len = 0;
+    sender = malloc(SIZEOF_WHISPER_DATA_LAYER_T);
+    receiver = malloc(SIZEOF_WHISPER_DATA_LAYER_T);
+    init_link(sender, sender_buf);
+    init_link(receiver, receiver_buf);
+    memset(pipes, 0, sizeof(pipes));
+    direct = 0;
+    delay_cb = 0;
+    num_deliveries = 0;
+    num_completions = 0;
+    completed_sent = 0;
+}
+
+void tearDown(void)
+{
+    free(muxes[0]);
+    free(muxes[1]);
+    free(sender);
+    free(receiver);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_init_checks_config);
+    RUN_TEST(test_fragments);
+    RUN_TEST(test_completed_within_the_link);
+    RUN_TEST(test_fragments_follow_the_link);
+    RUN_TEST(test_default_fragment_len_fits_the_link);
+    RUN_TEST(test_strict_priority_preempts_between_fragments);
+    RUN_TEST(test_weighted_share);
+    RUN_TEST(test_idle_channel_does_not_catch_up);
+    RUN_TEST(test_given_up_fragment_fails_the_message);
+    RUN_TEST(test_submit_and_receive_checks_channel);
+    return UNITY_END();
+}
@@ -0,0 +1,225 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <unity.h>
+#include <string.h>
+#include <stdlib.h>
+#include "bus_sim.h"
+#include "poll_scheduler.h"
+
+static struct bus_sim__config config;
+static struct bus_sim__report report;
+
+static void data_write(whisper_data_layer_t dl, const uint8_t *data, uint8_t data_len)
+{
+}
+
+static void set_delay(whisper_data_layer_t dl, uint16_t delay_in_ms, void (*delay_cb)(whisper_data_layer_t dl))
+{
+}
+
+static void cancel_delay(whisper_data_layer_t dl)
+{
+}
+
+static void test_turns(void)
+{
+    static uint8_t bufs[2][255];
+    whisper_data_layer_t links[2];
+    struct whisper_poll__node nodes[2];
+    struct whisper_poll__stats stats;
+    whisper_poll_t poll = malloc(SIZEOF_WHISPER_POLL_T);
+    uint8_t request[] = {0x01, 0x02};
+    uint8_t i;
+
+    for (i = 0; i < 2; i++)
+    {
+        struct whisper_data_layer__config cfg = {
+            .buf = bufs[i],
+            .buf_len = sizeof(bufs[i]),
+            .data_write = data_write,
+            .set_delay = set_delay,
+            .cancel_delay = cancel_delay,
+            .address = i + 1,
+            .master = 1,
+        };
+
+        links[i] = malloc(SIZEOF_WHISPER_DATA_LAYER_T);
+        whisper_data_layer__init(links[i], &cfg);
+        nodes[i].dl = links[i];
+    }
+    TEST_ASSERT_EQUAL(-1, whisper_poll__init(poll, nodes, 0, 1000));
+    TEST_ASSERT_EQUAL(0, whisper_poll__init(poll, nodes, 2, 1000));
+
+    // a single request per node at a time
+    TEST_ASSERT_EQUAL(0, whisper_poll__submit(poll, 1, request, sizeof(request)));
+    TEST_ASSERT_EQUAL(-1, whisper_poll__submit(poll, 1, request, sizeof(request)));
+    TEST_ASSERT_EQUAL(-1, whisper_poll__submit(poll, 2, request, sizeof(request)));
+
+    // the first node is polled, and only its answer ends the turn
+    TEST_ASSERT_EQUAL(1000, whisper_poll__run(poll, 0));
+    TEST_ASSERT_EQUAL(0, whisper_poll__polled(poll));
+    TEST_ASSERT_EQUAL(600, whisper_poll__run(poll, 400));
+    TEST_ASSERT_EQUAL(0, whisper_poll__received(poll, links[1]));
+    TEST_ASSERT_EQUAL(1, whisper_poll__received(poll, links[0]));
+    TEST_ASSERT_EQUAL(0, whisper_poll__received(poll, links[0]));
+
+    // the second node gets its request, and its turn ends by the timeout
+    TEST_ASSERT_EQUAL(1000, whisper_poll__run(poll, 500));
+    TEST_ASSERT_EQUAL(1, whisper_poll__polled(poll));
+    TEST_ASSERT_EQUAL(0, whisper_poll__submit(poll, 1, request, sizeof(request)));
+    whisper_poll__run(poll, 1500);
+    TEST_ASSERT_EQUAL(0, whisper_poll__polled(poll));
+
+    // the first node has not acknowledged its poll, its link is still busy with it
+    whisper_poll__run(poll, 2500);
+    whisper_poll__stats(poll, &stats);
+    TEST_ASSERT_EQUAL(4, stats.turns);
+    TEST_ASSERT_EQUAL(2, stats.timeouts);
+    TEST_ASSERT_EQUAL(2, stats.busy);
+
+    for (i = 0; i < 2; i++)
+        free(links[i]);
+    free(poll);
+}
+
+static void test_every_node_is_polled(void)
+{
+    uint8_t i;
+
+    TEST_ASSERT_EQUAL(0, bus_sim__run(&config, &report));
+
+    TEST_ASSERT_EQUAL(0, report.poll.timeouts);
+    TEST_ASSERT_EQUAL(0, report.poll.busy);
+    TEST_ASSERT_EQUAL(0, report.corrupted);
+    for (i = 0; i < config.num_nodes; i++)
+    {
+        TEST_ASSERT_UINT_WITHIN(1, report.poll.turns / config.num_nodes, report.node[i].polls);
+        // polled more often than it takes readings, none is replaced before it is sent
+        TEST_ASSERT_LESS_THAN(config.reading_interval_us, report.node[i].poll_interval_max_us);
+        TEST_ASSERT_UINT_WITHIN(1, report.node[i].readings, report.node[i].readings_delivered);
+    }
+
+    // a turn takes two turnarounds of the bus: the answer behind the acknowledgement of the poll, and the next poll
+    // behind the acknowledgement of the answer
+    TEST_ASSERT_UINT_WITHIN(report.poll.turns / 100, 2 * report.poll.turns,
+                            report.turnaround_share * report.elapsed_us / config.turnaround_us);
+#ifdef WHISPER_STATS
+    TEST_ASSERT_GREATER_THAN(report.poll.turns, report.filtered);
+#endif
+}
+
+static void test_scheduler_beats_fixed_slots(void)
+{
+    struct bus_sim__report fixed;
+
+    TEST_ASSERT_EQUAL(0, bus_sim__run(&config, &report));
+    config.fixed_slots = 1;
+    TEST_ASSERT_EQUAL(0, bus_sim__run(&config, &fixed));
+
+    TEST_ASSERT_EQUAL(0, fixed.poll.timeouts);
+    TEST_ASSERT_EQUAL(config.timeout_us * config.num_nodes, fixed.poll_interval_p50_us);
+    TEST_ASSERT_LESS_THAN(fixed.poll_interval_p50_us / 2, report.poll_interval_p50_us);
+    TEST_ASSERT_LESS_THAN(fixed.reading_latency_p50_us, report.reading_latency_p50_us);
+    TEST_ASSERT_TRUE(report.utilization > fixed.utilization);
+}
+
+static void test_commands_ride_the_polls(void)
+{
+    uint8_t i;
+
+    config.command_interval_us = 100000;
+    TEST_ASSERT_EQUAL(0, bus_sim__run(&config, &report));
+
+    TEST_ASSERT_EQUAL(0, report.corrupted);
+    for (i = 0; i < config.num_nodes; i++)
+    {
+        TEST_ASSERT_EQUAL(config.duration_us / config.command_interval_us, report.node[i].commands);
+        // but the last one, queued as the run ends
+        TEST_ASSERT_EQUAL(report.node[i].commands - 1, report.node[i].commands_delivered);
+    }
+}
+
+static void test_bit_errors(void)
+{
+    unsigned long delivered = 0;
+    unsigned long readings = 0;
+    uint8_t i;
+
+    config.bit_error_rate = 3e-5;
+    config.command_interval_us = 100000;
+    TEST_ASSERT_EQUAL(0, bus_sim__run(&config, &report));
+
+    // frames lost to bit errors cost turns, the links transmit them again
+    TEST_ASSERT_GREATER_THAN(0, report.poll.timeouts);
+    TEST_ASSERT_EQUAL(0, report.corrupted);
+    for (i = 0; i < config.num_nodes; i++)
+    {
+        TEST_ASSERT_GREATER_THAN(0, report.node[i].commands_delivered);
+        delivered += report.node[i].readings_delivered;
+        readings += report.node[i].readings;
+    }
+    TEST_ASSERT_GREATER_THAN(readings * 9 / 10, delivered);
+}
+
+static void test_compact_header(void)
+{
+    struct bus_sim__report compact;
+
+    TEST_ASSERT_EQUAL(0, bus_sim__run(&config, &report));
+    config.header = WHISPER_DATA_LAYER__HEADER_COMPACT;
+    TEST_ASSERT_EQUAL(0, bus_sim__run(&config, &compact));
+
+    TEST_ASSERT_EQUAL(0, compact.corrupted);
+    TEST_ASSERT_EQUAL(0, compact.poll.timeouts);
+    TEST_ASSERT_LESS_THAN(report.poll_interval_p50_us, compact.poll_interval_p50_us);
+}
+
+void setUp(void)
+{
+    memset(&config, 0, sizeof(config));
+    config.baud = 115200;
+    config.turnaround_us = 100;
+    config.num_nodes = 8;
+    config.reading_interval_us = 50000;
+    config.reading_len = 8;
+    config.command_len = 8;
+    config.timeout_us = 10000;
+    config.duration_us = 2000000;
+    config.seed = 1;
+}
+
+void tearDown(void)
+{
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_turns);
+    RUN_TEST(test_every_node_is_polled);
+    RUN_TEST(test_scheduler_beats_fixed_slots);
+    RUN_TEST(test_commands_ride_the_polls);
+    RUN_TEST(test_bit_errors);
+    RUN_TEST(test_compact_header);
+    return UNITY_END();
+}
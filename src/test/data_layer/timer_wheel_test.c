@@ -0,0 +1,239 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <unity.h>
+#include <stdlib.h>
+#include "timer_wheel.h"
+
+#define NUM_TIMERS 100000
+
+static whisper_timer_wheel_t wheel;
+static unsigned long num_fired;
+static unsigned long num_late;
+
+static void on_expired(struct whisper_timer *timer)
+{
+    ++num_fired;
+    if (whisper_timer_wheel__now(wheel) != timer->expires)
+        ++num_late;
+}
+
+static void test_expires_at_tick(void)
+{
+    struct whisper_timer timer;
+    whisper_timer__init(&timer, on_expired, 0);
+    whisper_timer_wheel__add(wheel, &timer, 10);
+    TEST_ASSERT_TRUE(whisper_timer__pending(&timer));
+    TEST_ASSERT_EQUAL(1, whisper_timer_wheel__count(wheel));
+
+    whisper_timer_wheel__advance(wheel, 9);
+    TEST_ASSERT_EQUAL(0, num_fired);
+
+    whisper_timer_wheel__advance(wheel, 10);
+    TEST_ASSERT_EQUAL(1, num_fired);
+    TEST_ASSERT_EQUAL(0, num_late);
+    TEST_ASSERT_FALSE(whisper_timer__pending(&timer));
+    TEST_ASSERT_EQUAL(0, whisper_timer_wheel__count(wheel));
+}
+
+static void test_cancel(void)
+{
+    struct whisper_timer timers[3];
+    unsigned int i;
+
+    for (i = 0; i < 3; i++)
+    {
+        whisper_timer__init(&timers[i], on_expired, 0);
+        whisper_timer_wheel__add(wheel, &timers[i], 5);
+    }
+
+    // in the middle, at the head and the last one of the slot
+    whisper_timer_wheel__cancel(wheel, &timers[1]);
+    whisper_timer_wheel__cancel(wheel, &timers[2]);
+    whisper_timer_wheel__cancel(wheel, &timers[2]);
+    TEST_ASSERT_EQUAL(1, whisper_timer_wheel__count(wheel));
+
+    whisper_timer_wheel__advance(wheel, 100);
+    TEST_ASSERT_EQUAL(1, num_fired);
+
+    whisper_timer_wheel__cancel(wheel, &timers[0]);
+    TEST_ASSERT_EQUAL(0, whisper_timer_wheel__count(wheel));
+}
+
+static void test_add_rearms(void)
+{
+    struct whisper_timer timer;
+    whisper_timer__init(&timer, on_expired, 0);
+    whisper_timer_wheel__add(wheel, &timer, 10);
+    whisper_timer_wheel__add(wheel, &timer, 5000);
+    TEST_ASSERT_EQUAL(1, whisper_timer_wheel__count(wheel));
+
+    whisper_timer_wheel__advance(wheel, 4999);
+    TEST_ASSERT_EQUAL(0, num_fired);
+    whisper_timer_wheel__advance(wheel, 5000);
+    TEST_ASSERT_EQUAL(1, num_fired);
+    TEST_ASSERT_EQUAL(0, num_late);
+}
+
+static void test_overdue_expires_on_next_advance(void)
+{
+    struct whisper_timer timer;
+    whisper_timer_wheel__advance(wheel, 100);
+
+    whisper_timer__init(&timer, on_expired, 0);
+    whisper_timer_wheel__add(wheel, &timer, 50);
+    whisper_timer_wheel__advance(wheel, 101);
+    TEST_ASSERT_EQUAL(1, num_fired);
+}
+
+static void test_cascade(void)
+{
+    static const unsigned long expiries[] = {63, 64, 65, 4095, 4096, 4097, 262149, 16777215, 16777216, 40000000};
+    struct whisper_timer timers[sizeof(expiries) / sizeof(expiries[0])];
+    unsigned int i;
+
+    for (i = 0; i < sizeof(expiries) / sizeof(expiries[0]); i++)
+    {
+        whisper_timer__init(&timers[i], on_expired, 0);
+        whisper_timer_wheel__add(wheel, &timers[i], expiries[i]);
+    }
+
+    for (i = 0; i < sizeof(expiries) / sizeof(expiries[0]); i++)
+    {
+        whisper_timer_wheel__advance(wheel, expiries[i] - 1);
+        TEST_ASSERT_EQUAL(i, num_fired);
+        whisper_timer_wheel__advance(wheel, expiries[i]);
+        TEST_ASSERT_EQUAL(i + 1, num_fired);
+    }
+    TEST_ASSERT_EQUAL(0, num_late);
+}
+
+static void test_next_deadline(void)
+{
+    struct whisper_timer timer;
+    unsigned long deadline;
+    unsigned int wakeups = 0;
+
+    TEST_ASSERT_NOT_EQUAL(0, whisper_timer_wheel__next_deadline(wheel, &deadline));
+
+    whisper_timer__init(&timer, on_expired, 0);
+    whisper_timer_wheel__add(wheel, &timer, 300000);
+
+    // sleep from deadline to deadline, as a tickless integration does
+    while (whisper_timer_wheel__next_deadline(wheel, &deadline) == 0)
+    {
+        TEST_ASSERT_LESS_OR_EQUAL(300000, deadline);
+        whisper_timer_wheel__advance(wheel, deadline);
+        ++wakeups;
+    }
+
+    TEST_ASSERT_EQUAL(1, num_fired);
+    TEST_ASSERT_EQUAL(0, num_late);
+    // one wakeup for every level cascading
+    TEST_ASSERT_LESS_OR_EQUAL(4, wakeups);
+}
+
+static struct whisper_timer *victim;
+
+static void cancel_victim(struct whisper_timer *timer)
+{
+    ++num_fired;
+    whisper_timer_wheel__cancel(wheel, victim);
+    // and come back later
+    whisper_timer_wheel__add(wheel, timer, timer->expires + 10);
+}
+
+static void test_callback_cancels_and_rearms(void)
+{
+    struct whisper_timer timers[2];
+
+    whisper_timer__init(&timers[0], on_expired, 0);
+    whisper_timer__init(&timers[1], cancel_victim, 0);
+    victim = &timers[0];
+    // the victim expires at the same tick, after the canceller in the slot
+    whisper_timer_wheel__add(wheel, &timers[0], 20);
+    whisper_timer_wheel__add(wheel, &timers[1], 20);
+
+    whisper_timer_wheel__advance(wheel, 20);
+    TEST_ASSERT_EQUAL(1, num_fired);
+    TEST_ASSERT_TRUE(whisper_timer__pending(&timers[1]));
+
+    whisper_timer_wheel__advance(wheel, 30);
+    TEST_ASSERT_EQUAL(2, num_fired);
+    whisper_timer_wheel__cancel(wheel, &timers[1]);
+}
+
+static void test_many_timers(void)
+{
+    struct whisper_timer *timers = malloc(sizeof(struct whisper_timer) * NUM_TIMERS);
+    unsigned long now = 0;
+    unsigned int i;
+
+    srand(30);
+    for (i = 0; i < NUM_TIMERS; i++)
+    {
+        whisper_timer__init(&timers[i], on_expired, 0);
+        whisper_timer_wheel__add(wheel, &timers[i], 1 + rand() % 1000000);
+    }
+    // cancel every tenth
+    for (i = 0; i < NUM_TIMERS; i += 10)
+        whisper_timer_wheel__cancel(wheel, &timers[i]);
+    TEST_ASSERT_EQUAL(NUM_TIMERS - NUM_TIMERS / 10, whisper_timer_wheel__count(wheel));
+
+    while (now < 1000000)
+    {
+        now += 1 + rand() % 5000;
+        whisper_timer_wheel__advance(wheel, now);
+    }
+
+    TEST_ASSERT_EQUAL(NUM_TIMERS - NUM_TIMERS / 10, num_fired);
+    TEST_ASSERT_EQUAL(0, num_late);
+    TEST_ASSERT_EQUAL(0, whisper_timer_wheel__count(wheel));
+    free(timers);
+}
+
+void setUp(void)
+{
+    wheel = malloc(SIZEOF_WHISPER_TIMER_WHEEL_T);
+    whisper_timer_wheel__init(wheel, 0);
+    num_fired = 0;
+    num_late = 0;
+}
+
+void tearDown(void)
+{
+    free(wheel);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_expires_at_tick);
+    RUN_TEST(test_cancel);
+    RUN_TEST(test_add_rearms);
+    RUN_TEST(test_overdue_expires_on_next_advance);
+    RUN_TEST(test_cascade);
+    RUN_TEST(test_next_deadline);
+    RUN_TEST(test_callback_cancels_and_rearms);
+    RUN_TEST(test_many_timers);
+    return UNITY_END();
+}
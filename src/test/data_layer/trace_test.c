@@ -0,0 +1,132 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <unity.h>
+#include <stdlib.h>
+#include "trace.h"
+
+#define CAPACITY 8
+
+static struct whisper_trace__record records[CAPACITY];
+static whisper_trace_t trace;
+static unsigned long now;
+
+static unsigned long fake_clock(void *ctx)
+{
+    return *(unsigned long *)ctx;
+}
+
+static void test_capacity_must_be_power_of_two(void)
+{
+    TEST_ASSERT_NOT_EQUAL(0, whisper_trace__init(trace, records, 0, 0, 0));
+    TEST_ASSERT_NOT_EQUAL(0, whisper_trace__init(trace, records, 6, 0, 0));
+    TEST_ASSERT_EQUAL(0, whisper_trace__init(trace, records, 1, 0, 0));
+}
+
+static void test_write(void)
+{
+    now = 1000;
+    whisper_trace__write(trace, WHISPER_TRACE__FRAME_RX, 0x02, 7);
+    now = 1005;
+    whisper_trace__write(trace, WHISPER_TRACE__ACK_TX, 0, 7);
+
+    TEST_ASSERT_EQUAL(2, whisper_trace__count(trace));
+    TEST_ASSERT_EQUAL(0, whisper_trace__lost(trace));
+    TEST_ASSERT_EQUAL(1000, whisper_trace__at(trace, 0)->timestamp);
+    TEST_ASSERT_EQUAL(WHISPER_TRACE__FRAME_RX, whisper_trace__at(trace, 0)->event);
+    TEST_ASSERT_EQUAL(0x02, whisper_trace__at(trace, 0)->arg8);
+    TEST_ASSERT_EQUAL(7, whisper_trace__at(trace, 0)->arg);
+    TEST_ASSERT_EQUAL(1005, whisper_trace__at(trace, 1)->timestamp);
+    TEST_ASSERT_EQUAL(WHISPER_TRACE__ACK_TX, whisper_trace__at(trace, 1)->event);
+}
+
+static void test_index_as_timestamp_without_clock(void)
+{
+    whisper_trace__init(trace, records, CAPACITY, 0, 0);
+    whisper_trace__write(trace, WHISPER_TRACE__STATE, 0, 1);
+    whisper_trace__write(trace, WHISPER_TRACE__STATE, 1, 2);
+
+    TEST_ASSERT_EQUAL(0, whisper_trace__at(trace, 0)->timestamp);
+    TEST_ASSERT_EQUAL(1, whisper_trace__at(trace, 1)->timestamp);
+}
+
+static void test_overwrite_oldest(void)
+{
+    uint16_t i;
+
+    for (i = 0; i < CAPACITY + 3; i++)
+    {
+        now = i;
+        whisper_trace__write(trace, WHISPER_TRACE__DATA_IN, 0, i);
+    }
+
+    TEST_ASSERT_EQUAL(CAPACITY, whisper_trace__count(trace));
+    TEST_ASSERT_EQUAL(3, whisper_trace__lost(trace));
+    for (i = 0; i < CAPACITY; i++)
+        TEST_ASSERT_EQUAL(i + 3, whisper_trace__at(trace, i)->arg);
+
+    whisper_trace__clear(trace);
+    TEST_ASSERT_EQUAL(0, whisper_trace__count(trace));
+    TEST_ASSERT_EQUAL(0, whisper_trace__lost(trace));
+}
+
+static void test_dump(void)
+{
+    uint8_t buf[3 * WHISPER_TRACE__DUMP_RECORD_LEN];
+    uint8_t expected[] = {0x04, 0x03, 0x02, 0x01, WHISPER_TRACE__FRAME_TX, 0x03, 0x34, 0x12};
+
+    now = 0x01020304;
+    whisper_trace__write(trace, WHISPER_TRACE__FRAME_TX, 3, 0x1234);
+    TEST_ASSERT_EQUAL(WHISPER_TRACE__DUMP_RECORD_LEN, whisper_trace__dump(trace, buf, sizeof(buf)));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, buf, sizeof(expected));
+
+    // only the latest records are dumped if the buffer is short
+    whisper_trace__write(trace, WHISPER_TRACE__ACK_RX, 0, 1);
+    whisper_trace__write(trace, WHISPER_TRACE__ACK_RX, 0, 2);
+    whisper_trace__write(trace, WHISPER_TRACE__ACK_RX, 0, 3);
+    TEST_ASSERT_EQUAL(sizeof(buf), whisper_trace__dump(trace, buf, sizeof(buf) + 1));
+    TEST_ASSERT_EQUAL(1, buf[6]);
+    TEST_ASSERT_EQUAL(3, buf[2 * WHISPER_TRACE__DUMP_RECORD_LEN + 6]);
+}
+
+void setUp(void)
+{
+    trace = malloc(SIZEOF_WHISPER_TRACE_T);
+    now = 0;
+    whisper_trace__init(trace, records, CAPACITY, fake_clock, &now);
+}
+
+void tearDown(void)
+{
+    free(trace);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_capacity_must_be_power_of_two);
+    RUN_TEST(test_write);
+    RUN_TEST(test_index_as_timestamp_without_clock);
+    RUN_TEST(test_overwrite_oldest);
+    RUN_TEST(test_dump);
+    return UNITY_END();
+}
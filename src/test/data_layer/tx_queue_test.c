@@ -0,0 +1,295 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <unity.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include "tx_queue.h"
+
+#define BUF_LEN 255
+#define CAPACITY 64
+#define NUM_PRODUCERS 8
+#define FRAMES_PER_PRODUCER 20000
+#define PIPE_LEN 4096
+
+/** a direction of the loopback, the bytes written by a link and not yet fed to the other one */
+struct pipe
+{
+    uint8_t data[PIPE_LEN];
+    unsigned int len;
+};
+
+static struct whisper_tx_queue__cell cells[CAPACITY];
+static whisper_tx_queue_t queue;
+static whisper_data_layer_t sender;
+static whisper_data_layer_t receiver;
+static uint8_t sender_buf[BUF_LEN];
+static uint8_t receiver_buf[BUF_LEN];
+static struct pipe pipes[2];
+// hand the bytes straight to the other link instead of buffering them for pump
+static char direct;
+
+// the next index expected from every producer, and the frames out of order
+static unsigned long expected[NUM_PRODUCERS];
+static unsigned long delivered;
+static unsigned long out_of_order;
+static unsigned long acked;
+
+static void data_write(whisper_data_layer_t dl, const uint8_t *data, uint8_t data_len)
+{
+    struct pipe *pipe = &pipes[dl == receiver];
+
+    if (direct)
+    {
+        whisper_data_layer__data_received(dl == receiver ? sender : receiver, data, data_len);
+        return;
+    }
+    TEST_ASSERT_LESS_OR_EQUAL(PIPE_LEN, pipe->len + data_len);
+    memcpy(&pipe->data[pipe->len], data, data_len);
+    pipe->len += data_len;
+}
+
+static void set_delay(whisper_data_layer_t dl, uint16_t delay_in_ms, void (*delay_cb)(whisper_data_layer_t dl)) {}
+
+static void cancel_delay(whisper_data_layer_t dl) {}
+
+static void on_packet_received(whisper_data_layer_t dl, uint8_t *payload, uint8_t payload_len)
+{
+    // the producer and its index of the frame
+    unsigned int producer = payload[0];
+    unsigned long index = payload[1] | (unsigned long)payload[2] << 8 | (unsigned long)payload[3] << 16;
+
+    ++delivered;
+    if (producer >= NUM_PRODUCERS || index != expected[producer])
+    {
+        ++out_of_order;
+        return;
+    }
+    ++expected[producer];
+}
+
+static void on_data_ack(whisper_data_layer_t dl, unsigned int seq_no, uint8_t sent)
+{
+    ++acked;
+    whisper_tx_queue__complete(queue, dl, seq_no);
+}
+
+/** feed the bytes of each direction to the other link, return the number of bytes moved */
+static unsigned int pump(void)
+{
+    static uint8_t data[PIPE_LEN];
+    unsigned int moved = 0;
+    unsigned int i;
+
+    for (i = 0; i < 2; i++)
+    {
+        whisper_data_layer_t to = i == 0 ? receiver : sender;
+        unsigned int len = pipes[i].len;
+        unsigned int offset;
+
+        // the link may write to the other direction while it is fed
+        memcpy(data, pipes[i].data, len);
+        pipes[i].len = 0;
+        for (offset = 0; offset < len; offset += 255)
+            whisper_data_layer__data_received(to, &data[offset], len - offset > 255 ? 255 : len - offset);
+        moved += len;
+    }
+    return moved;
+}
+
+static void init_link(whisper_data_layer_t dl, uint8_t *buf, char is_sender)
+{
+    struct whisper_data_layer__config config;
+
+    memset(&config, 0, sizeof(config));
+    config.buf = buf;
+    config.buf_len = BUF_LEN;
+    config.data_write = data_write;
+    config.set_delay = set_delay;
+    config.cancel_delay = cancel_delay;
+    if (is_sender)
+        config.data_ack_cb = on_data_ack;
+    else
+        config.packet_received_cb = on_packet_received;
+    whisper_data_layer__init(dl, &config);
+}
+
+static char submit(unsigned int producer, unsigned long index)
+{
+    uint8_t payload[4] = {producer, index, index >> 8, index >> 16};
+    return whisper_tx_queue__submit(queue, payload, sizeof(payload), 1);
+}
+
+static void test_init_checks_capacity(void)
+{
+    TEST_ASSERT_NOT_EQUAL(0, whisper_tx_queue__init(queue, cells, 0));
+    TEST_ASSERT_NOT_EQUAL(0, whisper_tx_queue__init(queue, cells, 48));
+}
+
+static void test_frames_in_order(void)
+{
+    unsigned long i;
+
+    for (i = 0; i < 3; i++)
+        TEST_ASSERT_EQUAL(0, submit(0, i));
+    TEST_ASSERT_EQUAL(3, whisper_tx_queue__count(queue));
+
+    // one frame in flight at a time, the next one is framed on the acknowledgement
+    TEST_ASSERT_NOT_EQUAL(0, whisper_tx_queue__drain(queue, sender));
+    TEST_ASSERT_EQUAL(0, whisper_tx_queue__drain(queue, sender));
+    while (pump() > 0)
+        ;
+
+    TEST_ASSERT_EQUAL(3, delivered);
+    TEST_ASSERT_EQUAL(3, acked);
+    TEST_ASSERT_EQUAL(0, out_of_order);
+    TEST_ASSERT_EQUAL(0, whisper_tx_queue__count(queue));
+    TEST_ASSERT_EQUAL(0, whisper_tx_queue__drain(queue, sender));
+}
+
+static void test_full(void)
+{
+    unsigned long i;
+
+    for (i = 0; i < CAPACITY; i++)
+        TEST_ASSERT_EQUAL(0, submit(0, i));
+    TEST_ASSERT_EQUAL(-1, submit(0, CAPACITY));
+
+    // the cell of the frame in flight is held until it completes
+    whisper_tx_queue__drain(queue, sender);
+    TEST_ASSERT_EQUAL(-1, submit(0, CAPACITY));
+    pump();
+    pump();
+    TEST_ASSERT_EQUAL(0, submit(0, CAPACITY));
+}
+
+static void test_ignores_frames_around_the_queue(void)
+{
+    uint8_t payload[4] = {0};
+    uint16_t seq_no = whisper_data_layer__data_sent(sender, payload, sizeof(payload), 1);
+
+    TEST_ASSERT_EQUAL(0, submit(0, 0));
+    // the link is busy with the frame sent around the queue
+    TEST_ASSERT_EQUAL(0, whisper_tx_queue__drain(queue, sender));
+    TEST_ASSERT_EQUAL(0, whisper_tx_queue__complete(queue, sender, seq_no));
+    TEST_ASSERT_EQUAL(1, whisper_tx_queue__count(queue));
+}
+
+static void test_completed_within_the_link(void)
+{
+    unsigned long i;
+
+    for (i = 0; i < 3; i++)
+        TEST_ASSERT_EQUAL(0, submit(0, i));
+
+    // the receiver acknowledges each frame before the sender returns from the link
+    direct = 1;
+    TEST_ASSERT_NOT_EQUAL(0, whisper_tx_queue__drain(queue, sender));
+
+    TEST_ASSERT_EQUAL(3, delivered);
+    TEST_ASSERT_EQUAL(3, acked);
+    TEST_ASSERT_EQUAL(0, out_of_order);
+    TEST_ASSERT_EQUAL(0, whisper_tx_queue__count(queue));
+
+    // the queue takes the next frame as well
+    TEST_ASSERT_EQUAL(0, submit(0, 3));
+    TEST_ASSERT_NOT_EQUAL(0, whisper_tx_queue__drain(queue, sender));
+    TEST_ASSERT_EQUAL(4, delivered);
+    TEST_ASSERT_EQUAL(0, whisper_tx_queue__count(queue));
+}
+
+static void *produce(void *arg)
+{
+    unsigned int producer = (unsigned long)arg;
+    unsigned long index;
+
+    for (index = 0; index < FRAMES_PER_PRODUCER; index++)
+    {
+        // the owner frees the cells as the frames are acknowledged
+        while (submit(producer, index) != 0)
+            sched_yield();
+    }
+    return 0;
+}
+
+static void test_many_producers(void)
+{
+    pthread_t threads[NUM_PRODUCERS];
+    unsigned long i;
+
+    for (i = 0; i < NUM_PRODUCERS; i++)
+        TEST_ASSERT_EQUAL(0, pthread_create(&threads[i], 0, produce, (void *)i));
+
+    // the owner of the link
+    while (delivered < NUM_PRODUCERS * FRAMES_PER_PRODUCER)
+    {
+        whisper_tx_queue__drain(queue, sender);
+        if (pump() == 0)
+            sched_yield();
+    }
+
+    for (i = 0; i < NUM_PRODUCERS; i++)
+    {
+        pthread_join(threads[i], 0);
+        TEST_ASSERT_EQUAL(FRAMES_PER_PRODUCER, expected[i]);
+    }
+    TEST_ASSERT_EQUAL(0, out_of_order);
+    TEST_ASSERT_EQUAL(NUM_PRODUCERS * FRAMES_PER_PRODUCER, acked);
+    TEST_ASSERT_EQUAL(0, whisper_tx_queue__count(queue));
+}
+
+void setUp(void)
+{
+    queue = malloc(SIZEOF_WHISPER_TX_QUEUE_T);
+    sender = malloc(SIZEOF_WHISPER_DATA_LAYER_T);
+    receiver = malloc(SIZEOF_WHISPER_DATA_LAYER_T);
+    TEST_ASSERT_EQUAL(0, whisper_tx_queue__init(queue, cells, CAPACITY));
+    init_link(sender, sender_buf, 1);
+    init_link(receiver, receiver_buf, 0);
+    memset(pipes, 0, sizeof(pipes));
+    direct = 0;
+    memset(expected, 0, sizeof(expected));
+    delivered = 0;
+    out_of_order = 0;
+    acked = 0;
+}
+
+void tearDown(void)
+{
+    free(queue);
+    free(sender);
+    free(receiver);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_init_checks_capacity);
+    RUN_TEST(test_frames_in_order);
+    RUN_TEST(test_full);
+    RUN_TEST(test_ignores_frames_around_the_queue);
+    RUN_TEST(test_completed_within_the_link);
+    RUN_TEST(test_many_producers);
+    return UNITY_END();
+}
@@ -0,0 +1,238 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <unity.h>
+#include "gateway.h"
+
+#define BUF_LEN 255
+#define NUM_PAIRS 32
+#define NUM_MESSAGES 200
+
+/** one end of a link, the ends of pair n are links 2n and 2n + 1 */
+struct end
+{
+    whisper_serial_t serial;
+    uint8_t buf[BUF_LEN];
+    uint8_t payload[16];
+    // messages sent and acknowledged, by the sending end only
+    unsigned long acked;
+    // messages received, by the receiving end only
+    unsigned long delivered;
+    unsigned long given_up;
+};
+
+static struct end ends[2 * NUM_PAIRS];
+static whisper_gateway_t gateway;
+static unsigned long completed;
+
+static unsigned long long now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+static void on_packet_received(whisper_data_layer_t dl, uint8_t *payload, uint8_t payload_len)
+{
+    struct end *end = whisper_serial__ctx(whisper_serial__of(dl));
+    ++end->delivered;
+}
+
+static void on_data_ack(whisper_data_layer_t dl, unsigned int seq_no, uint8_t sent)
+{
+    struct end *end = whisper_serial__ctx(whisper_serial__of(dl));
+
+    if (!sent)
+        ++end->given_up;
+    if (++end->acked == NUM_MESSAGES)
+    {
+        __atomic_fetch_add(&completed, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    // keep the link busy from its own callback
+    whisper_serial__send(end->serial, end->payload, sizeof(end->payload), 1);
+}
+
+static void open_pairs(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < NUM_PAIRS; i++)
+    {
+        int fds[2];
+        unsigned int j;
+
+        TEST_ASSERT_EQUAL(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+        for (j = 0; j < 2; j++)
+        {
+            struct end *end = &ends[2 * i + j];
+            struct whisper_serial__config config;
+
+            memset(&config, 0, sizeof(config));
+            config.fd = fds[j];
+            config.link.buf = end->buf;
+            config.link.buf_len = BUF_LEN;
+            config.link.ctx = end;
+            config.link.packet_received_cb = on_packet_received;
+            config.link.data_ack_cb = on_data_ack;
+            end->serial = malloc(SIZEOF_WHISPER_SERIAL_T);
+            TEST_ASSERT_EQUAL(0, whisper_serial__open(end->serial, &config));
+        }
+    }
+}
+
+static void run_until_completed(void)
+{
+    unsigned long long deadline = now_ms() + 10000;
+    unsigned int i;
+
+    // the first message of every pair, the rest is sent from the callbacks
+    for (i = 0; i < NUM_PAIRS; i++)
+        whisper_serial__send(ends[2 * i].serial, ends[2 * i].payload, sizeof(ends[2 * i].payload), 1);
+
+    TEST_ASSERT_EQUAL(0, whisper_gateway__start(gateway));
+    while (__atomic_load_n(&completed, __ATOMIC_RELAXED) < NUM_PAIRS && now_ms() < deadline)
+        usleep(1000);
+    whisper_gateway__stop(gateway);
+
+    TEST_ASSERT_EQUAL(NUM_PAIRS, completed);
+    for (i = 0; i < NUM_PAIRS; i++)
+    {
+        TEST_ASSERT_EQUAL(0, ends[2 * i].given_up);
+        TEST_ASSERT_GREATER_OR_EQUAL(NUM_MESSAGES, ends[2 * i + 1].delivered);
+    }
+}
+
+static void test_links_on_workers(void)
+{
+    struct whisper_gateway__config config = {.num_workers = 4, .no_stealing = 1};
+    struct whisper_gateway__stats stats;
+    unsigned long links = 0;
+    unsigned int i;
+
+    TEST_ASSERT_EQUAL(0, whisper_gateway__init(gateway, &config));
+    open_pairs();
+    for (i = 0; i < 2 * NUM_PAIRS; i++)
+        TEST_ASSERT_EQUAL(0, whisper_gateway__add(gateway, ends[i].serial, -1));
+
+    run_until_completed();
+
+    for (i = 0; i < whisper_gateway__num_workers(gateway); i++)
+    {
+        whisper_gateway__stats(gateway, i, &stats);
+        // spread evenly as added
+        TEST_ASSERT_EQUAL(2 * NUM_PAIRS / 4, stats.links);
+        TEST_ASSERT_GREATER_THAN(0, stats.events);
+        TEST_ASSERT_EQUAL(0, stats.steals);
+        links += stats.links;
+    }
+    TEST_ASSERT_EQUAL(2 * NUM_PAIRS, links);
+}
+
+static void test_stealing_rebalances(void)
+{
+    struct whisper_gateway__config config = {.num_workers = 4, .rebalance_ms = 2};
+    struct whisper_gateway__stats stats;
+    unsigned long steals = 0;
+    unsigned long links = 0;
+    unsigned int i;
+
+    TEST_ASSERT_EQUAL(0, whisper_gateway__init(gateway, &config));
+    open_pairs();
+    // every link on the first worker
+    for (i = 0; i < 2 * NUM_PAIRS; i++)
+        TEST_ASSERT_EQUAL(0, whisper_gateway__add(gateway, ends[i].serial, 0));
+
+    run_until_completed();
+
+    for (i = 0; i < whisper_gateway__num_workers(gateway); i++)
+    {
+        whisper_gateway__stats(gateway, i, &stats);
+        steals += stats.steals;
+        links += stats.links;
+    }
+    TEST_ASSERT_GREATER_THAN(0, steals);
+    TEST_ASSERT_EQUAL(2 * NUM_PAIRS, links);
+    whisper_gateway__stats(gateway, 0, &stats);
+    TEST_ASSERT_LESS_THAN(2 * NUM_PAIRS, stats.links);
+}
+
+static void test_hung_up_link_is_removed(void)
+{
+    struct whisper_gateway__config config = {.num_workers = 2};
+    struct whisper_gateway__stats stats;
+    unsigned long long deadline = now_ms() + 2000;
+    unsigned long failures = 0;
+
+    TEST_ASSERT_EQUAL(0, whisper_gateway__init(gateway, &config));
+    open_pairs();
+    TEST_ASSERT_EQUAL(0, whisper_gateway__add(gateway, ends[0].serial, 0));
+    TEST_ASSERT_EQUAL(0, whisper_gateway__start(gateway));
+
+    // the peer goes away
+    whisper_serial__close(ends[1].serial);
+    while (failures == 0 && now_ms() < deadline)
+    {
+        usleep(1000);
+        whisper_gateway__stats(gateway, 0, &stats);
+        failures = stats.failures;
+    }
+
+    TEST_ASSERT_EQUAL(1, failures);
+    TEST_ASSERT_EQUAL(0, stats.links);
+}
+
+void setUp(void)
+{
+    memset(ends, 0, sizeof(ends));
+    completed = 0;
+    gateway = malloc(SIZEOF_WHISPER_GATEWAY_T);
+}
+
+void tearDown(void)
+{
+    unsigned int i;
+
+    // closes the links added to the gateway
+    whisper_gateway__destroy(gateway);
+    free(gateway);
+    for (i = 0; i < 2 * NUM_PAIRS; i++)
+    {
+        whisper_serial__close(ends[i].serial);
+        free(ends[i].serial);
+    }
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_links_on_workers);
+    RUN_TEST(test_stealing_rebalances);
+    RUN_TEST(test_hung_up_link_is_removed);
+    return UNITY_END();
+}
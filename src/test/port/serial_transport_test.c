@@ -0,0 +1,228 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <pty.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <unity.h>
+#include "serial_transport.h"
+
+#define BUF_LEN 255
+#define NUM_MESSAGES 50
+
+struct endpoint
+{
+    uint8_t buf[BUF_LEN];
+    uint8_t payload[32];
+    unsigned long delivered;
+    unsigned long corrupted;
+    unsigned long acked;
+    unsigned long given_up;
+};
+
+static int master;
+static int slave;
+static struct endpoint ends[2];
+static whisper_serial_t a;
+static whisper_serial_t b;
+
+static unsigned long long now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+static void on_packet_received(whisper_data_layer_t dl, uint8_t *payload, uint8_t payload_len)
+{
+    struct endpoint *end = whisper_serial__ctx(whisper_serial__of(dl));
+    uint8_t i;
+
+    ++end->delivered;
+    for (i = 1; i < payload_len; i++)
+        if (payload[i] != (uint8_t)(payload[0] + i))
+            ++end->corrupted;
+}
+
+static void on_data_ack(whisper_data_layer_t dl, unsigned int seq_no, uint8_t sent)
+{
+    struct endpoint *end = whisper_serial__ctx(whisper_serial__of(dl));
+
+    if (sent)
+        ++end->acked;
+    else
+        ++end->given_up;
+}
+
+static char open_end(whisper_serial_t *serial, int fd, struct endpoint *end, uint8_t read_batch)
+{
+    struct whisper_serial__config config;
+
+    memset(&config, 0, sizeof(config));
+    config.fd = fd;
+    config.read_batch = read_batch;
+    config.link.buf = end->buf;
+    config.link.buf_len = BUF_LEN;
+    config.link.ctx = end;
+    config.link.packet_received_cb = on_packet_received;
+    config.link.data_ack_cb = on_data_ack;
+
+    *serial = malloc(SIZEOF_WHISPER_SERIAL_T);
+    return whisper_serial__open(*serial, &config);
+}
+
+static void send_message(whisper_serial_t serial, struct endpoint *end, unsigned long id)
+{
+    unsigned int i;
+
+    for (i = 0; i < sizeof(end->payload); i++)
+        end->payload[i] = (uint8_t)(id + i);
+    TEST_ASSERT_NOT_EQUAL(0, whisper_serial__send(serial, end->payload, sizeof(end->payload), 1));
+}
+
+static void test_round_trip(void)
+{
+    unsigned long long deadline = now_ms() + 5000;
+    unsigned long sent = 0;
+
+    TEST_ASSERT_EQUAL(0, open_end(&a, master, &ends[0], 1));
+    TEST_ASSERT_EQUAL(0, open_end(&b, slave, &ends[1], 1));
+
+    while (ends[0].acked < NUM_MESSAGES && now_ms() < deadline)
+    {
+        // the next message once the previous one is acknowledged
+        if (sent == ends[0].acked + ends[0].given_up && sent < NUM_MESSAGES)
+            send_message(a, &ends[0], sent++);
+
+        TEST_ASSERT_GREATER_OR_EQUAL(0, whisper_serial__poll(b, 1));
+        TEST_ASSERT_GREATER_OR_EQUAL(0, whisper_serial__poll(a, 1));
+    }
+
+    TEST_ASSERT_EQUAL(NUM_MESSAGES, ends[0].acked);
+    TEST_ASSERT_EQUAL(0, ends[0].given_up);
+    TEST_ASSERT_GREATER_OR_EQUAL(NUM_MESSAGES, ends[1].delivered);
+    TEST_ASSERT_EQUAL(0, ends[1].corrupted);
+}
+
+static void test_retransmission_on_timerfd(void)
+{
+    uint8_t buf[1024];
+    unsigned long long started = now_ms();
+    ssize_t len;
+
+    // nobody answers on the slave
+    TEST_ASSERT_EQUAL(0, open_end(&a, master, &ends[0], 1));
+    send_message(a, &ends[0], 7);
+    while (ends[0].given_up == 0 && now_ms() < started + 2000)
+        TEST_ASSERT_GREATER_OR_EQUAL(0, whisper_serial__poll(a, -1));
+
+    TEST_ASSERT_EQUAL(1, ends[0].given_up);
+    TEST_ASSERT_EQUAL(0, ends[0].acked);
+    // 3 transmissions, 50 ms apart, and the expiry of the last one
+    TEST_ASSERT_GREATER_OR_EQUAL(150, now_ms() - started);
+    TEST_ASSERT_LESS_THAN(1000, now_ms() - started);
+
+    len = read(slave, buf, sizeof(buf));
+    TEST_ASSERT_EQUAL(3 * (2 + 4 + sizeof(ends[0].payload) + 2), len);
+}
+
+static void test_read_batch_lingers_for_the_rest(void)
+{
+    unsigned long long deadline = now_ms() + 2000;
+
+    TEST_ASSERT_EQUAL(0, open_end(&a, master, &ends[0], 1));
+    // the frame is shorter than the batch, it is read once the line is quiet
+    TEST_ASSERT_EQUAL(0, open_end(&b, slave, &ends[1], 64));
+
+    send_message(a, &ends[0], 1);
+    while (ends[0].acked == 0 && now_ms() < deadline)
+    {
+        TEST_ASSERT_GREATER_OR_EQUAL(0, whisper_serial__poll(b, 1));
+        TEST_ASSERT_GREATER_OR_EQUAL(0, whisper_serial__poll(a, 1));
+    }
+
+    TEST_ASSERT_EQUAL(1, ends[1].delivered);
+    TEST_ASSERT_EQUAL(1, ends[0].acked);
+}
+
+static void test_hang_up(void)
+{
+    TEST_ASSERT_EQUAL(0, open_end(&a, master, &ends[0], 1));
+    close(slave);
+    slave = -1;
+
+    TEST_ASSERT_EQUAL(-1, whisper_serial__poll(a, 100));
+}
+
+static void test_open_fails_on_missing_device(void)
+{
+    struct whisper_serial__config config;
+    whisper_serial_t serial = malloc(SIZEOF_WHISPER_SERIAL_T);
+
+    memset(&config, 0, sizeof(config));
+    config.path = "/dev/does-not-exist";
+    config.link.buf = ends[0].buf;
+    config.link.buf_len = BUF_LEN;
+    TEST_ASSERT_NOT_EQUAL(0, whisper_serial__open(serial, &config));
+    free(serial);
+}
+
+void setUp(void)
+{
+    memset(ends, 0, sizeof(ends));
+    a = b = 0;
+    TEST_ASSERT_EQUAL(0, openpty(&master, &slave, 0, 0, 0));
+}
+
+void tearDown(void)
+{
+    // the transports close their ports
+    if (a)
+    {
+        whisper_serial__close(a);
+        free(a);
+        master = -1;
+    }
+    if (b)
+    {
+        whisper_serial__close(b);
+        free(b);
+        slave = -1;
+    }
+    if (master >= 0)
+        close(master);
+    if (slave >= 0)
+        close(slave);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_round_trip);
+    RUN_TEST(test_retransmission_on_timerfd);
+    RUN_TEST(test_read_batch_lingers_for_the_rest);
+    RUN_TEST(test_hang_up);
+    RUN_TEST(test_open_fails_on_missing_device);
+    return UNITY_END();
+}
@@ -0,0 +1,224 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <unity.h>
+#include "shm_transport.h"
+
+#define BUF_LEN 255
+#define NUM_MESSAGES 1000
+
+struct end
+{
+    whisper_shm_t shm;
+    uint8_t buf[BUF_LEN];
+    uint8_t payload[32];
+    unsigned long delivered;
+    unsigned long corrupted;
+    unsigned long acked;
+    unsigned long given_up;
+};
+
+static struct end ends[2];
+static int fd;
+
+static unsigned long long now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+static void on_packet_received(whisper_data_layer_t dl, uint8_t *payload, uint8_t payload_len)
+{
+    struct end *end = whisper_shm__ctx(whisper_shm__of(dl));
+
+    // the payload of message n is filled with n
+    if (payload_len != sizeof(end->payload) || payload[0] != (uint8_t)end->delivered ||
+        payload[payload_len - 1] != (uint8_t)end->delivered)
+        ++end->corrupted;
+    ++end->delivered;
+}
+
+static void on_data_ack(whisper_data_layer_t dl, unsigned int seq_no, uint8_t sent)
+{
+    struct end *end = whisper_shm__ctx(whisper_shm__of(dl));
+
+    if (sent)
+        ++end->acked;
+    else
+        ++end->given_up;
+}
+
+static void open_end(unsigned int side)
+{
+    struct end *end = &ends[side];
+    struct whisper_shm__config config;
+
+    memset(&config, 0, sizeof(config));
+    config.fd = fd;
+    config.side = side;
+    config.link.buf = end->buf;
+    config.link.buf_len = BUF_LEN;
+    config.link.ctx = end;
+    config.link.packet_received_cb = on_packet_received;
+    config.link.data_ack_cb = on_data_ack;
+    end->shm = malloc(SIZEOF_WHISPER_SHM_T);
+    TEST_ASSERT_EQUAL(0, whisper_shm__open(end->shm, &config));
+}
+
+static void send_next(struct end *end, unsigned long n)
+{
+    memset(end->payload, (uint8_t)n, sizeof(end->payload));
+    TEST_ASSERT_NOT_EQUAL(0, whisper_shm__send(end->shm, end->payload, sizeof(end->payload), 1));
+}
+
+static void test_create_checks_ring_len(void)
+{
+    TEST_ASSERT_EQUAL(-1, whisper_shm__create(0));
+    TEST_ASSERT_EQUAL(-1, whisper_shm__create(1000));
+}
+
+static void test_open_checks_region(void)
+{
+    int pipe_fds[2];
+    struct whisper_shm__config config;
+    whisper_shm_t shm = malloc(SIZEOF_WHISPER_SHM_T);
+
+    TEST_ASSERT_EQUAL(0, pipe(pipe_fds));
+    TEST_ASSERT_EQUAL(12, write(pipe_fds[1], "not a region", 12));
+    close(pipe_fds[1]);
+    memset(&config, 0, sizeof(config));
+    config.fd = pipe_fds[0];
+    TEST_ASSERT_NOT_EQUAL(0, whisper_shm__open(shm, &config));
+    close(pipe_fds[0]);
+
+    config.fd = fd;
+    config.side = 2;
+    TEST_ASSERT_NOT_EQUAL(0, whisper_shm__open(shm, &config));
+    free(shm);
+}
+
+static void test_frames_wrap_the_ring(void)
+{
+    unsigned long i;
+
+    close(fd);
+    // a frame of 40 bytes does not divide the ring
+    fd = whisper_shm__create(64);
+    TEST_ASSERT_NOT_EQUAL(-1, fd);
+    open_end(0);
+    open_end(1);
+
+    for (i = 0; i < NUM_MESSAGES; i++)
+    {
+        send_next(&ends[0], i);
+        TEST_ASSERT_EQUAL(40, whisper_shm__poll(ends[1].shm, 0));
+        TEST_ASSERT_EQUAL(10, whisper_shm__poll(ends[0].shm, 0));
+    }
+
+    TEST_ASSERT_EQUAL(NUM_MESSAGES, ends[1].delivered);
+    TEST_ASSERT_EQUAL(0, ends[1].corrupted);
+    TEST_ASSERT_EQUAL(NUM_MESSAGES, ends[0].acked);
+}
+
+static void test_gives_up_without_peer(void)
+{
+    unsigned long long started = now_ms();
+
+    open_end(0);
+    send_next(&ends[0], 0);
+    while (!ends[0].given_up && now_ms() < started + 2000)
+        TEST_ASSERT_EQUAL(0, whisper_shm__poll(ends[0].shm, 1000));
+
+    TEST_ASSERT_EQUAL(1, ends[0].given_up);
+    // three transmissions, 50 ms apart
+    TEST_ASSERT_GREATER_OR_EQUAL(150, now_ms() - started);
+}
+
+static void test_frames_between_processes(void)
+{
+    unsigned long long deadline = now_ms() + 10000;
+    int status;
+    unsigned long i;
+    pid_t child = fork();
+
+    TEST_ASSERT_NOT_EQUAL(-1, child);
+    if (child == 0)
+    {
+        // the receiver sleeps until the frames arrive
+        open_end(1);
+        while (ends[1].delivered < NUM_MESSAGES && now_ms() < deadline)
+            whisper_shm__poll(ends[1].shm, 1000);
+        _exit(ends[1].delivered == NUM_MESSAGES && ends[1].corrupted == 0 ? 0 : 1);
+    }
+
+    open_end(0);
+    for (i = 0; i < NUM_MESSAGES && now_ms() < deadline; i++)
+    {
+        send_next(&ends[0], i);
+        while (ends[0].acked + ends[0].given_up == i && now_ms() < deadline)
+            whisper_shm__poll(ends[0].shm, 1000);
+    }
+
+    TEST_ASSERT_EQUAL(child, waitpid(child, &status, 0));
+    TEST_ASSERT_TRUE(WIFEXITED(status));
+    TEST_ASSERT_EQUAL(0, WEXITSTATUS(status));
+    TEST_ASSERT_EQUAL(NUM_MESSAGES, ends[0].acked);
+    TEST_ASSERT_EQUAL(0, ends[0].given_up);
+}
+
+void setUp(void)
+{
+    memset(ends, 0, sizeof(ends));
+    fd = whisper_shm__create(4096);
+}
+
+void tearDown(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < 2; i++)
+    {
+        if (ends[i].shm)
+        {
+            whisper_shm__close(ends[i].shm);
+            free(ends[i].shm);
+        }
+    }
+    close(fd);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_create_checks_ring_len);
+    RUN_TEST(test_open_checks_region);
+    RUN_TEST(test_frames_wrap_the_ring);
+    RUN_TEST(test_gives_up_without_peer);
+    RUN_TEST(test_frames_between_processes);
+    return UNITY_END();
+}
@@ -0,0 +1,226 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unity.h>
+#include "udp_transport.h"
+
+#define BUF_LEN 255
+#define NUM_DEVICES 16
+#define NUM_MESSAGES 200
+
+/** one end of a link */
+struct end
+{
+    whisper_data_layer_t dl;
+    uint8_t buf[BUF_LEN];
+    uint8_t payload[32];
+    unsigned long delivered;
+    unsigned long corrupted;
+    unsigned long acked;
+};
+
+// a gateway socket with a link to every device, each device with a socket and a link of its own
+static whisper_udp_t gateway;
+static whisper_udp_t devices[NUM_DEVICES];
+static struct end gateway_ends[NUM_DEVICES];
+static struct end device_ends[NUM_DEVICES];
+
+static void on_packet_received(whisper_data_layer_t dl, uint8_t *payload, uint8_t payload_len)
+{
+    struct end *end = whisper_udp__ctx(dl);
+
+    // the payload of message n is filled with n
+    if (payload_len != sizeof(end->payload) || payload[0] != (uint8_t)end->delivered ||
+        payload[payload_len - 1] != (uint8_t)end->delivered)
+        ++end->corrupted;
+    ++end->delivered;
+}
+
+static void on_data_ack(whisper_data_layer_t dl, unsigned int seq_no, uint8_t sent)
+{
+    struct end *end = whisper_udp__ctx(dl);
+
+    if (sent)
+        ++end->acked;
+}
+
+static whisper_udp_t open_socket(unsigned int max_links)
+{
+    struct whisper_udp__config config;
+    whisper_udp_t udp = malloc(SIZEOF_WHISPER_UDP_T);
+
+    memset(&config, 0, sizeof(config));
+    config.addr = "127.0.0.1";
+    config.max_links = max_links;
+    TEST_ASSERT_EQUAL(0, whisper_udp__open(udp, &config));
+    TEST_ASSERT_NOT_EQUAL(0, whisper_udp__port(udp));
+    return udp;
+}
+
+static whisper_data_layer_t add_link(whisper_udp_t udp, whisper_udp_t peer, struct end *end)
+{
+    struct whisper_data_layer__config config;
+
+    memset(&config, 0, sizeof(config));
+    config.buf = end->buf;
+    config.buf_len = BUF_LEN;
+    config.ctx = end;
+    config.packet_received_cb = on_packet_received;
+    config.data_ack_cb = on_data_ack;
+    end->dl = whisper_udp__add(udp, "127.0.0.1", whisper_udp__port(peer), &config);
+    return end->dl;
+}
+
+static void send_next(struct end *end)
+{
+    memset(end->payload, (uint8_t)end->acked, sizeof(end->payload));
+    TEST_ASSERT_NOT_EQUAL(0, whisper_udp__send(end->dl, end->payload, sizeof(end->payload), 1));
+}
+
+static void test_frames_between_sockets(void)
+{
+    unsigned long i;
+
+    TEST_ASSERT_NOT_NULL(add_link(gateway, devices[0], &gateway_ends[0]));
+    TEST_ASSERT_NOT_NULL(add_link(devices[0], gateway, &device_ends[0]));
+
+    for (i = 0; i < NUM_MESSAGES; i++)
+    {
+        // both ways
+        send_next(&gateway_ends[0]);
+        send_next(&device_ends[0]);
+        whisper_udp__flush(gateway);
+        whisper_udp__flush(devices[0]);
+
+        // a short wait each, the other socket may be the one with a datagram pending
+        while (gateway_ends[0].acked == i || device_ends[0].acked == i)
+        {
+            TEST_ASSERT_NOT_EQUAL(-1, whisper_udp__poll(devices[0], 1));
+            TEST_ASSERT_NOT_EQUAL(-1, whisper_udp__poll(gateway, 1));
+        }
+    }
+
+    TEST_ASSERT_EQUAL(NUM_MESSAGES, device_ends[0].delivered);
+    TEST_ASSERT_EQUAL(NUM_MESSAGES, gateway_ends[0].delivered);
+    TEST_ASSERT_EQUAL(0, device_ends[0].corrupted + gateway_ends[0].corrupted);
+}
+
+static void test_batches_the_links(void)
+{
+    struct whisper_udp__stats stats;
+    unsigned int i;
+
+    for (i = 0; i < NUM_DEVICES; i++)
+    {
+        TEST_ASSERT_NOT_NULL(add_link(gateway, devices[i], &gateway_ends[i]));
+        TEST_ASSERT_NOT_NULL(add_link(devices[i], gateway, &device_ends[i]));
+        send_next(&device_ends[i]);
+        whisper_udp__flush(devices[i]);
+    }
+
+    // the frames of all devices in one call, the acknowledgements out in one call
+    TEST_ASSERT_EQUAL(NUM_DEVICES, whisper_udp__poll(gateway, 100));
+    whisper_udp__stats(gateway, &stats);
+    TEST_ASSERT_EQUAL(NUM_DEVICES, stats.datagrams_in);
+    TEST_ASSERT_EQUAL(1, stats.recv_calls);
+    TEST_ASSERT_EQUAL(NUM_DEVICES, stats.datagrams_out);
+    TEST_ASSERT_EQUAL(1, stats.send_calls);
+
+    for (i = 0; i < NUM_DEVICES; i++)
+    {
+        TEST_ASSERT_EQUAL(1, gateway_ends[i].delivered);
+        TEST_ASSERT_EQUAL(1, whisper_udp__poll(devices[i], 100));
+        TEST_ASSERT_EQUAL(1, device_ends[i].acked);
+    }
+}
+
+static void test_add_checks_the_peer(void)
+{
+    struct whisper_data_layer__config config;
+
+    TEST_ASSERT_NOT_NULL(add_link(gateway, devices[0], &gateway_ends[0]));
+    // the peer has a link already
+    TEST_ASSERT_NULL(add_link(gateway, devices[0], &gateway_ends[1]));
+
+    memset(&config, 0, sizeof(config));
+    config.buf = gateway_ends[1].buf;
+    config.buf_len = BUF_LEN;
+    TEST_ASSERT_NULL(whisper_udp__add(gateway, "not an address", 1, &config));
+}
+
+static void test_drops_unknown_peers(void)
+{
+    struct whisper_udp__stats stats;
+    struct sockaddr_in addr;
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(whisper_udp__port(gateway));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    TEST_ASSERT_EQUAL(5, sendto(fd, "hello", 5, 0, (struct sockaddr *)&addr, sizeof(addr)));
+    close(fd);
+
+    TEST_ASSERT_EQUAL(1, whisper_udp__poll(gateway, 100));
+    whisper_udp__stats(gateway, &stats);
+    TEST_ASSERT_EQUAL(1, stats.unknown_peers);
+}
+
+void setUp(void)
+{
+    unsigned int i;
+
+    memset(gateway_ends, 0, sizeof(gateway_ends));
+    memset(device_ends, 0, sizeof(device_ends));
+    gateway = open_socket(NUM_DEVICES);
+    for (i = 0; i < NUM_DEVICES; i++)
+        devices[i] = open_socket(1);
+}
+
+void tearDown(void)
+{
+    unsigned int i;
+
+    whisper_udp__close(gateway);
+    free(gateway);
+    for (i = 0; i < NUM_DEVICES; i++)
+    {
+        whisper_udp__close(devices[i]);
+        free(devices[i]);
+    }
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_frames_between_sockets);
+    RUN_TEST(test_batches_the_links);
+    RUN_TEST(test_add_checks_the_peer);
+    RUN_TEST(test_drops_unknown_peers);
+    return UNITY_END();
+}
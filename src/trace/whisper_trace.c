@@ -0,0 +1,222 @@
+/* MIT License
+ *
+ * Copyright (c) 2022 Ningbo Peakhonor Technology Co., Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * whisper_trace decodes dumps of trace rings, see whisper_trace__dump, and
+ * prints a timeline. The records of several dumps, e.g. of both ends of a
+ * link, are merged by their timestamps.
+ *
+ *   whisper_trace [--tick-ns N] DUMP...
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace.h"
+
+static const char *STATE_NAMES[] = {"PREFIX", "HEADER", "PAYLOAD", "CHECKSUM", "DISCARD"};
+
+struct dump
+{
+    const char *name;
+    uint8_t *data;
+    unsigned long len;
+    unsigned long pos;
+};
+
+static unsigned long timestamp_of(const uint8_t *record)
+{
+    return record[0] | (record[1] << 8) | ((unsigned long)record[2] << 16) | ((unsigned long)record[3] << 24);
+}
+
+static const char *state_name(unsigned int state)
+{
+    return state < sizeof(STATE_NAMES) / sizeof(STATE_NAMES[0]) ? STATE_NAMES[state] : "?";
+}
+
+static void print_event(const uint8_t *record)
+{
+    uint8_t event = record[4];
+    uint8_t arg8 = record[5];
+    unsigned int arg = record[6] | (record[7] << 8);
+
+    switch (event)
+    {
+    case WHISPER_TRACE__STATE:
+        printf("state %s -> %s", state_name(arg8), state_name(arg));
+        break;
+    case WHISPER_TRACE__DATA_IN:
+        printf("data in, %u bytes", arg);
+        break;
+    case WHISPER_TRACE__FRAME_RX:
+        printf("frame received, seq %u, flags 0x%02x", arg, arg8);
+        break;
+    case WHISPER_TRACE__FRAME_TX:
+        if (arg8)
+            printf("frame sent, seq %u, transmission %u", arg, arg8);
+        else
+            printf("window probe sent");
+        break;
+    case WHISPER_TRACE__ACK_TX:
+        printf("ack sent, seq %u", arg);
+        break;
+    case WHISPER_TRACE__ACK_RX:
+        printf("ack received, seq %u", arg);
+        break;
+    case WHISPER_TRACE__CRC_ERROR:
+        printf("checksum mismatch, seq %u", arg);
+        break;
+    case WHISPER_TRACE__HEADER_ERROR:
+        printf("invalid header, flags 0x%02x, payload length %u", arg8, arg);
+        break;
+    case WHISPER_TRACE__TIMER_START:
+        printf("timer started, %u ms", arg);
+        break;
+    case WHISPER_TRACE__TIMER_STOP:
+        printf("timer stopped");
+        break;
+    case WHISPER_TRACE__TIMER_EXPIRED:
+        printf("timer expired, seq %u after %u transmissions", arg, arg8);
+        break;
+    case WHISPER_TRACE__DROP:
+        printf("frame dropped, seq %u after %u transmissions", arg, arg8);
+        break;
+    case WHISPER_TRACE__FEC_CORRECTED:
+        printf("%s corrected, %u bytes", arg8 ? "frame" : "header", arg);
+        break;
+    case WHISPER_TRACE__DUPLICATE:
+        printf("duplicate, seq %u", arg);
+        break;
+    case WHISPER_TRACE__CREDITS:
+        if (arg)
+            printf("credits %u, with ack of seq %u", arg8, arg);
+        else
+            printf("credits %u, window update", arg8);
+        break;
+    case WHISPER_TRACE__REFUSED:
+        printf("refused for lack of credits, seq %u", arg);
+        break;
+    case WHISPER_TRACE__HANDSHAKE:
+        if (arg8 == 0)
+            printf("handshake sent%s", arg ? ", answer" : "");
+        else if (arg8 == 1)
+            printf("handshake received, peer started over, payloads up to %u", arg);
+        else if (arg8 == 2)
+            printf("handshake answered, payloads up to %u", arg);
+        else
+            printf("handshake given up");
+        break;
+    default:
+        printf("unknown event %u (%u, %u)", event, arg8, arg);
+    }
+    printf("\n");
+}
+
+static char load(struct dump *dump)
+{
+    FILE *file = fopen(dump->name, "rb");
+    long len;
+
+    if (!file)
+        return -1;
+
+    fseek(file, 0, SEEK_END);
+    len = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    dump->len = len - len % WHISPER_TRACE__DUMP_RECORD_LEN;
+    dump->data = malloc(dump->len + 1);
+    dump->pos = 0;
+    if (fread(dump->data, 1, dump->len, file) != dump->len)
+    {
+        fclose(file);
+        return -1;
+    }
+
+    fclose(file);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    struct dump *dumps = calloc(argc, sizeof(struct dump));
+    unsigned long tick_ns = 0;
+    unsigned long prev = 0;
+    int num_dumps = 0;
+    int first = 1;
+    int arg;
+
+    for (arg = 1; arg < argc; arg++)
+    {
+        if (strcmp(argv[arg], "--tick-ns") == 0 && arg + 1 < argc)
+        {
+            tick_ns = strtoul(argv[++arg], 0, 10);
+            continue;
+        }
+
+        dumps[num_dumps].name = argv[arg];
+        if (load(&dumps[num_dumps]) != 0)
+        {
+            fprintf(stderr, "cannot read %s\n", argv[arg]);
+            return 2;
+        }
+        ++num_dumps;
+    }
+
+    if (num_dumps == 0)
+    {
+        fprintf(stderr, "usage: %s [--tick-ns N] DUMP...\n", argv[0]);
+        return 2;
+    }
+
+    while (1)
+    {
+        struct dump *next = 0;
+        unsigned long timestamp;
+        int i;
+
+        // merge the dumps, each of them is in order
+        for (i = 0; i < num_dumps; i++)
+        {
+            if (dumps[i].pos == dumps[i].len)
+                continue;
+            if (!next || timestamp_of(&dumps[i].data[dumps[i].pos]) < timestamp_of(&next->data[next->pos]))
+                next = &dumps[i];
+        }
+        if (!next)
+            break;
+
+        timestamp = timestamp_of(&next->data[next->pos]);
+        if (tick_ns)
+            printf("%14.3f us %+12.3f  ", timestamp * (double)tick_ns / 1e3,
+                   first ? 0 : (double)(timestamp - prev) * tick_ns / 1e3);
+        else
+            printf("%10lu %+8ld  ", timestamp, first ? 0 : (long)(timestamp - prev));
+        if (num_dumps > 1)
+            printf("%-12s ", next->name);
+        print_event(&next->data[next->pos]);
+
+        prev = timestamp;
+        first = 0;
+        next->pos += WHISPER_TRACE__DUMP_RECORD_LEN;
+    }
+
+    return 0;
+}